@@ -31,13 +31,15 @@ StreamIngester::StreamIngester(const RedisConnection &connection,
                                bool *terminated,
                                std::vector<std::pair<std::regex, StreamIngestionSettings>> stream_settings_by_name_glob,
                                int stalled_timeout_ms,
-                               int stale_period_ms)
+                               int stale_period_ms,
+                               int64_t memory_budget_bytes)
         : _connection(connection),
           _output_directory(output_directory),
           _terminated(terminated),
           stream_settings_by_name_glob_(std::move(stream_settings_by_name_glob)),
           _stalled_timeout_ms(stalled_timeout_ms),
-          _stale_period_ms(stale_period_ms) {
+          _stale_period_ms(stale_period_ms),
+          _over_memory_budget(false) {
     // Create the output directory if necessary
     if (boost::filesystem::exists(output_directory)) {
         if (!boost::filesystem::is_directory(output_directory)) {
@@ -49,13 +51,22 @@ StreamIngester::StreamIngester(const RedisConnection &connection,
         }
     }
 
-    this->_redis = internal::Redis::Create(connection);
+    // Only used for listing streams, so can be served by a replica.
+    this->_redis = internal::Redis::CreateForReads(connection);
+    if (memory_budget_bytes > 0) {
+        this->_memory_accountant = make_unique<StreamMemoryAccountant>(connection, memory_budget_bytes);
+    }
 
     auto func = boost::bind(&StreamIngester::ingest_single, this, boost::placeholders::_1);
     _pool = make_unique<IngesterThreadPool<string, StreamIngestionResult>>(4, func);
 }
 
 void StreamIngester::Ingest() {
+    if (_memory_accountant) {
+        _memory_accountant->Refresh();
+        _over_memory_budget = _memory_accountant->is_over_budget();
+    }
+
     auto stream_names = _redis->ListStreamNames();
 
     if (stream_names.empty()) {
@@ -138,7 +149,8 @@ StreamIngestionResult StreamIngester::ingest_single(string stream_name) {
                                                        _terminated,
                                                        _stalled_timeout_ms,
                                                        _stale_period_ms,
-                                                       settings);
+                                                       settings,
+                                                       &_over_memory_budget);
         auto ret = ingester.Ingest();
         {
             lock_guard<mutex> lock(_streams_in_progress_mtx);
@@ -165,14 +177,16 @@ SingleStreamIngester::SingleStreamIngester(const RedisConnection &connection,
                                            bool *terminated,
                                            int stalled_timeout_ms,
                                            int stale_period_ms,
-                                           StreamIngestionSettings settings)
+                                           StreamIngestionSettings settings,
+                                           const std::atomic_bool *over_memory_budget)
         : _connection(connection),
           _stalled_timeout_ms(stalled_timeout_ms),
           _stale_period_ms(stale_period_ms),
           stream_name_(stream_name),
           should_ingest(true),
           settings_(std::move(settings)),
-          _terminated(terminated) {
+          _terminated(terminated),
+          _over_memory_budget(over_memory_budget) {
     this->reader = std::make_unique<StreamReader>(connection);
     this->reader->Initialize(stream_name);
     auto local_schema = reader->schema();
@@ -257,6 +271,7 @@ StreamIngestionResult SingleStreamIngester::Ingest() {
 
             int *sizes_ptr = &sizes[row_group_size];
             string *keys_ptr = &keys[row_group_size];
+            int64_t samples_dropped_before = reader->total_samples_dropped();
             int64_t num_read = reader->ReadBytes(&read_buffer[row_group_size * sample_size],
                                                  samples_to_read,
                                                  &sizes_ptr,
@@ -275,6 +290,9 @@ StreamIngestionResult SingleStreamIngester::Ingest() {
                 break;
             }
 
+            // For lossy (ring-buffer) streams, samples may have been trimmed before we could read them. Reads never
+            // span such a gap, so any dropped samples precede everything returned by this read.
+            global_offset += reader->total_samples_dropped() - samples_dropped_before;
             for (int64_t i = 0; i < num_read; i++) {
                 data_indices[row_group_size + i] = global_offset + i;
             }
@@ -458,7 +476,10 @@ void SingleStreamIngester::delete_up_to(const string& last_key_persisted) {
 
     auto elapsed_seconds = std::chrono::duration_cast<std::chrono::seconds>(
             std::chrono::system_clock::now() - KeyTimestamp(last_key_persisted.c_str()));
-    if (elapsed_seconds.count() > settings_.minimum_age_seconds_before_deletion) {
+    if (_over_memory_budget != nullptr && *_over_memory_budget) {
+        // Already persisted, so free up Redis memory right away rather than risk Redis running out.
+        spdlog::info("Over the Redis memory budget; deleting up to key {} without waiting.", last_key_persisted);
+    } else if (elapsed_seconds.count() < settings_.minimum_age_seconds_before_deletion) {
         long long to_sleep = settings_.minimum_age_seconds_before_deletion - elapsed_seconds.count() + 1;
         if (to_sleep > 0) {
             spdlog::info(
@@ -487,6 +508,17 @@ void SingleStreamIngester::delete_up_to(const string& last_key_persisted) {
         redis->DeleteMetadata(stream_name_);
         spdlog::info("Stream metadata for {} deleted.", stream_name_);
     }
+
+    // Subsequent ingestion reads from replicas, which must not still serve what was just deleted (e.g. to avoid
+    // re-ingesting a completed stream), so wait for them to catch up.
+    int num_replicas = static_cast<int>(_connection.read_endpoints().size());
+    if (num_replicas > 0) {
+        int num_acknowledged = redis->WaitForReplicas(num_replicas, _stalled_timeout_ms);
+        if (num_acknowledged < num_replicas) {
+            spdlog::warn("Only {} of {} replicas acknowledged deletions for stream {} within {} ms.",
+                         num_acknowledged, num_replicas, stream_name_, _stalled_timeout_ms);
+        }
+    }
 }
 
 void SingleStreamIngester::add_eof_if_necessary() {
@@ -501,7 +533,8 @@ void SingleStreamIngester::add_eof_if_necessary() {
         ~TailListener() = default;
     };
 
-    unique_ptr<StreamReader> tail_reader = make_unique<StreamReader>(_connection);
+    // Read from the primary, as a lagging replica could make a live stream look stale.
+    unique_ptr<StreamReader> tail_reader = make_unique<StreamReader>(_connection.PrimaryOnly());
     auto listener = make_unique<TailListener>();
     tail_reader->AddListener(listener.get());
     tail_reader->Initialize(stream_name_);
@@ -526,7 +559,7 @@ void SingleStreamIngester::add_eof_if_necessary() {
     internal::DecodeCursor(key, &last_sample_written_at_ms, &b);
 
     unique_ptr<internal::Redis> redis = internal::Redis::Create(_connection);
-    int64_t time_us = redis->TimeUs();
+    int64_t time_us = redis->TimeUs(listener->last_stream_key);
 
     int64_t elapsed_us = time_us - last_sample_written_at_ms * 1000;
     if (elapsed_us > _stale_period_ms * 1000) {
@@ -776,6 +809,8 @@ void SingleStreamIngester::append_metadata(StreamIngestionResult result) {
     root.put("stream_name", stream_name_);
     root.put("local_minus_server_clock_us", std::to_string(reader->local_minus_server_clock_us()));
     root.put("initialized_at_us", std::to_string(reader->initialized_at_us()));
+    root.put("lossy", reader->is_lossy());
+    root.put("total_samples_dropped", std::to_string(reader->total_samples_dropped()));
 
     string result_str;
     switch (result) {
@@ -26,6 +26,7 @@
 #include <spdlog/fmt/fmt.h>
 #include <utility>
 #include <chrono>
+#include <atomic>
 #include "ingester_settings.h"
 
 #include "ingester_threadpool.h"
@@ -47,7 +48,8 @@ public:
             bool *terminated,
             std::vector<std::pair<std::regex, StreamIngestionSettings>> stream_settings_by_name_glob,
             int stalled_timeout_ms = 1000,
-            int stale_period_ms = 300000);
+            int stale_period_ms = 300000,
+            int64_t memory_budget_bytes = 0);
 
     ~StreamIngester() {
         Stop();
@@ -67,6 +69,9 @@ private:
     std::vector<std::pair<std::regex, StreamIngestionSettings>> stream_settings_by_name_glob_;
     const int _stalled_timeout_ms;
     const int _stale_period_ms;
+    // Only set if given a memory budget.
+    unique_ptr<StreamMemoryAccountant> _memory_accountant;
+    std::atomic_bool _over_memory_budget;
     std::set<string> _streams_in_progress;
     mutex _streams_in_progress_mtx;
 };
@@ -80,7 +85,8 @@ public:
                          bool *terminated,
                          int stalled_timeout_ms,
                          int stale_period_ms,
-                         StreamIngestionSettings settings);
+                         StreamIngestionSettings settings,
+                         const std::atomic_bool *over_memory_budget = nullptr);
 
     StreamIngestionResult Ingest();
 private:
@@ -97,6 +103,7 @@ private:
     unique_ptr<StreamReader> reader;
     bool should_ingest;
     bool *_terminated;
+    const std::atomic_bool *_over_memory_budget;
 
     static void write_parquet_file(const string &filepath, const arrow::Table& table);
 
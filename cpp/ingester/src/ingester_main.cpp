@@ -26,6 +26,8 @@ int main(int argc, char **argv) {
     string output_directory;
     string settings_filename;
     int http_server_port;
+    int64_t memory_budget_bytes;
+    vector<string> redis_read_endpoints;
 
     po::options_description desc("Allowed options");
     desc.add_options()
@@ -40,6 +42,13 @@ int main(int argc, char **argv) {
              "Output directory for all files [required]")
             ("http_server_port", po::value<int>(&http_server_port)->default_value(7487),
              "HTTP server to start listening on. Defaults to port 7487. Set to 0 or negative to disable. [optional]")
+            ("redis_read_endpoints", po::value<vector<string>>(&redis_read_endpoints)->multitoken(),
+             "Read replicas of the Redis given above as host:port, to read streams from instead of the primary. "
+             "[optional]")
+            ("memory_budget_bytes", po::value<int64_t>(&memory_budget_bytes)->default_value(0),
+             "Budget for Redis memory used by all streams. While over budget, persisted data is deleted from Redis "
+             "immediately, and writers are signaled to back off (see StreamWriter::MemoryStatus()). Defaults to 0, "
+             "i.e. no budget. [optional]")
         ;
 
     po::variables_map vm;
@@ -86,12 +95,23 @@ int main(int argc, char **argv) {
     }
 
     river::RedisConnection rc(redis_hostname, redis_port, redis_password);
+    for (const auto &endpoint : redis_read_endpoints) {
+        size_t separator = endpoint.rfind(':');
+        if (separator == string::npos) {
+            cerr << "Invalid read endpoint " << endpoint << "; expected host:port." << endl;
+            return 1;
+        }
+        rc.AddReadEndpoint(endpoint.substr(0, separator), stoi(endpoint.substr(separator + 1)));
+    }
     {
         river::StreamIngester ingester(
                 rc,
                 output_directory,
                 &terminated,
-                settings_by_stream);
+                settings_by_stream,
+                1000,
+                300000,
+                memory_budget_bytes);
         spdlog::info("Beginning ingestion forever...");
         while (!terminated) {
             ingester.Ingest();
@@ -395,3 +395,32 @@ TEST_F(StreamIngesterTest, TestIngestionSettings_WhitelistField_Matches) {
     settings_columns_whitelist = std::vector<std::regex>({ std::regex("field.*") });
     write_and_assert<double, arrow::DoubleArray>(FieldDefinition::DOUBLE);
 }
+
+TEST_F(StreamIngesterTest, TestWaitsMinimumAgeBeforeDeleting) {
+    vector<FieldDefinition> field_definitions = vector<FieldDefinition>{
+            FieldDefinition("field1", FieldDefinition::INT32, sizeof(int32_t))
+    };
+    StreamSchema schema(field_definitions);
+    vector<int32_t> data(100);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = (int32_t) i;
+    }
+
+    auto writer = make_unique<StreamWriter>(connection);
+    writer->Initialize(stream_name, schema);
+    writer->Write(data.data(), (int) data.size());
+    writer->Stop();
+
+    // The samples were just written, so the ingester must wait out minimum_age_seconds_before_deletion (1 second)
+    // before deleting them.
+    auto start = chrono::steady_clock::now();
+    auto ingester = new_ingester(10, schema);
+    ingester->Ingest();
+    ingester->Stop();
+    auto elapsed = chrono::steady_clock::now() - start;
+    ASSERT_GE(elapsed, chrono::seconds(1));
+
+    auto result = boost::get<StreamIngestionResult>(*ingester->GetResult(stream_name));
+    ASSERT_EQ(result, StreamIngestionResult::COMPLETED);
+    ASSERT_FALSE(redis->GetMetadata(stream_name));
+}
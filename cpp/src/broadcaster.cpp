@@ -0,0 +1,189 @@
+#include "broadcaster.h"
+
+#include <chrono>
+#include <cstring>
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+
+using namespace std;
+
+namespace river {
+
+// How long each read of the broadcasting thread blocks, and thus how long it can take to notice it's been stopped.
+static const int BROADCAST_POLL_TIMEOUT_MS = 1000;
+// Number of times to poll an empty ring before sleeping in between polls.
+static const int SUBSCRIBER_SPIN_POLLS = 10000;
+
+StreamSubscriber::StreamSubscriber(shared_ptr<internal::SharedMemoryRing> ring, int sample_size)
+    : ring_(std::move(ring)), sample_size_(sample_size), next_sample_index_(-1), record_offset_(0), is_eof_(false),
+      total_samples_read_(0), total_samples_dropped_(0) {
+    position_ = ring_->write_position();
+}
+
+int64_t StreamSubscriber::ReadBytes(char *buffer, int64_t num_samples, int timeout_ms) {
+    using ReadResult = internal::SharedMemoryRing::ReadResult;
+
+    if (is_eof_) {
+        return -1;
+    }
+
+    int64_t end_us;
+    if (timeout_ms <= 0) {
+        end_us = INT64_MAX;
+    } else {
+        end_us = chrono::duration_cast<chrono::microseconds>(
+            chrono::steady_clock::now().time_since_epoch()).count() + 1000 * timeout_ms;
+    }
+
+    int64_t samples_read = 0;
+    int num_empty_polls = 0;
+    while (samples_read < num_samples) {
+        if (record_offset_ >= record_.num_samples) {
+            auto result = ring_->Read(position_, &record_, &payload_);
+            if (result == ReadResult::OVERRUN) {
+                // Skip ahead to the newest samples; the number dropped is known once that record is read.
+                position_ = ring_->latest_record_position();
+                record_ = {};
+                continue;
+            }
+            if (result == ReadResult::NOT_YET_PUBLISHED) {
+                int64_t now_us = chrono::duration_cast<chrono::microseconds>(
+                    chrono::steady_clock::now().time_since_epoch()).count();
+                if (now_us >= end_us) {
+                    break;
+                }
+                if (++num_empty_polls < SUBSCRIBER_SPIN_POLLS) {
+                    this_thread::yield();
+                } else {
+                    this_thread::sleep_for(chrono::microseconds(50));
+                }
+                continue;
+            }
+
+            if (record_.num_samples < 0) {
+                is_eof_ = true;
+                record_ = {};
+                total_samples_read_ += samples_read;
+                return samples_read > 0 ? samples_read : -1;
+            }
+            if (next_sample_index_ >= 0 && record_.first_sample_index > next_sample_index_) {
+                if (samples_read > 0) {
+                    // Return what we have so far, and read this record again on the next read.
+                    record_ = {};
+                    break;
+                }
+                int64_t num_dropped = record_.first_sample_index - next_sample_index_;
+                spdlog::warn("Subscriber fell behind; skipping {} samples.", num_dropped);
+                total_samples_dropped_ += num_dropped;
+            }
+            if (sample_size_ <= 0) {
+                sample_size_ = static_cast<int>(record_.data_num_bytes / record_.num_samples);
+            }
+            position_ += record_.num_bytes;
+            record_offset_ = 0;
+            next_sample_index_ = record_.first_sample_index;
+        }
+
+        int64_t num_to_copy = min(num_samples - samples_read, record_.num_samples - record_offset_);
+        memcpy(&buffer[samples_read * sample_size_],
+               payload_.data() + record_offset_ * sample_size_,
+               num_to_copy * sample_size_);
+        record_offset_ += num_to_copy;
+        samples_read += num_to_copy;
+        next_sample_index_ += num_to_copy;
+        num_empty_polls = 0;
+    }
+
+    total_samples_read_ += samples_read;
+    return samples_read;
+}
+
+StreamBroadcaster::StreamBroadcaster(const StreamReaderParams &params, int64_t ring_bytes)
+    : reader_(params), max_fetch_size_(params.max_fetch_size),
+      ring_(internal::SharedMemoryRing::CreateInProcess(ring_bytes)), is_stopped_(false),
+      total_samples_broadcasted_(0), is_eof_published_(false) {}
+
+StreamBroadcaster::~StreamBroadcaster() {
+    Stop();
+}
+
+void StreamBroadcaster::Initialize(const string &stream_name, int timeout_ms) {
+    if (is_stopped_) {
+        throw StreamReaderException("Broadcaster is already stopped; cannot initialize a stopped broadcaster.");
+    }
+    if (thread_.joinable()) {
+        return;
+    }
+
+    reader_.Initialize(stream_name, timeout_ms);
+    const StreamSchema &schema = reader_.schema();
+    if (schema.has_variable_width_field()) {
+        throw StreamReaderException("Streams with variable-width fields can't be broadcasted.");
+    }
+    uint64_t max_record_num_bytes =
+        sizeof(internal::SharedMemoryRingRecord) + uint64_t(max_fetch_size_) * schema.sample_size();
+    if (max_record_num_bytes > ring_->capacity()) {
+        throw StreamReaderException(fmt::format(
+            "Ring of {} bytes is too small for batches of up to {} bytes; use a larger ring or smaller max fetch size.",
+            ring_->capacity(), max_record_num_bytes));
+    }
+
+    thread_ = thread(&StreamBroadcaster::Run, this);
+}
+
+unique_ptr<StreamSubscriber> StreamBroadcaster::Subscribe() {
+    // Before initialization, the sample size isn't known, but neither has anything been broadcasted.
+    int sample_size = reader_.is_initialized() ? reader_.schema().sample_size() : 0;
+    return unique_ptr<StreamSubscriber>(new StreamSubscriber(ring_, sample_size));
+}
+
+void StreamBroadcaster::Run() {
+    const int sample_size = reader_.schema().sample_size();
+    vector<char> buffer(int64_t{max_fetch_size_} * sample_size);
+    try {
+        while (!is_stopped_) {
+            // Publish whatever is available rather than waiting for full batches, to not add latency.
+            int64_t num_read = reader_.ReadBytes(
+                buffer.data(), max_fetch_size_, nullptr, nullptr, BROADCAST_POLL_TIMEOUT_MS, 1);
+            if (num_read < 0) {
+                break;
+            }
+            if (num_read == 0) {
+                continue;
+            }
+
+            internal::SharedMemoryRingRecord record{};
+            record.first_sample_index = total_samples_broadcasted_;
+            record.num_samples = num_read;
+            record.data_num_bytes = num_read * sample_size;
+            ring_->Publish(record, nullptr, buffer.data());
+            total_samples_broadcasted_ += num_read;
+        }
+    } catch (const exception &e) {
+        spdlog::error("Broadcasting stream {} failed: {}", reader_.stream_name(), e.what());
+    }
+    PublishEof();
+}
+
+void StreamBroadcaster::PublishEof() {
+    if (is_eof_published_) {
+        return;
+    }
+    internal::SharedMemoryRingRecord record{};
+    record.first_sample_index = total_samples_broadcasted_;
+    record.num_samples = -1;
+    ring_->Publish(record, nullptr, nullptr);
+    is_eof_published_ = true;
+}
+
+void StreamBroadcaster::Stop() {
+    is_stopped_ = true;
+    if (thread_.joinable()) {
+        thread_.join();
+    } else {
+        PublishEof();
+    }
+    reader_.Stop();
+}
+
+}
@@ -0,0 +1,135 @@
+#ifndef RIVER_SRC_BROADCASTER_H_
+#define RIVER_SRC_BROADCASTER_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "reader.h"
+#include "shared_memory_ring.h"
+
+namespace river {
+
+/**
+ * One consumer of a StreamBroadcaster, obtained via StreamBroadcaster#Subscribe(). Each subscriber reads the
+ * broadcasted samples at its own pace; a subscriber that falls more than the broadcaster's ring behind skips ahead to
+ * what's still in the ring, see #total_samples_dropped(). Subscribers should each be used by only one thread.
+ */
+class StreamSubscriber {
+public:
+    /**
+     * Reads the next samples, with the same semantics as StreamReader#Read(): blocks until `num_samples` samples are
+     * read (or until the timeout, if positive), and returns -1 once the stream has ended. A read never spans samples
+     * that were dropped.
+     */
+    template<class DataT>
+    int64_t Read(DataT *buffer, int64_t num_samples, int timeout_ms = -1) {
+        if (sample_size_ > 0 && sizeof(buffer[0]) != sample_size_) {
+            throw StreamReaderException("Buffer given was not the same size as what's stored in metadata.");
+        }
+        return ReadBytes(reinterpret_cast<char *>(buffer), num_samples, timeout_ms);
+    }
+
+    int64_t ReadBytes(char *buffer, int64_t num_samples, int timeout_ms = -1);
+
+    /**
+     * Whether there is possibly more to read, i.e. the broadcasted stream hasn't ended.
+     */
+    bool Good() const {
+        return !is_eof_;
+    }
+
+    int64_t total_samples_read() const {
+        return total_samples_read_;
+    }
+
+    /**
+     * Number of samples skipped because they were overwritten in the broadcaster's ring before this subscriber got to
+     * them.
+     */
+    int64_t total_samples_dropped() const {
+        return total_samples_dropped_;
+    }
+
+private:
+    StreamSubscriber(std::shared_ptr<internal::SharedMemoryRing> ring, int sample_size);
+    friend class StreamBroadcaster;
+
+    const std::shared_ptr<internal::SharedMemoryRing> ring_;
+    // Zero until known, when subscribing before the broadcaster is initialized.
+    int sample_size_;
+    uint64_t position_;
+    // Index (within the broadcast) of the next sample expected, or -1 if none has been read yet.
+    int64_t next_sample_index_;
+    internal::SharedMemoryRingRecord record_{};
+    std::vector<char> payload_;
+    int64_t record_offset_;
+    bool is_eof_;
+    int64_t total_samples_read_;
+    int64_t total_samples_dropped_;
+};
+
+/**
+ * Reads a stream once on behalf of any number of consumers within this process. A background thread reads batches of
+ * samples with a single StreamReader and publishes them into a lock-free ring, from which each StreamSubscriber copies
+ * them out. Thus Redis load and decompression stay constant regardless of the number of consumers, and a slow consumer
+ * never holds back the others. Only streams with fixed-width schemas can be broadcasted.
+ */
+class StreamBroadcaster {
+public:
+    /**
+     * @param params Parameters of the underlying StreamReader. Its max_fetch_size also bounds the number of samples in
+     * each batch published to subscribers.
+     * @param ring_bytes Size of the ring of batches that subscribers read from.
+     */
+    explicit StreamBroadcaster(const StreamReaderParams &params, int64_t ring_bytes = int64_t{1} << 26);
+
+    ~StreamBroadcaster();
+
+    /**
+     * Initializes the underlying reader to the given stream (see StreamReader#Initialize()) and starts broadcasting.
+     */
+    void Initialize(const std::string &stream_name, int timeout_ms = -1);
+
+    /**
+     * Creates a new subscriber, which receives samples broadcasted from now on. Subscribing before #Initialize()
+     * receives the stream from its start.
+     */
+    std::unique_ptr<StreamSubscriber> Subscribe();
+
+    /**
+     * Stops broadcasting; subscribers then see the stream as ended once they've read everything before that.
+     */
+    void Stop();
+
+    /**
+     * The schema of the broadcasted stream; only valid after #Initialize().
+     */
+    const StreamSchema &schema() {
+        return reader_.schema();
+    }
+
+    /**
+     * Number of samples broadcasted so far.
+     */
+    int64_t total_samples_broadcasted() const {
+        return total_samples_broadcasted_;
+    }
+
+private:
+    void Run();
+    void PublishEof();
+
+    StreamReader reader_;
+    const int max_fetch_size_;
+    const std::shared_ptr<internal::SharedMemoryRing> ring_;
+    std::thread thread_;
+    std::atomic_bool is_stopped_;
+    std::atomic<int64_t> total_samples_broadcasted_;
+    bool is_eof_published_;
+};
+
+}
+
+#endif //RIVER_SRC_BROADCASTER_H_
@@ -0,0 +1,180 @@
+#include "adaptive_compressor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <nlohmann/json.hpp>
+#include "compressor.h"
+
+using json = nlohmann::json;
+
+namespace river {
+namespace internal {
+
+namespace {
+const size_t ID_SIZE = sizeof(uint8_t);
+const size_t MAX_CANDIDATES = 256;
+
+std::string GetOrDefault(const std::unordered_map<std::string, std::string> &params,
+                         const std::string &key_name,
+                         const std::string &default_value) {
+    auto it = params.find(key_name);
+    return it == params.end() ? default_value : it->second;
+}
+}
+
+std::vector<StreamCompression> ParseAdaptiveCandidates(const StreamCompression &compression,
+                                                       const StreamSchema &schema) {
+    auto params = compression.params();
+    auto candidates_it = params.find("candidates");
+    if (candidates_it == params.end()) {
+        throw std::invalid_argument("Expected candidates for ADAPTIVE compression");
+    }
+
+    std::vector<StreamCompression> ret;
+    bool has_uncompressed = false;
+    for (const auto &candidate_json : json::parse(candidates_it->second)) {
+        std::unordered_map<std::string, std::string> candidate_params =
+            candidate_json.value("params", json::object());
+        auto candidate = StreamCompression::Create(candidate_json["name"], candidate_params);
+        switch (candidate.type()) {
+            case StreamCompression::Type::ADAPTIVE:
+                throw std::invalid_argument("ADAPTIVE compression can't be nested.");
+            case StreamCompression::Type::ZFP_LOSSLESS:
+            case StreamCompression::Type::ZFP_LOSSY:
+            case StreamCompression::Type::ZFP_FIXED_RATE:
+            case StreamCompression::Type::FIELD_GROUPS:
+                if (schema.has_variable_width_field()) {
+                    throw std::invalid_argument(candidate.name() + " compresses fixed-width samples only, so can't be "
+                                                                   "a candidate for variable-width samples.");
+                }
+                break;
+            case StreamCompression::Type::UNCOMPRESSED:
+                has_uncompressed = true;
+                break;
+            default:
+                break;
+        }
+        ret.push_back(candidate);
+    }
+    if (!has_uncompressed) {
+        ret.emplace_back(StreamCompression::Type::UNCOMPRESSED);
+    }
+    if (ret.size() > MAX_CANDIDATES) {
+        throw std::invalid_argument("ADAPTIVE compression takes at most " + std::to_string(MAX_CANDIDATES)
+                                        + " candidates.");
+    }
+    return ret;
+}
+
+AdaptiveCompressor::AdaptiveCompressor(const StreamCompression &compression, const StreamSchema &schema)
+    : candidates_(ParseAdaptiveCandidates(compression, schema)) {
+    auto params = compression.params();
+    max_ns_per_byte_ = std::stod(GetOrDefault(params, "max_ns_per_byte", "0"));
+    batches_per_trial_ = std::stoi(GetOrDefault(params, "batches_per_trial", "16"));
+    trial_bytes_ = std::stoul(GetOrDefault(params, "trial_bytes", "65536"));
+    if (batches_per_trial_ <= 0 || trial_bytes_ == 0) {
+        throw std::invalid_argument("ADAPTIVE compression needs positive batches_per_trial and trial_bytes.");
+    }
+    // Variable-width batches are compressed as one block of sizes and data, which general-purpose codecs can cut
+    // anywhere.
+    trial_unit_ = schema.has_variable_width_field() ? 1 : schema.sample_size();
+
+    for (const auto &candidate : candidates_) {
+        compressors_.push_back(CreateCompressor(candidate, schema));
+        AdaptiveCompressionStats candidate_stats;
+        candidate_stats.compression = candidate;
+        stats_.push_back(candidate_stats);
+    }
+}
+
+size_t AdaptiveCompressor::PickCandidate(const char *data, size_t length) {
+    size_t trial_length = std::min(length, std::max(trial_bytes_ - trial_bytes_ % trial_unit_, trial_unit_));
+    size_t best = 0;
+    double best_ratio = -1;
+    for (size_t i = 0; i < compressors_.size(); i++) {
+        double ratio = 1.0;
+        if (compressors_[i]) {
+            if (!warmed_up_) {
+                // Warm up, so the first trial isn't slowed by e.g. the compressor allocating its context.
+                compressors_[i]->compress_into(data, trial_length, &compressed_);
+            }
+            auto start = std::chrono::steady_clock::now();
+            compressors_[i]->compress_into(data, trial_length, &compressed_);
+            std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            if (max_ns_per_byte_ > 0 && elapsed.count() > max_ns_per_byte_ * trial_length) {
+                continue;
+            }
+            ratio = static_cast<double>(trial_length) / std::max<size_t>(compressed_.size(), 1);
+        }
+        if (ratio > best_ratio) {
+            best = i;
+            best_ratio = ratio;
+        }
+    }
+    warmed_up_ = true;
+    return best;
+}
+
+std::vector<char> AdaptiveCompressor::compress(const char *data, size_t length) {
+    if (num_batches_++ % batches_per_trial_ == 0 && length > 0) {
+        current_candidate_ = PickCandidate(data, length);
+    }
+
+    std::vector<char> ret;
+    auto *compressor = compressors_[current_candidate_].get();
+    if (compressor) {
+        compressor->compress_into(data, length, &compressed_);
+        ret.reserve(ID_SIZE + compressed_.size());
+        ret.push_back(static_cast<char>(current_candidate_));
+        ret.insert(ret.end(), compressed_.begin(), compressed_.end());
+    } else {
+        ret.reserve(ID_SIZE + length);
+        ret.push_back(static_cast<char>(current_candidate_));
+        ret.insert(ret.end(), data, data + length);
+    }
+
+    std::lock_guard<std::mutex> lock(stats_mtx_);
+    auto &candidate_stats = stats_[current_candidate_];
+    candidate_stats.num_batches++;
+    candidate_stats.uncompressed_bytes += length;
+    candidate_stats.compressed_bytes += ret.size() - ID_SIZE;
+    return ret;
+}
+
+std::vector<AdaptiveCompressionStats> AdaptiveCompressor::stats() const {
+    std::lock_guard<std::mutex> lock(stats_mtx_);
+    return stats_;
+}
+
+AdaptiveDecompressor::AdaptiveDecompressor(const StreamCompression &compression, const StreamSchema &schema) {
+    for (const auto &candidate : ParseAdaptiveCandidates(compression, schema)) {
+        decompressors_.push_back(CreateDecompressor(candidate, schema));
+    }
+}
+
+std::vector<char> AdaptiveDecompressor::decompress(const char *data, size_t length) {
+    std::vector<char> ret;
+    decompress_into(data, length, &ret);
+    return ret;
+}
+
+void AdaptiveDecompressor::decompress_into(const char *data, size_t length, std::vector<char> *out) {
+    if (length < ID_SIZE) {
+        throw std::runtime_error("ADAPTIVE-compressed data is missing its candidate ID.");
+    }
+    auto id = static_cast<size_t>(static_cast<unsigned char>(data[0]));
+    if (id >= decompressors_.size()) {
+        throw std::runtime_error("ADAPTIVE-compressed data has an unknown candidate ID " + std::to_string(id));
+    }
+    if (decompressors_[id]) {
+        decompressors_[id]->decompress_into(data + ID_SIZE, length - ID_SIZE, out);
+    } else {
+        out->assign(data + ID_SIZE, data + length);
+    }
+}
+
+}
+}
@@ -0,0 +1,75 @@
+#ifndef RIVER_SRC_COMPRESSION_ADAPTIVE_COMPRESSOR_H_
+#define RIVER_SRC_COMPRESSION_ADAPTIVE_COMPRESSOR_H_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "compressor_types.h"
+#include "../schema.h"
+
+namespace river {
+namespace internal {
+
+/**
+ * Parses the candidates of ADAPTIVE compression, in the order their IDs are assigned, with UNCOMPRESSED appended if it
+ * isn't one of them. Throws std::invalid_argument if a candidate can't compress the given schema's samples.
+ */
+std::vector<StreamCompression> ParseAdaptiveCandidates(const StreamCompression &compression,
+                                                       const StreamSchema &schema);
+
+/**
+ * Compresses each batch with whichever candidate compression was last picked, into one payload of:
+ *
+ *   <uint8: ID of the candidate used, i.e. its index within ParseAdaptiveCandidates()> <the batch, compressed>
+ *
+ * Candidates are picked by trial on the first batch and then every `batches_per_trial` batches; see
+ * StreamCompression#Adaptive().
+ */
+class AdaptiveCompressor : public Compressor {
+public:
+    AdaptiveCompressor(const StreamCompression &compression, const StreamSchema &schema);
+    std::vector<char> compress(const char *data, size_t length) override;
+
+    /**
+     * Per-candidate stats of the batches compressed so far, indexed by candidate ID. Safe to call while compressing on
+     * another thread.
+     */
+    std::vector<AdaptiveCompressionStats> stats() const;
+private:
+    // Tries each candidate on the start of the batch, returning the ID of the one to use.
+    size_t PickCandidate(const char *data, size_t length);
+
+    std::vector<StreamCompression> candidates_;
+    // Null for UNCOMPRESSED.
+    std::vector<std::unique_ptr<Compressor>> compressors_;
+    double max_ns_per_byte_;
+    int batches_per_trial_;
+    size_t trial_bytes_;
+    // Trials compress whole samples, since e.g. ZFP needs whole rows.
+    size_t trial_unit_;
+
+    int64_t num_batches_ = 0;
+    // Whether each candidate has compressed once already, untimed; see PickCandidate().
+    bool warmed_up_ = false;
+    size_t current_candidate_ = 0;
+    std::vector<char> compressed_;
+
+    mutable std::mutex stats_mtx_;
+    std::vector<AdaptiveCompressionStats> stats_;
+};
+
+class AdaptiveDecompressor : public Decompressor {
+public:
+    AdaptiveDecompressor(const StreamCompression &compression, const StreamSchema &schema);
+    std::vector<char> decompress(const char *data, size_t length) override;
+    void decompress_into(const char *data, size_t length, std::vector<char> *out) override;
+private:
+    // Null for UNCOMPRESSED.
+    std::vector<std::unique_ptr<Decompressor>> decompressors_;
+};
+
+}
+}
+
+#endif //RIVER_SRC_COMPRESSION_ADAPTIVE_COMPRESSOR_H_
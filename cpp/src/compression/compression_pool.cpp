@@ -0,0 +1,55 @@
+#include "compression_pool.h"
+
+using namespace std;
+
+namespace river {
+
+CompressionPool::CompressionPool(int num_threads) : is_stopping_(false) {
+    if (num_threads <= 0) {
+        num_threads = max(1, static_cast<int>(thread::hardware_concurrency()));
+    }
+    for (int i = 0; i < num_threads; i++) {
+        threads_.emplace_back(&CompressionPool::Run, this);
+    }
+}
+
+CompressionPool::~CompressionPool() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        is_stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto &t : threads_) {
+        t.join();
+    }
+}
+
+future<vector<char>> CompressionPool::Submit(function<vector<char>()> task) {
+    packaged_task<vector<char>()> packaged(std::move(task));
+    auto ret = packaged.get_future();
+    {
+        lock_guard<mutex> lock(mutex_);
+        tasks_.push_back(std::move(packaged));
+    }
+    cv_.notify_one();
+    return ret;
+}
+
+void CompressionPool::Run() {
+    while (true) {
+        packaged_task<vector<char>()> task;
+        {
+            unique_lock<mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return is_stopping_ || !tasks_.empty(); });
+            // Finish queued tasks before stopping, since writers are waiting on them.
+            if (tasks_.empty()) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+}
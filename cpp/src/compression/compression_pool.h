@@ -0,0 +1,51 @@
+#ifndef RIVER_SRC_COMPRESSION_COMPRESSION_POOL_H_
+#define RIVER_SRC_COMPRESSION_COMPRESSION_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace river {
+
+/**
+ * A pool of worker threads that compress batches on behalf of StreamWriters (see
+ * StreamWriterParamsBuilder#compression_pool()), so that compressing a writer's next batches overlaps with sending its
+ * current one. One pool can be shared by any number of writers in a process; tasks run in the order they're
+ * submitted.
+ */
+class CompressionPool {
+public:
+    /**
+     * @param num_threads Number of worker threads; if nonpositive, one per hardware thread.
+     */
+    explicit CompressionPool(int num_threads = 0);
+
+    ~CompressionPool();
+
+    /**
+     * Runs the given task on a worker thread. Its result, or any exception it throws, is available via the returned
+     * future.
+     */
+    std::future<std::vector<char>> Submit(std::function<std::vector<char>()> task);
+
+    int num_threads() const {
+        return static_cast<int>(threads_.size());
+    }
+
+private:
+    void Run();
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::packaged_task<std::vector<char>()>> tasks_;
+    bool is_stopping_;
+};
+
+}
+
+#endif //RIVER_SRC_COMPRESSION_COMPRESSION_POOL_H_
@@ -3,8 +3,12 @@
 //
 
 #include "compressor.h"
+#include "filter_pipeline.h"
+#include "field_group_compressor.h"
+#include "adaptive_compressor.h"
 #include <sstream>
 #include <cassert>
+#include <nlohmann/json.hpp>
 
 
 namespace river {
@@ -22,21 +26,42 @@ static std::string GetOrThrow(
     return it->second;
 }
 
+// General-purpose codecs can have filters applied to batches before they're compressed; see FilterPipeline.
+static std::unique_ptr<Compressor> WithFilters(const StreamCompression &compression,
+                                               std::unique_ptr<Compressor> compressor) {
+    internal::FilterPipeline pipeline(compression.params());
+    if (pipeline.empty()) {
+        return compressor;
+    }
+    return std::make_unique<internal::FilteredCompressor>(std::move(pipeline), std::move(compressor));
+}
+
+static std::unique_ptr<Decompressor> WithFilters(const StreamCompression &compression,
+                                                 std::unique_ptr<Decompressor> decompressor) {
+    internal::FilterPipeline pipeline(compression.params());
+    if (pipeline.empty()) {
+        return decompressor;
+    }
+    return std::make_unique<internal::FilteredDecompressor>(std::move(pipeline), std::move(decompressor));
+}
+
 std::unique_ptr<Decompressor> CreateDecompressor(const StreamCompression &compression) {
     switch (compression.type()) {
         case StreamCompression::Type::UNCOMPRESSED: return {};
         case StreamCompression::Type::ZFP_LOSSLESS:
-        case StreamCompression::Type::ZFP_LOSSY: {
+        case StreamCompression::Type::ZFP_LOSSY:
+        case StreamCompression::Type::ZFP_FIXED_RATE: {
             auto params = compression.params();
             auto data_type = GetOrThrow(params, "data_type", compression.name());
+            bool fixed_rate = compression.type() == StreamCompression::Type::ZFP_FIXED_RATE;
             if (data_type == "int16") {
-                return std::make_unique<ZfpDecompressor<int16_t>>();
+                return std::make_unique<ZfpDecompressor<int16_t>>(fixed_rate);
             } else if (data_type == "int32") {
-                return std::make_unique<ZfpDecompressor<int32_t>>();
+                return std::make_unique<ZfpDecompressor<int32_t>>(fixed_rate);
             } else if (data_type == "float") {
-                return std::make_unique<ZfpDecompressor<float>>();
+                return std::make_unique<ZfpDecompressor<float>>(fixed_rate);
             } else if (data_type == "double") {
-                return std::make_unique<ZfpDecompressor<double>>();
+                return std::make_unique<ZfpDecompressor<double>>(fixed_rate);
             } else {
                 throw std::invalid_argument("Unhandled compression data type");
             }
@@ -44,6 +69,11 @@ std::unique_ptr<Decompressor> CreateDecompressor(const StreamCompression &compre
             break;
         case StreamCompression::Type::DUMMY: return std::make_unique<DummyCompressor>();
             break;
+        case StreamCompression::Type::LZ4: return WithFilters(compression, std::make_unique<Lz4Decompressor>());
+        case StreamCompression::Type::ZSTD: return WithFilters(compression, std::make_unique<ZstdDecompressor>());
+        case StreamCompression::Type::FIELD_GROUPS:
+        case StreamCompression::Type::ADAPTIVE:
+            throw std::invalid_argument(compression.name() + " compression needs the stream's schema.");
     }
     throw std::invalid_argument("Unhandled decompressor type!");
 }
@@ -52,7 +82,8 @@ std::unique_ptr<Compressor> CreateCompressor(const StreamCompression &compressio
     switch (compression.type()) {
         case StreamCompression::Type::UNCOMPRESSED: return {};
         case StreamCompression::Type::ZFP_LOSSLESS:
-        case StreamCompression::Type::ZFP_LOSSY: {
+        case StreamCompression::Type::ZFP_LOSSY:
+        case StreamCompression::Type::ZFP_FIXED_RATE: {
             auto params = compression.params();
             auto num_cols = std::stoi(GetOrThrow(params, "num_cols", compression.name()));
             auto data_type = GetOrThrow(params, "data_type", compression.name());
@@ -63,6 +94,13 @@ std::unique_ptr<Compressor> CreateCompressor(const StreamCompression &compressio
                 // Lossless
                 tolerance = -1;
             }
+            double rate = 0;
+            if (compression.type() == StreamCompression::Type::ZFP_FIXED_RATE) {
+                rate = std::stod(GetOrThrow(params, "rate", compression.name()));
+                if (rate <= 0) {
+                    throw std::invalid_argument("ZFP_FIXED_RATE compression needs a positive rate.");
+                }
+            }
 
             auto use_openmp_it = params.find("use_openmp");
             bool use_openmp;
@@ -73,13 +111,13 @@ std::unique_ptr<Compressor> CreateCompressor(const StreamCompression &compressio
             }
 
             if (data_type == "int16") {
-                return std::make_unique<ZfpCompressor<int16_t>>(num_cols, tolerance, use_openmp);
+                return std::make_unique<ZfpCompressor<int16_t>>(num_cols, tolerance, use_openmp, rate);
             } else if (data_type == "int32") {
-                return std::make_unique<ZfpCompressor<int32_t>>(num_cols, tolerance, use_openmp);
+                return std::make_unique<ZfpCompressor<int32_t>>(num_cols, tolerance, use_openmp, rate);
             } else if (data_type == "float") {
-                return std::make_unique<ZfpCompressor<float>>(num_cols, tolerance, use_openmp);
+                return std::make_unique<ZfpCompressor<float>>(num_cols, tolerance, use_openmp, rate);
             } else if (data_type == "double") {
-                return std::make_unique<ZfpCompressor<double>>(num_cols, tolerance, use_openmp);
+                return std::make_unique<ZfpCompressor<double>>(num_cols, tolerance, use_openmp, rate);
             } else {
                 throw std::invalid_argument("Unhandled compression data type");
             }
@@ -87,7 +125,78 @@ std::unique_ptr<Compressor> CreateCompressor(const StreamCompression &compressio
             break;
         case StreamCompression::Type::DUMMY:return std::make_unique<DummyCompressor>();
             break;
+        case StreamCompression::Type::LZ4: {
+            auto params = compression.params();
+            auto acceleration_it = params.find("acceleration");
+            int acceleration = acceleration_it == params.end() ? 1 : std::stoi(acceleration_it->second);
+            return WithFilters(compression, std::make_unique<Lz4Compressor>(acceleration));
+        }
+        case StreamCompression::Type::ZSTD: {
+            auto params = compression.params();
+            auto level_it = params.find("level");
+            int level = level_it == params.end() ? 3 : std::stoi(level_it->second);
+            return WithFilters(compression, std::make_unique<ZstdCompressor>(level));
+        }
+        case StreamCompression::Type::FIELD_GROUPS:
+        case StreamCompression::Type::ADAPTIVE:
+            throw std::invalid_argument(compression.name() + " compression needs the stream's schema.");
     }
     throw std::invalid_argument("Unhandled compression type!");
 }
+
+std::unique_ptr<Decompressor> CreateDecompressor(const StreamCompression &compression, const StreamSchema &schema) {
+    if (compression.type() == StreamCompression::Type::FIELD_GROUPS) {
+        return std::make_unique<internal::FieldGroupDecompressor>(compression, schema);
+    }
+    if (compression.type() == StreamCompression::Type::ADAPTIVE) {
+        return std::make_unique<internal::AdaptiveDecompressor>(compression, schema);
+    }
+    return CreateDecompressor(compression);
+}
+
+std::unique_ptr<Compressor> CreateCompressor(const StreamCompression &compression, const StreamSchema &schema) {
+    if (compression.type() == StreamCompression::Type::FIELD_GROUPS) {
+        return std::make_unique<internal::FieldGroupCompressor>(compression, schema);
+    }
+    if (compression.type() == StreamCompression::Type::ADAPTIVE) {
+        return std::make_unique<internal::AdaptiveCompressor>(compression, schema);
+    }
+    return CreateCompressor(compression);
+}
+
+StreamCompression StreamCompression::PerFieldGroup(
+    const std::vector<std::pair<std::vector<std::string>, StreamCompression>> &groups,
+    bool parallel) {
+    nlohmann::json groups_json = nlohmann::json::array();
+    for (const auto &group : groups) {
+        nlohmann::json group_json;
+        group_json["fields"] = group.first;
+        group_json["name"] = group.second.name();
+        group_json["params"] = group.second.params();
+        groups_json.push_back(group_json);
+    }
+    return StreamCompression(Type::FIELD_GROUPS, {
+        {"groups", groups_json.dump()},
+        {"parallel", parallel ? "true" : "false"},
+    });
+}
+
+StreamCompression StreamCompression::Adaptive(const std::vector<StreamCompression> &candidates,
+                                              double max_ns_per_byte,
+                                              int batches_per_trial,
+                                              int trial_bytes) {
+    nlohmann::json candidates_json = nlohmann::json::array();
+    for (const auto &candidate : candidates) {
+        nlohmann::json candidate_json;
+        candidate_json["name"] = candidate.name();
+        candidate_json["params"] = candidate.params();
+        candidates_json.push_back(candidate_json);
+    }
+    return StreamCompression(Type::ADAPTIVE, {
+        {"candidates", candidates_json.dump()},
+        {"max_ns_per_byte", nlohmann::json(max_ns_per_byte).dump()},
+        {"batches_per_trial", std::to_string(batches_per_trial)},
+        {"trial_bytes", std::to_string(trial_bytes)},
+    });
+}
 }
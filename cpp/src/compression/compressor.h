@@ -11,13 +11,30 @@
 #include <vector>
 #include <memory>
 #include "compressor_types.h"
+#include "../schema.h"
 
 namespace river {
 
+class ZfpDecompressorImpl;
+
 template <class DataTypeT>
 class ZfpDecompressor : public Decompressor {
 public:
+    /**
+     * @param fixed_rate whether batches were compressed in fixed-rate mode, and so can be decompressed in part.
+     */
+    explicit ZfpDecompressor(bool fixed_rate = false);
+    ~ZfpDecompressor() noexcept override;
     std::vector<char> decompress(const char *data, size_t length) override;
+    void decompress_into(const char *data, size_t length, std::vector<char> *out) override;
+    bool supports_random_access() const override {
+        return fixed_rate_;
+    }
+    size_t decompress_range(const char *data, size_t length, size_t offset, size_t num_bytes,
+                            std::vector<char> *out) override;
+private:
+    ZfpDecompressorImpl *impl_;
+    bool fixed_rate_;
 };
 
 class ZfpCompressorImpl;
@@ -29,15 +46,72 @@ public:
      * @param num_cols number of columns for each block of data that will be given to the compressor.
      * @param tolerance if <= 0, then reversible mode, aka lossless mode, will be used. Else, this is the allowed
      * absolute tolerance as specified
+     * @param rate if > 0, then fixed-rate mode will be used instead, at this many bits per value (and tolerance is
+     * ignored), so that batches can be decompressed in part; see ZfpDecompressor#decompress_range().
      */
-    ZfpCompressor(int num_cols, double tolerance, bool use_openmp);
+    ZfpCompressor(int num_cols, double tolerance, bool use_openmp, double rate = 0);
     ~ZfpCompressor() noexcept override;
     std::vector<char> compress(const char *data, size_t length) override;
+    void compress_into(const char *data, size_t length, std::vector<char> *out) override;
 private:
+    // Compresses into the impl's buffer, returning the compressed size.
+    size_t CompressToBuffer(const char *data, size_t length);
+
     ZfpCompressorImpl *impl_;
     int num_cols_;
     double tolerance_;
     bool use_openmp_;
+    double rate_;
+};
+
+class Lz4CompressorImpl;
+
+/**
+ * General-purpose compression with LZ4, for samples of any schema. Favors speed over ratio; `acceleration` > 1 trades
+ * ratio for yet more speed. The compression state is reused across calls.
+ */
+class Lz4Compressor : public Compressor {
+public:
+    explicit Lz4Compressor(int acceleration);
+    ~Lz4Compressor() noexcept override;
+    std::vector<char> compress(const char *data, size_t length) override;
+private:
+    Lz4CompressorImpl *impl_;
+    int acceleration_;
+};
+
+class Lz4Decompressor : public Decompressor {
+public:
+    std::vector<char> decompress(const char *data, size_t length) override;
+    void decompress_into(const char *data, size_t length, std::vector<char> *out) override;
+};
+
+class ZstdCompressorImpl;
+
+/**
+ * General-purpose compression with zstd, for samples of any schema, at the given compression level. The compression
+ * context is reused across calls.
+ */
+class ZstdCompressor : public Compressor {
+public:
+    explicit ZstdCompressor(int level);
+    ~ZstdCompressor() noexcept override;
+    std::vector<char> compress(const char *data, size_t length) override;
+private:
+    ZstdCompressorImpl *impl_;
+    int level_;
+};
+
+class ZstdDecompressorImpl;
+
+class ZstdDecompressor : public Decompressor {
+public:
+    ZstdDecompressor();
+    ~ZstdDecompressor() noexcept override;
+    std::vector<char> decompress(const char *data, size_t length) override;
+    void decompress_into(const char *data, size_t length, std::vector<char> *out) override;
+private:
+    ZstdDecompressorImpl *impl_;
 };
 
 class DummyCompressor : public Compressor, public Decompressor {
@@ -54,6 +128,12 @@ public:
 std::unique_ptr<Decompressor> CreateDecompressor(const StreamCompression &compression);
 std::unique_ptr<Compressor> CreateCompressor(const StreamCompression &compression);
 
+/**
+ * As above, for a stream of the given schema, which FIELD_GROUPS compression needs to split samples into fields.
+ */
+std::unique_ptr<Decompressor> CreateDecompressor(const StreamCompression &compression, const StreamSchema &schema);
+std::unique_ptr<Compressor> CreateCompressor(const StreamCompression &compression, const StreamSchema &schema);
+
 }
 
 #endif //RIVER_SRC_COMPRESSION_COMPRESSOR_H_
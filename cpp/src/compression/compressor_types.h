@@ -5,6 +5,7 @@
 #ifndef RIVER_SRC_COMPRESSION_COMPRESSOR_TYPES_H_
 #define RIVER_SRC_COMPRESSION_COMPRESSOR_TYPES_H_
 
+#include <cstdint>
 #include <utility>
 #include <string>
 #include <cstdlib>
@@ -28,6 +29,23 @@ public:
         ZFP_LOSSLESS = 1,
         ZFP_LOSSY = 2,
         DUMMY = 3,
+        // General-purpose codecs, usable with any schema, including multi-field and variable-width ones. Require River
+        // to be built with the codec. LZ4 takes an optional "acceleration" (default 1) and ZSTD an optional "level"
+        // (default 3). Both can also filter batches before compressing them, e.g. to delta-encode and shuffle integer
+        // samples; see internal::FilterPipeline for its params.
+        LZ4 = 4,
+        ZSTD = 5,
+        // Compresses groups of fields separately, each with its own compression, e.g. int16 channels with ZFP and an
+        // int64 timestamp with delta-filtered ZSTD. Create with PerFieldGroup().
+        FIELD_GROUPS = 6,
+        // ZFP at a fixed number of bits per value, given by "rate" (along with "data_type" and "num_cols" as for the
+        // other ZFP types). Lossy, but each block of 4x4 values takes the same space, so readers tailing or seeking
+        // into the middle of a batch only decode the blocks holding the samples they read.
+        ZFP_FIXED_RATE = 7,
+        // Picks between candidate compressions every so often, by trying each on the start of a batch and keeping the
+        // one with the best ratio within a CPU budget, and tags each batch with the compression it used. Create with
+        // Adaptive().
+        ADAPTIVE = 8,
     };
 
     explicit StreamCompression() : type_(Type::UNCOMPRESSED) {}
@@ -48,6 +66,11 @@ public:
             case Type::ZFP_LOSSLESS: return "ZFP_LOSSLESS";
             case Type::ZFP_LOSSY: return "ZFP_LOSSY";
             case Type::DUMMY: return "DUMMY";
+            case Type::LZ4: return "LZ4";
+            case Type::ZSTD: return "ZSTD";
+            case Type::FIELD_GROUPS: return "FIELD_GROUPS";
+            case Type::ZFP_FIXED_RATE: return "ZFP_FIXED_RATE";
+            case Type::ADAPTIVE: return "ADAPTIVE";
         }
         throw std::invalid_argument("Unhandled type");
     }
@@ -67,15 +90,105 @@ public:
             return StreamCompression(Type::ZFP_LOSSY, params);
         } else if (name == "DUMMY") {
             return StreamCompression(Type::DUMMY, params);
+        } else if (name == "LZ4") {
+            return StreamCompression(Type::LZ4, params);
+        } else if (name == "ZSTD") {
+            return StreamCompression(Type::ZSTD, params);
+        } else if (name == "FIELD_GROUPS") {
+            return StreamCompression(Type::FIELD_GROUPS, params);
+        } else if (name == "ZFP_FIXED_RATE") {
+            return StreamCompression(Type::ZFP_FIXED_RATE, params);
+        } else if (name == "ADAPTIVE") {
+            return StreamCompression(Type::ADAPTIVE, params);
         } else {
             throw std::invalid_argument("Unhandled type");
         }
     }
+
+    /**
+     * Compression where each group of fields, given by name, is compressed on its own with its own compression (which
+     * must not itself be FIELD_GROUPS); any fields not in a group are left uncompressed. Each group's samples are given
+     * to its compressor as rows of just the group's fields, so e.g. a ZFP group's num_cols defaults to its number of
+     * fields. Only for schemas of fixed-width fields.
+     *
+     * If `parallel`, each compressor and decompressor compresses its groups in parallel on one thread per group beyond
+     * the first. Off by default, as those threads add up across streams, and writers using a CompressionPool already
+     * compress batches in parallel.
+     */
+    static StreamCompression PerFieldGroup(
+        const std::vector<std::pair<std::vector<std::string>, StreamCompression>> &groups,
+        bool parallel = false);
+
+    /**
+     * Compression that picks, for each batch, one of the given candidates (which must not be ADAPTIVE themselves);
+     * UNCOMPRESSED is always a candidate, even if not given. Every `batches_per_trial` batches, each candidate
+     * compresses up to the first `trial_bytes` of the batch, and the one with the best ratio that took at most
+     * `max_ns_per_byte` nanoseconds per byte to do so is used until the next trial; a `max_ns_per_byte` <= 0 means no
+     * budget. Each candidate's first trial is run twice and only the second is timed, so that one-time setup (e.g.
+     * allocating a codec's context) doesn't count against it. See StreamWriter#CompressionStats() for which candidates
+     * were picked.
+     *
+     * Writers compressing on a CompressionPool keep several compressors per stream, one per batch in flight; each runs
+     * its own trial schedule on the batches it's given, so trials happen more often overall and different batches of
+     * a stream may use different candidates at once.
+     */
+    static StreamCompression Adaptive(const std::vector<StreamCompression> &candidates,
+                                      double max_ns_per_byte = 0,
+                                      int batches_per_trial = 16,
+                                      int trial_bytes = 1 << 16);
 private:
     StreamCompression::Type type_;
     std::unordered_map<std::string, std::string> params_;
 };
 
+/**
+ * Compression applied only to data in flight between a client and Redis, as opposed to StreamCompression which
+ * determines how data is stored at rest. Data compressed on the wire is decompressed by the River Redis module before
+ * being added to the stream (and vice versa for reads), so what's stored in Redis is unaffected. Requires the River
+ * Redis module to be installed and built with support for the given codec; otherwise data is sent uncompressed.
+ */
+enum class WireCompression {
+    NONE = 0,
+    LZ4 = 1,
+    ZSTD = 2,
+};
+
+inline std::string WireCompressionName(WireCompression wire_compression) {
+    switch (wire_compression) {
+        case WireCompression::NONE: return "NONE";
+        case WireCompression::LZ4: return "LZ4";
+        case WireCompression::ZSTD: return "ZSTD";
+    }
+    throw std::invalid_argument("Unhandled wire compression");
+}
+
+inline WireCompression WireCompressionFromName(const std::string &name) {
+    if (name == "NONE") {
+        return WireCompression::NONE;
+    } else if (name == "LZ4") {
+        return WireCompression::LZ4;
+    } else if (name == "ZSTD") {
+        return WireCompression::ZSTD;
+    } else {
+        throw std::invalid_argument("Unhandled wire compression");
+    }
+}
+
+/**
+ * How one candidate of ADAPTIVE compression has fared over the batches written so far.
+ */
+struct AdaptiveCompressionStats {
+    StreamCompression compression;
+    // Number of batches compressed with this candidate, and their sizes before and after compression.
+    int64_t num_batches = 0;
+    int64_t uncompressed_bytes = 0;
+    int64_t compressed_bytes = 0;
+
+    double ratio() const {
+        return compressed_bytes > 0 ? static_cast<double>(uncompressed_bytes) / compressed_bytes : 0.0;
+    }
+};
+
 /**
  * Interface for a class that compresses data.
  */
@@ -85,6 +198,15 @@ public:
      * Compresses input data, returning a new std::vector of compressed bytes.
      */
     virtual std::vector<char> compress(const char *data, size_t length) = 0;
+
+    /**
+     * Compresses input data into `out`, replacing its contents. Compressors that support it write into `out`'s
+     * existing memory, so that reusing `out` across calls doesn't allocate.
+     */
+    virtual void compress_into(const char *data, size_t length, std::vector<char> *out) {
+        *out = compress(data, length);
+    }
+
     virtual ~Compressor() = default;
 };
 
@@ -97,6 +219,31 @@ public:
      * Decompresses input compressed data, returning a new std::vector of decompressed bytes.
      */
     virtual std::vector<char> decompress(const char *data, size_t length) = 0;
+
+    /**
+     * Decompresses input compressed data into `out`, replacing its contents; see Compressor#compress_into().
+     */
+    virtual void decompress_into(const char *data, size_t length, std::vector<char> *out) {
+        *out = decompress(data, length);
+    }
+
+    /**
+     * Whether #decompress_range() can decode part of a batch without decompressing all of it.
+     */
+    virtual bool supports_random_access() const {
+        return false;
+    }
+
+    /**
+     * Decompresses only bytes [offset, offset + num_bytes) of what #decompress() would return into `out`, replacing
+     * its contents. Returns the number of bytes decompressed, which is fewer than `num_bytes` if the batch ends first.
+     * Only supported if #supports_random_access().
+     */
+    virtual size_t decompress_range(const char * /*data*/, size_t /*length*/, size_t /*offset*/,
+                                    size_t /*num_bytes*/, std::vector<char> * /*out*/) {
+        throw std::logic_error("This compression doesn't support decompressing part of a batch.");
+    }
+
     virtual ~Decompressor() = default;
 };
 
@@ -0,0 +1,319 @@
+#include "field_group_compressor.h"
+
+#include <cstring>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <nlohmann/json.hpp>
+#include "compressor.h"
+
+using json = nlohmann::json;
+
+namespace river {
+namespace internal {
+
+namespace {
+const size_t NUM_GROUPS_SIZE = sizeof(uint32_t);
+const size_t GROUP_SIZE_SIZE = sizeof(uint64_t);
+
+void WriteLittleEndian(char *dst, uint64_t value, size_t num_bytes) {
+    for (size_t i = 0; i < num_bytes; i++) {
+        dst[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+uint64_t ReadLittleEndian(const char *src, size_t num_bytes) {
+    uint64_t ret = 0;
+    for (size_t i = 0; i < num_bytes; i++) {
+        ret |= static_cast<uint64_t>(static_cast<unsigned char>(src[i])) << (8 * i);
+    }
+    return ret;
+}
+
+// Copies the group's fields of each sample into rows of just those fields, or back.
+void Gather(const FieldGroup &group, const char *samples, int64_t num_samples, int sample_size, char *out) {
+    for (int64_t i = 0; i < num_samples; i++) {
+        const char *sample = samples + i * sample_size;
+        for (const auto &run : group.runs) {
+            memcpy(out, sample + run.first, run.second);
+            out += run.second;
+        }
+    }
+}
+
+void Scatter(const FieldGroup &group, const char *in, int64_t num_samples, int sample_size, char *samples) {
+    for (int64_t i = 0; i < num_samples; i++) {
+        char *sample = samples + i * sample_size;
+        for (const auto &run : group.runs) {
+            memcpy(sample + run.first, in, run.second);
+            in += run.second;
+        }
+    }
+}
+
+// Runs tasks 1..n on the pool and task 0 on this thread, so that a single group needs no other threads. Without a
+// pool, runs every task on this thread.
+std::vector<std::vector<char>> RunAll(CompressionPool *pool,
+                                      const std::vector<std::function<std::vector<char>()>> &tasks) {
+    std::vector<std::vector<char>> ret;
+    ret.reserve(tasks.size());
+    if (!pool) {
+        for (const auto &task : tasks) {
+            ret.push_back(task());
+        }
+        return ret;
+    }
+
+    std::vector<std::future<std::vector<char>>> futures;
+    for (size_t i = 1; i < tasks.size(); i++) {
+        futures.push_back(pool->Submit(tasks[i]));
+    }
+    std::exception_ptr first_error;
+    try {
+        ret.push_back(tasks[0]());
+    } catch (...) {
+        first_error = std::current_exception();
+    }
+    // Wait on every task, even after one fails, since they reference the caller's buffers.
+    for (auto &future : futures) {
+        try {
+            ret.push_back(future.get());
+        } catch (...) {
+            if (!first_error) {
+                first_error = std::current_exception();
+            }
+        }
+    }
+    if (first_error) {
+        std::rethrow_exception(first_error);
+    }
+    return ret;
+}
+
+// ZFP and the compression filters treat a group's bytes as one array of elements, so each of its fields must be made
+// of such elements; e.g. an INT64 field in an int16 ZFP group would otherwise be compressed as four int16s.
+void CheckFieldFitsGroup(const FieldDefinition &field,
+                         const StreamCompression &compression,
+                         const std::unordered_map<std::string, std::string> &params) {
+    switch (compression.type()) {
+        case StreamCompression::Type::ZFP_LOSSLESS:
+        case StreamCompression::Type::ZFP_LOSSY:
+        case StreamCompression::Type::ZFP_FIXED_RATE: {
+            auto data_type_it = params.find("data_type");
+            if (data_type_it == params.end()) {
+                return;
+            }
+            const auto &data_type = data_type_it->second;
+            if ((data_type == "int16" && field.type != FieldDefinition::INT16)
+                || (data_type == "int32" && field.type != FieldDefinition::INT32)
+                || (data_type == "float" && field.type != FieldDefinition::FLOAT)
+                || (data_type == "double" && field.type != FieldDefinition::DOUBLE)) {
+                throw std::invalid_argument(
+                    "Field " + field.name + " doesn't match the " + data_type + " data type of its compression group.");
+            }
+            return;
+        }
+        case StreamCompression::Type::LZ4:
+        case StreamCompression::Type::ZSTD: {
+            auto filters_it = params.find("filters");
+            auto element_size_it = params.find("element_size");
+            if (filters_it == params.end() || filters_it->second.empty() || element_size_it == params.end()) {
+                return;
+            }
+            int element_size = std::stoi(element_size_it->second);
+            // Numeric fields are single elements, whereas fixed-width bytes may hold several.
+            bool fits = field.type == FieldDefinition::FIXED_WIDTH_BYTES
+                        ? element_size > 0 && field.size % element_size == 0
+                        : field.size == element_size;
+            if (!fits) {
+                throw std::invalid_argument("Field " + field.name + " doesn't match the element size of "
+                                            + element_size_it->second + " of its compression group.");
+            }
+            return;
+        }
+        default: return;
+    }
+}
+
+std::unique_ptr<CompressionPool> CreatePool(const StreamCompression &compression, size_t num_groups) {
+    auto params = compression.params();
+    auto parallel_it = params.find("parallel");
+    bool parallel = parallel_it != params.end() && parallel_it->second == "true";
+    if (!parallel || num_groups <= 1) {
+        return {};
+    }
+    return std::make_unique<CompressionPool>(static_cast<int>(num_groups) - 1);
+}
+}
+
+std::vector<FieldGroup> ParseFieldGroups(const StreamCompression &compression, const StreamSchema &schema) {
+    if (schema.has_variable_width_field()) {
+        throw std::invalid_argument("FIELD_GROUPS compression requires fixed-width fields.");
+    }
+    auto params = compression.params();
+    auto groups_it = params.find("groups");
+    if (groups_it == params.end()) {
+        throw std::invalid_argument("Expected groups for FIELD_GROUPS compression");
+    }
+
+    const auto &fields = schema.field_definitions;
+    std::unordered_map<std::string, size_t> field_indices;
+    std::vector<int> field_offsets;
+    int offset = 0;
+    for (size_t i = 0; i < fields.size(); i++) {
+        field_indices[fields[i].name] = i;
+        field_offsets.push_back(offset);
+        offset += fields[i].size;
+    }
+
+    // Group of each field, in schema order, with ungrouped fields in a last group.
+    json groups_json = json::parse(groups_it->second);
+    std::vector<int> field_groups(fields.size(), static_cast<int>(groups_json.size()));
+    std::vector<FieldGroup> ret(groups_json.size() + 1);
+    for (size_t g = 0; g < groups_json.size(); g++) {
+        const auto &group_json = groups_json[g];
+        std::unordered_map<std::string, std::string> group_params = group_json.value("params", json::object());
+        auto group_compression = StreamCompression::Create(group_json["name"], group_params);
+        if (group_compression.type() == StreamCompression::Type::FIELD_GROUPS) {
+            throw std::invalid_argument("FIELD_GROUPS compression can't be nested.");
+        }
+
+        int num_fields = 0;
+        for (const auto &field_json : group_json["fields"]) {
+            std::string name = field_json;
+            auto it = field_indices.find(name);
+            if (it == field_indices.end()) {
+                throw std::invalid_argument("No field " + name + " to compress in the schema.");
+            }
+            if (field_groups[it->second] != static_cast<int>(groups_json.size())) {
+                throw std::invalid_argument("Field " + name + " is in more than one compression group.");
+            }
+            CheckFieldFitsGroup(fields[it->second], group_compression, group_params);
+            field_groups[it->second] = static_cast<int>(g);
+            num_fields++;
+        }
+        if (num_fields == 0) {
+            throw std::invalid_argument("Compression group " + std::to_string(g) + " has no fields.");
+        }
+        if (group_params.find("num_cols") == group_params.end()) {
+            group_params["num_cols"] = std::to_string(num_fields);
+        }
+        ret[g].compression = StreamCompression(group_compression.type(), group_params);
+    }
+
+    for (size_t i = 0; i < fields.size(); i++) {
+        auto &group = ret[field_groups[i]];
+        if (!group.runs.empty() && group.runs.back().first + group.runs.back().second == field_offsets[i]) {
+            group.runs.back().second += fields[i].size;
+        } else {
+            group.runs.emplace_back(field_offsets[i], fields[i].size);
+        }
+        group.sample_size += fields[i].size;
+    }
+    if (ret.back().runs.empty()) {
+        ret.pop_back();
+    }
+    return ret;
+}
+
+FieldGroupCompressor::FieldGroupCompressor(const StreamCompression &compression, const StreamSchema &schema)
+    : groups_(ParseFieldGroups(compression, schema)), sample_size_(schema.sample_size()) {
+    for (const auto &group : groups_) {
+        compressors_.push_back(CreateCompressor(group.compression));
+    }
+    gathered_.resize(groups_.size());
+    pool_ = CreatePool(compression, groups_.size());
+}
+
+std::vector<char> FieldGroupCompressor::compress(const char *data, size_t length) {
+    if (length % sample_size_ != 0) {
+        throw std::invalid_argument("FIELD_GROUPS compression needs whole samples.");
+    }
+    auto num_samples = static_cast<int64_t>(length / sample_size_);
+
+    std::vector<std::function<std::vector<char>()>> tasks;
+    for (size_t g = 0; g < groups_.size(); g++) {
+        tasks.emplace_back([this, g, data, num_samples]() {
+            const auto &group = groups_[g];
+            auto &gathered = gathered_[g];
+            gathered.resize(num_samples * group.sample_size);
+            Gather(group, data, num_samples, sample_size_, gathered.data());
+            if (!compressors_[g]) {
+                return gathered;
+            }
+            return compressors_[g]->compress(gathered.data(), gathered.size());
+        });
+    }
+    auto compressed = RunAll(pool_.get(), tasks);
+
+    size_t header_size = NUM_GROUPS_SIZE + GROUP_SIZE_SIZE * compressed.size();
+    size_t total_size = header_size;
+    for (const auto &group : compressed) {
+        total_size += group.size();
+    }
+    std::vector<char> ret(total_size);
+    WriteLittleEndian(ret.data(), compressed.size(), NUM_GROUPS_SIZE);
+    size_t offset = header_size;
+    for (size_t g = 0; g < compressed.size(); g++) {
+        WriteLittleEndian(ret.data() + NUM_GROUPS_SIZE + g * GROUP_SIZE_SIZE, compressed[g].size(), GROUP_SIZE_SIZE);
+        memcpy(ret.data() + offset, compressed[g].data(), compressed[g].size());
+        offset += compressed[g].size();
+    }
+    return ret;
+}
+
+FieldGroupDecompressor::FieldGroupDecompressor(const StreamCompression &compression, const StreamSchema &schema)
+    : groups_(ParseFieldGroups(compression, schema)), sample_size_(schema.sample_size()) {
+    for (const auto &group : groups_) {
+        decompressors_.push_back(CreateDecompressor(group.compression));
+    }
+    pool_ = CreatePool(compression, groups_.size());
+}
+
+std::vector<char> FieldGroupDecompressor::decompress(const char *data, size_t length) {
+    if (length < NUM_GROUPS_SIZE || ReadLittleEndian(data, NUM_GROUPS_SIZE) != groups_.size()) {
+        throw std::runtime_error("Compressed batch doesn't have the stream's number of field groups.");
+    }
+    size_t header_size = NUM_GROUPS_SIZE + GROUP_SIZE_SIZE * groups_.size();
+    if (length < header_size) {
+        throw std::runtime_error("Compressed batch is missing its header.");
+    }
+
+    std::vector<std::function<std::vector<char>()>> tasks;
+    size_t offset = header_size;
+    for (size_t g = 0; g < groups_.size(); g++) {
+        uint64_t group_size = ReadLittleEndian(data + NUM_GROUPS_SIZE + g * GROUP_SIZE_SIZE, GROUP_SIZE_SIZE);
+        if (group_size > length - offset) {
+            throw std::runtime_error("Compressed batch is shorter than its field groups.");
+        }
+        const char *group_data = data + offset;
+        tasks.emplace_back([this, g, group_data, group_size]() {
+            if (!decompressors_[g]) {
+                return std::vector<char>(group_data, group_data + group_size);
+            }
+            return decompressors_[g]->decompress(group_data, group_size);
+        });
+        offset += group_size;
+    }
+    auto decompressed = RunAll(pool_.get(), tasks);
+
+    int64_t num_samples = -1;
+    for (size_t g = 0; g < groups_.size(); g++) {
+        auto group_sample_size = static_cast<size_t>(groups_[g].sample_size);
+        auto group_num_samples = static_cast<int64_t>(decompressed[g].size() / group_sample_size);
+        if (decompressed[g].size() % group_sample_size != 0 || (num_samples >= 0 && group_num_samples != num_samples)) {
+            throw std::runtime_error("Field groups of a compressed batch have different numbers of samples.");
+        }
+        num_samples = group_num_samples;
+    }
+
+    std::vector<char> ret(num_samples * sample_size_);
+    for (size_t g = 0; g < groups_.size(); g++) {
+        Scatter(groups_[g], decompressed[g].data(), num_samples, sample_size_, ret.data());
+    }
+    return ret;
+}
+
+}
+}
@@ -0,0 +1,69 @@
+#ifndef RIVER_SRC_COMPRESSION_FIELD_GROUP_COMPRESSOR_H_
+#define RIVER_SRC_COMPRESSION_FIELD_GROUP_COMPRESSOR_H_
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "compressor_types.h"
+#include "compression_pool.h"
+#include "../schema.h"
+
+namespace river {
+namespace internal {
+
+/**
+ * A group of fields of FIELD_GROUPS compression: where its fields are in each sample, and how they're compressed.
+ */
+struct FieldGroup {
+    // (offset, size) in bytes of each run of adjacent fields of the group within a sample.
+    std::vector<std::pair<int, int>> runs;
+    int sample_size = 0;
+    StreamCompression compression;
+};
+
+/**
+ * Parses FIELD_GROUPS compression for the given schema, with a final uncompressed group for any fields not in a group.
+ * Throws std::invalid_argument if a group has no fields, or a field is missing from the schema or in more than one
+ * group.
+ */
+std::vector<FieldGroup> ParseFieldGroups(const StreamCompression &compression, const StreamSchema &schema);
+
+/**
+ * Compresses each group of fields of a batch separately, into one payload of:
+ *
+ *   <uint32 little-endian: n groups> <n uint64 little-endian: each group's compressed size> <each group, compressed>
+ *
+ * where each group is compressed as rows of just its fields, so that e.g. ZFP sees a homogeneous 2D array. Groups are
+ * compressed one after another, unless the "parallel" param is "true", in which case they're compressed in parallel on
+ * threads owned by this compressor.
+ */
+class FieldGroupCompressor : public Compressor {
+public:
+    FieldGroupCompressor(const StreamCompression &compression, const StreamSchema &schema);
+    std::vector<char> compress(const char *data, size_t length) override;
+private:
+    std::vector<FieldGroup> groups_;
+    std::vector<std::unique_ptr<Compressor>> compressors_;
+    std::vector<std::vector<char>> gathered_;
+    int sample_size_;
+    // Null unless compressing groups in parallel.
+    std::unique_ptr<CompressionPool> pool_;
+};
+
+class FieldGroupDecompressor : public Decompressor {
+public:
+    FieldGroupDecompressor(const StreamCompression &compression, const StreamSchema &schema);
+    std::vector<char> decompress(const char *data, size_t length) override;
+private:
+    std::vector<FieldGroup> groups_;
+    std::vector<std::unique_ptr<Decompressor>> decompressors_;
+    int sample_size_;
+    // Null unless compressing groups in parallel.
+    std::unique_ptr<CompressionPool> pool_;
+};
+
+}
+}
+
+#endif //RIVER_SRC_COMPRESSION_FIELD_GROUP_COMPRESSOR_H_
@@ -0,0 +1,89 @@
+#include "filter_pipeline.h"
+
+#include <sstream>
+#include <stdexcept>
+#include "../simd.h"
+
+namespace river {
+namespace internal {
+
+FilterPipeline::FilterPipeline(const std::unordered_map<std::string, std::string> &params)
+    : element_size_(1), num_cols_(1) {
+    auto filters_it = params.find("filters");
+    if (filters_it == params.end() || filters_it->second.empty()) {
+        return;
+    }
+
+    std::stringstream ss(filters_it->second);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        if (name == "delta") {
+            filters_.push_back(Filter::DELTA);
+        } else if (name == "byteshuffle") {
+            filters_.push_back(Filter::BYTESHUFFLE);
+        } else if (name == "bitshuffle") {
+            filters_.push_back(Filter::BITSHUFFLE);
+        } else {
+            throw std::invalid_argument("Unknown compression filter " + name);
+        }
+    }
+
+    auto element_size_it = params.find("element_size");
+    if (element_size_it == params.end()) {
+        throw std::invalid_argument("Expected element_size for compression filters");
+    }
+    element_size_ = std::stoi(element_size_it->second);
+    if (element_size_ <= 0) {
+        throw std::invalid_argument("element_size must be positive");
+    }
+    auto num_cols_it = params.find("num_cols");
+    if (num_cols_it != params.end()) {
+        num_cols_ = std::stoll(num_cols_it->second);
+        if (num_cols_ <= 0) {
+            throw std::invalid_argument("num_cols must be positive");
+        }
+    }
+    for (auto filter : filters_) {
+        if (filter == Filter::DELTA && element_size_ != 1 && element_size_ != 2 && element_size_ != 4
+            && element_size_ != 8) {
+            throw std::invalid_argument("The delta filter needs an element_size of 1, 2, 4, or 8");
+        }
+    }
+}
+
+void FilterPipeline::Run(Filter filter, bool invert, const char *in, size_t length, char *out) const {
+    auto n = static_cast<int64_t>(length);
+    switch (filter) {
+        case Filter::DELTA:
+            return invert ? DeltaDecode(in, n, element_size_, num_cols_, out)
+                          : DeltaEncode(in, n, element_size_, num_cols_, out);
+        case Filter::BYTESHUFFLE:
+            return invert ? ByteUnshuffle(in, n, element_size_, out) : ByteShuffle(in, n, element_size_, out);
+        case Filter::BITSHUFFLE:
+            return invert ? BitUnshuffle(in, n, element_size_, out) : BitShuffle(in, n, element_size_, out);
+    }
+}
+
+const char *FilterPipeline::Apply(const char *data, size_t length) {
+    // Alternate between two buffers, which are kept (and so stay allocated) across batches.
+    const char *in = data;
+    for (size_t i = 0; i < filters_.size(); i++) {
+        auto &out = buffers_[i % 2];
+        out.resize(length);
+        Run(filters_[i], false, in, length, out.data());
+        in = out.data();
+    }
+    return in;
+}
+
+void FilterPipeline::Invert(std::vector<char> *data) {
+    auto &scratch = buffers_[0];
+    for (auto it = filters_.rbegin(); it != filters_.rend(); ++it) {
+        scratch.resize(data->size());
+        Run(*it, true, data->data(), data->size(), scratch.data());
+        data->swap(scratch);
+    }
+}
+
+}
+}
@@ -0,0 +1,94 @@
+#ifndef RIVER_SRC_COMPRESSION_FILTER_PIPELINE_H_
+#define RIVER_SRC_COMPRESSION_FILTER_PIPELINE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "compressor_types.h"
+
+namespace river {
+namespace internal {
+
+/**
+ * Reversible, size-preserving transforms of a batch's bytes that make it more compressible by a general-purpose codec,
+ * applied in order before compressing (and in reverse after decompressing). Configured through the params of an LZ4 or
+ * ZSTD StreamCompression, and so recorded in the stream's compression_params_json:
+ *
+ *   "filters": comma-separated, from "delta", "byteshuffle", and "bitshuffle", e.g. "delta,bitshuffle"
+ *   "element_size": bytes per element (e.g. 2 for int16); required if there are any filters
+ *   "num_cols": elements per sample (default 1), so that deltas are taken between samples of the same column
+ *
+ * Filters treat the batch as one array of elements, so they suit schemas whose fields are all of the same integer type.
+ */
+class FilterPipeline {
+public:
+    enum class Filter {
+        DELTA,
+        BYTESHUFFLE,
+        BITSHUFFLE,
+    };
+
+    /**
+     * Throws std::invalid_argument if the params are invalid.
+     */
+    explicit FilterPipeline(const std::unordered_map<std::string, std::string> &params);
+
+    bool empty() const {
+        return filters_.empty();
+    }
+
+    /**
+     * Applies the filters, returning the filtered bytes, which are valid until the next call.
+     */
+    const char *Apply(const char *data, size_t length);
+
+    /**
+     * Undoes the filters in place.
+     */
+    void Invert(std::vector<char> *data);
+
+private:
+    void Run(Filter filter, bool invert, const char *in, size_t length, char *out) const;
+
+    std::vector<Filter> filters_;
+    int element_size_;
+    int64_t num_cols_;
+    std::vector<char> buffers_[2];
+};
+
+class FilteredCompressor : public Compressor {
+public:
+    FilteredCompressor(FilterPipeline pipeline, std::unique_ptr<Compressor> compressor)
+        : pipeline_(std::move(pipeline)), compressor_(std::move(compressor)) {}
+    std::vector<char> compress(const char *data, size_t length) override {
+        return compressor_->compress(pipeline_.Apply(data, length), length);
+    }
+private:
+    FilterPipeline pipeline_;
+    std::unique_ptr<Compressor> compressor_;
+};
+
+class FilteredDecompressor : public Decompressor {
+public:
+    FilteredDecompressor(FilterPipeline pipeline, std::unique_ptr<Decompressor> decompressor)
+        : pipeline_(std::move(pipeline)), decompressor_(std::move(decompressor)) {}
+    std::vector<char> decompress(const char *data, size_t length) override {
+        std::vector<char> ret;
+        decompress_into(data, length, &ret);
+        return ret;
+    }
+    void decompress_into(const char *data, size_t length, std::vector<char> *out) override {
+        decompressor_->decompress_into(data, length, out);
+        pipeline_.Invert(out);
+    }
+private:
+    FilterPipeline pipeline_;
+    std::unique_ptr<Decompressor> decompressor_;
+};
+
+}
+}
+
+#endif //RIVER_SRC_COMPRESSION_FILTER_PIPELINE_H_
@@ -0,0 +1,161 @@
+#include "compressor.h"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include "lz4_zstd.h"
+
+#ifdef RIVER_HAS_LZ4
+#include <lz4.h>
+#endif
+#ifdef RIVER_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace river {
+
+namespace {
+#if !defined(RIVER_HAS_LZ4) || !defined(RIVER_HAS_ZSTD)
+[[noreturn]] void ThrowUnsupported(const std::string &codec) {
+    throw std::logic_error(codec + " compression is disabled via build flags. Re-build and re-install River with"
+                                   " the appropriate " + codec + " build flag enabled.");
+}
+#endif
+}
+
+#ifdef RIVER_HAS_LZ4
+class Lz4CompressorImpl {
+public:
+    Lz4CompressorImpl() : state(LZ4_sizeofState()) {}
+    std::vector<char> state;
+};
+#else
+class Lz4CompressorImpl {
+};
+#endif
+
+Lz4Compressor::Lz4Compressor(int acceleration) : impl_(nullptr), acceleration_(acceleration) {
+#ifdef RIVER_HAS_LZ4
+    impl_ = new Lz4CompressorImpl();
+#else
+    ThrowUnsupported("LZ4");
+#endif
+}
+
+Lz4Compressor::~Lz4Compressor() noexcept {
+    delete impl_;
+}
+
+std::vector<char> Lz4Compressor::compress(const char *data, size_t length) {
+#ifdef RIVER_HAS_LZ4
+    // LZ4 blocks don't record their decompressed size (unlike zstd frames), so it's prepended.
+    std::vector<char> ret;
+    internal::Lz4CompressFramed(data, length, acceleration_, impl_->state.data(), &ret);
+    return ret;
+#else
+    ThrowUnsupported("LZ4");
+#endif
+}
+
+std::vector<char> Lz4Decompressor::decompress(const char *data, size_t length) {
+    std::vector<char> ret;
+    decompress_into(data, length, &ret);
+    return ret;
+}
+
+void Lz4Decompressor::decompress_into(const char *data, size_t length, std::vector<char> *out) {
+#ifdef RIVER_HAS_LZ4
+    internal::Lz4DecompressFramed(data, length, out);
+#else
+    ThrowUnsupported("LZ4");
+#endif
+}
+
+#ifdef RIVER_HAS_ZSTD
+class ZstdCompressorImpl {
+public:
+    ZstdCompressorImpl() : context(ZSTD_createCCtx()) {
+        if (context == nullptr) {
+            throw std::runtime_error("Unable to create zstd compression context.");
+        }
+    }
+    ~ZstdCompressorImpl() {
+        ZSTD_freeCCtx(context);
+    }
+    ZSTD_CCtx *context;
+};
+
+class ZstdDecompressorImpl {
+public:
+    ZstdDecompressorImpl() : context(ZSTD_createDCtx()) {
+        if (context == nullptr) {
+            throw std::runtime_error("Unable to create zstd decompression context.");
+        }
+    }
+    ~ZstdDecompressorImpl() {
+        ZSTD_freeDCtx(context);
+    }
+    ZSTD_DCtx *context;
+};
+#else
+class ZstdCompressorImpl {
+};
+class ZstdDecompressorImpl {
+};
+#endif
+
+ZstdCompressor::ZstdCompressor(int level) : impl_(nullptr), level_(level) {
+#ifdef RIVER_HAS_ZSTD
+    if (level < ZSTD_minCLevel() || level > ZSTD_maxCLevel()) {
+        throw std::invalid_argument("zstd compression level must be between " + std::to_string(ZSTD_minCLevel())
+                                        + " and " + std::to_string(ZSTD_maxCLevel()));
+    }
+    impl_ = new ZstdCompressorImpl();
+#else
+    ThrowUnsupported("ZSTD");
+#endif
+}
+
+ZstdCompressor::~ZstdCompressor() noexcept {
+    delete impl_;
+}
+
+std::vector<char> ZstdCompressor::compress(const char *data, size_t length) {
+#ifdef RIVER_HAS_ZSTD
+    std::vector<char> ret;
+    internal::ZstdCompressAppend(data, length, level_, impl_->context, &ret);
+    return ret;
+#else
+    ThrowUnsupported("ZSTD");
+#endif
+}
+
+ZstdDecompressor::ZstdDecompressor() : impl_(nullptr) {
+#ifdef RIVER_HAS_ZSTD
+    impl_ = new ZstdDecompressorImpl();
+#else
+    ThrowUnsupported("ZSTD");
+#endif
+}
+
+ZstdDecompressor::~ZstdDecompressor() noexcept {
+    delete impl_;
+}
+
+std::vector<char> ZstdDecompressor::decompress(const char *data, size_t length) {
+    std::vector<char> ret;
+    decompress_into(data, length, &ret);
+    return ret;
+}
+
+void ZstdDecompressor::decompress_into(const char *data, size_t length, std::vector<char> *out) {
+#ifdef RIVER_HAS_ZSTD
+    // Frames written by ZstdCompressor always record their decompressed size.
+    out->resize(internal::ZstdFrameContentSize(data, length));
+    internal::ZstdDecompressExact(data, length, impl_->context, out->data(), out->size());
+#else
+    ThrowUnsupported("ZSTD");
+#endif
+}
+
+}
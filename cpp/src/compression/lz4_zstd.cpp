@@ -0,0 +1,113 @@
+#include "lz4_zstd.h"
+
+#include <stdexcept>
+#include <string>
+
+#ifdef RIVER_HAS_LZ4
+#include <lz4.h>
+#endif
+
+namespace river {
+namespace internal {
+
+namespace {
+void CheckUncompressedSize(size_t length) {
+    if (length > MAX_UNCOMPRESSED_SIZE) {
+        throw std::invalid_argument("Can't compress " + std::to_string(length) + " bytes at once; the maximum is "
+                                        + std::to_string(MAX_UNCOMPRESSED_SIZE) + ".");
+    }
+}
+}
+
+void WriteLengthHeader(char *dst, uint64_t uncompressed_length) {
+    for (size_t i = 0; i < LENGTH_HEADER_SIZE; i++) {
+        dst[i] = static_cast<char>((uncompressed_length >> (8 * i)) & 0xFF);
+    }
+}
+
+uint64_t ReadLengthHeader(const char *data, size_t length) {
+    if (length < LENGTH_HEADER_SIZE) {
+        throw std::runtime_error("Compressed data is missing its length header.");
+    }
+    uint64_t ret = 0;
+    for (size_t i = 0; i < LENGTH_HEADER_SIZE; i++) {
+        ret |= static_cast<uint64_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+    }
+    if (ret > MAX_UNCOMPRESSED_SIZE) {
+        throw std::runtime_error("Compressed data claims " + std::to_string(ret)
+                                     + " uncompressed bytes, more than the maximum of "
+                                     + std::to_string(MAX_UNCOMPRESSED_SIZE) + ".");
+    }
+    return ret;
+}
+
+#ifdef RIVER_HAS_LZ4
+void Lz4CompressFramed(const char *data, size_t length, int acceleration, void *state, std::vector<char> *out) {
+    CheckUncompressedSize(length);
+    size_t offset = out->size();
+    int bound = LZ4_compressBound(static_cast<int>(length));
+    out->resize(offset + LENGTH_HEADER_SIZE + bound);
+    WriteLengthHeader(out->data() + offset, length);
+    char *dst = out->data() + offset + LENGTH_HEADER_SIZE;
+    int compressed_size = state != nullptr
+        ? LZ4_compress_fast_extState(state, data, dst, static_cast<int>(length), bound, acceleration)
+        : LZ4_compress_fast(data, dst, static_cast<int>(length), bound, acceleration);
+    if (compressed_size <= 0) {
+        throw std::runtime_error("LZ4 compression failed.");
+    }
+    out->resize(offset + LENGTH_HEADER_SIZE + compressed_size);
+}
+
+void Lz4DecompressFramed(const char *data, size_t length, std::vector<char> *out) {
+    uint64_t uncompressed_length = ReadLengthHeader(data, length);
+    out->resize(uncompressed_length);
+    int decompressed_size = LZ4_decompress_safe(
+        data + LENGTH_HEADER_SIZE, out->data(), static_cast<int>(length - LENGTH_HEADER_SIZE),
+        static_cast<int>(out->size()));
+    if (decompressed_size < 0 || static_cast<uint64_t>(decompressed_size) != uncompressed_length) {
+        throw std::runtime_error("LZ4 decompression failed.");
+    }
+}
+#endif
+
+#ifdef RIVER_HAS_ZSTD
+void ZstdCompressAppend(const char *data, size_t length, int level, ZSTD_CCtx *context, std::vector<char> *out) {
+    CheckUncompressedSize(length);
+    size_t offset = out->size();
+    out->resize(offset + ZSTD_compressBound(length));
+    char *dst = out->data() + offset;
+    size_t capacity = out->size() - offset;
+    size_t compressed_size = context != nullptr
+        ? ZSTD_compressCCtx(context, dst, capacity, data, length, level)
+        : ZSTD_compress(dst, capacity, data, length, level);
+    if (ZSTD_isError(compressed_size)) {
+        throw std::runtime_error(std::string("zstd compression failed: ") + ZSTD_getErrorName(compressed_size));
+    }
+    out->resize(offset + compressed_size);
+}
+
+uint64_t ZstdFrameContentSize(const char *data, size_t length) {
+    unsigned long long ret = ZSTD_getFrameContentSize(data, length);
+    if (ret == ZSTD_CONTENTSIZE_ERROR || ret == ZSTD_CONTENTSIZE_UNKNOWN) {
+        throw std::runtime_error("zstd-compressed data has an invalid frame header.");
+    }
+    if (ret > MAX_UNCOMPRESSED_SIZE) {
+        throw std::runtime_error("zstd-compressed data claims " + std::to_string(ret)
+                                     + " uncompressed bytes, more than the maximum of "
+                                     + std::to_string(MAX_UNCOMPRESSED_SIZE) + ".");
+    }
+    return ret;
+}
+
+void ZstdDecompressExact(const char *data, size_t length, ZSTD_DCtx *context, char *out, size_t uncompressed_length) {
+    size_t decompressed_size = context != nullptr
+        ? ZSTD_decompressDCtx(context, out, uncompressed_length, data, length)
+        : ZSTD_decompress(out, uncompressed_length, data, length);
+    if (ZSTD_isError(decompressed_size) || decompressed_size != uncompressed_length) {
+        throw std::runtime_error("zstd decompression failed.");
+    }
+}
+#endif
+
+}
+}
@@ -0,0 +1,71 @@
+#ifndef RIVER_SRC_COMPRESSION_LZ4_ZSTD_H_
+#define RIVER_SRC_COMPRESSION_LZ4_ZSTD_H_
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#ifdef RIVER_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace river {
+namespace internal {
+
+/**
+ * LZ4 and zstd calls shared by stream compression (see Lz4Compressor and ZstdCompressor) and wire compression (see
+ * wire_codec.h), so both frame and bound their data the same way.
+ */
+
+// Size of the uint64 little-endian uncompressed length that's prepended to LZ4 blocks (which, unlike zstd frames,
+// don't record it) and to wire-compressed payloads.
+const size_t LENGTH_HEADER_SIZE = sizeof(uint64_t);
+
+// Largest uncompressed size that's compressed, or trusted from compressed data before allocating for it. Same as the
+// River module's limit.
+const uint64_t MAX_UNCOMPRESSED_SIZE = 512ULL * 1024 * 1024;
+
+void WriteLengthHeader(char *dst, uint64_t uncompressed_length);
+
+/**
+ * Reads the uncompressed length prepended to the given data. Throws std::runtime_error if the data is too short to
+ * have one or if it's over MAX_UNCOMPRESSED_SIZE.
+ */
+uint64_t ReadLengthHeader(const char *data, size_t length);
+
+#ifdef RIVER_HAS_LZ4
+/**
+ * Appends the length header and then an LZ4 block of the given data to `out`. `state`, if given, is LZ4_sizeofState()
+ * bytes to reuse across calls.
+ */
+void Lz4CompressFramed(const char *data, size_t length, int acceleration, void *state, std::vector<char> *out);
+
+/**
+ * Inverse of #Lz4CompressFramed(), resizing `out` to the uncompressed data.
+ */
+void Lz4DecompressFramed(const char *data, size_t length, std::vector<char> *out);
+#endif
+
+#ifdef RIVER_HAS_ZSTD
+/**
+ * Appends a zstd frame of the given data, which records its uncompressed size, to `out`. Uses `context` if given.
+ */
+void ZstdCompressAppend(const char *data, size_t length, int level, ZSTD_CCtx *context, std::vector<char> *out);
+
+/**
+ * Uncompressed size recorded by a zstd frame. Throws std::runtime_error if it isn't recorded, or is over
+ * MAX_UNCOMPRESSED_SIZE.
+ */
+uint64_t ZstdFrameContentSize(const char *data, size_t length);
+
+/**
+ * Decompresses a zstd frame into exactly `uncompressed_length` bytes at `out`, throwing std::runtime_error otherwise.
+ * Uses `context` if given.
+ */
+void ZstdDecompressExact(const char *data, size_t length, ZSTD_DCtx *context, char *out, size_t uncompressed_length);
+#endif
+
+}
+}
+
+#endif //RIVER_SRC_COMPRESSION_LZ4_ZSTD_H_
@@ -0,0 +1,66 @@
+#include "variable_width_block.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace river {
+namespace internal {
+
+static const size_t HEADER_SIZE = 4;
+
+std::vector<char> EncodeVariableWidthBlock(Compressor *compressor,
+                                           const char *data,
+                                           int64_t num_samples,
+                                           const int *sizes,
+                                           int64_t data_num_bytes) {
+    size_t sizes_num_bytes = sizeof(int32_t) * num_samples;
+    std::vector<char> uncompressed(sizes_num_bytes + data_num_bytes);
+    memcpy(uncompressed.data(), sizes, sizes_num_bytes);
+    memcpy(uncompressed.data() + sizes_num_bytes, data, data_num_bytes);
+    auto compressed = compressor->compress(uncompressed.data(), uncompressed.size());
+
+    std::vector<char> block(HEADER_SIZE + compressed.size());
+    auto n = static_cast<uint32_t>(num_samples);
+    for (size_t i = 0; i < HEADER_SIZE; i++) {
+        block[i] = static_cast<char>((n >> (8 * i)) & 0xFF);
+    }
+    memcpy(block.data() + HEADER_SIZE, compressed.data(), compressed.size());
+    return block;
+}
+
+int64_t DecodeVariableWidthBlock(Decompressor *decompressor,
+                                 const char *block,
+                                 size_t block_length,
+                                 std::vector<int> *sizes,
+                                 std::vector<char> *decompressed) {
+    if (block_length < HEADER_SIZE) {
+        throw std::invalid_argument("Variable-width block is too short");
+    }
+    uint32_t num_samples = 0;
+    for (size_t i = 0; i < HEADER_SIZE; i++) {
+        num_samples |= static_cast<uint32_t>(static_cast<unsigned char>(block[i])) << (8 * i);
+    }
+
+    decompressor->decompress_into(block + HEADER_SIZE, block_length - HEADER_SIZE, decompressed);
+    size_t sizes_num_bytes = sizeof(int32_t) * num_samples;
+    if (decompressed->size() < sizes_num_bytes) {
+        throw std::invalid_argument("Variable-width block is missing its sizes");
+    }
+    sizes->resize(num_samples);
+    memcpy(sizes->data(), decompressed->data(), sizes_num_bytes);
+
+    int64_t data_num_bytes = 0;
+    for (int size : *sizes) {
+        if (size < 0) {
+            throw std::invalid_argument("Variable-width block has a negative sample size");
+        }
+        data_num_bytes += size;
+    }
+    if (static_cast<int64_t>(decompressed->size() - sizes_num_bytes) != data_num_bytes) {
+        throw std::invalid_argument("Variable-width block's data doesn't match its sizes");
+    }
+    return static_cast<int64_t>(sizes_num_bytes);
+}
+
+}
+}
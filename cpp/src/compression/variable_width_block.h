@@ -0,0 +1,39 @@
+#ifndef RIVER_SRC_COMPRESSION_VARIABLE_WIDTH_BLOCK_H_
+#define RIVER_SRC_COMPRESSION_VARIABLE_WIDTH_BLOCK_H_
+
+#include <cstdint>
+#include <vector>
+#include "compressor_types.h"
+
+namespace river {
+namespace internal {
+
+/**
+ * Compressed batches of variable-width samples are stored as blocks of:
+ *
+ *   <uint32 little-endian: n samples> <compressed: n int32 sample sizes, followed by the samples' data>
+ *
+ * The number of samples is left uncompressed so that Redis (i.e. RIVER.batch_xadd_variable_compressed) can check a
+ * block without decompressing it. Sizes and data are compressed together, as sizes are often as compressible as the
+ * data itself.
+ */
+std::vector<char> EncodeVariableWidthBlock(Compressor *compressor,
+                                           const char *data,
+                                           int64_t num_samples,
+                                           const int *sizes,
+                                           int64_t data_num_bytes);
+
+/**
+ * Decodes a block from EncodeVariableWidthBlock() into `sizes` and `decompressed`, returning the offset into
+ * `decompressed` of the first sample's data.
+ */
+int64_t DecodeVariableWidthBlock(Decompressor *decompressor,
+                                 const char *block,
+                                 size_t block_length,
+                                 std::vector<int> *sizes,
+                                 std::vector<char> *decompressed);
+
+}
+}
+
+#endif //RIVER_SRC_COMPRESSION_VARIABLE_WIDTH_BLOCK_H_
@@ -0,0 +1,101 @@
+#include "wire_codec.h"
+
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include "lz4_zstd.h"
+
+namespace river {
+namespace internal {
+
+bool IsWireCompressionSupported(WireCompression wire_compression) {
+    switch (wire_compression) {
+        case WireCompression::NONE:
+            return true;
+        case WireCompression::LZ4:
+#ifdef RIVER_HAS_LZ4
+            return true;
+#else
+            return false;
+#endif
+        case WireCompression::ZSTD:
+#ifdef RIVER_HAS_ZSTD
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+std::vector<char> WireCompress(WireCompression wire_compression, const char *data, size_t length) {
+    if (!IsWireCompressionSupported(wire_compression)) {
+        throw std::invalid_argument(
+            "Wire compression " + WireCompressionName(wire_compression) + " is not supported by this build of River.");
+    }
+
+    std::vector<char> ret;
+    switch (wire_compression) {
+        case WireCompression::NONE: {
+            if (length > MAX_UNCOMPRESSED_SIZE) {
+                throw std::invalid_argument("Payload too large to send at once.");
+            }
+            ret.resize(LENGTH_HEADER_SIZE + length);
+            WriteLengthHeader(ret.data(), length);
+            memcpy(ret.data() + LENGTH_HEADER_SIZE, data, length);
+            break;
+        }
+        case WireCompression::LZ4: {
+#ifdef RIVER_HAS_LZ4
+            Lz4CompressFramed(data, length, 1, nullptr, &ret);
+#endif
+            break;
+        }
+        case WireCompression::ZSTD: {
+#ifdef RIVER_HAS_ZSTD
+            ret.resize(LENGTH_HEADER_SIZE);
+            WriteLengthHeader(ret.data(), length);
+            // Level 1 favors speed, as this is on the hot path of the writer.
+            ZstdCompressAppend(data, length, 1, nullptr, &ret);
+#endif
+            break;
+        }
+    }
+    return ret;
+}
+
+std::vector<char> WireDecompress(WireCompression wire_compression, const char *data, size_t length) {
+    if (!IsWireCompressionSupported(wire_compression)) {
+        throw std::invalid_argument(
+            "Wire compression " + WireCompressionName(wire_compression) + " is not supported by this build of River.");
+    }
+    std::vector<char> ret;
+    switch (wire_compression) {
+        case WireCompression::NONE: {
+            uint64_t uncompressed_length = ReadLengthHeader(data, length);
+            if (length - LENGTH_HEADER_SIZE != uncompressed_length) {
+                throw std::runtime_error("Wire payload length does not match its header.");
+            }
+            ret.assign(data + LENGTH_HEADER_SIZE, data + length);
+            break;
+        }
+        case WireCompression::LZ4: {
+#ifdef RIVER_HAS_LZ4
+            Lz4DecompressFramed(data, length, &ret);
+#endif
+            break;
+        }
+        case WireCompression::ZSTD: {
+#ifdef RIVER_HAS_ZSTD
+            ret.resize(ReadLengthHeader(data, length));
+            ZstdDecompressExact(data + LENGTH_HEADER_SIZE, length - LENGTH_HEADER_SIZE, nullptr, ret.data(), ret.size());
+#endif
+            break;
+        }
+    }
+    return ret;
+}
+
+}
+}
@@ -0,0 +1,35 @@
+#ifndef RIVER_SRC_COMPRESSION_WIRE_CODEC_H_
+#define RIVER_SRC_COMPRESSION_WIRE_CODEC_H_
+
+#include <vector>
+#include <cstdlib>
+#include "compressor_types.h"
+
+namespace river {
+namespace internal {
+
+/**
+ * Whether this build of River has support for the given wire compression codec. WireCompression::NONE is always
+ * supported.
+ */
+bool IsWireCompressionSupported(WireCompression wire_compression);
+
+/**
+ * Compresses a payload for sending to the River Redis module. The framing, shared with the module, is:
+ *
+ *   <uint64 little-endian: length of the uncompressed payload> <LZ4 block or zstd frame>
+ *
+ * Throws std::invalid_argument if the codec is not supported by this build.
+ */
+std::vector<char> WireCompress(WireCompression wire_compression, const char *data, size_t length);
+
+/**
+ * Inverse of #WireCompress(), e.g. for payloads returned by RIVER.xrange_packed. Throws std::runtime_error if the
+ * payload is malformed or claims to decompress to more than 512MB, the module's limit.
+ */
+std::vector<char> WireDecompress(WireCompression wire_compression, const char *data, size_t length);
+
+}
+}
+
+#endif //RIVER_SRC_COMPRESSION_WIRE_CODEC_H_
@@ -5,18 +5,22 @@
 #include "compressor.h"
 #include <zfp.hpp>
 #include <cassert>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include "../simd.h"
 
 
 namespace river {
 
+// Kept across calls, and only resized when a batch's shape changes, so that compressing doesn't allocate once its
+// buffers have grown to the largest batch.
 class ZfpCompressorImpl {
 public:
-    int num_rows_;
-    int num_cols_;
     std::vector<char> buffer_;
-    std::unique_ptr<std::vector<int32_t>> data_promoted;
-    zfp_stream *zfp_;
-    zfp_field  *field_;
+    std::vector<int32_t> data_promoted;
+    zfp_stream *zfp_ = nullptr;
+    zfp_field  *field_ = nullptr;
 
     ~ZfpCompressorImpl() {
         if (zfp_) {
@@ -31,6 +35,24 @@ public:
     }
 };
 
+class ZfpDecompressorImpl {
+public:
+    std::vector<int32_t> data_promoted;
+    // The rows of blocks decoded by decompress_range(), as int32's for int16 data.
+    std::vector<char> decoded_rows;
+    zfp_stream *zfp_ = nullptr;
+    zfp_field  *field_ = nullptr;
+
+    ~ZfpDecompressorImpl() {
+        if (zfp_) {
+            zfp_stream_close(zfp_);
+        }
+        if (field_) {
+            zfp_field_free(field_);
+        }
+    }
+};
+
 template <class DataTypeT>
 constexpr zfp_type zfp_type_for_class() {
     if constexpr (std::is_same_v<DataTypeT, int16_t> || std::is_same_v<DataTypeT, int32_t>) {
@@ -44,12 +66,80 @@ constexpr zfp_type zfp_type_for_class() {
     }
 }
 
+namespace {
+// Reads a batch compressed by a ZfpCompressor into the given (reused) stream and field, and detaches and closes the
+// batch's bit stream when done.
+class BatchReader {
+public:
+    BatchReader(zfp_stream *zfp, const char *data, size_t length)
+        : zfp_(zfp), stream_(stream_open((void *) data, length)), header_bits_(0) {
+        zfp_stream_set_bit_stream(zfp_, stream_);
+        zfp_stream_rewind(zfp_);
+    }
+
+    ~BatchReader() {
+        zfp_stream_set_bit_stream(zfp_, nullptr);
+        stream_close(stream_);
+    }
+
+    BatchReader(const BatchReader &) = delete;
+    BatchReader &operator=(const BatchReader &) = delete;
+
+    // Reads the batch's header into the stream and field, leaving the stream at the first block.
+    void ReadHeader(zfp_field *field, zfp_type type) {
+        header_bits_ = zfp_read_header(zfp_, field, ZFP_HEADER_FULL);
+        if (header_bits_ == 0 || field->type != type || zfp_field_dimensionality(field) != 2) {
+            throw std::runtime_error("Invalid ZFP header for this stream's data type.");
+        }
+    }
+
+    bitstream *stream() const {
+        return stream_;
+    }
+
+    size_t header_bits() const {
+        return header_bits_;
+    }
+
+private:
+    zfp_stream *zfp_;
+    bitstream *stream_;
+    size_t header_bits_;
+};
+
+// Decodes one block of up to 4x4 values into rows `sy` values apart.
+void DecodeBlock(zfp_stream *zfp, int32_t *p, size_t nx, size_t ny, ptrdiff_t sy) {
+    if (nx == 4 && ny == 4) {
+        zfp_decode_block_strided_int32_2(zfp, p, 1, sy);
+    } else {
+        zfp_decode_partial_block_strided_int32_2(zfp, p, nx, ny, 1, sy);
+    }
+}
+
+void DecodeBlock(zfp_stream *zfp, float *p, size_t nx, size_t ny, ptrdiff_t sy) {
+    if (nx == 4 && ny == 4) {
+        zfp_decode_block_strided_float_2(zfp, p, 1, sy);
+    } else {
+        zfp_decode_partial_block_strided_float_2(zfp, p, nx, ny, 1, sy);
+    }
+}
+
+void DecodeBlock(zfp_stream *zfp, double *p, size_t nx, size_t ny, ptrdiff_t sy) {
+    if (nx == 4 && ny == 4) {
+        zfp_decode_block_strided_double_2(zfp, p, 1, sy);
+    } else {
+        zfp_decode_partial_block_strided_double_2(zfp, p, nx, ny, 1, sy);
+    }
+}
+}
+
 template <class DataTypeT>
-ZfpCompressor<DataTypeT>::ZfpCompressor(int num_cols, double tolerance, bool use_openmp)
+ZfpCompressor<DataTypeT>::ZfpCompressor(int num_cols, double tolerance, bool use_openmp, double rate)
     : impl_(nullptr) {
     this->num_cols_ = num_cols;
     this->tolerance_ = tolerance;
     this->use_openmp_ = use_openmp;
+    this->rate_ = rate;
 }
 
 template <class DataTypeT>
@@ -61,35 +151,22 @@ ZfpCompressor<DataTypeT>::~ZfpCompressor() noexcept {
 }
 
 template <class DataTypeT>
-std::vector<char> ZfpCompressor<DataTypeT>::compress(const char *data, size_t length) {
+size_t ZfpCompressor<DataTypeT>::CompressToBuffer(const char *data, size_t length) {
     assert(length % (sizeof(DataTypeT) * num_cols_) == 0);
-    auto num_rows = (int) (length / sizeof(DataTypeT) / num_cols_);
-
-    if (impl_ == nullptr || impl_->num_rows_ != num_rows) {
-        // We lazily instantiate the internal data structure within this compressor to minimize the number of
-        // initializations we do. This paradigm leverages the fact that most StreamWriter's will likely call Write()
-        // with the same number of rows of data every time.
-
-        // Clean up past impl_ struct (delete nullptr is okay)
-        delete impl_;
+    auto num_rows = length / sizeof(DataTypeT) / num_cols_;
 
-        // initialize metadata for a compressed stream
+    if (impl_ == nullptr) {
+        // We lazily instantiate the internal data structure within this compressor, and then only resize it as the
+        // number of rows changes from batch to batch.
         impl_ = new ZfpCompressorImpl();
-        impl_->num_rows_ = num_rows;
-        impl_->num_cols_ = this->num_cols_;
         impl_->zfp_ = zfp_stream_open(nullptr);
-
-        impl_->field_ = zfp_field_2d(
-            nullptr,
-            zfp_type_for_class<DataTypeT>(),
-            impl_->num_cols_,
-            impl_->num_rows_);
-
-        size_t bufsize = zfp_stream_maximum_size(impl_->zfp_, impl_->field_);
-        impl_->buffer_.resize(bufsize);
+        impl_->field_ = zfp_field_2d(nullptr, zfp_type_for_class<DataTypeT>(), num_cols_, num_rows);
 
         // initialize metadata for a compressed stream
-        if (tolerance_ < 0.0) {
+        if (rate_ > 0.0) {
+            // Not word-aligned, since blocks are found by their bit offsets.
+            zfp_stream_set_rate(impl_->zfp_, rate_, zfp_type_for_class<DataTypeT>(), 2, 0);
+        } else if (tolerance_ < 0.0) {
             zfp_stream_set_reversible(impl_->zfp_);
         } else {
             zfp_stream_set_accuracy(impl_->zfp_, tolerance_);
@@ -99,82 +176,165 @@ std::vector<char> ZfpCompressor<DataTypeT>::compress(const char *data, size_t le
         } else {
             zfp_stream_set_execution(impl_->zfp_, zfp_exec_serial);
         }
+    } else {
+        zfp_field_set_size_2d(impl_->field_, num_cols_, num_rows);
+    }
 
-        // associate bit stream with allocated buffer
+    size_t bufsize = zfp_stream_maximum_size(impl_->zfp_, impl_->field_);
+    if (bufsize > impl_->buffer_.size()) {
+        // associate bit stream with (newly) allocated buffer
+        impl_->buffer_.resize(bufsize);
+        if (impl_->zfp_->stream) {
+            stream_close(impl_->zfp_->stream);
+        }
         bitstream *stream = stream_open(impl_->buffer_.data(), impl_->buffer_.size());
         zfp_stream_set_bit_stream(impl_->zfp_, stream);
-
-        if constexpr (std::is_same_v<DataTypeT, int16_t>) {
-            impl_->data_promoted = std::make_unique<std::vector<int32_t>>(num_rows * num_cols_);
-        }
     }
 
-    // Needs promotion explicitly since ZFP only supports int32's. We copy the logic from the zfp_promote* functions
-    // here.
+    // Needs promotion explicitly since ZFP only supports int32's.
     if constexpr (std::is_same_v<DataTypeT, int16_t>) {
-        auto data_int16 = (int16_t *) data;
-        for (size_t i = 0; i < impl_->data_promoted->size(); i++) {
-            // Promote it properly
-            impl_->data_promoted->at(i) = ((int32_t) data_int16[i]) << 15;
+        auto num_values = static_cast<int64_t>(length / sizeof(int16_t));
+        if (impl_->data_promoted.size() < static_cast<size_t>(num_values)) {
+            impl_->data_promoted.resize(num_values);
         }
-        zfp_field_set_pointer(impl_->field_, (void *) impl_->data_promoted->data());
+        internal::PromoteInt16ToInt32(
+            reinterpret_cast<const int16_t *>(data), num_values, impl_->data_promoted.data());
+        zfp_field_set_pointer(impl_->field_, (void *) impl_->data_promoted.data());
     } else {
         zfp_field_set_pointer(impl_->field_, (void *) data);
     }
     zfp_stream_rewind(impl_->zfp_);
 
-    assert(length == impl_->field_->nx * impl_->field_->ny * sizeof(DataTypeT));
-
-    // compress array
-    size_t zfpheadersize = zfp_write_header(impl_->zfp_, impl_->field_, ZFP_HEADER_FULL);
-    size_t zfpsize = zfp_compress(impl_->zfp_, impl_->field_);                // return value is byte size of compressed stream
+    // compress array; the returned size is of the whole stream, including the header.
+    zfp_write_header(impl_->zfp_, impl_->field_, ZFP_HEADER_FULL);
+    size_t zfpsize = zfp_compress(impl_->zfp_, impl_->field_);
+    if (zfpsize == 0) {
+        throw std::runtime_error("ZFP compression failed.");
+    }
+    return zfpsize;
+}
 
+template <class DataTypeT>
+std::vector<char> ZfpCompressor<DataTypeT>::compress(const char *data, size_t length) {
+    size_t zfpsize = CompressToBuffer(data, length);
     const char *ret_start = impl_->buffer_.data();
-    return {ret_start, ret_start + zfpheadersize + zfpsize};
+    return {ret_start, ret_start + zfpsize};
+}
+
+template <class DataTypeT>
+void ZfpCompressor<DataTypeT>::compress_into(const char *data, size_t length, std::vector<char> *out) {
+    size_t zfpsize = CompressToBuffer(data, length);
+    out->assign(impl_->buffer_.data(), impl_->buffer_.data() + zfpsize);
+}
+
+template <class DataTypeT>
+ZfpDecompressor<DataTypeT>::ZfpDecompressor(bool fixed_rate)
+    : impl_(new ZfpDecompressorImpl()), fixed_rate_(fixed_rate) {
+    impl_->zfp_ = zfp_stream_open(nullptr);
+    impl_->field_ = zfp_field_alloc();
+}
+
+template <class DataTypeT>
+ZfpDecompressor<DataTypeT>::~ZfpDecompressor() noexcept {
+    delete impl_;
 }
 
 template <class DataTypeT>
 std::vector<char> ZfpDecompressor<DataTypeT>::decompress(const char *data, size_t length) {
-    // associate bit stream with allocated buffer
-    bitstream *stream = stream_open((void *)data, length);         // bit stream to compress to
-    zfp_stream *zfp = zfp_stream_open(stream);                  // compressed stream and parameters
-    zfp_stream_rewind(zfp);                                   // rewind stream to beginning
-
-    zfp_field* field = zfp_field_alloc();
-    size_t zfpheadersize = zfp_read_header(zfp, field, ZFP_HEADER_FULL);
-
-    assert(zfpheadersize > 0);
-    assert(field->type == zfp_type_for_class<DataTypeT>());
-    assert(field->data == nullptr);
-    assert(field->nx > 0);
-    assert(field->ny > 0);
-    assert(field->nz == 0);
-    assert(field->nw == 0);
+    std::vector<char> ret;
+    decompress_into(data, length, &ret);
+    return ret;
+}
+
+template <class DataTypeT>
+void ZfpDecompressor<DataTypeT>::decompress_into(const char *data, size_t length, std::vector<char> *out) {
+    // The stream and field are reused across calls.
+    zfp_stream *zfp = impl_->zfp_;
+    zfp_field *field = impl_->field_;
+    BatchReader batch(zfp, data, length);
+    batch.ReadHeader(field, zfp_type_for_class<DataTypeT>());
     auto num_elements = field->nx * field->ny;
 
     if constexpr (std::is_same_v<DataTypeT, int16_t>) {
-        std::vector<char> decompressed_data(sizeof(int32_t) * num_elements);
-        zfp_field_set_pointer(field, decompressed_data.data());
-        zfp_decompress(zfp, field);
-
-        auto *decompressed_int32 = (int32_t *) field->data;
-        std::vector<char> ret(sizeof(int16_t) * num_elements);
-        auto *decompressed_int16 = (int16_t *) ret.data();
-        for (size_t i = 0; i < num_elements; i++) {
-            // Copies logic in zfp's zfp_demote* int16s.
-            int32_t val = (decompressed_int32[i] >> 15);
-            decompressed_int16[i] = (int16_t) ((std::max<int32_t>)(-0x8000, (std::min<int32_t>)(val, 0x7fff)));
+        if (impl_->data_promoted.size() < num_elements) {
+            impl_->data_promoted.resize(num_elements);
+        }
+        zfp_field_set_pointer(field, impl_->data_promoted.data());
+        if (zfp_decompress(zfp, field) == 0) {
+            throw std::runtime_error("ZFP decompression failed.");
+        }
+        out->resize(sizeof(int16_t) * num_elements);
+        internal::DemoteInt32ToInt16(
+            impl_->data_promoted.data(), static_cast<int64_t>(num_elements), reinterpret_cast<int16_t *>(out->data()));
+    } else {
+        out->resize(sizeof(DataTypeT) * num_elements);
+        zfp_field_set_pointer(field, out->data());
+        if (zfp_decompress(zfp, field) == 0) {
+            throw std::runtime_error("ZFP decompression failed.");
+        }
+    }
+    zfp_field_set_pointer(field, nullptr);
+}
+
+template <class DataTypeT>
+size_t ZfpDecompressor<DataTypeT>::decompress_range(const char *data, size_t length, size_t offset, size_t num_bytes,
+                                                    std::vector<char> *out) {
+    if (!fixed_rate_) {
+        throw std::logic_error("Only fixed-rate ZFP batches can be decompressed in part.");
+    }
+    zfp_stream *zfp = impl_->zfp_;
+    zfp_field *field = impl_->field_;
+    BatchReader batch(zfp, data, length);
+    batch.ReadHeader(field, zfp_type_for_class<DataTypeT>());
+    if (zfp->minbits != zfp->maxbits) {
+        throw std::runtime_error("ZFP batch wasn't compressed in fixed-rate mode.");
+    }
+
+    size_t nx = field->nx;
+    size_t ny = field->ny;
+    size_t row_size = sizeof(DataTypeT) * nx;
+    if (offset >= row_size * ny || num_bytes == 0) {
+        out->clear();
+        return 0;
+    }
+    num_bytes = std::min(num_bytes, row_size * ny - offset);
+
+    // Each block is of 4 rows by 4 columns and takes exactly maxbits, and they're laid out one row of blocks after
+    // another, so decode only the rows of blocks that the range falls in.
+    using DecodedT = std::conditional_t<std::is_same_v<DataTypeT, int16_t>, int32_t, DataTypeT>;
+    size_t first_block_row = offset / row_size / 4;
+    size_t last_block_row = (offset + num_bytes - 1) / row_size / 4;
+    size_t first_row = 4 * first_block_row;
+    size_t num_rows = std::min(ny, 4 * (last_block_row + 1)) - first_row;
+    size_t blocks_per_row = (nx + 3) / 4;
+    if (impl_->decoded_rows.size() < sizeof(DecodedT) * nx * num_rows) {
+        impl_->decoded_rows.resize(sizeof(DecodedT) * nx * num_rows);
+    }
+    auto *decoded = reinterpret_cast<DecodedT *>(impl_->decoded_rows.data());
+    for (size_t block_row = first_block_row; block_row <= last_block_row; block_row++) {
+        stream_rseek(batch.stream(), batch.header_bits() + block_row * blocks_per_row * zfp->maxbits);
+        size_t y = 4 * block_row;
+        DecodedT *rows = decoded + (y - first_row) * nx;
+        for (size_t x = 0; x < nx; x += 4) {
+            DecodeBlock(zfp, rows + x, std::min<size_t>(4, nx - x), std::min<size_t>(4, ny - y), nx);
         }
+    }
 
-        zfp_field_free(field);
-        return ret;
+    size_t decoded_offset = offset - first_row * row_size;
+    if constexpr (std::is_same_v<DataTypeT, int16_t>) {
+        // Demote whole values, then trim to the range in case it doesn't start or end on one.
+        size_t first_value = decoded_offset / sizeof(int16_t);
+        size_t end_value = (decoded_offset + num_bytes + sizeof(int16_t) - 1) / sizeof(int16_t);
+        out->resize(sizeof(int16_t) * (end_value - first_value));
+        internal::DemoteInt32ToInt16(decoded + first_value, static_cast<int64_t>(end_value - first_value),
+                                     reinterpret_cast<int16_t *>(out->data()));
+        out->erase(out->begin(), out->begin() + (decoded_offset - sizeof(int16_t) * first_value));
+        out->resize(num_bytes);
     } else {
-        std::vector<char> decompressed_data(sizeof(DataTypeT) * num_elements);
-        zfp_field_set_pointer(field, decompressed_data.data());
-        zfp_decompress(zfp, field);
-        zfp_field_free(field);
-        return decompressed_data;
+        const char *decoded_bytes = impl_->decoded_rows.data() + decoded_offset;
+        out->assign(decoded_bytes, decoded_bytes + num_bytes);
     }
+    return num_bytes;
 }
 
 // And then handle the linker for templated classes by explicitly declaring possible types supported:
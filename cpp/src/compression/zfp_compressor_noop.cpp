@@ -11,8 +11,11 @@ namespace river {
 class ZfpCompressorImpl {
 };
 
+class ZfpDecompressorImpl {
+};
+
 template <class DataTypeT>
-ZfpCompressor<DataTypeT>::ZfpCompressor(int num_cols, double tolerance, bool use_openmp)
+ZfpCompressor<DataTypeT>::ZfpCompressor(int num_cols, double tolerance, bool use_openmp, double rate)
     : impl_(nullptr) {
         throw std::logic_error("ZFP compression is disabled via build flags. Re-build and re-install River with"
                                " the appropriate ZFP build flag enabled.");
@@ -28,12 +31,39 @@ std::vector<char> ZfpCompressor<DataTypeT>::compress(const char *data, size_t le
                            " the appropriate ZFP build flag enabled.");
 }
 
+template <class DataTypeT>
+void ZfpCompressor<DataTypeT>::compress_into(const char *data, size_t length, std::vector<char> *out) {
+    throw std::logic_error("ZFP compression is disabled via build flags. Re-build and re-install River with"
+                           " the appropriate ZFP build flag enabled.");
+}
+
+template <class DataTypeT>
+ZfpDecompressor<DataTypeT>::ZfpDecompressor(bool fixed_rate) : impl_(nullptr), fixed_rate_(fixed_rate) {
+}
+
+template <class DataTypeT>
+ZfpDecompressor<DataTypeT>::~ZfpDecompressor() noexcept {
+}
+
 template <class DataTypeT>
 std::vector<char> ZfpDecompressor<DataTypeT>::decompress(const char *data, size_t length) {
     throw std::logic_error("ZFP compression is disabled via build flags. Re-build and re-install River with"
                            " the appropriate ZFP build flag enabled.");
 }
 
+template <class DataTypeT>
+void ZfpDecompressor<DataTypeT>::decompress_into(const char *data, size_t length, std::vector<char> *out) {
+    throw std::logic_error("ZFP compression is disabled via build flags. Re-build and re-install River with"
+                           " the appropriate ZFP build flag enabled.");
+}
+
+template <class DataTypeT>
+size_t ZfpDecompressor<DataTypeT>::decompress_range(const char *data, size_t length, size_t offset, size_t num_bytes,
+                                                    std::vector<char> *out) {
+    throw std::logic_error("ZFP compression is disabled via build flags. Re-build and re-install River with"
+                           " the appropriate ZFP build flag enabled.");
+}
+
 // And then handle the linker for templated classes by explicitly declaring possible types supported:
 template class ZfpCompressor<int16_t>;
 template class ZfpCompressor<int32_t>;
@@ -0,0 +1,214 @@
+#include "concurrent_writer.h"
+
+#include <chrono>
+#include <spdlog/spdlog.h>
+#include "simd.h"
+
+using namespace std;
+
+namespace river {
+
+// Upper bound on how much the flusher coalesces into a single write to the underlying StreamWriter.
+static const size_t MAX_COALESCED_BYTES = size_t{16} << 20;
+// How long the flusher sleeps at most when idle, in case it misses a wakeup.
+static const chrono::milliseconds FLUSHER_IDLE_WAIT(1);
+
+ConcurrentStreamWriter::ConcurrentStreamWriter(const StreamWriterParams &params, int64_t max_queued_bytes)
+    : writer_(params), max_queued_bytes_(max_queued_bytes), sample_size_(-1), has_variable_width_field_(false),
+      head_(nullptr), tail_(nullptr), total_samples_enqueued_(0), total_samples_written_(0), queued_bytes_(0),
+      num_producers_in_flight_(0), is_stopping_(false), is_flusher_waiting_(false), has_flusher_error_(false),
+      is_stopped_(false) {
+    tail_ = new Chunk();
+    head_.store(tail_);
+}
+
+ConcurrentStreamWriter::~ConcurrentStreamWriter() {
+    try {
+        Stop();
+    } catch (const exception &e) {
+        spdlog::error("Error stopping stream {}: {}", writer_.stream_name(), e.what());
+    }
+    while (tail_ != nullptr) {
+        Chunk *next = tail_->next.load();
+        delete tail_;
+        tail_ = next;
+    }
+}
+
+void ConcurrentStreamWriter::Initialize(const string &stream_name,
+                                        const StreamSchema &schema,
+                                        const unordered_map<string, string> &user_metadata,
+                                        bool compute_local_minus_global_clock) {
+    if (flusher_.joinable()) {
+        return;
+    }
+    writer_.Initialize(stream_name, schema, user_metadata, compute_local_minus_global_clock);
+    sample_size_ = writer_.schema().sample_size();
+    has_variable_width_field_ = writer_.schema().has_variable_width_field();
+    flusher_ = thread(&ConcurrentStreamWriter::RunFlusher, this);
+}
+
+void ConcurrentStreamWriter::WriteBytes(const char *data, int64_t num_samples, const int *sizes) {
+    if (num_samples <= 0) {
+        return;
+    }
+    if (!flusher_.joinable()) {
+        throw StreamWriterException("Stream is not yet initialized. Call #Initialize() first.");
+    }
+    // Counted before checking is_stopping_ (both sequentially consistent), so that either Stop() sees this producer
+    // and waits for its chunk, or this producer sees Stop().
+    num_producers_in_flight_++;
+    struct InFlight {
+        std::atomic<int64_t> *num_producers_in_flight;
+        ~InFlight() {
+            (*num_producers_in_flight)--;
+        }
+    } in_flight{&num_producers_in_flight_};
+    if (is_stopping_) {
+        throw StreamWriterException("Stream has already been stopped. Do not reuse these objects.");
+    }
+    if (has_variable_width_field_ && sizes == nullptr) {
+        throw StreamWriterException("Stream has variable width fields; the size of each sample must be given!");
+    }
+    RethrowFlusherError();
+
+    int64_t num_bytes = has_variable_width_field_ ? internal::SumSizes(sizes, num_samples) : num_samples * sample_size_;
+
+    if (max_queued_bytes_ > 0 && queued_bytes_.load(memory_order_relaxed) >= max_queued_bytes_) {
+        {
+            unique_lock<mutex> lock(mutex_);
+            written_cv_.wait(lock, [&]() { return queued_bytes_.load() < max_queued_bytes_ || has_flusher_error_; });
+        }
+        RethrowFlusherError();
+    }
+
+    auto *chunk = new Chunk();
+    chunk->data.assign(data, data + num_bytes);
+    if (has_variable_width_field_) {
+        chunk->sizes.assign(sizes, sizes + num_samples);
+    }
+    chunk->num_samples = num_samples;
+
+    queued_bytes_ += num_bytes;
+    total_samples_enqueued_ += num_samples;
+    Enqueue(chunk);
+}
+
+void ConcurrentStreamWriter::Enqueue(Chunk *chunk) {
+    Chunk *prev = head_.exchange(chunk, memory_order_acq_rel);
+    // Until this store, the flusher sees the queue as ending at `prev`.
+    prev->next.store(chunk, memory_order_release);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (is_flusher_waiting_.load(memory_order_relaxed)) {
+        lock_guard<mutex> lock(mutex_);
+        enqueued_cv_.notify_one();
+    }
+}
+
+ConcurrentStreamWriter::Chunk *ConcurrentStreamWriter::Dequeue() {
+    Chunk *next = tail_->next.load(memory_order_acquire);
+    if (next == nullptr) {
+        return nullptr;
+    }
+    // The returned chunk becomes the new stub, so it stays valid until the next call.
+    delete tail_;
+    tail_ = next;
+    return next;
+}
+
+void ConcurrentStreamWriter::RunFlusher() {
+    vector<char> coalesced_data;
+    vector<int> coalesced_sizes;
+
+    auto write = [this](const char *data, int64_t num_samples, const int *sizes, size_t num_bytes) {
+        writer_.WriteBytes(data, num_samples, has_variable_width_field_ ? sizes : nullptr);
+        queued_bytes_ -= static_cast<int64_t>(num_bytes);
+        total_samples_written_ += num_samples;
+        {
+            lock_guard<mutex> lock(mutex_);
+        }
+        written_cv_.notify_all();
+    };
+
+    try {
+        while (true) {
+            Chunk *chunk = Dequeue();
+            if (chunk != nullptr) {
+                if (tail_->next.load(memory_order_acquire) == nullptr) {
+                    // Only one chunk queued, so write it as is rather than copying it.
+                    write(chunk->data.data(), chunk->num_samples, chunk->sizes.data(), chunk->data.size());
+                    vector<char>().swap(chunk->data);
+                    vector<int>().swap(chunk->sizes);
+                    continue;
+                }
+
+                coalesced_data.clear();
+                coalesced_sizes.clear();
+                int64_t num_samples = 0;
+                do {
+                    coalesced_data.insert(coalesced_data.end(), chunk->data.begin(), chunk->data.end());
+                    coalesced_sizes.insert(coalesced_sizes.end(), chunk->sizes.begin(), chunk->sizes.end());
+                    num_samples += chunk->num_samples;
+                    vector<char>().swap(chunk->data);
+                    vector<int>().swap(chunk->sizes);
+                } while (coalesced_data.size() < MAX_COALESCED_BYTES && (chunk = Dequeue()) != nullptr);
+                write(coalesced_data.data(), num_samples, coalesced_sizes.data(), coalesced_data.size());
+                continue;
+            }
+
+            // Once stopping, producers that got past their check may still be linking their chunks in, or about to.
+            if (is_stopping_ && num_producers_in_flight_ == 0 && head_.load() == tail_) {
+                break;
+            }
+            unique_lock<mutex> lock(mutex_);
+            is_flusher_waiting_.store(true, memory_order_relaxed);
+            atomic_thread_fence(memory_order_seq_cst);
+            if (tail_->next.load(memory_order_acquire) == nullptr && (!is_stopping_ || num_producers_in_flight_ > 0)) {
+                enqueued_cv_.wait_for(lock, FLUSHER_IDLE_WAIT);
+            }
+            is_flusher_waiting_.store(false, memory_order_relaxed);
+        }
+    } catch (...) {
+        flusher_error_ = current_exception();
+        {
+            lock_guard<mutex> lock(mutex_);
+            has_flusher_error_ = true;
+        }
+        written_cv_.notify_all();
+    }
+}
+
+void ConcurrentStreamWriter::Flush() {
+    int64_t target = total_samples_enqueued_.load();
+    {
+        unique_lock<mutex> lock(mutex_);
+        written_cv_.wait(lock, [&]() { return total_samples_written_.load() >= target || has_flusher_error_; });
+    }
+    RethrowFlusherError();
+}
+
+void ConcurrentStreamWriter::Stop() {
+    if (is_stopped_) {
+        return;
+    }
+    is_stopped_ = true;
+    is_stopping_ = true;
+    if (flusher_.joinable()) {
+        {
+            lock_guard<mutex> lock(mutex_);
+            enqueued_cv_.notify_one();
+        }
+        flusher_.join();
+    }
+    writer_.Stop();
+    RethrowFlusherError();
+}
+
+void ConcurrentStreamWriter::RethrowFlusherError() {
+    if (has_flusher_error_) {
+        rethrow_exception(flusher_error_);
+    }
+}
+
+}
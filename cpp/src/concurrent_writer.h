@@ -0,0 +1,133 @@
+#ifndef RIVER_SRC_CONCURRENT_WRITER_H_
+#define RIVER_SRC_CONCURRENT_WRITER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "writer.h"
+
+namespace river {
+
+/**
+ * A thread-safe front-end to a StreamWriter, for multiple threads ("producers") writing to the same stream.
+ *
+ * Each #Write() copies the given samples into a chunk and enqueues it onto a lock-free multi-producer, single-consumer
+ * queue, so producers only ever contend on one atomic exchange. A single flusher thread drains the queue, coalescing
+ * chunks into large writes to the underlying StreamWriter, which assigns sample indices in the order chunks were
+ * enqueued. Thus samples of any one producer are written in the order it wrote them, and producers never block on
+ * network I/O (unless over max_queued_bytes; see the constructor).
+ *
+ * Errors writing to Redis are raised on the flusher thread, and rethrown from the next call to #Write(), #Flush(), or
+ * #Stop().
+ */
+class ConcurrentStreamWriter {
+public:
+    /**
+     * @param params Parameters of the underlying StreamWriter.
+     * @param max_queued_bytes If positive, producers wait while at least this many bytes are queued
+     * but not yet written, bounding memory use when Redis can't keep up.
+     */
+    explicit ConcurrentStreamWriter(const StreamWriterParams &params, int64_t max_queued_bytes = 0);
+
+    ~ConcurrentStreamWriter();
+
+    /**
+     * See StreamWriter#Initialize(). Must be called before any producer writes.
+     */
+    void Initialize(const std::string &stream_name,
+                    const StreamSchema &schema,
+                    const std::unordered_map<std::string, std::string> &user_metadata =
+                    std::unordered_map<std::string, std::string>(),
+                    bool compute_local_minus_global_clock = false);
+
+    /**
+     * Enqueues samples to be written; see StreamWriter#Write(). Safe to call from any number of threads concurrently.
+     */
+    template <class DataT>
+    void Write(DataT *data, int64_t num_samples, const int *sizes = nullptr) {
+        if (!has_variable_width_field_ && sizeof(data[0]) != sample_size_) {
+            throw StreamWriterException("Sample size that was given is not equal to the data!");
+        }
+        WriteBytes(reinterpret_cast<const char *>(data), num_samples, sizes);
+    }
+
+    void WriteBytes(const char *data, int64_t num_samples, const int *sizes = nullptr);
+
+    /**
+     * Blocks until all samples enqueued before this call have been written to Redis.
+     */
+    void Flush();
+
+    /**
+     * Writes all enqueued samples and then stops the stream; see StreamWriter#Stop(). No more writes are allowed.
+     */
+    void Stop();
+
+    /**
+     * Number of samples written to Redis so far.
+     */
+    int64_t total_samples_written() const {
+        return total_samples_written_;
+    }
+
+    const std::string &stream_name() {
+        return writer_.stream_name();
+    }
+
+    int64_t initialized_at_us() {
+        return writer_.initialized_at_us();
+    }
+
+private:
+    // Node of the queue, holding a copy of one producer's write.
+    struct Chunk {
+        std::atomic<Chunk *> next{nullptr};
+        std::vector<char> data;
+        std::vector<int> sizes;
+        int64_t num_samples = 0;
+    };
+
+    void Enqueue(Chunk *chunk);
+    Chunk *Dequeue();
+    void RunFlusher();
+    void RethrowFlusherError();
+
+    StreamWriter writer_;
+    const int64_t max_queued_bytes_;
+    int sample_size_;
+    bool has_variable_width_field_;
+
+    // Vyukov's intrusive MPSC queue: producers exchange themselves onto the head, while the flusher pops from the
+    // tail, which is always a "stub" chunk whose data was already consumed.
+    std::atomic<Chunk *> head_;
+    Chunk *tail_;
+
+    std::atomic<int64_t> total_samples_enqueued_;
+    std::atomic<int64_t> total_samples_written_;
+    std::atomic<int64_t> queued_bytes_;
+    // Producers within WriteBytes(), from before checking is_stopping_ until their chunk is linked into the queue.
+    // After stopping, the flusher only exits once there are none, so a write that passed the check isn't lost.
+    std::atomic<int64_t> num_producers_in_flight_;
+
+    std::thread flusher_;
+    std::atomic_bool is_stopping_;
+    std::atomic_bool is_flusher_waiting_;
+    // Only used for the flusher to sleep when there's nothing to write, and for Flush() and producers over
+    // max_queued_bytes to wait on the flusher.
+    std::mutex mutex_;
+    std::condition_variable enqueued_cv_;
+    std::condition_variable written_cv_;
+    std::exception_ptr flusher_error_;
+    std::atomic_bool has_flusher_error_;
+    bool is_stopped_;
+};
+
+}
+
+#endif //RIVER_SRC_CONCURRENT_WRITER_H_
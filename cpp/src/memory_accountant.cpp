@@ -0,0 +1,165 @@
+#include "memory_accountant.h"
+
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+#include <unordered_set>
+
+using namespace std;
+
+namespace river {
+
+StreamMemoryAccountant::StreamMemoryAccountant(const RedisConnection &connection, int64_t budget_bytes)
+        : budget_bytes_(budget_bytes), total_bytes_(0) {
+    if (budget_bytes_ < 0) {
+        throw invalid_argument("Memory budget must be nonnegative.");
+    }
+    this->redis_ = internal::Redis::Create(connection);
+}
+
+int64_t StreamMemoryAccountant::MeasureStream(const string &stream_name) {
+    auto metadata = redis_->GetMetadata(stream_name);
+    if (!metadata) {
+        measured_streams_.erase(stream_name);
+        return -1;
+    }
+    int64_t ret = max(redis_->MemoryUsage(redis_->MetadataKey(stream_name)), int64_t{0});
+
+    // Stream keys are contiguous from first_stream_key onwards (earlier ones having been deleted), so walk forwards
+    // until one doesn't exist.
+    auto first_stream_key_it = metadata->find("first_stream_key");
+    if (first_stream_key_it == metadata->end()) {
+        return ret;
+    }
+    const string &first_stream_key = first_stream_key_it->second;
+    size_t separator = first_stream_key.rfind('-');
+    if (separator == string::npos) {
+        return ret;
+    }
+    int64_t stream_key_idx;
+    try {
+        stream_key_idx = stoll(first_stream_key.substr(separator + 1));
+    } catch (const logic_error &e) {
+        spdlog::warn("Unparseable first_stream_key {} for stream {}.", first_stream_key, stream_name);
+        return ret;
+    }
+
+    auto &measured = measured_streams_[stream_name];
+    auto initialized_at_us_it = metadata->find("initialized_at_us");
+    string initialized_at_us = initialized_at_us_it == metadata->end() ? "" : initialized_at_us_it->second;
+    if (measured.initialized_at_us != initialized_at_us) {
+        // A new stream by the same name, whose keys have nothing to do with the old one's.
+        measured = MeasuredStream();
+        measured.initialized_at_us = initialized_at_us;
+    }
+    // Keys before first_stream_key were deleted.
+    measured.complete_key_bytes.erase(measured.complete_key_bytes.begin(),
+                                      measured.complete_key_bytes.lower_bound(stream_key_idx));
+    int64_t previous_last_stream_key_idx = measured.last_stream_key_idx;
+    measured.last_stream_key_idx = -1;
+    while (true) {
+        auto it = measured.complete_key_bytes.find(stream_key_idx);
+        if (it != measured.complete_key_bytes.end()) {
+            ret += it->second;
+        } else {
+            int64_t key_bytes = redis_->MemoryUsage(redis_->StreamKey(stream_name, stream_key_idx));
+            if (key_bytes < 0) {
+                break;
+            }
+            ret += key_bytes;
+            // A later key existed before this was measured, so it had already been tombstoned and won't change.
+            if (stream_key_idx < previous_last_stream_key_idx) {
+                measured.complete_key_bytes[stream_key_idx] = key_bytes;
+            }
+        }
+        measured.last_stream_key_idx = stream_key_idx;
+        stream_key_idx++;
+    }
+    return ret;
+}
+
+void StreamMemoryAccountant::Refresh() {
+    unordered_map<string, int64_t> bytes_by_stream;
+    int64_t total_bytes = 0;
+    auto stream_names = redis_->ListStreamNames();
+    // Forget streams that were deleted entirely.
+    unordered_set<string> stream_names_set(stream_names.begin(), stream_names.end());
+    for (auto it = measured_streams_.begin(); it != measured_streams_.end();) {
+        if (stream_names_set.count(it->first) == 0) {
+            it = measured_streams_.erase(it);
+        } else {
+            it++;
+        }
+    }
+    for (const auto &stream_name : stream_names) {
+        int64_t stream_bytes = MeasureStream(stream_name);
+        if (stream_bytes < 0) {
+            // Deleted in the meantime.
+            continue;
+        }
+        bytes_by_stream[stream_name] = stream_bytes;
+        total_bytes += stream_bytes;
+    }
+
+    bool was_over_budget = is_over_budget();
+    bytes_by_stream_ = std::move(bytes_by_stream);
+    total_bytes_ = total_bytes;
+    if (is_over_budget() && !was_over_budget) {
+        spdlog::warn("Streams are using {} bytes in Redis, over the budget of {} bytes.", total_bytes_, budget_bytes_);
+    } else if (!is_over_budget() && was_over_budget) {
+        spdlog::info("Streams are using {} bytes in Redis, back under the budget of {} bytes.",
+                     total_bytes_, budget_bytes_);
+    }
+
+    vector<pair<string, string>> stream_pairs;
+    for (const auto &pair : bytes_by_stream_) {
+        stream_pairs.emplace_back(pair.first, to_string(pair.second));
+    }
+    redis_->ReplaceHash(STREAMS_KEY, stream_pairs);
+    redis_->ReplaceHash(STATUS_KEY, {
+        {"budget_bytes", to_string(budget_bytes_)},
+        {"total_bytes", to_string(total_bytes_)},
+        {"updated_at_us", to_string(redis_->TimeUs(STATUS_KEY))},
+    });
+}
+
+int64_t StreamMemoryAccountant::budget_bytes() const {
+    return budget_bytes_;
+}
+
+int64_t StreamMemoryAccountant::total_bytes() const {
+    return total_bytes_;
+}
+
+bool StreamMemoryAccountant::is_over_budget() const {
+    return budget_bytes_ > 0 && total_bytes_ >= budget_bytes_;
+}
+
+const unordered_map<string, int64_t> &StreamMemoryAccountant::bytes_by_stream() const {
+    return bytes_by_stream_;
+}
+
+StreamMemoryStatus StreamMemoryAccountant::FetchStatus(internal::Redis *redis, const string &stream_name) {
+    StreamMemoryStatus ret;
+    auto status = redis->GetHash(STATUS_KEY);
+    if (!status) {
+        return ret;
+    }
+    try {
+        ret.budget_bytes = stoll(status->at("budget_bytes"));
+        ret.total_bytes = stoll(status->at("total_bytes"));
+        ret.updated_at_us = stoll(status->at("updated_at_us"));
+    } catch (const logic_error &e) {
+        throw internal::RedisException(fmt::format("Malformed memory status in {}: {}", STATUS_KEY, e.what()));
+    }
+
+    auto streams = redis->GetHash(STREAMS_KEY);
+    if (streams) {
+        auto it = streams->find(stream_name);
+        if (it != streams->end()) {
+            ret.stream_bytes = stoll(it->second);
+        }
+    }
+    return ret;
+}
+
+}
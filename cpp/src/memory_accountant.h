@@ -0,0 +1,97 @@
+#ifndef RIVER_SRC_MEMORY_ACCOUNTANT_H_
+#define RIVER_SRC_MEMORY_ACCOUNTANT_H_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "redis.h"
+
+namespace river {
+
+/**
+ * A snapshot of Redis memory usage as last published by a StreamMemoryAccountant.
+ */
+class StreamMemoryStatus {
+public:
+    // Global budget in bytes across all streams; 0 if no accountant has published a budget.
+    int64_t budget_bytes = 0;
+    // Bytes used by all streams in Redis.
+    int64_t total_bytes = 0;
+    // Bytes used by the stream in question; -1 if unknown (e.g. not yet measured).
+    int64_t stream_bytes = -1;
+    // Server time in microseconds since epoch at which this snapshot was published; 0 if never.
+    int64_t updated_at_us = 0;
+
+    /**
+     * Whether streams in Redis are using more memory than the budget allows, in which case writers should back off
+     * (e.g. drop or buffer samples) until the ingester catches up.
+     */
+    bool is_over_budget() const {
+        return budget_bytes > 0 && total_bytes >= budget_bytes;
+    }
+};
+
+/**
+ * Tracks how much Redis memory each stream takes up (via MEMORY USAGE on each of its `{stream}-{k}` keys and its
+ * metadata) and enforces a global budget across all streams.
+ *
+ * Each call to Refresh() publishes a snapshot to Redis, so that writers can check it via StreamWriter#MemoryStatus()
+ * and dashboards can read it directly:
+ *   - `river-memory` is a hash of budget_bytes, total_bytes, and updated_at_us;
+ *   - `river-memory-streams` is a hash of stream name => bytes.
+ *
+ * Typically run by the ingester (see its --memory_budget_bytes option), which also deletes already-persisted stream
+ * keys as early as possible while over budget.
+ */
+class StreamMemoryAccountant {
+public:
+    static constexpr const char *STATUS_KEY = "river-memory";
+    static constexpr const char *STREAMS_KEY = "river-memory-streams";
+
+    StreamMemoryAccountant(const RedisConnection &connection, int64_t budget_bytes);
+
+    /**
+     * Measures every stream in Redis and publishes the result.
+     */
+    void Refresh();
+
+    /**
+     * Bytes used by a single stream, summing all of its stream keys and its metadata. Returns -1 if the stream
+     * doesn't exist.
+     *
+     * Stream keys that the stream has since rolled over from don't change until they're deleted, so each is only
+     * measured once; later calls just re-measure the metadata and the keys still being written to.
+     */
+    int64_t MeasureStream(const std::string &stream_name);
+
+    int64_t budget_bytes() const;
+    int64_t total_bytes() const;
+    bool is_over_budget() const;
+    const std::unordered_map<std::string, int64_t> &bytes_by_stream() const;
+
+    /**
+     * Fetches the last published snapshot for the given stream.
+     */
+    static StreamMemoryStatus FetchStatus(internal::Redis *redis, const std::string &stream_name);
+
+private:
+    std::unique_ptr<internal::Redis> redis_;
+    const int64_t budget_bytes_;
+    int64_t total_bytes_;
+    std::unordered_map<std::string, int64_t> bytes_by_stream_;
+
+    struct MeasuredStream {
+        // Of the stream as measured, to tell it apart from a later stream by the same name.
+        std::string initialized_at_us;
+        // Last stream key found by the previous measurement; -1 if none.
+        int64_t last_stream_key_idx = -1;
+        // Bytes of each stream key that was measured after a later key already existed, by stream key index.
+        std::map<int64_t, int64_t> complete_key_bytes;
+    };
+    std::unordered_map<std::string, MeasuredStream> measured_streams_;
+};
+
+}
+
+#endif //RIVER_SRC_MEMORY_ACCOUNTANT_H_
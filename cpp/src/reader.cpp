@@ -5,6 +5,9 @@
 #include <spdlog/fmt/fmt.h>
 #include <spdlog/spdlog.h>
 #include "compression/compressor.h"
+#include "compression/wire_codec.h"
+#include "compression/variable_width_block.h"
+#include "simd.h"
 #include <nlohmann/json.hpp>
 
 using json = nlohmann::json;
@@ -13,9 +16,17 @@ namespace river {
 
 using namespace std;
 
-StreamReader::StreamReader(const RedisConnection &connection, const int max_fetch_size)
-        : max_fetch_size_(max_fetch_size), cursor_(RedisCursor()), current_sample_idx_(-1), num_samples_read_(0) {
-    this->redis_ = internal::Redis::Create(connection);
+static const int REPLICA_CATCH_UP_TIMEOUT_MS = 1000;
+// Number of times to poll an empty shared memory ring before sleeping in between polls.
+static const int RING_SPIN_POLLS = 10000;
+// How often lossy readers check whether their current stream key was trimmed while they wait for new samples.
+static const int64_t STREAM_KEY_TRIM_CHECK_INTERVAL_US = 100 * 1000;
+
+StreamReader::StreamReader(const StreamReaderParams &params)
+        : max_fetch_size_(params.max_fetch_size), wire_compression_(params.wire_compression),
+          use_shared_memory_(params.shared_memory), cursor_(RedisCursor()),
+          current_sample_idx_(-1), num_samples_read_(0) {
+    this->redis_ = internal::Redis::CreateForReads(params.connection);
 
     this->cursor_.left = 0;
     this->cursor_.right = 0;
@@ -70,11 +81,48 @@ void StreamReader::Initialize(const std::string &stream_name, int timeout_ms) {
     } else {
         this->compression_ = StreamCompression(StreamCompression::Type::UNCOMPRESSED);
     }
-    this->decompressor_ = CreateDecompressor(this->compression_);
+    this->decompressor_ = CreateDecompressor(this->compression_, *this->schema_);
+    this->is_lossy_ = metadata.find("retention_json") != metadata.end();
+
+    if (wire_compression_ != WireCompression::NONE) {
+        // As with the writer, wire compression is only an optimization, so fall back to plain XRANGEs if unavailable.
+        auto installed_modules = redis_->GetInstalledModules();
+        auto wire_compression_name = WireCompressionName(wire_compression_);
+        if (std::find(installed_modules.begin(), installed_modules.end(), "river") == installed_modules.end()) {
+            spdlog::warn("Wire compression {} requires the River module; reading data uncompressed.",
+                         wire_compression_name);
+        } else if (!internal::IsWireCompressionSupported(wire_compression_)) {
+            spdlog::warn("Wire compression {} not supported by this build; reading data uncompressed.",
+                         wire_compression_name);
+        } else if (!redis_->IsWireCodecSupportedByModule(wire_compression_name)) {
+            spdlog::warn("Wire compression {} not supported by the River module; reading data uncompressed.",
+                         wire_compression_name);
+        } else if (this->decompressor_) {
+            spdlog::warn("Stream is already compressed via {}; not using wire compression {}.",
+                         this->compression_.name(), wire_compression_name);
+        } else if (this->is_lossy_) {
+            // Packed reads don't report each sample's index, which is needed to detect trimmed samples.
+            spdlog::warn("Stream is lossy; not using wire compression {}.", wire_compression_name);
+        } else {
+            this->use_packed_reads_ = true;
+        }
+    }
+
     this->sample_size_ = schema_->sample_size();
     this->stream_name_ = stream_name;
     this->is_initialized_ = true;
 
+    if (use_shared_memory_) {
+        shared_memory_ring_ = internal::SharedMemoryRing::Open(stream_name, initialized_at_us_);
+        if (shared_memory_ring_) {
+            // Older records will most likely have been overwritten by the time we've caught up to them.
+            ring_position_ = shared_memory_ring_->write_position();
+            spdlog::info("Found shared memory ring for stream {}.", stream_name);
+        } else {
+            spdlog::info("No shared memory ring found for stream {}; reading from Redis only.", stream_name);
+        }
+    }
+
     FireStreamKeyChange("", current_stream_key_);
 }
 
@@ -84,6 +132,76 @@ int64_t StreamReader::ReadBytes(
         int **sizes,
         std::string **keys,
         int timeout_ms) {
+    return ReadBytes(buffer, num_samples, sizes, keys, timeout_ms, num_samples);
+}
+
+int64_t StreamReader::ReadColumns(void **columns,
+                                  int64_t num_samples,
+                                  const unordered_map<string, ColumnConversion> &conversions,
+                                  int timeout_ms) {
+    if (!schema_) {
+        throw StreamReaderException("Schema has not been initialized. Did you call initialize()?");
+    }
+    if (has_variable_width_field_) {
+        throw StreamReaderException("Columns can only be read from streams without variable-width fields.");
+    }
+    const auto &fields = schema_->field_definitions;
+    vector<int> field_sizes;
+    // Converted fields are first copied out into column_conversion_buffer_, at these offsets.
+    vector<int64_t> conversion_offsets(fields.size(), -1);
+    int64_t conversion_num_bytes = 0;
+    for (size_t f = 0; f < fields.size(); f++) {
+        field_sizes.push_back(fields[f].size);
+        auto it = conversions.find(fields[f].name);
+        if (it == conversions.end() || columns[f] == nullptr) {
+            continue;
+        }
+        if (fields[f].type == FieldDefinition::FIXED_WIDTH_BYTES
+            || (it->second.type != FieldDefinition::FLOAT && it->second.type != FieldDefinition::DOUBLE)) {
+            throw StreamReaderException(fmt::format(
+                "Field {} can't be converted; only numeric fields can, to FLOAT or DOUBLE.", fields[f].name));
+        }
+        conversion_offsets[f] = conversion_num_bytes;
+        conversion_num_bytes += num_samples * fields[f].size;
+    }
+    for (const auto &conversion : conversions) {
+        if (std::none_of(fields.begin(), fields.end(),
+                         [&](const FieldDefinition &field) { return field.name == conversion.first; })) {
+            throw StreamReaderException(fmt::format("No field {} to convert in the schema.", conversion.first));
+        }
+    }
+
+    column_read_buffer_.resize(num_samples * sample_size_);
+    int64_t num_read = ReadBytes(column_read_buffer_.data(), num_samples, nullptr, nullptr, timeout_ms);
+    if (num_read <= 0) {
+        return num_read;
+    }
+
+    column_conversion_buffer_.resize(conversion_num_bytes);
+    vector<char *> out_columns(fields.size());
+    for (size_t f = 0; f < fields.size(); f++) {
+        out_columns[f] = conversion_offsets[f] >= 0
+                         ? &column_conversion_buffer_[conversion_offsets[f]]
+                         : static_cast<char *>(columns[f]);
+    }
+    internal::DeinterleaveColumns(column_read_buffer_.data(), field_sizes, num_read, out_columns.data());
+    for (size_t f = 0; f < fields.size(); f++) {
+        if (conversion_offsets[f] >= 0) {
+            const auto &conversion = conversions.at(fields[f].name);
+            internal::ConvertColumn(out_columns[f], fields[f].type, num_read, conversion.scale, conversion.type,
+                                    static_cast<char *>(columns[f]));
+        }
+    }
+    return num_read;
+}
+
+int64_t StreamReader::ReadBytes(
+        char *buffer,
+        int64_t num_samples,
+        int **sizes,
+        std::string **keys,
+        int timeout_ms,
+        int64_t min_samples) {
     if (this->has_variable_width_field_ && sizes == nullptr) {
         spdlog::info("Schema has a variable width field, so sizes must be given.");
         return -1;
@@ -95,9 +213,14 @@ int64_t StreamReader::ReadBytes(
         return -1;
     }
 
+    if (shared_memory_ring_ && keys != nullptr) {
+        CloseSharedMemoryRing();
+    }
+
     int64_t samples_fetched = 0;
     int64_t buffer_index = 0;
     bool should_xread = false;
+    int num_empty_ring_polls = 0;
 
     int64_t end_us;
     if (timeout_ms <= 0) {
@@ -121,13 +244,50 @@ int64_t StreamReader::ReadBytes(
         int64_t samples_remaining = num_samples - samples_fetched;
         int64_t num_to_fetch = samples_remaining > max_fetch_size_ ? max_fetch_size_ : samples_remaining;
 
+        if (shared_memory_ring_) {
+            int64_t num_from_ring = ReadSharedMemoryBytes(buffer, &buffer_index, num_to_fetch, sizes, samples_fetched);
+            if (num_from_ring > 0) {
+                samples_fetched += num_from_ring;
+                num_samples_read_ += num_from_ring;
+                num_empty_ring_polls = 0;
+                continue;
+            }
+            if (is_reading_from_ring_) {
+                if (samples_fetched >= min_samples) {
+                    break;
+                }
+                // Caught up to the writer, so wait for its next batch in the ring rather than in Redis.
+                if (++num_empty_ring_polls < RING_SPIN_POLLS) {
+                    std::this_thread::yield();
+                } else {
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                }
+                continue;
+            }
+        }
+
+        // When catching up on a stream, fetch contiguous data entries compressed in a single payload. Anything else
+        // (tombstones, EOFs) is left to the XRANGE/XREAD handling below; an empty stream is handled as an empty XRANGE.
+        bool packed_caught_up = false;
+        if (use_packed_reads_ && !should_xread) {
+            int64_t num_packed = ReadPackedBytes(
+                buffer, &buffer_index, num_to_fetch, sizes, keys, samples_fetched, &packed_caught_up);
+            if (num_packed > 0) {
+                samples_fetched += num_packed;
+                num_samples_read_ += num_packed;
+                continue;
+            }
+        }
+
         // NB: depending whether we XREAD or XRANGE, the data in reply is shaped differently, hence the need to split
         // out a separate "data_reply" pointer.
         internal::Redis::UniqueRedisReplyPtr reply;
-        redisReply *data_reply;
+        redisReply *data_reply = nullptr;
 
-        int num_elements_fetched;
-        if (should_xread) {
+        int num_elements_fetched = 0;
+        if (packed_caught_up) {
+            // The packed read already found nothing past the cursor; XRANGE would only find the same.
+        } else if (should_xread) {
             int64_t to_block = max(int64_t{1LL}, min(remaining_us / 1000 - redis_resolution_ms, int64_t{1000LL}));
             reply = redis_->Xread(
                 num_to_fetch,
@@ -164,6 +324,13 @@ int64_t StreamReader::ReadBytes(
         remaining_us = end_us - chrono::duration_cast<std::chrono::microseconds>(
                 chrono::steady_clock::now().time_since_epoch()).count();
         if (num_elements_fetched == 0) {
+            if (samples_fetched >= min_samples) {
+                break;
+            }
+            if (is_lossy_ && FastForwardIfStreamKeyTrimmed()) {
+                should_xread = false;
+                continue;
+            }
             if (remaining_us > redis_resolution_ms * 1000) {
                 should_xread = true;
             } else if (remaining_us > 0) {
@@ -178,17 +345,36 @@ int64_t StreamReader::ReadBytes(
 
         // Format of the reply is:
         // [ (key, (field1, value1, field2, value2, ...)), ... ]
+        bool stopped_at_gap = false;
         for (size_t i = 0; i < data_reply->elements; i++) {
             redisReply *element = data_reply->element[i]->element[1];
             int len;
             const char *value = FindField(element, "val", &len);
 
+            if (is_lossy_ && value != nullptr) {
+                int64_t sample_idx = GetSampleIndexOrThrow(element);
+                if (sample_idx > current_sample_idx_ + 1) {
+                    if (samples_fetched > 0) {
+                        // Return what we have so far, and resume at this sample on the next read.
+                        internal::DecodeCursor(data_reply->element[i]->element[0]->str, &cursor_.left, &cursor_.right);
+                        stopped_at_gap = true;
+                        break;
+                    }
+                    int64_t num_dropped = sample_idx - current_sample_idx_ - 1;
+                    spdlog::warn("Fell behind on lossy stream {}; skipping {} trimmed samples.",
+                                 stream_name_, num_dropped);
+                    total_samples_dropped_ += num_dropped;
+                }
+                current_sample_idx_ = sample_idx;
+            }
+
             if (value == nullptr) {
                 if (!this->decompressor_) {
                     continue;
                 }
 
-                if (lookahead_data_cache_index_ > (lookahead_data_cache_.size() - sample_size_)) {
+                int sample_num_bytes = NextLookaheadSampleSize();
+                if (sample_num_bytes < 0) {
                     if (FindField(element, "reference", nullptr) == nullptr) {
                         // This is a non-value field (like an EOF or tombstone), so skip.
                         continue;
@@ -199,12 +385,13 @@ int64_t StreamReader::ReadBytes(
                     throw StreamReaderException("Lookahead data cache empty, but expected an element.");
                 }
 
-                memcpy(
-                    &buffer[buffer_index],
-                    lookahead_data_cache_.data() + lookahead_data_cache_index_,
-                    sample_size_);
-                lookahead_data_cache_index_ += sample_size_;
-                buffer_index += sample_size_;
+                if (sizes != nullptr) {
+                    (*sizes)[samples_fetched] = sample_num_bytes;
+                }
+                if (keys != nullptr) {
+                    (*keys)[samples_fetched] = data_reply->element[i]->element[0]->str;
+                }
+                buffer_index += CopyNextLookaheadSample(&buffer[buffer_index]);
             } else {
                 if (sizes != nullptr) {
                     (*sizes)[samples_fetched] = len;
@@ -216,13 +403,11 @@ int64_t StreamReader::ReadBytes(
                 if (this->decompressor_) {
                     // Compressed stream but we're on an element with "val", meaning we need to repopulate our cache
                     // and extract out the relevant element we're on.
-                    lookahead_data_cache_ = decompressor_->decompress(value, len);
-                    memcpy(
-                        &buffer[buffer_index],
-                        lookahead_data_cache_.data(),
-                        sample_size_);
-                    lookahead_data_cache_index_ = sample_size_;
-                    buffer_index += sample_size_;
+                    LoadLookaheadCache(value, len, 0);
+                    if (sizes != nullptr) {
+                        (*sizes)[samples_fetched] = NextLookaheadSampleSize();
+                    }
+                    buffer_index += CopyNextLookaheadSample(&buffer[buffer_index]);
                 } else if (this->has_variable_width_field_) {
                     memcpy(&buffer[buffer_index], value, len);
                     buffer_index += len;
@@ -235,6 +420,10 @@ int64_t StreamReader::ReadBytes(
             num_samples_read_++;
         }
 
+        if (stopped_at_gap) {
+            break;
+        }
+
         redisReply *last_element = data_reply->element[data_reply->elements - 1];
 
         IncrementCursorFrom(last_element->element[0]->str);
@@ -288,16 +477,260 @@ int64_t StreamReader::ReadBytes(
   return samples_fetched;
 }
 
+int64_t StreamReader::ReadSharedMemoryBytes(char *buffer,
+                                            int64_t *buffer_index,
+                                            int64_t num_to_fetch,
+                                            int **sizes,
+                                            int64_t samples_fetched) {
+    if (ring_record_offset_ >= ring_record_.num_samples && !LoadNextRingRecord()) {
+        return 0;
+    }
+
+    int64_t num_samples = min(num_to_fetch, ring_record_.num_samples - ring_record_offset_);
+    int64_t num_bytes;
+    if (has_variable_width_field_) {
+        num_bytes = 0;
+        for (int64_t i = 0; i < num_samples; i++) {
+            int size;
+            memcpy(&size, ring_payload_.data() + sizeof(int) * (ring_record_offset_ + i), sizeof(int));
+            (*sizes)[samples_fetched + i] = size;
+            num_bytes += size;
+        }
+    } else {
+        num_bytes = num_samples * sample_size_;
+        if (sizes != nullptr) {
+            for (int64_t i = 0; i < num_samples; i++) {
+                (*sizes)[samples_fetched + i] = sample_size_;
+            }
+        }
+    }
+
+    const char *data = ring_payload_.data() + ring_record_.sizes_num_bytes + ring_record_data_index_;
+    memcpy(&buffer[*buffer_index], data, num_bytes);
+    *buffer_index += num_bytes;
+    ring_record_data_index_ += num_bytes;
+    ring_record_offset_ += num_samples;
+    current_sample_idx_ += num_samples;
+    return num_samples;
+}
+
+bool StreamReader::LoadNextRingRecord() {
+    using ReadResult = internal::SharedMemoryRing::ReadResult;
+
+    int64_t next_sample_idx = current_sample_idx_ + 1;
+    internal::SharedMemoryRingRecord header{};
+    while (true) {
+        auto result = shared_memory_ring_->ReadHeader(ring_position_, &header);
+        if (result == ReadResult::NOT_YET_PUBLISHED) {
+            return false;
+        }
+        if (result == ReadResult::OVERRUN) {
+            StopReadingFromRing("fell behind the writer");
+            ring_position_ = shared_memory_ring_->write_position();
+            return false;
+        }
+
+        if (header.num_samples < 0) {
+            // The writer has stopped, so there's nothing more to read from the ring; the EOF itself is read from Redis.
+            is_reading_from_ring_ = false;
+            shared_memory_ring_.reset();
+            return false;
+        }
+        if (next_sample_idx < header.first_sample_index) {
+            // Either Redis is still behind the ring, or the writer skipped a batch too large for the ring.
+            StopReadingFromRing("batch missing from the ring");
+            return false;
+        }
+        if (next_sample_idx < header.first_sample_index + header.num_samples) {
+            break;
+        }
+        // Already read from Redis.
+        ring_position_ += header.num_bytes;
+    }
+
+    if (shared_memory_ring_->Read(ring_position_, &ring_record_, &ring_payload_) != ReadResult::OK) {
+        StopReadingFromRing("fell behind the writer");
+        ring_position_ = shared_memory_ring_->write_position();
+        ring_record_ = {};
+        return false;
+    }
+    int64_t expected_data_num_bytes = sample_size_ * ring_record_.num_samples;
+    if ((has_variable_width_field_ && ring_record_.sizes_num_bytes != int64_t{sizeof(int)} * ring_record_.num_samples)
+        || (!has_variable_width_field_ && ring_record_.data_num_bytes != expected_data_num_bytes)) {
+        throw StreamReaderException(fmt::format("Malformed record in shared memory ring of stream {}.", stream_name_));
+    }
+    ring_position_ += ring_record_.num_bytes;
+
+    ring_record_offset_ = next_sample_idx - ring_record_.first_sample_index;
+    ring_record_data_index_ = 0;
+    for (int64_t i = 0; i < ring_record_offset_; i++) {
+        int size = sample_size_;
+        if (has_variable_width_field_) {
+            memcpy(&size, ring_payload_.data() + sizeof(int) * i, sizeof(int));
+        }
+        ring_record_data_index_ += size;
+    }
+
+    if (!is_reading_from_ring_) {
+        spdlog::info("Caught up to the writer of stream {}; reading from shared memory.", stream_name_);
+        is_reading_from_ring_ = true;
+    }
+    std::string stream_key = redis_->StreamKey(stream_name_, ring_record_.stream_key_idx);
+    if (stream_key != current_stream_key_) {
+        FireStreamKeyChange(current_stream_key_, stream_key);
+        current_stream_key_ = stream_key;
+    }
+    // Should we fall back to Redis, resume right after this record.
+    cursor_.left = ring_record_.last_id_ms;
+    cursor_.right = ring_record_.last_id_seq + 1;
+    return true;
+}
+
+void StreamReader::StopReadingFromRing(const char *reason) {
+    if (is_reading_from_ring_) {
+        spdlog::warn("Reading stream {} from Redis instead of shared memory: {}.", stream_name_, reason);
+        is_reading_from_ring_ = false;
+    }
+}
+
+void StreamReader::CloseSharedMemoryRing() {
+    int64_t num_unread = ring_record_.num_samples - ring_record_offset_;
+    if (num_unread > 0) {
+        // The cursor is after the record, whose unread samples are the last num_unread entries up to and including
+        // its last ID, as the writer adds each batch's entries contiguously. So resume after the entry before those.
+        auto reply = redis_->Xrevrange(
+            num_unread + 1, current_stream_key_,
+            fmt::format("{}-{}", ring_record_.last_id_ms, ring_record_.last_id_seq), 0, 0);
+        if (static_cast<int64_t>(reply->elements) == num_unread + 1) {
+            internal::DecodeCursor(reply->element[num_unread]->element[0]->str, &cursor_.left, &cursor_.right);
+            cursor_.right++;
+        } else {
+            // Nothing precedes the unread samples in their stream key, so read it from the start.
+            cursor_.left = 0;
+            cursor_.right = 0;
+        }
+    }
+    spdlog::info("Reading stream {} from Redis rather than shared memory, as keys were requested.", stream_name_);
+    is_reading_from_ring_ = false;
+    ring_record_ = {};
+    ring_record_offset_ = 0;
+    shared_memory_ring_.reset();
+}
+
+int64_t StreamReader::ReadPackedBytes(char *buffer,
+                                      int64_t *buffer_index,
+                                      int64_t num_to_fetch,
+                                      int **sizes,
+                                      std::string **keys,
+                                      int64_t samples_fetched,
+                                      bool *caught_up) {
+    *caught_up = false;
+    auto reply = redis_->XrangePacked(
+        num_to_fetch, current_stream_key_, cursor_.left, cursor_.right, WireCompressionName(wire_compression_));
+    if (reply->type == REDIS_REPLY_ERROR) {
+        throw StreamReaderException(fmt::format("RIVER.xrange_packed failed: {}", reply->str));
+    }
+    // NB: older modules reply without the 4th element, in which case an empty read is always retried via XRANGE.
+    if (reply->type != REDIS_REPLY_ARRAY || (reply->elements != 3 && reply->elements != 4)) {
+        throw StreamReaderException(fmt::format("Unexpected response received when fetching! Got reply type {}",
+                                                reply->type));
+    }
+
+    int64_t num_entries = reply->element[0]->integer;
+    if (num_entries <= 0) {
+        *caught_up = reply->elements == 4 && reply->element[3]->integer == 0;
+        return 0;
+    }
+    int64_t last_sample_index = reply->element[1]->integer;
+
+    // Layout: <n x (uint64 ms, uint64 seq) stream ids> <n x int32 value sizes> <n values, concatenated>
+    auto packed = internal::WireDecompress(wire_compression_, reply->element[2]->str, reply->element[2]->len);
+    size_t ids_num_bytes = sizeof(uint64_t) * 2 * num_entries;
+    size_t sizes_num_bytes = sizeof(int32_t) * num_entries;
+    if (packed.size() < ids_num_bytes + sizes_num_bytes) {
+        throw StreamReaderException("Packed payload was smaller than expected.");
+    }
+    const char *ids = packed.data();
+    const char *entry_sizes = ids + ids_num_bytes;
+    const char *values = entry_sizes + sizes_num_bytes;
+    const char *values_end = packed.data() + packed.size();
+
+    for (int64_t i = 0; i < num_entries; i++) {
+        int32_t len;
+        memcpy(&len, entry_sizes + sizeof(int32_t) * i, sizeof(int32_t));
+        if (len < 0 || values + len > values_end || (!has_variable_width_field_ && len != sample_size_)) {
+            throw StreamReaderException(fmt::format("Invalid sample size {} in packed payload.", len));
+        }
+
+        if (sizes != nullptr) {
+            (*sizes)[samples_fetched + i] = len;
+        }
+        if (keys != nullptr) {
+            uint64_t id[2];
+            memcpy(id, ids + sizeof(uint64_t) * 2 * i, sizeof(id));
+            (*keys)[samples_fetched + i] = fmt::format("{}-{}", id[0], id[1]);
+        }
+        memcpy(&buffer[*buffer_index], values, len);
+        *buffer_index += len;
+        values += len;
+    }
+
+    uint64_t last_id[2];
+    memcpy(last_id, ids + sizeof(uint64_t) * 2 * (num_entries - 1), sizeof(last_id));
+    cursor_.left = last_id[0];
+    cursor_.right = last_id[1] + 1;
+
+    if (last_sample_index < current_sample_idx_) {
+        throw StreamReaderException(fmt::format(
+            "Sample index {} was less than current sample idx of {} (stream {})",
+            last_sample_index, current_sample_idx_, stream_name_));
+    }
+    current_sample_idx_ = last_sample_index;
+    return num_entries;
+}
+
+bool StreamReader::FastForwardIfStreamKeyTrimmed() {
+    // Writers of lossy streams delete old stream keys outright (after first updating first_stream_key), so a reader
+    // that's fallen far enough behind can find its current key gone without ever seeing its tombstone. Checked at most
+    // every STREAM_KEY_TRIM_CHECK_INTERVAL_US, since an empty poll usually just means nothing new was written.
+    int64_t now_us = chrono::duration_cast<std::chrono::microseconds>(
+            chrono::steady_clock::now().time_since_epoch()).count();
+    if (last_stream_key_trim_check_us_ != 0
+        && now_us - last_stream_key_trim_check_us_ < STREAM_KEY_TRIM_CHECK_INTERVAL_US) {
+        return false;
+    }
+    last_stream_key_trim_check_us_ = now_us;
+
+    if (redis_->Exists(current_stream_key_)) {
+        return false;
+    }
+
+    auto metadata = redis_->GetMetadata(stream_name_);
+    if (!metadata) {
+        return false;
+    }
+    auto first_stream_key_it = metadata->find("first_stream_key");
+    if (first_stream_key_it == metadata->end() || first_stream_key_it->second == current_stream_key_) {
+        // E.g. nothing has been written to this stream yet.
+        return false;
+    }
+
+    spdlog::warn("Stream key {} was trimmed; fast-forwarding to {}", current_stream_key_, first_stream_key_it->second);
+    FireStreamKeyChange(current_stream_key_, first_stream_key_it->second);
+    current_stream_key_ = first_stream_key_it->second;
+    cursor_.left = 0;
+    cursor_.right = 0;
+    return true;
+}
+
 void StreamReader::ReloadLookaheadCache(const char *val_str, int val_str_len, const redisReply *values) {
     if (!decompressor_) {
         return;
     }
 
-    int64_t decompressed_sample_offset;
     if (val_str != nullptr) {
         // We got to the data sample that contains the encrypted value, so load it directly
-        decompressed_sample_offset = 0;
-        lookahead_data_cache_ = decompressor_->decompress(val_str, val_str_len);
+        LoadLookaheadCache(val_str, val_str_len, 0);
     } else {
         // We got a data sample that follows a compressed blob. There should be a "reference" key that
         // then references the source of truth
@@ -327,10 +760,76 @@ void StreamReader::ReloadLookaheadCache(const char *val_str, int val_str_len, co
         }
 
         auto reference_index = GetSampleIndexUnchecked(reference_values);
-        decompressed_sample_offset = current_sample_idx_ - reference_index;
-        lookahead_data_cache_ = decompressor_->decompress(compressed_blob_str, compressed_blob_len);
+        LoadLookaheadCache(compressed_blob_str, compressed_blob_len, current_sample_idx_ - reference_index,
+                           std::move(reference_reply));
+    }
+}
+
+void StreamReader::LoadLookaheadCache(const char *blob, int blob_len, int64_t sample_offset,
+                                      internal::Redis::UniqueRedisReplyPtr blob_reply) {
+    lookahead_blob_reply_.reset();
+    lookahead_blob_ = nullptr;
+    if (!has_variable_width_field_ && sample_offset > 0 && blob_reply && decompressor_->supports_random_access()) {
+        // Tailing or seeking into the middle of a batch, so just decompress the one sample that's about to be read. The
+        // rest stays in the reply rather than being copied out.
+        size_t offset = sample_offset * sample_size_;
+        decompressor_->decompress_range(blob, blob_len, offset, sample_size_, &lookahead_data_cache_);
+        lookahead_blob_reply_ = std::move(blob_reply);
+        lookahead_blob_ = blob;
+        lookahead_blob_len_ = blob_len;
+        lookahead_blob_offset_ = offset + lookahead_data_cache_.size();
+        lookahead_sample_index_ = sample_offset;
+        lookahead_data_cache_index_ = 0;
+        return;
     }
-    lookahead_data_cache_index_ = decompressed_sample_offset * sample_size_;
+
+    if (!has_variable_width_field_) {
+        decompressor_->decompress_into(blob, blob_len, &lookahead_data_cache_);
+        lookahead_sample_index_ = sample_offset;
+        lookahead_data_cache_index_ = sample_offset * sample_size_;
+        return;
+    }
+
+    lookahead_data_cache_index_ =
+        internal::DecodeVariableWidthBlock(decompressor_.get(), blob, blob_len, &lookahead_sizes_,
+                                           &lookahead_data_cache_);
+    if (sample_offset < 0 || sample_offset > static_cast<int64_t>(lookahead_sizes_.size())) {
+        throw StreamReaderException(fmt::format("Sample offset {} is out of range of a compressed batch of {} samples",
+                                                sample_offset, lookahead_sizes_.size()));
+    }
+    for (int64_t i = 0; i < sample_offset; i++) {
+        lookahead_data_cache_index_ += lookahead_sizes_[i];
+    }
+    lookahead_sample_index_ = sample_offset;
+}
+
+int StreamReader::NextLookaheadSampleSize() {
+    if (has_variable_width_field_) {
+        return lookahead_sample_index_ < static_cast<int64_t>(lookahead_sizes_.size())
+               ? lookahead_sizes_[lookahead_sample_index_] : -1;
+    }
+    if (lookahead_blob_ != nullptr
+        && lookahead_data_cache_index_ + sample_size_ > static_cast<int64_t>(lookahead_data_cache_.size())) {
+        // Reading on past the sample that was tailed or seeked to, so decompress the rest of its batch.
+        decompressor_->decompress_range(lookahead_blob_, lookahead_blob_len_, lookahead_blob_offset_,
+                                        SIZE_MAX, &lookahead_data_cache_);
+        lookahead_blob_reply_.reset();
+        lookahead_blob_ = nullptr;
+        lookahead_data_cache_index_ = 0;
+    }
+    return lookahead_data_cache_index_ + sample_size_ <= static_cast<int64_t>(lookahead_data_cache_.size())
+           ? sample_size_ : -1;
+}
+
+int StreamReader::CopyNextLookaheadSample(char *buffer) {
+    int sample_num_bytes = NextLookaheadSampleSize();
+    if (sample_num_bytes < 0) {
+        throw StreamReaderException("Lookahead data cache empty, but expected an element.");
+    }
+    memcpy(buffer, lookahead_data_cache_.data() + lookahead_data_cache_index_, sample_num_bytes);
+    lookahead_data_cache_index_ += sample_num_bytes;
+    lookahead_sample_index_++;
+    return sample_num_bytes;
 }
 
 int64_t StreamReader::TailBytes(char *buffer, int timeout_ms, char *key, int64_t *sample_index) {
@@ -339,6 +838,12 @@ int64_t StreamReader::TailBytes(char *buffer, int timeout_ms, char *key, int64_t
         spdlog::info(good_err_msg);
         return -1;
     }
+    if (shared_memory_ring_) {
+        // Tailing skips ahead via Redis; subsequent reads pick the ring back up once caught up to it.
+        is_reading_from_ring_ = false;
+        ring_record_ = {};
+        ring_position_ = shared_memory_ring_->write_position();
+    }
 
     int64_t end_us;
     if (timeout_ms <= 0) {
@@ -410,6 +915,10 @@ int64_t StreamReader::TailBytes(char *buffer, int timeout_ms, char *key, int64_t
         remaining_us = end_us - chrono::duration_cast<std::chrono::microseconds>(
                 chrono::steady_clock::now().time_since_epoch()).count();
         if (!did_read) {
+            if (is_lossy_ && FastForwardIfStreamKeyTrimmed()) {
+                should_xread = false;
+                continue;
+            }
             if (remaining_us > redis_resolution_ms * 1000) {
                 should_xread = true;
             } else if (remaining_us > 0) {
@@ -449,9 +958,7 @@ int64_t StreamReader::TailBytes(char *buffer, int timeout_ms, char *key, int64_t
             // itself and instead has a "reference" to the key where the data exists.
             if (decompressor_) {
                 ReloadLookaheadCache(val_str, len, values);
-                auto data_start = lookahead_data_cache_.data() + lookahead_data_cache_index_;
-                memcpy(buffer, lookahead_data_cache_.data() + lookahead_data_cache_index_, sample_size_);
-                lookahead_data_cache_index_ += sample_size_;
+                CopyNextLookaheadSample(buffer);
             }  else if (this->has_variable_width_field_) {
                 memcpy(buffer, val_str, len);
             } else {
@@ -510,6 +1017,9 @@ int64_t StreamReader::Seek(const std::string &key) {
         spdlog::info(err);
         return -1;
     }
+    if (use_shared_memory_) {
+        throw StreamReaderException("Seek() isn't supported when reading via shared memory.");
+    }
 
     while (true) {
         auto reply = redis_->Xrevrange(
@@ -600,6 +1110,12 @@ unique_ptr<unordered_map<std::string, std::string>> StreamReader::RetryablyFetch
         return maybe_metadata;
     } while (chrono::duration_cast<std::chrono::milliseconds>(
             chrono::steady_clock::now().time_since_epoch()).count() < end_ms);
+
+    // A replica might just not have the stream yet (e.g. if its writer was just initialized), so give it a chance to
+    // catch up before declaring the stream nonexistent.
+    if (redis_->is_replica() && redis_->CatchUpToPrimary(REPLICA_CATCH_UP_TIMEOUT_MS)) {
+        return redis_->GetMetadata(stream_name);
+    }
     return unique_ptr<unordered_map<std::string, std::string>>();
 }
 
@@ -617,6 +1133,7 @@ void StreamReader::Stop() {
     if (redis_) {
       redis_.reset();
     }
+    shared_memory_ring_.reset();
 }
 
 void StreamReader::AddListener(internal::StreamReaderListener *listener) {
@@ -13,8 +13,11 @@
 #include <vector>
 #include <cstring>
 #include <memory>
+#include <unordered_map>
+#include <utility>
 #include "schema.h"
 #include "redis.h"
+#include "shared_memory_ring.h"
 #include "compression/compressor_types.h"
 
 namespace river {
@@ -42,6 +45,81 @@ class StreamDoesNotExistException : public StreamReaderException {
     using StreamReaderException::StreamReaderException;
 };
 
+/**
+ * How StreamReader#ReadColumns() converts a field on its way out, e.g. raw INT16 samples to FLOAT in physical units.
+ * Any numeric field can be converted to FLOAT or DOUBLE; each value is multiplied by `scale`.
+ */
+struct ColumnConversion {
+    FieldDefinition::Type type;
+    double scale;
+
+    explicit ColumnConversion(FieldDefinition::Type type_, double scale_ = 1.0) : type(type_), scale(scale_) {}
+};
+
+class StreamReaderParamsBuilder;
+class StreamReaderParams {
+public:
+    RedisConnection connection;
+    int max_fetch_size;
+    WireCompression wire_compression;
+    bool shared_memory;
+private:
+    StreamReaderParams(RedisConnection _connection,
+                       int _max_fetch_size,
+                       WireCompression _wire_compression,
+                       bool _shared_memory) :
+        connection(std::move(_connection)),
+        max_fetch_size(_max_fetch_size),
+        wire_compression(_wire_compression),
+        shared_memory(_shared_memory) {}
+    friend StreamReaderParamsBuilder;
+};
+
+class StreamReaderParamsBuilder {
+public:
+    StreamReaderParamsBuilder &connection(const RedisConnection &connection) {
+        connection_ = std::make_unique<RedisConnection>(connection);
+        return *this;
+    }
+    StreamReaderParamsBuilder &max_fetch_size(int max_fetch_size) {
+        max_fetch_size_ = max_fetch_size;
+        return *this;
+    }
+    /**
+     * Compresses data in flight from Redis, reducing bandwidth for readers on slow links. Only takes effect if the
+     * River module is installed (and built with the codec) and the stream is otherwise uncompressed.
+     */
+    StreamReaderParamsBuilder &wire_compression(WireCompression wire_compression) {
+        wire_compression_ = wire_compression;
+        return *this;
+    }
+    /**
+     * Reads samples from the writer's shared memory ring (see StreamWriterParamsBuilder#shared_memory_ring_bytes())
+     * when on the same host as the writer, once this reader has caught up to it via Redis. Reading from Redis resumes
+     * whenever the ring can't serve the next sample, e.g. after falling too far behind. While caught up, reads
+     * busy-poll the ring for new samples. Samples read from the ring don't have their keys at hand, so the first read
+     * that asks for keys closes the ring, and this reader reads from Redis from then on. Seek() isn't supported when
+     * enabled.
+     */
+    StreamReaderParamsBuilder &shared_memory(bool shared_memory) {
+        shared_memory_ = shared_memory;
+        return *this;
+    }
+
+    StreamReaderParams build() {
+        if (!connection_) {
+            throw std::invalid_argument("Need to provide a connection!");
+        }
+        return {*connection_, max_fetch_size_, wire_compression_, shared_memory_};
+    }
+
+private:
+    std::unique_ptr<RedisConnection> connection_;
+    int max_fetch_size_ = 10000;
+    WireCompression wire_compression_ = WireCompression::NONE;
+    bool shared_memory_ = false;
+};
+
 /**
  * The main entry point for River for reading an existing stream. This class is initialized with a stream name
  * corresponding to an existing stream, and allows for batch consumption of the stream. Reads requesting more data than
@@ -59,7 +137,14 @@ public:
      * @param max_fetch_size: maximum number of elements to fetch from redis at a time (to prevent untenably large
      * batches if a large number of bytes are consumed).
      */
-    explicit StreamReader(const RedisConnection& connection, const int max_fetch_size = 10000);
+    explicit StreamReader(const RedisConnection& connection, const int max_fetch_size = 10000) :
+        StreamReader(
+            StreamReaderParamsBuilder()
+                .connection(connection)
+                .max_fetch_size(max_fetch_size)
+                .build()) {}
+
+    explicit StreamReader(const StreamReaderParams& params);
 
     /**
      * Initialize this reader to a particular stream. If timeout_ms is positive, this call will wait for up to
@@ -161,6 +246,21 @@ public:
                       char *key = nullptr,
                       int64_t *sample_index = nullptr);
 
+    /**
+     * Like #ReadBytes(), but reads into one array per field of the schema, in the schema's field order, rather than
+     * into packed samples. Only for schemas without variable-width fields.
+     *
+     * @param columns Each column must hold num_samples values of its field's size, or of the converted type's size
+     * if given in `conversions`. Fields whose column is null are skipped.
+     * @param conversions Fields, by name, to convert rather than copy as is.
+     * @return the number of samples read into each column, or -1 on EOF; see #ReadBytes().
+     */
+    int64_t ReadColumns(void **columns,
+                        int64_t num_samples,
+                        const std::unordered_map<std::string, ColumnConversion> &conversions =
+                        std::unordered_map<std::string, ColumnConversion>(),
+                        int timeout_ms = -1);
+
     /**
      * Seeks the internal cursor to the given key. Any elements returned by read/tail will be *after* this element.
      *
@@ -216,6 +316,23 @@ public:
         return num_samples_read_;
     }
 
+    /**
+     * Whether this stream is lossy, i.e. was written as a ring buffer that only retains recent samples. For such
+     * streams, samples that were trimmed before this reader got to them are skipped.
+     */
+    bool is_lossy() {
+        return is_lossy_;
+    }
+
+    /**
+     * Number of samples skipped because they were trimmed from a lossy stream before they could be read. A read never
+     * spans such a gap: every call returns a contiguous run of samples, with any skipped samples counted here before
+     * the first sample returned.
+     */
+    int64_t total_samples_dropped() {
+        return total_samples_dropped_;
+    }
+
     /**
      * Add a listener to this reader. Can be called at any point, even before initialization of the stream. See
      * StreamReaderListener for more details.
@@ -251,6 +368,19 @@ public:
     void Stop();
 
 private:
+    friend class StreamBroadcaster;
+
+    /**
+     * Like the public #ReadBytes(), but returns as soon as at least `min_samples` samples have been read and no more
+     * are immediately available.
+     */
+    int64_t ReadBytes(char *buffer,
+                      int64_t num_samples,
+                      int **sizes,
+                      std::string **keys,
+                      int timeout_ms,
+                      int64_t min_samples);
+
     std::unique_ptr<internal::Redis> redis_;
 
     const int max_fetch_size_;
@@ -265,9 +395,66 @@ private:
     std::unique_ptr<Decompressor> decompressor_;
     StreamCompression compression_;
 
+    WireCompression wire_compression_;
+    // Whether to fetch data entries via RIVER.xrange_packed; decided on Initialize().
+    bool use_packed_reads_{};
+    // Sets *caught_up if the stream had nothing past the cursor, in which case there's no need to XRANGE for it.
+    int64_t ReadPackedBytes(char *buffer,
+                            int64_t *buffer_index,
+                            int64_t num_to_fetch,
+                            int **sizes,
+                            std::string **keys,
+                            int64_t samples_fetched,
+                            bool *caught_up);
+
+    const bool use_shared_memory_;
+    // Only set if the stream's writer is publishing to a ring on this host.
+    std::unique_ptr<internal::SharedMemoryRing> shared_memory_ring_;
+    // Position in the ring of the next record to read.
+    uint64_t ring_position_{};
+    // Whether this reader has caught up to the ring, and thus reads from it rather than Redis.
+    bool is_reading_from_ring_{};
+    // The record being read from the ring, of which ring_record_offset_ samples have been read so far.
+    internal::SharedMemoryRingRecord ring_record_{};
+    std::vector<char> ring_payload_;
+    int64_t ring_record_offset_{};
+    int64_t ring_record_data_index_{};
+    int64_t ReadSharedMemoryBytes(char *buffer,
+                                  int64_t *buffer_index,
+                                  int64_t num_to_fetch,
+                                  int **sizes,
+                                  int64_t samples_fetched);
+    bool LoadNextRingRecord();
+    void StopReadingFromRing(const char *reason);
+    // Closes the ring for good, resuming from Redis right after the last sample read.
+    void CloseSharedMemoryRing();
+
     std::vector<char> lookahead_data_cache_;
-    int64_t lookahead_data_cache_index_;
+    int64_t lookahead_data_cache_index_{};
+    // For variable-width streams, the sizes of the samples in lookahead_data_cache_.
+    std::vector<int> lookahead_sizes_;
+    int64_t lookahead_sample_index_{};
+    // For compressions that support random access, tailing or seeking into the middle of a batch only decompresses the
+    // sample read; the reply holding the batch is kept here, along with the offset of the rest of it, in case more of
+    // it is read.
+    internal::Redis::UniqueRedisReplyPtr lookahead_blob_reply_;
+    const char *lookahead_blob_{};
+    size_t lookahead_blob_len_{};
+    size_t lookahead_blob_offset_{};
+
+    // Reused by ReadColumns() for the packed samples, and for the fields it converts before they're converted.
+    std::vector<char> column_read_buffer_;
+    std::vector<char> column_conversion_buffer_;
     void ReloadLookaheadCache(const char *val_str, int val_str_len, const redisReply *values);
+    // blob_reply, if given, is the reply that blob points into; only then can part of the blob be decompressed, with the
+    // reply kept for the rest.
+    void LoadLookaheadCache(const char *blob, int blob_len, int64_t sample_offset,
+                            internal::Redis::UniqueRedisReplyPtr blob_reply = {});
+    // Size of the next sample in the lookahead cache, or -1 if it's exhausted. Decompresses the rest of a partially
+    // decompressed batch if need be.
+    int NextLookaheadSampleSize();
+    // Copies out the next sample in the lookahead cache and returns its size; throws if it's exhausted.
+    int CopyNextLookaheadSample(char *buffer);
 
     std::vector<internal::StreamReaderListener *> listeners_;
 
@@ -281,6 +468,12 @@ private:
     int64_t current_sample_idx_;
     int64_t num_samples_read_;
 
+    bool is_lossy_{};
+    int64_t total_samples_dropped_{};
+    // When FastForwardIfStreamKeyTrimmed() last checked Redis, in steady-clock microseconds.
+    int64_t last_stream_key_trim_check_us_{};
+    bool FastForwardIfStreamKeyTrimmed();
+
     void FireStreamKeyChange(const std::string &old_stream_key, const std::string &new_stream_key);
 
     std::unique_ptr<std::unordered_map<std::string, std::string>> RetryablyFetchMetadata(
@@ -3,14 +3,25 @@
 //
 
 #include "redis.h"
+#include "redis_functions.h"
 #include <hiredis.h>
 #include <iostream>
 #include <nlohmann/json.hpp>
 #include <regex>
+#include <algorithm>
+#include <cstdarg>
+#include <cstring>
+#include <thread>
 #include <spdlog/fmt/fmt.h>
 #include <spdlog/spdlog.h>
 
 #include "net/sockcompat.h"
+#if defined(__linux__)
+#include <linux/errqueue.h>
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#define RIVER_HAS_ZEROCOPY
+#endif
+#endif
 #if defined(_WIN32) || defined(_WIN64)
 #include <windows.h>
 #endif
@@ -21,18 +32,128 @@ using namespace std;
 namespace river {
 namespace internal {
 
-unique_ptr<Redis> Redis::Create(const RedisConnection &connection) {
+static const int NUM_CLUSTER_SLOTS = 16384;
+static const int MAX_CLUSTER_REDIRECTS = 5;
+// How long to wait for MSG_ZEROCOPY completions when the connection has no timeout of its own.
+static const int DEFAULT_ZERO_COPY_TIMEOUT_MS = 30 * 1000;
+
+// CRC16-CCITT (XMODEM), as used by Redis Cluster for key slots.
+static uint16_t Crc16(const char *buf, size_t len) {
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t) ((uint8_t) buf[i]) << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t) ((crc << 1) ^ 0x1021) : (uint16_t) (crc << 1);
+        }
+    }
+    return crc;
+}
+
+int ClusterKeySlot(const string &key) {
+    // Only hash whatever is between the first { and the next }, if nonempty.
+    size_t tag_start = key.find('{');
+    if (tag_start != string::npos) {
+        size_t tag_end = key.find('}', tag_start + 1);
+        if (tag_end != string::npos && tag_end > tag_start + 1) {
+            return Crc16(key.data() + tag_start + 1, tag_end - tag_start - 1) & (NUM_CLUSTER_SLOTS - 1);
+        }
+    }
+    return Crc16(key.data(), key.size()) & (NUM_CLUSTER_SLOTS - 1);
+}
+
+bool ParseClusterRedirect(const redisReply *reply, string *endpoint, bool *is_ask) {
+    if (reply == nullptr || reply->type != REDIS_REPLY_ERROR) {
+        return false;
+    }
+    string error(reply->str, reply->len);
+    bool is_moved = error.rfind("MOVED ", 0) == 0;
+    *is_ask = error.rfind("ASK ", 0) == 0;
+    if (!is_moved && !*is_ask) {
+        return false;
+    }
+    *endpoint = error.substr(error.rfind(' ') + 1);
+    return true;
+}
+
+vector<pair<const char *, size_t>> SliceParts(const vector<pair<const char *, size_t>> &parts,
+                                              size_t start, size_t end) {
+    vector<pair<const char *, size_t>> ret;
+    size_t part_start = 0;
+    for (const auto &part : parts) {
+        size_t part_end = part_start + part.second;
+        if (part_end > start && part_start < end) {
+            size_t from = std::max(start, part_start);
+            size_t to = std::min(end, part_end);
+            ret.emplace_back(part.first + (from - part_start), to - from);
+        }
+        part_start = part_end;
+    }
+    return ret;
+}
+
+// Throws unless the reply to ASKING is +OK, as otherwise the command that follows would just be redirected again.
+static void CheckAskingReply(const redisReply *reply, const string &endpoint) {
+    if (reply == nullptr) {
+        throw RedisException(fmt::format("Null response to ASKING from {}.", endpoint));
+    }
+    if (reply->type != REDIS_REPLY_STATUS || string(reply->str, reply->len) != "OK") {
+        throw RedisException(fmt::format(
+            "Error sending ASKING to {}: {}", endpoint,
+            reply->type == REDIS_REPLY_ERROR ? string(reply->str, reply->len) : std::to_string(reply->type)));
+    }
+}
+
+static void SetSocketOption(redisContext *context, int level, int option, int value, const char *name) {
+    if (setsockopt(context->fd, level, option, (const char *) &value, sizeof(value)) != 0) {
+        spdlog::warn("Failed to set socket option {}={} [errno {}].", name, value, errno);
+    }
+}
+
+static void ApplySocketOptions(redisContext *context, const RedisSocketOptions &options, bool is_tcp) {
+    if (is_tcp) {
+        SetSocketOption(context, IPPROTO_TCP, TCP_NODELAY, options.tcp_nodelay ? 1 : 0, "TCP_NODELAY");
+    }
+    if (options.send_buffer_bytes > 0) {
+        SetSocketOption(context, SOL_SOCKET, SO_SNDBUF, options.send_buffer_bytes, "SO_SNDBUF");
+    }
+    if (options.receive_buffer_bytes > 0) {
+        SetSocketOption(context, SOL_SOCKET, SO_RCVBUF, options.receive_buffer_bytes, "SO_RCVBUF");
+    }
+    if (options.busy_poll_us > 0) {
+#ifdef SO_BUSY_POLL
+        SetSocketOption(context, SOL_SOCKET, SO_BUSY_POLL, options.busy_poll_us, "SO_BUSY_POLL");
+#else
+        spdlog::warn("Busy polling isn't supported on this platform; ignoring.");
+#endif
+    }
+    if (options.zero_copy_send && is_tcp) {
+#ifdef RIVER_HAS_ZEROCOPY
+        SetSocketOption(context, SOL_SOCKET, SO_ZEROCOPY, 1, "SO_ZEROCOPY");
+#else
+        spdlog::warn("MSG_ZEROCOPY isn't supported on this platform; sending with copies.");
+#endif
+    }
+}
+
+redisContext *Redis::Connect(const RedisConnection &connection, const string &hostname, int port,
+                             const string &unix_socket_path) {
     struct timeval timeout = {connection.timeout_seconds(), 0};
-    std::string redis_hostname = connection.redis_hostname();
-    redisContext *new_context = redisConnectWithTimeout(
-        redis_hostname.c_str(), connection.redis_port(), timeout);
+    const bool is_tcp = unix_socket_path.empty();
+    redisContext *new_context = is_tcp
+                                ? redisConnectWithTimeout(hostname.c_str(), port, timeout)
+                                : redisConnectUnixWithTimeout(unix_socket_path.c_str(), timeout);
     if (new_context == nullptr || new_context->err) {
-        string msg = fmt::format("Connection error to host:port={}:{}, err={}",
-                                 redis_hostname, connection.redis_port(),
-                                 new_context != nullptr ? new_context->errstr : "NULL");
+        string msg = is_tcp
+                     ? fmt::format("Connection error to host:port={}:{}, err={}",
+                                   hostname, port,
+                                   new_context != nullptr ? new_context->errstr : "NULL")
+                     : fmt::format("Connection error to unix socket {}, err={}",
+                                   unix_socket_path,
+                                   new_context != nullptr ? new_context->errstr : "NULL");
         redisFree(new_context);
         throw RedisException(msg);
     }
+    ApplySocketOptions(new_context, connection.socket_options(), is_tcp);
 
     auto redis_password = connection.redis_password();
     if (connection.redis_password().length() > 0) {
@@ -55,19 +176,308 @@ unique_ptr<Redis> Redis::Create(const RedisConnection &connection) {
         spdlog::info("AUTH response: {}", reply_str);
         freeReplyObject(reply);
     }
+    return new_context;
+}
+
+unique_ptr<Redis> Redis::Create(const RedisConnection &connection) {
+    redisContext *new_context = Connect(connection, connection.redis_hostname(), connection.redis_port(),
+                                        connection.unix_socket_path());
+
+    bool is_cluster = false;
+    auto *reply = (redisReply *) redisCommand(new_context, "INFO cluster");
+    if (reply != nullptr && reply->type == REDIS_REPLY_STRING) {
+        is_cluster = string(reply->str, reply->len).find("cluster_enabled:1") != string::npos;
+    }
+    if (reply != nullptr) {
+        freeReplyObject(reply);
+    }
+    if (is_cluster) {
+        spdlog::info("Connected to a Redis Cluster via {}:{}.", connection.redis_hostname(), connection.redis_port());
+    }
 
-    auto *redis = new Redis(new_context);
+    auto *redis = new Redis(new_context, connection, is_cluster);
     return unique_ptr<Redis>(redis);
 }
 
+// Value of the given field in an INFO reply (lines of "<field>:<value>"), or empty if absent.
+static string InfoField(const string &info, const string &field) {
+    const string prefix = field + ":";
+    size_t start = info.rfind(prefix, 0) == 0 ? 0 : info.find("\n" + prefix);
+    if (start == string::npos) {
+        return "";
+    }
+    start = info.find(':', start) + 1;
+    size_t end = info.find_first_of("\r\n", start);
+    return info.substr(start, end == string::npos ? string::npos : end - start);
+}
+
+static string InfoReplication(redisContext *context) {
+    auto *reply = (redisReply *) redisCommand(context, "INFO replication");
+    if (reply == nullptr || reply->type != REDIS_REPLY_STRING) {
+        string msg = fmt::format("Error fetching INFO replication. Reply: {}",
+                                 reply == nullptr ? "NULL" : to_string(reply->type));
+        if (reply != nullptr) {
+            freeReplyObject(reply);
+        }
+        throw RedisException(msg);
+    }
+    string ret(reply->str, reply->len);
+    freeReplyObject(reply);
+    return ret;
+}
+
+unique_ptr<Redis> Redis::CreateForReads(const RedisConnection &connection) {
+    unique_ptr<Redis> primary = Create(connection.PrimaryOnly());
+    if (connection.read_endpoints().empty()) {
+        return primary;
+    }
+    if (primary->is_cluster()) {
+        spdlog::warn("Read endpoints aren't supported for Redis Cluster; reading from the primaries.");
+        return primary;
+    }
+
+    for (const auto &endpoint : connection.read_endpoints()) {
+        redisContext *context;
+        try {
+            context = Connect(connection, endpoint.hostname, endpoint.port);
+        } catch (const RedisException &e) {
+            spdlog::warn("Skipping read endpoint {}:{}: {}", endpoint.hostname, endpoint.port, e.what());
+            continue;
+        }
+
+        string info;
+        try {
+            info = InfoReplication(context);
+        } catch (const RedisException &e) {
+            spdlog::warn("Skipping read endpoint {}:{}: {}", endpoint.hostname, endpoint.port, e.what());
+            redisFree(context);
+            continue;
+        }
+        // A replica whose link to the primary is down could be arbitrarily stale.
+        if (InfoField(info, "role") != "slave" || InfoField(info, "master_link_status") != "up") {
+            spdlog::warn("Skipping read endpoint {}:{}, as it isn't a healthy replica [role={}, master_link_status={}].",
+                         endpoint.hostname, endpoint.port, InfoField(info, "role"),
+                         InfoField(info, "master_link_status"));
+            redisFree(context);
+            continue;
+        }
+
+        RedisConnection replica_connection(
+                endpoint.hostname, endpoint.port, connection.redis_password(), connection.timeout_seconds());
+        replica_connection.SetSocketOptions(connection.socket_options());
+        auto *redis = new Redis(context, replica_connection, false);
+        redis->primary_ = std::move(primary);
+        return unique_ptr<Redis>(redis);
+    }
+
+    spdlog::warn("No healthy read endpoints found; reading from the primary.");
+    return primary;
+}
+
+int64_t Redis::ReplicationOffset() {
+    string offset = InfoField(InfoReplication(_context), "master_repl_offset");
+    if (offset.empty()) {
+        throw RedisException("INFO replication is missing master_repl_offset.");
+    }
+    return strtoll(offset.c_str(), nullptr, 10);
+}
+
+int Redis::WaitForReplicas(int num_replicas, int timeout_ms) {
+    auto *reply = (redisReply *) redisCommand(_context, "WAIT %d %d", num_replicas, timeout_ms);
+    if (reply == nullptr || reply->type != REDIS_REPLY_INTEGER) {
+        string msg = fmt::format("Error waiting for replicas. Reply: {}",
+                                 reply == nullptr ? "NULL" : to_string(reply->type));
+        if (reply != nullptr) {
+            freeReplyObject(reply);
+        }
+        throw RedisException(msg);
+    }
+    int ret = static_cast<int>(reply->integer);
+    freeReplyObject(reply);
+    return ret;
+}
+
+bool Redis::CatchUpToPrimary(int timeout_ms) {
+    if (!primary_) {
+        return true;
+    }
+    int64_t primary_offset = primary_->ReplicationOffset();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (ReplicationOffset() < primary_offset) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+string Redis::MetadataKey(const string &stream_name) const {
+    return is_cluster_ ? fmt::format("{{{}}}-metadata", stream_name) : fmt::format("{}-metadata", stream_name);
+}
+
+string Redis::StreamKey(const string &stream_name, int64_t stream_key_idx) const {
+    return fmt::format("{}-{}", StreamKeyPrefix(stream_name), stream_key_idx);
+}
+
+string Redis::StreamKeyPrefix(const string &stream_name) const {
+    return is_cluster_ ? fmt::format("{{{}}}", stream_name) : stream_name;
+}
+
+redisContext *Redis::NodeContext(const string &endpoint) {
+    auto it = node_contexts_.find(endpoint);
+    if (it != node_contexts_.end()) {
+        return it->second;
+    }
+
+    size_t separator = endpoint.rfind(':');
+    if (separator == string::npos) {
+        throw RedisException(fmt::format("Invalid cluster node endpoint {}", endpoint));
+    }
+    string hostname = endpoint.substr(0, separator);
+    if (hostname.empty() || hostname == "?") {
+        // Nodes that don't know their own address are reachable at the one we connected to.
+        hostname = connection_->redis_hostname();
+    }
+    int port = stoi(endpoint.substr(separator + 1));
+    redisContext *context = Connect(*connection_, hostname, port);
+    // A new socket can reuse the fd of one closed since, so don't trust what was cached for it.
+    zero_copy_enabled_by_fd_.erase(context->fd);
+    node_contexts_[endpoint] = context;
+    return context;
+}
+
+void Redis::FreeContext(redisContext *context) {
+    if (context == nullptr) {
+        return;
+    }
+    zero_copy_enabled_by_fd_.erase(context->fd);
+    if (zero_copy_pending_ > 0 && zero_copy_pending_fd_ == context->fd) {
+        // Completions of a closed socket never arrive.
+        zero_copy_pending_ = 0;
+    }
+    redisFree(context);
+}
+
+void Redis::RefreshClusterSlots() {
+    UniqueRedisReplyPtr reply((redisReply *) redisCommand(_context, "CLUSTER SLOTS"));
+    if (reply == nullptr || reply->type != REDIS_REPLY_ARRAY) {
+        throw RedisException(fmt::format(
+                "Array response expected for CLUSTER SLOTS. Reply: {}",
+                reply == nullptr ? "NULL" : to_string(reply->type)));
+    }
+
+    vector<string> slot_endpoints(NUM_CLUSTER_SLOTS);
+    for (size_t i = 0; i < reply->elements; i++) {
+        // Each element is [start slot, end slot, [master host, master port, ...], replicas...]
+        const redisReply *range = reply->element[i];
+        if (range->type != REDIS_REPLY_ARRAY || range->elements < 3
+            || range->element[2]->type != REDIS_REPLY_ARRAY || range->element[2]->elements < 2) {
+            throw RedisException("Unexpected format of CLUSTER SLOTS reply.");
+        }
+        const redisReply *master = range->element[2];
+        string endpoint = fmt::format("{}:{}", string(master->element[0]->str, master->element[0]->len),
+                                      master->element[1]->integer);
+        for (long long slot = range->element[0]->integer; slot <= range->element[1]->integer; slot++) {
+            slot_endpoints[slot] = endpoint;
+        }
+    }
+    slot_endpoints_ = std::move(slot_endpoints);
+    slots_stale_ = false;
+}
+
+vector<redisContext *> Redis::MasterContexts() {
+    if (!is_cluster_) {
+        return {_context};
+    }
+    if (slots_stale_) {
+        RefreshClusterSlots();
+    }
+    vector<string> endpoints(slot_endpoints_.begin(), slot_endpoints_.end());
+    std::sort(endpoints.begin(), endpoints.end());
+    endpoints.erase(std::unique(endpoints.begin(), endpoints.end()), endpoints.end());
+
+    vector<redisContext *> ret;
+    for (const auto &endpoint : endpoints) {
+        if (!endpoint.empty()) {
+            ret.push_back(NodeContext(endpoint));
+        }
+    }
+    return ret;
+}
+
+void Redis::RouteToKey(const string &key) {
+    if (!is_cluster_) {
+        return;
+    }
+    if (slots_stale_) {
+        RefreshClusterSlots();
+    }
+    const string &endpoint = slot_endpoints_[ClusterKeySlot(key)];
+    if (endpoint.empty()) {
+        throw RedisException(fmt::format("No cluster node serves the slot of key {}.", key));
+    }
+    _context = NodeContext(endpoint);
+}
+
+redisReply *Redis::ExecuteForKey(const string &key, const std::function<redisReply *(redisContext *)> &command) {
+    RouteToKey(key);
+    if (!is_cluster_) {
+        return command(_context);
+    }
+
+    for (int num_redirects = 0;; num_redirects++) {
+        redisReply *reply = command(_context);
+        string endpoint;
+        bool is_ask;
+        if (num_redirects >= MAX_CLUSTER_REDIRECTS || !ParseClusterRedirect(reply, &endpoint, &is_ask)) {
+            return reply;
+        }
+        freeReplyObject(reply);
+
+        redisContext *target = NodeContext(endpoint);
+        if (!is_ask) {
+            // The slot has permanently moved, and likely others with it.
+            RefreshClusterSlots();
+            _context = target;
+            continue;
+        }
+
+        // The slot is mid-migration: only this command goes to the target node, and it must be preceded by ASKING.
+        UniqueRedisReplyPtr asking_reply((redisReply *) redisCommand(target, "ASKING"));
+        CheckAskingReply(asking_reply.get(), endpoint);
+        return command(target);
+    }
+}
+
+redisReply *Redis::CommandForKey(const string &key, const char *format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    redisReply *reply = ExecuteForKey(key, [&](redisContext *context) {
+        va_list ap_copy;
+        va_copy(ap_copy, ap);
+        auto *r = (redisReply *) redisvCommand(context, format, ap_copy);
+        va_end(ap_copy);
+        return r;
+    });
+    va_end(ap);
+    return reply;
+}
+
+redisReply *Redis::CommandArgvForKey(const string &key, int argc, const char **argv, const size_t *argvlen) {
+    return ExecuteForKey(key, [&](redisContext *context) {
+        return (redisReply *) redisCommandArgv(context, argc, argv, argvlen);
+    });
+}
+
 Redis::UniqueRedisReplyPtr Redis::Xread(
         int64_t num_to_fetch,
         int timeout_ms,
         const string &stream_name,
         uint64_t key_part1,
         uint64_t key_part2) {
-    auto *reply = (redisReply *) redisCommand(
-            _context, "XREAD COUNT %d BLOCK %lld STREAMS %s %llu-%llu",
+    auto *reply = CommandForKey(
+            stream_name, "XREAD COUNT %d BLOCK %lld STREAMS %s %llu-%llu",
             num_to_fetch,
             timeout_ms,
             stream_name.c_str(),
@@ -88,8 +498,8 @@ Redis::UniqueRedisReplyPtr Redis::Xrange(
         const string &stream_name,
         uint64_t key_part1,
         uint64_t key_part2) {
-    auto reply = (redisReply *) redisCommand(
-            _context, "XRANGE %s %llu-%llu + COUNT %lld",
+    auto reply = CommandForKey(
+            stream_name, "XRANGE %s %llu-%llu + COUNT %lld",
             stream_name.c_str(),
             key_part1,
             key_part2,
@@ -104,14 +514,37 @@ Redis::UniqueRedisReplyPtr Redis::Xrange(
     return UniqueRedisReplyPtr(reply);
 }
 
+Redis::UniqueRedisReplyPtr Redis::XrangePacked(
+        int64_t num_to_fetch,
+        const string &stream_name,
+        uint64_t key_part1,
+        uint64_t key_part2,
+        const string &codec) {
+    auto reply = CommandForKey(
+            stream_name, "RIVER.xrange_packed %s %llu-%llu %lld %s",
+            stream_name.c_str(),
+            key_part1,
+            key_part2,
+            num_to_fetch,
+            codec.c_str());
+    if (reply == nullptr) {
+        throw RedisException(
+                fmt::format("Null response received when fetching! err={}, errstr={}",
+                            _context->err,
+                            _context->errstr));
+    }
+
+    return UniqueRedisReplyPtr(reply);
+}
+
 Redis::UniqueRedisReplyPtr Redis::Xrevrange(
         int64_t num_to_fetch,
         const string &stream_name,
         const string &key_left,
         uint64_t key_right_part1,
         uint64_t key_right_part2) {
-    auto *reply = (redisReply *) redisCommand(
-            _context,
+    auto *reply = CommandForKey(
+            stream_name,
             "XREVRANGE %s %s %llu-%llu COUNT %d",
             stream_name.c_str(),
             key_left.c_str(),
@@ -134,7 +567,8 @@ Redis::UniqueRedisReplyPtr Redis::Xrevrange(
 
 
 unique_ptr<unordered_map<string, string>> Redis::GetMetadata(const string &stream_name) {
-    auto *reply = (redisReply *) redisCommand(_context, "HGETALL %s-metadata", stream_name.c_str());
+    const string metadata_key = MetadataKey(stream_name);
+    auto *reply = CommandForKey(metadata_key, "HGETALL %s", metadata_key.c_str());
     if (reply == nullptr) {
         throw RedisException(
                 fmt::format("Null response received when fetching metadata! err={}, errstr={}",
@@ -164,16 +598,23 @@ unique_ptr<unordered_map<string, string>> Redis::GetMetadata(const string &strea
     return make_unique<unordered_map<string, string>>(ret);
 }
 
-std::vector<std::string> Redis::GetInstalledModules() {
-    auto *reply = (redisReply *) redisCommand(_context, "MODULE LIST");
+static vector<string> InstalledModules(redisContext *context) {
+    auto *reply = (redisReply *) redisCommand(context, "MODULE LIST");
     if (reply == nullptr) {
         throw RedisException(
             fmt::format("Null response received when fetching! err={}, errstr={}",
-                        _context->err,
-                        _context->errstr));
+                        context->err,
+                        context->errstr));
     }
-    UniqueRedisReplyPtr reply_ptr(reply);
+    Redis::UniqueRedisReplyPtr reply_ptr(reply);
 
+    if (reply->type == REDIS_REPLY_ERROR) {
+        // Some (e.g. managed) Redis instances disallow the MODULE command entirely, in which case no modules can be
+        // installed anyways.
+        spdlog::info("MODULE LIST returned an error; assuming no modules are installed. Error: {}",
+                     std::string(reply->str, reply->len));
+        return {};
+    }
     if (reply->type != REDIS_REPLY_ARRAY) {
         throw RedisException("Array response expected for MODULE LIST.");
     }
@@ -199,6 +640,100 @@ std::vector<std::string> Redis::GetInstalledModules() {
     return ret;
 }
 
+std::vector<std::string> Redis::GetInstalledModules() {
+    // In cluster mode, a stream's commands go to whichever master owns its slot, so only count modules on all of them.
+    vector<string> ret;
+    bool is_first = true;
+    for (redisContext *context : MasterContexts()) {
+        vector<string> modules = InstalledModules(context);
+        if (is_first) {
+            ret = modules;
+            is_first = false;
+        } else {
+            ret.erase(std::remove_if(ret.begin(), ret.end(), [&](const string &module) {
+                return std::find(modules.begin(), modules.end(), module) == modules.end();
+            }), ret.end());
+        }
+    }
+    return ret;
+}
+
+bool Redis::IsWireCodecSupportedByModule(const std::string &codec) {
+    for (redisContext *context : MasterContexts()) {
+        auto *reply = (redisReply *) redisCommand(context, "RIVER.wire_codec_supported %s", codec.c_str());
+        if (reply == nullptr) {
+            throw RedisException(
+                fmt::format("Null response received when fetching! err={}, errstr={}",
+                            context->err,
+                            context->errstr));
+        }
+        UniqueRedisReplyPtr reply_ptr(reply);
+        if (reply->type != REDIS_REPLY_INTEGER || reply->integer != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Whether the node already has this exact version of River's Redis Functions library, in which case every writer's
+// initialization needn't recompile it via FUNCTION LOAD REPLACE.
+static bool HasRiverFunctionsLoaded(redisContext *context) {
+    auto *reply = (redisReply *) redisCommand(context, "FUNCTION LIST LIBRARYNAME river WITHCODE");
+    if (reply == nullptr) {
+        return false;
+    }
+    Redis::UniqueRedisReplyPtr reply_ptr(reply);
+    if (reply->type != REDIS_REPLY_ARRAY) {
+        return false;
+    }
+    // Each library is a flat array of field names and their values. LIBRARYNAME is a pattern, so check the name too.
+    for (size_t i = 0; i < reply->elements; i++) {
+        const redisReply *library = reply->element[i];
+        string name, code;
+        for (size_t j = 0; library->type == REDIS_REPLY_ARRAY && j + 1 < library->elements; j += 2) {
+            const redisReply *field = library->element[j];
+            const redisReply *value = library->element[j + 1];
+            if (field->type != REDIS_REPLY_STRING || value->type != REDIS_REPLY_STRING) {
+                continue;
+            }
+            string field_name(field->str, field->len);
+            if (field_name == "library_name") {
+                name.assign(value->str, value->len);
+            } else if (field_name == "library_code") {
+                code.assign(value->str, value->len);
+            }
+        }
+        if (name == "river") {
+            return code == RIVER_FUNCTIONS_LIBRARY;
+        }
+    }
+    return false;
+}
+
+bool Redis::LoadRiverFunctions() {
+    // Functions aren't propagated between cluster masters, so each needs its own copy.
+    for (redisContext *context : MasterContexts()) {
+        if (HasRiverFunctionsLoaded(context)) {
+            continue;
+        }
+        auto *reply = (redisReply *) redisCommand(context, "FUNCTION LOAD REPLACE %s", RIVER_FUNCTIONS_LIBRARY);
+        if (reply == nullptr) {
+            throw RedisException(
+                fmt::format("Null response received when loading functions! err={}, errstr={}",
+                            context->err,
+                            context->errstr));
+        }
+        UniqueRedisReplyPtr reply_ptr(reply);
+
+        if (reply->type == REDIS_REPLY_ERROR) {
+            spdlog::info("Unable to load River's Redis Functions library. Error: {}",
+                         std::string(reply->str, reply->len));
+            return false;
+        }
+    }
+    return true;
+}
+
 unique_ptr<unordered_map<string, string>> Redis::GetUserMetadata(const string &stream_name) {
     auto maybe_metadata = this->GetMetadata(stream_name);
     if (!maybe_metadata) {
@@ -239,11 +774,107 @@ void Redis::SetUserMetadata(const string &stream_name, const unordered_map<strin
     this->SetMetadata(stream_name, {{"user_metadata", out}});
 }
 
+bool Redis::CreateOrJoinMultiWriterStream(const string &stream_name,
+                                          const vector<std::pair<string, string>> &key_value_pairs,
+                                          const unordered_map<string, string> &user_metadata) {
+    json parent;
+    for (auto &it : user_metadata) {
+        parent[it.first] = it.second;
+    }
+
+    vector<string> parts = {"FCALL", "river_multi_writer_join", "1", MetadataKey(stream_name)};
+    for (const auto &pair : key_value_pairs) {
+        parts.push_back(pair.first);
+        parts.push_back(pair.second);
+    }
+    parts.emplace_back("user_metadata");
+    parts.push_back(parent.dump());
+
+    vector<size_t> part_sizes;
+    vector<const char *> parts_cstr;
+    for (const auto &part : parts) {
+        parts_cstr.push_back(part.c_str());
+        part_sizes.push_back(part.size());
+    }
+
+    auto *reply = CommandArgvForKey(parts[3], parts_cstr.size(), &parts_cstr.front(), &part_sizes.front());
+    if (reply == nullptr) {
+        throw RedisException("Error joining multi-writer stream. Got null.");
+    }
+    UniqueRedisReplyPtr reply_ptr(reply);
+    if (reply->type != REDIS_REPLY_INTEGER) {
+        throw RedisException(fmt::format(
+            "Error joining multi-writer stream {}: {}", stream_name,
+            reply->type == REDIS_REPLY_ERROR ? string(reply->str, reply->len) : std::to_string(reply->type)));
+    }
+    return reply->integer == 1;
+}
+
+bool Redis::LeaveMultiWriterStream(const string &stream_name, int64_t keys_per_redis_stream,
+                                   int64_t next_sample_index_hint) {
+    const string key_prefix = StreamKeyPrefix(stream_name);
+    const string keys_per_redis_stream_f = fmt::format_int(keys_per_redis_stream).str();
+    for (int attempt = 0; attempt < MULTI_WRITER_MAX_ATTEMPTS; attempt++) {
+        vector<string> keys = MultiWriterKeys(stream_name, keys_per_redis_stream, next_sample_index_hint, 0);
+        const string num_keys = fmt::format_int(keys.size()).str();
+        vector<const char *> argv = {"FCALL", "river_multi_writer_leave", num_keys.c_str()};
+        vector<size_t> argvlen = {5, 24, num_keys.size()};
+        for (const auto &key : keys) {
+            argv.push_back(key.c_str());
+            argvlen.push_back(key.size());
+        }
+        argv.push_back(key_prefix.c_str());
+        argvlen.push_back(key_prefix.size());
+        argv.push_back(keys_per_redis_stream_f.c_str());
+        argvlen.push_back(keys_per_redis_stream_f.size());
+
+        auto *reply = CommandArgvForKey(keys[0], argv.size(), argv.data(), argvlen.data());
+        if (reply == nullptr) {
+            throw RedisException("Error leaving multi-writer stream. Got null.");
+        }
+        UniqueRedisReplyPtr reply_ptr(reply);
+        if (ParseUndeclaredKeysError(reply, &next_sample_index_hint)) {
+            continue;
+        }
+        if (reply->type != REDIS_REPLY_INTEGER) {
+            throw RedisException(fmt::format(
+                "Error leaving multi-writer stream {}: {}", stream_name,
+                reply->type == REDIS_REPLY_ERROR ? string(reply->str, reply->len) : std::to_string(reply->type)));
+        }
+        return reply->integer == 1;
+    }
+    throw RedisException(fmt::format(
+        "Error leaving multi-writer stream {}: other writers kept moving it to new stream keys.", stream_name));
+}
+
+vector<string> Redis::MultiWriterKeys(const string &stream_name, int64_t keys_per_redis_stream,
+                                      int64_t next_sample_index_hint, int64_t num_samples) const {
+    // Starting a stream key means adding a tombstone to the previous one, i.e. the one holding the sample before.
+    int64_t first_stream_key_idx = std::max<int64_t>(next_sample_index_hint - 1, 0) / keys_per_redis_stream;
+    int64_t last_stream_key_idx =
+        std::max<int64_t>(next_sample_index_hint + num_samples - 1, 0) / keys_per_redis_stream + 1;
+    vector<string> keys = {MetadataKey(stream_name)};
+    for (int64_t stream_key_idx = first_stream_key_idx; stream_key_idx <= last_stream_key_idx; stream_key_idx++) {
+        keys.push_back(StreamKey(stream_name, stream_key_idx));
+    }
+    return keys;
+}
+
+bool Redis::ParseUndeclaredKeysError(const redisReply *reply, int64_t *next_sample_index) {
+    static const string prefix = "UNDECLAREDKEYS ";
+    if (reply->type != REDIS_REPLY_ERROR || reply->len <= prefix.size()
+        || strncmp(reply->str, prefix.c_str(), prefix.size()) != 0) {
+        return false;
+    }
+    *next_sample_index = std::stoll(string(reply->str + prefix.size(), reply->len - prefix.size()));
+    return true;
+}
+
 int Redis::SetMetadata(const string &stream_name, const vector<std::pair<string, string>>& key_value_pairs) {
     vector<string> parts;
 
     parts.push_back("HSET");
-    parts.push_back(fmt::format("{}-metadata", stream_name));
+    parts.push_back(MetadataKey(stream_name));
     for (const auto &pair : key_value_pairs) {
         parts.push_back(pair.first);
         parts.push_back(pair.second);
@@ -256,8 +887,7 @@ int Redis::SetMetadata(const string &stream_name, const vector<std::pair<string,
         part_sizes.push_back(part.size());
     }
 
-    auto *reply = (redisReply *) redisCommandArgv(_context, parts_cstr.size(), &parts_cstr.front(),
-                                                  &part_sizes.front());
+    auto *reply = CommandArgvForKey(parts[1], parts_cstr.size(), &parts_cstr.front(), &part_sizes.front());
 
     if (reply == nullptr) {
         throw RedisException("Error setting metadata. Got null.");
@@ -278,10 +908,13 @@ int Redis::SetMetadata(const string &stream_name, const vector<std::pair<string,
     return ret;
 }
 
-int64_t Redis::TimeUs() {
-    auto *reply = (redisReply *) redisCommand(_context, "TIME");
+int64_t Redis::TimeUs(const string &key) {
+    auto *reply = CommandForKey(key, "TIME");
 
     if (reply == nullptr || reply->type != REDIS_REPLY_ARRAY || reply->elements != 2) {
+        if (reply != nullptr) {
+            freeReplyObject(reply);
+        }
         return -1;
     }
     auto ret = static_cast<int64_t>(strtoll(reply->element[0]->str, nullptr, 10) * 1000000ULL +
@@ -309,8 +942,7 @@ Redis::Xadd(const string &stream_name, initializer_list<pair<string, string>> ke
         part_sizes.push_back(part.size());
     }
 
-    auto *reply = (redisReply *) redisCommandArgv(_context, parts_cstr.size(), &parts_cstr.front(),
-                                                  &part_sizes.front());
+    auto *reply = CommandArgvForKey(stream_name, parts_cstr.size(), &parts_cstr.front(), &part_sizes.front());
 
     if (reply == nullptr) {
         throw RedisException(
@@ -325,44 +957,48 @@ Redis::Xadd(const string &stream_name, initializer_list<pair<string, string>> ke
 vector<string> Redis::ListStreamNames() {
     vector<string> ret;
 
-    string cursor = "0";
-    while (true) {
-        UniqueRedisReplyPtr reply = UniqueRedisReplyPtr(
-                (redisReply *) redisCommand(_context, "SCAN %s MATCH %s-metadata",
-                                            cursor.c_str(),
-                                            "*"));
-        if (reply.get() == nullptr) {
-            throw RedisException("SCAN returned null.");
-        }
-        if (reply->type != REDIS_REPLY_ARRAY) {
-            throw RedisException("Fetching SCAN returned non-array.");
-        }
-        if (reply->elements == 0) {
-            throw RedisException("Fetching SCAN returned zero elements; should have at least returned cursor.");
-        }
-        if (reply->element[0]->type != REDIS_REPLY_STRING) {
-            throw RedisException("Fetching SCAN should have returned a string cursor.");
-        }
-        cursor = reply->element[0]->str;
+    // In cluster mode, each master only scans its own keys. Metadata keys are hash-tagged there, i.e. `{name}-metadata`.
+    const char *pattern = is_cluster_ ? "{*}-metadata" : "*-metadata";
+    const std::regex suffix = is_cluster_ ? std::regex("^\\{|\\}-metadata$") : std::regex("-metadata$");
+    for (redisContext *context : MasterContexts()) {
+        string cursor = "0";
+        while (true) {
+            UniqueRedisReplyPtr reply = UniqueRedisReplyPtr(
+                    (redisReply *) redisCommand(context, "SCAN %s MATCH %s",
+                                                cursor.c_str(),
+                                                pattern));
+            if (reply.get() == nullptr) {
+                throw RedisException("SCAN returned null.");
+            }
+            if (reply->type != REDIS_REPLY_ARRAY) {
+                throw RedisException("Fetching SCAN returned non-array.");
+            }
+            if (reply->elements == 0) {
+                throw RedisException("Fetching SCAN returned zero elements; should have at least returned cursor.");
+            }
+            if (reply->element[0]->type != REDIS_REPLY_STRING) {
+                throw RedisException("Fetching SCAN should have returned a string cursor.");
+            }
+            cursor = reply->element[0]->str;
 
-        if (reply->element[1]->type != REDIS_REPLY_ARRAY) {
-            throw RedisException("SCAN should have returned an array of items.");
-        }
-        for (size_t i = 0; i < reply->element[1]->elements; i++) {
-            auto stream_name = regex_replace(string(reply->element[1]->element[i]->str),
-                                             std::regex("-metadata$"), "");
-            ret.push_back(stream_name);
-        }
+            if (reply->element[1]->type != REDIS_REPLY_ARRAY) {
+                throw RedisException("SCAN should have returned an array of items.");
+            }
+            for (size_t i = 0; i < reply->element[1]->elements; i++) {
+                auto stream_name = regex_replace(string(reply->element[1]->element[i]->str), suffix, "");
+                ret.push_back(stream_name);
+            }
 
-        if (cursor == "0") {
-            break;
+            if (cursor == "0") {
+                break;
+            }
         }
     }
     return ret;
 }
 
 void Redis::Unlink(const string &stream_key) {
-    auto *reply = (redisReply *) redisCommand(_context, "UNLINK %s", stream_key.c_str());
+    auto *reply = CommandForKey(stream_key, "UNLINK %s", stream_key.c_str());
     if (reply == nullptr || reply->type != REDIS_REPLY_INTEGER) {
         string msg = fmt::format(
                 "Error deleting stream key {}. Reply: {}",
@@ -376,8 +1012,121 @@ void Redis::Unlink(const string &stream_key) {
     freeReplyObject(reply);
 }
 
+bool Redis::Exists(const string &stream_key) {
+    auto *reply = CommandForKey(stream_key, "EXISTS %s", stream_key.c_str());
+    if (reply == nullptr || reply->type != REDIS_REPLY_INTEGER) {
+        string msg = fmt::format(
+                "Error checking existence of stream key {}. Reply: {}",
+                stream_key,
+                reply == nullptr ? "NULL" : to_string(reply->type));
+        if (reply != nullptr) {
+            freeReplyObject(reply);
+        }
+        throw RedisException(msg);
+    }
+    bool ret = reply->integer > 0;
+    freeReplyObject(reply);
+    return ret;
+}
+
+int64_t Redis::MemoryUsage(const string &key) {
+    auto *reply = CommandForKey(key, "MEMORY USAGE %s", key.c_str());
+    if (reply == nullptr || (reply->type != REDIS_REPLY_INTEGER && reply->type != REDIS_REPLY_NIL)) {
+        string msg = fmt::format(
+                "Error fetching memory usage of key {}. Reply: {}",
+                key,
+                reply == nullptr ? "NULL" : to_string(reply->type));
+        if (reply != nullptr) {
+            freeReplyObject(reply);
+        }
+        throw RedisException(msg);
+    }
+    int64_t ret = reply->type == REDIS_REPLY_NIL ? -1 : reply->integer;
+    freeReplyObject(reply);
+    return ret;
+}
+
+unique_ptr<unordered_map<string, string>> Redis::GetHash(const string &key) {
+    UniqueRedisReplyPtr reply(CommandForKey(key, "HGETALL %s", key.c_str()));
+    if (reply == nullptr) {
+        throw RedisException(
+                fmt::format("Null response received when fetching hash! err={}, errstr={}",
+                            _context->err,
+                            _context->errstr));
+    }
+    if (reply->type != REDIS_REPLY_ARRAY) {
+        throw RedisException(fmt::format(
+                "Array response expected for HGETALL, but got {} [key {}].", reply->type, key));
+    }
+    if (reply->elements == 0) {
+        return unique_ptr<unordered_map<string, string>>();
+    }
+
+    auto ret = make_unique<unordered_map<string, string>>();
+    for (size_t field_idx = 0; field_idx < reply->elements; field_idx += 2) {
+        ret->insert({string(reply->element[field_idx]->str, reply->element[field_idx]->len),
+                     string(reply->element[field_idx + 1]->str, reply->element[field_idx + 1]->len)});
+    }
+    return ret;
+}
+
+void Redis::ReplaceHash(const string &key, const vector<std::pair<string, string>> &key_value_pairs) {
+    vector<string> parts;
+    parts.push_back("HSET");
+    parts.push_back(key);
+    for (const auto &pair : key_value_pairs) {
+        parts.push_back(pair.first);
+        parts.push_back(pair.second);
+    }
+    vector<size_t> part_sizes;
+    vector<const char *> parts_cstr;
+    for (const auto &part : parts) {
+        parts_cstr.push_back(part.c_str());
+        part_sizes.push_back(part.size());
+    }
+
+    const char *multi = "MULTI";
+    const char *exec = "EXEC";
+    const char *unlink_argv[] = {"UNLINK", key.c_str()};
+    size_t unlink_argvlen[] = {6, key.size()};
+
+    RouteToKey(key);
+    int num_commands = 0;
+    SendCommandArgv(1, &multi, nullptr);
+    SendCommandArgv(2, unlink_argv, unlink_argvlen);
+    num_commands += 2;
+    if (!key_value_pairs.empty()) {
+        SendCommandArgv(parts_cstr.size(), &parts_cstr.front(), &part_sizes.front());
+        num_commands++;
+    }
+    SendCommandArgv(1, &exec, nullptr);
+    num_commands++;
+
+    for (int i = 0; i < num_commands; i++) {
+        auto reply = GetReply();
+        if (reply->type == REDIS_REPLY_ERROR) {
+            throw RedisException(fmt::format("Error replacing hash {}: {}", key, string(reply->str, reply->len)));
+        }
+        if (i < num_commands - 1) {
+            continue;
+        }
+        // Commands that fail while EXEC runs them don't fail the EXEC, only their element of its reply.
+        if (reply->type != REDIS_REPLY_ARRAY) {
+            throw RedisException(fmt::format("Error replacing hash {}: EXEC replied with type {}", key, reply->type));
+        }
+        for (size_t j = 0; j < reply->elements; j++) {
+            const redisReply *element = reply->element[j];
+            if (element->type == REDIS_REPLY_ERROR) {
+                throw RedisException(fmt::format(
+                    "Error replacing hash {}: {}", key, string(element->str, element->len)));
+            }
+        }
+    }
+}
+
 void Redis::DeleteMetadata(const string &stream_name) {
-    auto *reply = (redisReply *) redisCommand(_context, "DEL %s-metadata", stream_name.c_str());
+    const string metadata_key = MetadataKey(stream_name);
+    auto *reply = CommandForKey(metadata_key, "DEL %s", metadata_key.c_str());
     if (reply == nullptr || reply->type != REDIS_REPLY_INTEGER) {
         string msg = fmt::format("Error deleting metadata for stream {}. Reply: {}", stream_name,
                                  reply == nullptr ? "NULL" : to_string(reply->type));
@@ -408,11 +1157,54 @@ void __redisSetError(redisContext *c, int type, const char *str) {
     }
 }
 
+int Redis::ZeroCopyMinBytes() {
+#ifdef RIVER_HAS_ZEROCOPY
+    if (!connection_ || !connection_->socket_options().zero_copy_send) {
+        return 0;
+    }
+    auto it = zero_copy_enabled_by_fd_.find(_context->fd);
+    if (it == zero_copy_enabled_by_fd_.end()) {
+        // MSG_ZEROCOPY is silently ignored (i.e. never completes) on sockets without SO_ZEROCOPY, so check for it.
+        int enabled = 0;
+        socklen_t enabled_len = sizeof(enabled);
+        bool is_enabled = getsockopt(_context->fd, SOL_SOCKET, SO_ZEROCOPY, &enabled, &enabled_len) == 0 && enabled;
+        it = zero_copy_enabled_by_fd_.insert({_context->fd, is_enabled}).first;
+    }
+    return it->second ? connection_->socket_options().zero_copy_min_bytes : 0;
+#else
+    return 0;
+#endif
+}
+
 int Redis::SendCommandPreformatted(std::vector<std::pair<const char *, size_t>> preformatted_commands) {
+    const int zero_copy_min_bytes = ZeroCopyMinBytes();
+    if (zero_copy_pending_ > 0 && zero_copy_pending_fd_ != _context->fd) {
+        // Completions are tracked for one socket at a time.
+        WaitForZeroCopyCompletions();
+    }
+
     int nwritten_total = 0;
     for (int i = 0; i < preformatted_commands.size(); i++) {
+        int flags = 0;
+#ifdef RIVER_HAS_ZEROCOPY
+        if (zero_copy_min_bytes > 0 && preformatted_commands[i].second >= (size_t) zero_copy_min_bytes) {
+            flags = MSG_ZEROCOPY;
+        }
+#endif
         int nwritten = redis_sockcompat::send_redis_sockcompat(
-            _context->fd, preformatted_commands[i].first, preformatted_commands[i].second, 0);
+            _context->fd, preformatted_commands[i].first, preformatted_commands[i].second, flags);
+#ifdef RIVER_HAS_ZEROCOPY
+        if (nwritten < 0 && flags == MSG_ZEROCOPY && errno == ENOBUFS) {
+            // Over the limit of pinned memory (net.core.optmem_max); copy this one instead.
+            flags = 0;
+            nwritten = redis_sockcompat::send_redis_sockcompat(
+                _context->fd, preformatted_commands[i].first, preformatted_commands[i].second, flags);
+        }
+        if (nwritten >= 0 && flags == MSG_ZEROCOPY) {
+            zero_copy_pending_++;
+            zero_copy_pending_fd_ = _context->fd;
+        }
+#endif
         if (nwritten < 0) {
             if ((errno == EWOULDBLOCK && !(_context->flags & REDIS_BLOCK)) || (errno == EINTR)) {
                 /* Try again later */
@@ -426,6 +1218,102 @@ int Redis::SendCommandPreformatted(std::vector<std::pair<const char *, size_t>>
     return nwritten_total;
 }
 
+vector<Redis::UniqueRedisReplyPtr> Redis::GetPipelinedReplies(const vector<pair<const char *, size_t>> &parts,
+                                                              const vector<size_t> &command_ends) {
+    vector<UniqueRedisReplyPtr> replies;
+    for (size_t i = 0; i < command_ends.size(); i++) {
+        replies.push_back(GetReply());
+    }
+    if (!is_cluster_) {
+        return replies;
+    }
+
+    for (int num_redirects = 0; num_redirects < MAX_CLUSTER_REDIRECTS; num_redirects++) {
+        // Resend every redirected command at once, pipelined to each node in their original order. Commands whose
+        // keys were still on the original node (e.g. for ASK, keys not yet migrated) already ran, so aren't resent.
+        struct Resent {
+            size_t command;
+            redisContext *target;
+            string endpoint;
+            bool is_ask;
+        };
+        vector<Resent> resent;
+        for (size_t i = 0; i < replies.size(); i++) {
+            string endpoint;
+            bool is_ask;
+            if (!ParseClusterRedirect(replies[i].get(), &endpoint, &is_ask)) {
+                continue;
+            }
+            redisContext *target = NodeContext(endpoint);
+            if (is_ask) {
+                redisAppendCommand(target, "ASKING");
+            }
+            string command;
+            for (const auto &part : SliceParts(parts, i == 0 ? 0 : command_ends[i - 1], command_ends[i])) {
+                command.append(part.first, part.second);
+            }
+            redisAppendFormattedCommand(target, command.data(), command.size());
+            resent.push_back({i, target, endpoint, is_ask});
+        }
+        if (resent.empty()) {
+            break;
+        }
+        spdlog::info("Resending {} of {} pipelined commands redirected by the cluster.", resent.size(), replies.size());
+        for (const auto &r : resent) {
+            if (r.is_ask) {
+                CheckAskingReply(GetReply(r.target).get(), r.endpoint);
+            }
+            replies[r.command] = GetReply(r.target);
+        }
+    }
+    return replies;
+}
+
+void Redis::WaitForZeroCopyCompletions() {
+#ifdef RIVER_HAS_ZEROCOPY
+    const int timeout_ms = connection_ && connection_->timeout_seconds() > 0
+                           ? connection_->timeout_seconds() * 1000 : DEFAULT_ZERO_COPY_TIMEOUT_MS;
+    while (zero_copy_pending_ > 0) {
+        // Completions arrive on the socket's error queue, which is signaled via POLLERR.
+        struct pollfd pfd = {zero_copy_pending_fd_, 0, 0};
+        int ret = poll(&pfd, 1, timeout_ms);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            throw RedisException(fmt::format(
+                "Failed waiting for {} MSG_ZEROCOPY completions [errno {}]; sent buffers may still be in use.",
+                zero_copy_pending_, ret == 0 ? ETIMEDOUT : errno));
+        }
+
+        while (zero_copy_pending_ > 0) {
+            char control[128];
+            struct msghdr msg = {};
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            if (recvmsg(zero_copy_pending_fd_, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                    break;
+                }
+                throw RedisException(fmt::format("Failed reading MSG_ZEROCOPY completions [errno {}].", errno));
+            }
+            for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR)
+                    && !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+                    continue;
+                }
+                auto *err = (struct sock_extended_err *) CMSG_DATA(cmsg);
+                if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                    continue;
+                }
+                // Each notification covers the inclusive range [ee_info, ee_data] of sends on this socket.
+                zero_copy_pending_ -= (int64_t) (err->ee_data - err->ee_info) + 1;
+            }
+        }
+    }
+#endif
+}
+
 
 }
 }
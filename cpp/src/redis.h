@@ -6,17 +6,44 @@
 #define PARENT_REDIS_H
 
 #include <sstream>
+#include <string>
 #include <cstdlib>
 #include <chrono>
 #include <utility>
 #include <memory>
 #include <vector>
 #include <unordered_map>
+#include <functional>
 #include <hiredis.h>
 #include <cassert>
 
 namespace river {
 
+struct RedisEndpoint {
+    std::string hostname;
+    int port;
+};
+
+/**
+ * Socket-level tuning of connections to Redis; see RedisConnection#SetSocketOptions(). Zeros leave the OS defaults.
+ */
+struct RedisSocketOptions {
+    // Disables Nagle's algorithm so that small batches aren't delayed. Only applies to TCP.
+    bool tcp_nodelay = true;
+    // SO_SNDBUF and SO_RCVBUF, respectively. Larger buffers help writers of large batches.
+    int send_buffer_bytes = 0;
+    int receive_buffer_bytes = 0;
+    // Busy-polls the socket for up to this many microseconds while waiting for replies, trading CPU for latency
+    // (SO_BUSY_POLL; Linux only, ignored elsewhere).
+    int busy_poll_us = 0;
+    // Sends large batches via MSG_ZEROCOPY, which avoids copying them into the kernel (Linux >= 4.14, TCP only). Since
+    // the kernel then reads from the sent buffers asynchronously, writers wait for the kernel to release them before
+    // returning. Only worthwhile for batches of at least tens of kilobytes, and not over loopback.
+    bool zero_copy_send = false;
+    // Minimum size of a single send for it to use MSG_ZEROCOPY.
+    int zero_copy_min_bytes = 16384;
+};
+
 class RedisConnection {
 public:
 
@@ -43,11 +70,57 @@ public:
         return timeout_seconds_;
     }
 
+    /**
+     * Connects via the given Unix domain socket instead of TCP, which notably reduces per-batch latency for writers
+     * on the same host as Redis. The hostname and port are then unused (besides logging), though read endpoints are
+     * still connected to via TCP.
+     */
+    RedisConnection &SetUnixSocketPath(std::string unix_socket_path) {
+        unix_socket_path_ = std::move(unix_socket_path);
+        return *this;
+    }
+    const std::string &unix_socket_path() const {
+        return unix_socket_path_;
+    }
+
+    RedisConnection &SetSocketOptions(const RedisSocketOptions &socket_options) {
+        socket_options_ = socket_options;
+        return *this;
+    }
+    const RedisSocketOptions &socket_options() const {
+        return socket_options_;
+    }
+
+    /**
+     * Adds a read replica of the Redis given above. If any are given, reads (by StreamReader, and by the ingester) are
+     * served by the first healthy one, leaving the primary to writers; metadata updates and deletions still go to the
+     * primary. Falls back to the primary if no replica is healthy. Replicas must use the same password.
+     */
+    RedisConnection &AddReadEndpoint(std::string hostname, int port) {
+        read_endpoints_.push_back({std::move(hostname), port});
+        return *this;
+    }
+    const std::vector<RedisEndpoint> &read_endpoints() const {
+        return read_endpoints_;
+    }
+
+    /**
+     * This connection without any read endpoints, i.e. for when reads must be up-to-date with the primary.
+     */
+    RedisConnection PrimaryOnly() const {
+        RedisConnection ret(*this);
+        ret.read_endpoints_.clear();
+        return ret;
+    }
+
 private:
     std::string redis_hostname_;
     int redis_port_;
     std::string redis_password_;
     int timeout_seconds_;
+    std::string unix_socket_path_;
+    RedisSocketOptions socket_options_;
+    std::vector<RedisEndpoint> read_endpoints_;
 };
 
 namespace internal {
@@ -85,14 +158,39 @@ private:
     std::string _message;
 };
 
+/**
+ * The Redis Cluster hash slot of the given key, honoring hash tags (e.g. `{stream}-0` hashes only `stream`).
+ */
+int ClusterKeySlot(const std::string &key);
+
+/**
+ * If the reply is a Redis Cluster redirection, i.e. "MOVED <slot> <host>:<port>" or "ASK <slot> <host>:<port>", sets
+ * the endpoint ("<host>:<port>") it redirects to and whether it's an ASK, and returns true.
+ */
+bool ParseClusterRedirect(const redisReply *reply, std::string *endpoint, bool *is_ask);
+
+/**
+ * Bytes [start, end) of the concatenation of the given parts, as parts pointing into them.
+ */
+std::vector<std::pair<const char *, size_t>> SliceParts(const std::vector<std::pair<const char *, size_t>> &parts,
+                                                        size_t start, size_t end);
+
 class Redis {
 public:
     explicit Redis() {
         _context = nullptr;
+        is_cluster_ = false;
+        slots_stale_ = false;
     }
 
     ~Redis() {
-        redisFree(_context);
+        if (node_contexts_.empty()) {
+            FreeContext(_context);
+        }
+        for (auto &pair : node_contexts_) {
+            FreeContext(pair.second);
+        }
+        node_contexts_.clear();
         _context = nullptr;
     }
 
@@ -124,6 +222,16 @@ public:
             uint64_t key_right_part1,
             uint64_t key_right_part2);
 
+    /**
+     * Issues RIVER.xrange_packed, i.e. an XRANGE whose data entries are returned as a single wire-compressed payload.
+     * Requires the River module. See redismodule/river_redismodule.c for the reply format.
+     */
+    UniqueRedisReplyPtr XrangePacked(
+            int64_t num_to_fetch,
+            const std::string &stream_name,
+            uint64_t key_part1,
+            uint64_t key_part2,
+            const std::string &codec);
 
     UniqueRedisReplyPtr Xadd(const std::string &stream_name, std::initializer_list<std::pair<std::string, std::string>> key_value_pairs);
 
@@ -131,8 +239,25 @@ public:
 
     std::unique_ptr<std::unordered_map<std::string, std::string>> GetUserMetadata(const std::string &stream_name);
 
+    /**
+     * Names of the modules installed on the server, or in cluster mode, on every master.
+     */
     std::vector<std::string> GetInstalledModules();
 
+    /**
+     * Whether the installed River module (on every master, in cluster mode) can compress and decompress the given wire
+     * codec (e.g. "LZ4"). False if the module was built without it, or predates RIVER.wire_codec_supported.
+     */
+    bool IsWireCodecSupportedByModule(const std::string &codec);
+
+    /**
+     * Loads (or replaces) River's Redis Functions library, which provides batch commands equivalent to the River Redis
+     * module; see redis_functions.h. Nodes that already have this version of it, as per FUNCTION LIST, are left as is.
+     * Returns false if the server doesn't support or allow Redis Functions (e.g. Redis < 7.0, or the FUNCTION command
+     * is disallowed).
+     */
+    bool LoadRiverFunctions();
+
     // Atomically set internal and user metadata at the same time to prevent race conditions.
     int SetMetadataAndUserMetadata(const std::string &stream_name,
                                    const std::vector<std::pair<std::string, std::string>>& key_value_pairs,
@@ -140,6 +265,40 @@ public:
 
     void SetUserMetadata(const std::string &stream_name, const std::unordered_map<std::string, std::string> &metadata);
 
+    /**
+     * Atomically creates the metadata of a stream shared by multiple writers, or joins the stream if another writer
+     * already created it, in which case the given metadata isn't written. Returns true if created. Requires River's
+     * Redis Functions library to be loaded; see LoadRiverFunctions().
+     */
+    bool CreateOrJoinMultiWriterStream(const std::string &stream_name,
+                                       const std::vector<std::pair<std::string, std::string>> &key_value_pairs,
+                                       const std::unordered_map<std::string, std::string> &user_metadata);
+
+    /**
+     * Leaves a stream joined via CreateOrJoinMultiWriterStream(). The last writer to leave ends the stream. Returns
+     * true if this ended the stream. next_sample_index_hint is the stream's next sample index as last seen by this
+     * writer; see MultiWriterKeys().
+     */
+    bool LeaveMultiWriterStream(const std::string &stream_name, int64_t keys_per_redis_stream,
+                                int64_t next_sample_index_hint);
+
+    /**
+     * The keys to declare when calling River's multi-writer functions with num_samples samples: the metadata key, and
+     * the stream keys that the call would write to were the stream's next sample index next_sample_index_hint, plus
+     * the following stream key in case other writers get there first.
+     */
+    std::vector<std::string> MultiWriterKeys(const std::string &stream_name, int64_t keys_per_redis_stream,
+                                             int64_t next_sample_index_hint, int64_t num_samples) const;
+
+    /**
+     * If the reply is a multi-writer function's UNDECLAREDKEYS error, i.e. MultiWriterKeys() was given a stale hint,
+     * sets next_sample_index to the stream's actual one to retry with and returns true.
+     */
+    static bool ParseUndeclaredKeysError(const redisReply *reply, int64_t *next_sample_index);
+
+    // How many times to retry multi-writer functions that failed due to other writers moving the stream along.
+    static const int MULTI_WRITER_MAX_ATTEMPTS = 8;
+
     int SetMetadata(const std::string &stream_name, const std::vector<std::pair<std::string, std::string>>& key_value_pairs);
 
     void DeleteMetadata(const std::string &stream_name);
@@ -149,16 +308,72 @@ public:
     }
 
     inline std::string FormatCommandArgv(int argc, const char **argv, const size_t *argvlen) {
+        std::string formatted;
+        AppendFormattedCommandArgv(&formatted, argc, argv, argvlen);
+        return formatted;
+    }
+
+    /**
+     * Like FormatCommandArgv(), but appends to the given buffer, e.g. to send many commands at once via
+     * SendCommandPreformatted().
+     */
+    inline void AppendFormattedCommandArgv(std::string *buffer, int argc, const char **argv, const size_t *argvlen) {
         sds cmd;
-        size_t cmd_strlen = redisFormatSdsCommandArgv(&cmd, argc, argv, argvlen);
-        return {cmd, cmd_strlen};
+        long long cmd_strlen = redisFormatSdsCommandArgv(&cmd, argc, argv, argvlen);
+        buffer->append(cmd, cmd_strlen);
+        redisFreeSdsCommand(cmd);
     }
 
     int SendCommandPreformatted(std::vector<std::pair<const char *, size_t>> preformatted_commands);
 
+    /**
+     * Blocks until the kernel has released every buffer passed to SendCommandPreformatted() that was sent via
+     * MSG_ZEROCOPY (see RedisSocketOptions#zero_copy_send), after which they can be safely modified or freed. Receiving
+     * Redis's reply isn't sufficient, as the kernel might still be holding the buffer for retransmission. Returns
+     * immediately if nothing is pending.
+     */
+    void WaitForZeroCopyCompletions();
+
+    /**
+     * Reads the replies to commands sent via SendCommandPreformatted(parts), where command i is the bytes up to
+     * command_ends[i] of the concatenated parts. Every reply is read, even after an error, so that the connection stays
+     * in sync. In cluster mode, commands redirected via MOVED or ASK (e.g. while their slot migrates between nodes) are
+     * resent to the node redirected to, and the replies from there returned instead.
+     */
+    std::vector<UniqueRedisReplyPtr> GetPipelinedReplies(const std::vector<std::pair<const char *, size_t>> &parts,
+                                                         const std::vector<size_t> &command_ends);
+
+    /**
+     * Routes subsequent pipelined commands (i.e. SendCommandArgv(), SendCommandPreformatted(), and GetReply()) to the
+     * cluster node owning the given key. All other methods route themselves. No-op outside of cluster mode.
+     */
+    void RouteToKey(const std::string &key);
+
+    /**
+     * Whether the server is a Redis Cluster. If so, all of a stream's keys are hash-tagged with the stream name (e.g.
+     * `{stream}-metadata` and `{stream}-0`) so that they map to the same slot, and commands are routed to whichever
+     * node owns it.
+     */
+    bool is_cluster() const {
+        return is_cluster_;
+    }
+
+    std::string MetadataKey(const std::string &stream_name) const;
+
+    std::string StreamKey(const std::string &stream_name, int64_t stream_key_idx) const;
+
+    /**
+     * What the stream keys of a stream start with, i.e. StreamKey() is `<prefix>-<stream key idx>`.
+     */
+    std::string StreamKeyPrefix(const std::string &stream_name) const;
+
     inline UniqueRedisReplyPtr GetReply() {
+        return GetReply(_context);
+    }
+
+    inline UniqueRedisReplyPtr GetReply(redisContext *context) {
         redisReply *reply = nullptr;
-        int response = redisGetReply(_context, (void **) &reply);
+        int response = redisGetReply(context, (void **) &reply);
         if (response != REDIS_OK) {
             std::stringstream ss;
             if (reply != nullptr) {
@@ -172,6 +387,10 @@ public:
             }
             throw RedisException(ss.str());
         }
+        if (is_cluster_ && reply->type == REDIS_REPLY_ERROR) {
+            // Possibly a MOVED/ASK redirection from a slot migration; pick up the new owner before the next command.
+            slots_stale_ = true;
+        }
         return UniqueRedisReplyPtr(reply);
     }
 
@@ -179,16 +398,105 @@ public:
 
     void Unlink(const std::string &stream_key);
 
-    int64_t TimeUs();
+    bool Exists(const std::string &stream_key);
+
+    /**
+     * Number of bytes the given key and its value take in Redis (via MEMORY USAGE), or -1 if the key doesn't exist.
+     */
+    int64_t MemoryUsage(const std::string &key);
+
+    /**
+     * All fields of the hash at the given key, or null if it doesn't exist.
+     */
+    std::unique_ptr<std::unordered_map<std::string, std::string>> GetHash(const std::string &key);
+
+    /**
+     * Atomically replaces the hash at the given key with exactly the given fields. Removes the key if none are given.
+     */
+    void ReplaceHash(const std::string &key, const std::vector<std::pair<std::string, std::string>> &key_value_pairs);
+
+    /**
+     * The server's current time, in microseconds. In cluster mode, as per the node owning the given key.
+     */
+    int64_t TimeUs(const std::string &key);
+
+    /**
+     * This server's replication offset, i.e. `master_repl_offset` from INFO replication.
+     */
+    int64_t ReplicationOffset();
+
+    /**
+     * Blocks until `num_replicas` replicas have acknowledged all writes sent on this connection (via WAIT), or until
+     * the timeout. Returns the number of replicas that acknowledged.
+     */
+    int WaitForReplicas(int num_replicas, int timeout_ms);
+
+    /**
+     * Whether this connection is to a read replica (see CreateForReads()).
+     */
+    bool is_replica() const {
+        return primary_ != nullptr;
+    }
+
+    /**
+     * For replicas, waits until this replica has caught up with the primary's replication offset as of this call, so
+     * that any writes made before this call are visible. Returns false on timeout. Always true for primaries.
+     */
+    bool CatchUpToPrimary(int timeout_ms);
 
     static std::unique_ptr<Redis> Create(const RedisConnection &connection);
 
+    /**
+     * Connects to the first healthy read endpoint of the given connection (see RedisConnection#AddReadEndpoint()), or
+     * to the primary if there are none. Not supported for Redis Cluster, where reads go to the primaries.
+     */
+    static std::unique_ptr<Redis> CreateForReads(const RedisConnection &connection);
+
 private:
-    explicit Redis(redisContext *context) {
-        this->_context = context;
+    Redis(redisContext *context, const RedisConnection &connection, bool is_cluster)
+            : _context(context),
+              connection_(std::make_unique<RedisConnection>(connection)),
+              is_cluster_(is_cluster),
+              slots_stale_(is_cluster) {
+        if (is_cluster_) {
+            node_contexts_[connection.redis_hostname() + ":" + std::to_string(connection.redis_port())] = context;
+        }
     }
 
+    // Connects and authenticates, via TCP to the given hostname and port unless a Unix socket path is given.
+    static redisContext *Connect(const RedisConnection &connection, const std::string &hostname, int port,
+                                 const std::string &unix_socket_path = "");
+
+    // Executes a single command concerning the given key: in cluster mode, on the node owning the key's slot and
+    // following any MOVED/ASK redirections.
+    redisReply *CommandForKey(const std::string &key, const char *format, ...);
+    redisReply *CommandArgvForKey(const std::string &key, int argc, const char **argv, const size_t *argvlen);
+    redisReply *ExecuteForKey(const std::string &key, const std::function<redisReply *(redisContext *)> &command);
+
+    void RefreshClusterSlots();
+    redisContext *NodeContext(const std::string &endpoint);
+    // The connection to every master if in cluster mode, else just the one connection.
+    std::vector<redisContext *> MasterContexts();
+
     redisContext *_context;
+    std::unique_ptr<RedisConnection> connection_;
+    bool is_cluster_;
+    // Cluster mode only: the endpoint ("host:port") of the master owning each slot, and a connection per endpoint
+    // (which includes _context).
+    bool slots_stale_;
+    std::vector<std::string> slot_endpoints_;
+    std::unordered_map<std::string, redisContext *> node_contexts_;
+    // Only set for replicas.
+    std::unique_ptr<Redis> primary_;
+
+    // Minimum bytes for a send on _context to use MSG_ZEROCOPY, or 0 if it isn't enabled on that socket.
+    int ZeroCopyMinBytes();
+    // Whether SO_ZEROCOPY is enabled on each open socket; entries are dropped when their context is freed.
+    std::unordered_map<redisFD, bool> zero_copy_enabled_by_fd_;
+    void FreeContext(redisContext *context);
+    // Number of MSG_ZEROCOPY sends whose completions haven't been received yet, all on the same socket.
+    int64_t zero_copy_pending_ = 0;
+    redisFD zero_copy_pending_fd_ = 0;
 };
 
 }
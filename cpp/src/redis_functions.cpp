@@ -0,0 +1,330 @@
+#include "redis_functions.h"
+
+namespace river {
+namespace internal {
+
+// NB: sample indices are formatted via string.format('%d', ...) rather than passed as Lua numbers, as Redis converts
+// Lua numbers to strings with limited precision (e.g. 1e+15), which would corrupt large sample indices.
+const char *RIVER_FUNCTIONS_LIBRARY = R"LUA(#!lua name=river
+
+-- Batch functions reply with the ID of the last entry they added, as a status reply.
+
+-- Optional retention arguments ("MAXLEN <n>" or "MAXAGE <ms>") are given just before the data.
+local function is_valid_retention(strategy, threshold)
+    return (strategy == 'MAXLEN' or strategy == 'MAXAGE') and tonumber(threshold) ~= nil
+end
+
+local function apply_retention(key, strategy, threshold)
+    if strategy == 'MAXLEN' then
+        redis.call('XTRIM', key, 'MAXLEN', '~', threshold)
+    elseif strategy == 'MAXAGE' then
+        local now = redis.call('TIME')
+        local now_ms = tonumber(now[1]) * 1000 + math.floor(tonumber(now[2]) / 1000)
+        local min_ms = now_ms - tonumber(threshold)
+        if min_ms > 0 then
+            redis.call('XTRIM', key, 'MINID', '~', string.format('%d', min_ms))
+        end
+    end
+end
+
+-- Integer arguments (e.g. sample indices and counts), or nil if not given or not an integer.
+local function to_integer(arg)
+    local value = tonumber(arg)
+    if value == nil or value ~= math.floor(value) then
+        return nil
+    end
+    return value
+end
+
+-- Sizes are an array of little-endian int32s, which must be nonnegative and add up to the length of the data.
+local function check_sizes(sizes, data)
+    if #sizes % 4 ~= 0 then
+        return redis.error_reply('ERR sizes must be an array of 4-byte integers')
+    end
+    local total = 0
+    for i = 0, #sizes / 4 - 1 do
+        local sample_size = struct.unpack('<i4', sizes, i * 4 + 1)
+        if sample_size < 0 then
+            return redis.error_reply('ERR sizes must be nonnegative')
+        end
+        total = total + sample_size
+    end
+    if total ~= #data then
+        return redis.error_reply('ERR data length does not match the sum of sizes')
+    end
+    return nil
+end
+
+local function batch_xadd(keys, args)
+    if #keys ~= 1 or (#args ~= 4 and #args ~= 6) then
+        return redis.error_reply('ERR wrong number of arguments')
+    end
+    local key = keys[1]
+    local index_start = to_integer(args[1])
+    local num_samples = to_integer(args[2])
+    local sample_size = to_integer(args[3])
+    local data = args[#args]
+    if index_start == nil or num_samples == nil or sample_size == nil or num_samples <= 0 or sample_size <= 0 then
+        return redis.error_reply('ERR sample index, number of samples and sample size must be positive integers')
+    end
+    if #args == 6 and not is_valid_retention(args[4], args[5]) then
+        return redis.error_reply('ERR invalid retention policy')
+    end
+    if #data ~= num_samples * sample_size then
+        return redis.error_reply('ERR data length does not match number of samples and sample size')
+    end
+
+    local last_id
+    for i = 0, num_samples - 1 do
+        local sample_start = i * sample_size
+        last_id = redis.call('XADD', key, '*',
+                             'i', string.format('%d', index_start + i),
+                             'val', string.sub(data, sample_start + 1, sample_start + sample_size))
+    end
+    if #args == 6 then
+        apply_retention(key, args[4], args[5])
+    end
+    return redis.status_reply(last_id)
+end
+
+local function batch_xadd_compressed(keys, args)
+    if #keys ~= 1 or #args ~= 3 then
+        return redis.error_reply('ERR wrong number of arguments')
+    end
+    local key = keys[1]
+    local index_start = to_integer(args[1])
+    local num_samples = to_integer(args[2])
+    local data = args[3]
+    if index_start == nil or num_samples == nil or num_samples <= 0 then
+        return redis.error_reply('ERR sample index and number of samples must be integers, with at least one sample')
+    end
+
+    local reference_id = redis.call('XADD', key, '*', 'i', string.format('%d', index_start), 'val', data)
+    local last_id = reference_id
+    for i = 1, num_samples - 1 do
+        last_id = redis.call('XADD', key, '*',
+                             'i', string.format('%d', index_start + i),
+                             'reference', reference_id)
+    end
+    return redis.status_reply(last_id)
+end
+
+-- The block starts with its number of samples (as a little-endian uint32), followed by the compressed sizes and values
+-- of the samples.
+local function batch_xadd_variable_compressed(keys, args)
+    if #args ~= 3 then
+        return redis.error_reply('ERR wrong number of arguments')
+    end
+    local num_samples = to_integer(args[2])
+    local data = args[3]
+    if num_samples == nil or #data < 4 or struct.unpack('<I4', data) ~= num_samples or num_samples <= 0 then
+        return redis.error_reply('ERR number of samples does not match the block')
+    end
+    return batch_xadd_compressed(keys, args)
+end
+
+local function batch_xadd_variable(keys, args)
+    if #keys ~= 1 or (#args ~= 3 and #args ~= 5) then
+        return redis.error_reply('ERR wrong number of arguments')
+    end
+    local key = keys[1]
+    local index_start = to_integer(args[1])
+    local sizes = args[2]
+    local data = args[#args]
+    if index_start == nil then
+        return redis.error_reply('ERR sample index must be an integer')
+    end
+    if #args == 5 and not is_valid_retention(args[3], args[4]) then
+        return redis.error_reply('ERR invalid retention policy')
+    end
+    local sizes_error = check_sizes(sizes, data)
+    if sizes_error then
+        return sizes_error
+    end
+
+    local num_samples = #sizes / 4
+    local sample_start = 1
+    local last_id = '0-0'
+    for i = 0, num_samples - 1 do
+        local sample_size = struct.unpack('<i4', sizes, i * 4 + 1)
+        last_id = redis.call('XADD', key, '*',
+                             'i', string.format('%d', index_start + i),
+                             'val', string.sub(data, sample_start, sample_start + sample_size - 1))
+        sample_start = sample_start + sample_size
+    end
+    if #args == 5 then
+        apply_retention(key, args[3], args[4])
+    end
+    return redis.status_reply(last_id)
+end
+
+-- Streams with multiple writers. Their metadata hash tracks the next sample index and the number of active writers,
+-- and the stream keys are named <key prefix>-<stream key idx>. These keys all share a hash slot with the metadata key
+-- in cluster mode, as they're hash-tagged with the stream name.
+--
+-- Like any key a function accesses, the stream keys written to must be declared, after the metadata key. Writers
+-- can't know which ones a batch lands in until its sample indices are reserved, so they declare those they expect; if
+-- one is missing, nothing is written, and the UNDECLAREDKEYS error gives the next sample index to retry with.
+
+local function stream_key(key_prefix, stream_key_idx)
+    return key_prefix .. '-' .. string.format('%d', stream_key_idx)
+end
+
+local function are_stream_keys_declared(keys, key_prefix, first_stream_key_idx, last_stream_key_idx)
+    local declared = {}
+    for i = 2, #keys do
+        declared[keys[i]] = true
+    end
+    for stream_key_idx = first_stream_key_idx, last_stream_key_idx do
+        if not declared[stream_key(key_prefix, stream_key_idx)] then
+            return false
+        end
+    end
+    return true
+end
+
+local function undeclared_keys_error(next_sample_index)
+    return redis.error_reply('UNDECLAREDKEYS ' .. string.format('%d', next_sample_index))
+end
+
+-- Reserves the next num_samples sample indices of the stream, and adds the sample returned by sample_at(i) for each.
+-- Rolls over to the next stream key (adding a tombstone to the previous one) at the same sample indices as a single
+-- writer would.
+local function append_shared(keys, key_prefix, keys_per_stream, num_samples, sample_at)
+    local metadata_key = keys[1]
+    local next_index = tonumber(redis.call('HGET', metadata_key, 'next_sample_index'))
+    -- Starting a stream key means adding a tombstone to the previous one, i.e. the one holding next_index - 1.
+    if not are_stream_keys_declared(keys, key_prefix,
+                                    math.floor(math.max(next_index - 1, 0) / keys_per_stream),
+                                    math.floor((next_index + num_samples - 1) / keys_per_stream)) then
+        return undeclared_keys_error(next_index)
+    end
+
+    local index_start = redis.call('HINCRBY', metadata_key, 'next_sample_index', num_samples) - num_samples
+    for i = 0, num_samples - 1 do
+        local index = index_start + i
+        local stream_key_idx = math.floor(index / keys_per_stream)
+        if index > 0 and index % keys_per_stream == 0 then
+            redis.call('XADD', stream_key(key_prefix, stream_key_idx - 1), '*',
+                       'tombstone', '1',
+                       'next_stream_key', stream_key(key_prefix, stream_key_idx),
+                       'sample_index', string.format('%d', index - 1))
+        end
+        redis.call('XADD', stream_key(key_prefix, stream_key_idx), '*',
+                   'i', string.format('%d', index),
+                   'val', sample_at(i))
+    end
+    return index_start
+end
+
+local function batch_xadd_shared(keys, args)
+    if #keys == 0 or #args ~= 5 then
+        return redis.error_reply('ERR wrong number of arguments')
+    end
+    local key_prefix = args[1]
+    local keys_per_stream = to_integer(args[2])
+    local num_samples = to_integer(args[3])
+    local sample_size = to_integer(args[4])
+    local data = args[5]
+    if keys_per_stream == nil or num_samples == nil or sample_size == nil
+            or keys_per_stream <= 0 or num_samples <= 0 or sample_size <= 0 then
+        return redis.error_reply('ERR keys per stream, number of samples and sample size must be positive integers')
+    end
+    if #data ~= num_samples * sample_size then
+        return redis.error_reply('ERR data length does not match number of samples and sample size')
+    end
+
+    return append_shared(keys, key_prefix, keys_per_stream, num_samples, function(i)
+        local sample_start = i * sample_size
+        return string.sub(data, sample_start + 1, sample_start + sample_size)
+    end)
+end
+
+local function batch_xadd_shared_variable(keys, args)
+    if #keys == 0 or #args ~= 4 then
+        return redis.error_reply('ERR wrong number of arguments')
+    end
+    local key_prefix = args[1]
+    local keys_per_stream = to_integer(args[2])
+    local sizes = args[3]
+    local data = args[4]
+    if keys_per_stream == nil or keys_per_stream <= 0 or #sizes == 0 then
+        return redis.error_reply('ERR keys per stream must be a positive integer, with at least one sample')
+    end
+    local sizes_error = check_sizes(sizes, data)
+    if sizes_error then
+        return sizes_error
+    end
+
+    -- Samples are visited in order, so track where the next one starts.
+    local sample_start = 1
+    return append_shared(keys, key_prefix, keys_per_stream, #sizes / 4, function(i)
+        local sample_size = struct.unpack('<i4', sizes, i * 4 + 1)
+        local sample = string.sub(data, sample_start, sample_start + sample_size - 1)
+        sample_start = sample_start + sample_size
+        return sample
+    end)
+end
+
+-- Arguments are the metadata fields to create the stream with. Returns 1 if created, or 0 if joined.
+local function multi_writer_join(keys, args)
+    if #keys ~= 1 or #args % 2 ~= 0 then
+        return redis.error_reply('ERR wrong number of arguments')
+    end
+    local metadata_key = keys[1]
+    if redis.call('EXISTS', metadata_key) == 0 then
+        redis.call('HSET', metadata_key, 'next_sample_index', '0', 'active_writers', '1', unpack(args))
+        return 1
+    end
+    if redis.call('HEXISTS', metadata_key, 'multi_writer') == 0 then
+        return redis.error_reply('ERR stream exists, but was not created for multiple writers')
+    end
+    if redis.call('HINCRBY', metadata_key, 'active_writers', 1) == 1 then
+        redis.call('HINCRBY', metadata_key, 'active_writers', -1)
+        return redis.error_reply('ERR stream has already been stopped by all of its writers')
+    end
+    return 0
+end
+
+-- Returns 1 if this was the last active writer, in which case the stream is ended, or 0 otherwise.
+local function multi_writer_leave(keys, args)
+    if #keys == 0 or #args ~= 2 then
+        return redis.error_reply('ERR wrong number of arguments')
+    end
+    local metadata_key = keys[1]
+    local key_prefix = args[1]
+    local keys_per_stream = to_integer(args[2])
+    if keys_per_stream == nil or keys_per_stream <= 0 then
+        return redis.error_reply('ERR keys per stream must be a positive integer')
+    end
+    local next_index = tonumber(redis.call('HGET', metadata_key, 'next_sample_index'))
+    if next_index == nil then
+        return redis.error_reply('ERR stream was not created for multiple writers')
+    end
+    local last_index = math.max(next_index - 1, 0)
+    local last_stream_key_idx = math.floor(last_index / keys_per_stream)
+    if not are_stream_keys_declared(keys, key_prefix, last_stream_key_idx, last_stream_key_idx) then
+        return undeclared_keys_error(next_index)
+    end
+    if redis.call('HINCRBY', metadata_key, 'active_writers', -1) > 0 then
+        return 0
+    end
+
+    redis.call('XADD', stream_key(key_prefix, last_stream_key_idx), '*',
+               'eof', '1',
+               'sample_index', string.format('%d', last_index))
+    return 1
+end
+
+redis.register_function('river_batch_xadd', batch_xadd)
+redis.register_function('river_batch_xadd_compressed', batch_xadd_compressed)
+redis.register_function('river_batch_xadd_variable', batch_xadd_variable)
+redis.register_function('river_batch_xadd_variable_compressed', batch_xadd_variable_compressed)
+redis.register_function('river_batch_xadd_shared', batch_xadd_shared)
+redis.register_function('river_batch_xadd_shared_variable', batch_xadd_shared_variable)
+redis.register_function('river_multi_writer_join', multi_writer_join)
+redis.register_function('river_multi_writer_leave', multi_writer_leave)
+)LUA";
+
+}
+}
@@ -0,0 +1,43 @@
+#ifndef RIVER_SRC_REDIS_FUNCTIONS_H_
+#define RIVER_SRC_REDIS_FUNCTIONS_H_
+
+namespace river {
+namespace internal {
+
+/**
+ * Source of the "river" Redis Functions library (Redis >= 7.0), loaded via FUNCTION LOAD.
+ *
+ * This library mirrors the batch commands of the River Redis module (see redismodule/river_redismodule.c) for Redis
+ * servers in which loading a module is not possible (e.g. managed Redis instances). Each function takes the same
+ * arguments as its module counterpart, but invoked via FCALL, e.g.:
+ *
+ *   FCALL river_batch_xadd 1 <key> <index start> <n samples> <sample size in bytes> [MAXLEN <n> | MAXAGE <ms>]
+ *       <value in bytes>
+ *   FCALL river_batch_xadd_compressed 1 <key> <index start> <n samples> <value in bytes>
+ *   FCALL river_batch_xadd_variable_compressed 1 <key> <index start> <n samples> <block in bytes>
+ *   FCALL river_batch_xadd_variable 1 <key> <index start> <sizes in ints> [MAXLEN <n> | MAXAGE <ms>] <value in bytes>
+ *
+ * The resulting stream entries are identical to those written by the module, so readers don't need to know which of
+ * the two was used.
+ *
+ * In addition, it provides functions for streams with multiple writers (see StreamWriterParamsBuilder#multi_writer()),
+ * which have no module counterpart. Rather than being given a sample index, these reserve one from the stream's
+ * metadata, and return the first sample index reserved:
+ *
+ *   FCALL river_batch_xadd_shared <1 + n stream keys> <metadata key> <stream key> ... <key prefix> <keys per stream>
+ *       <n samples> <sample size in bytes> <value in bytes>
+ *   FCALL river_batch_xadd_shared_variable <1 + n stream keys> <metadata key> <stream key> ... <key prefix>
+ *       <keys per stream> <sizes in ints> <value in bytes>
+ *   FCALL river_multi_writer_join 1 <metadata key> [<field> <value> ...]
+ *   FCALL river_multi_writer_leave <1 + n stream keys> <metadata key> <stream key> ... <key prefix> <keys per stream>
+ *
+ * The stream keys given must include every one the call writes to, which depends on the stream's next sample index
+ * when it runs; see Redis#MultiWriterKeys(). Otherwise, the call fails without writing anything with the error
+ * `UNDECLAREDKEYS <next sample index>`, and can be retried with the keys for that index.
+ */
+extern const char *RIVER_FUNCTIONS_LIBRARY;
+
+}
+}
+
+#endif //RIVER_SRC_REDIS_FUNCTIONS_H_
@@ -3,21 +3,31 @@
 //
 
 #include "redis_writer_commands.h"
+#include <stdexcept>
 #include <spdlog/fmt/fmt.h>
 
 namespace river {
 
-RedisWriterCommand::RedisWriterCommand(const std::string &formatted_command) {
-    if (formatted_command[0] != '*') {
+static int NumArrayElements(const std::string &formatted_command) {
+    if (formatted_command.empty() || formatted_command[0] != '*') {
         throw std::invalid_argument("Expected array type for commands!");
     }
     auto delimiter_pos = formatted_command.find("\r\n", 1);
-    auto num_array_elements = std::stoi(formatted_command.substr(1, delimiter_pos - 1));
+    return std::stoi(formatted_command.substr(1, delimiter_pos - 1));
+}
+
+RedisWriterCommand::RedisWriterCommand(const std::string &formatted_command)
+    : RedisWriterCommand(formatted_command, {NumArrayElements(formatted_command) - 1}) {}
+
+RedisWriterCommand::RedisWriterCommand(const std::string &formatted_command,
+                                       const std::vector<int> &replaced_arg_indices) {
+    auto num_array_elements = NumArrayElements(formatted_command);
 
     // Start right after the *[0-9...]\r\n
-    auto formatted_command_pos = delimiter_pos + 2;
-    // Skip until the last command
-    for (int i = 0; i < num_array_elements - 1; i++) {
+    size_t formatted_command_pos = formatted_command.find("\r\n", 1) + 2;
+    size_t segment_start = 0;
+    size_t next_replaced = 0;
+    for (int i = 0; i < num_array_elements; i++) {
         if (formatted_command[formatted_command_pos] != '$') {
             throw std::invalid_argument("Expected only bulk strings for XADD commands.");
         }
@@ -25,47 +35,54 @@ RedisWriterCommand::RedisWriterCommand(const std::string &formatted_command) {
         auto bulk_string_size =
             std::stoi(formatted_command.substr(formatted_command_pos + 1,
                                                delimiter_pos_bulk_string - formatted_command_pos - 1));
-        formatted_command_pos = delimiter_pos_bulk_string + 2 + bulk_string_size + 2;
-    }
-
-    // Split an entire command into 6 portions, assuming the command is a Redis ARRAY type.
-    // <prefix>, $, <data length>, \r\n, <data>, \r\n
-    // where the prefix is everything up until the start of the last bulk string in the array command.
-    command_parts_.resize(6);
-    command_parts_lens_.resize(6);
-
-    formatted_command_prefix_ = formatted_command.substr(0, formatted_command_pos);
-    command_parts_[0] = formatted_command_prefix_.c_str();
-    command_parts_lens_[0] = formatted_command_prefix_.size();
-
-    command_parts_[1] = "$";
-    command_parts_lens_[1] = 1;
-
-    // Omit #2 which will be the length of the last bulk string
-
-    command_parts_[3] = "\r\n";
-    command_parts_lens_[3] = 2;
+        size_t next_formatted_command_pos = delimiter_pos_bulk_string + 2 + bulk_string_size + 2;
 
-    // Omit #4 which will be the actual data
-
-    command_parts_[5] = "\r\n";
-    command_parts_lens_[5] = 2;
+        if (next_replaced < replaced_arg_indices.size() && replaced_arg_indices[next_replaced] == i) {
+            // Everything up until this bulk string's "$", and then resume from the "\r\n" that ends it.
+            formatted_command_segments_.push_back(
+                formatted_command.substr(segment_start, formatted_command_pos - segment_start));
+            segment_start = next_formatted_command_pos - 2;
+            next_replaced++;
+        }
+        formatted_command_pos = next_formatted_command_pos;
+    }
+    if (next_replaced != replaced_arg_indices.size()) {
+        throw std::invalid_argument("Replaced argument indices must be increasing and within the command.");
+    }
+    formatted_command_segments_.push_back(formatted_command.substr(segment_start));
+    formatted_bulk_string_headers_.resize(replaced_arg_indices.size());
 }
 
 std::vector<std::pair<const char *, size_t>> RedisWriterCommand::ReplaceLastBulkStringAndAssemble(
     const char *data, size_t data_length) {
-    // Make sure we hold on to this formatted string so it remains allocated
-    formatted_total_size_bytes_ = fmt::format_int(data_length).str();
-    command_parts_[2] = formatted_total_size_bytes_.c_str();
-    command_parts_lens_[2] = formatted_total_size_bytes_.size();
+    return ReplaceBulkStringsAndAssemble({{data, data_length}});
+}
 
-    command_parts_[4] = data;
-    command_parts_lens_[4] = data_length;
+std::vector<std::pair<const char *, size_t>> RedisWriterCommand::ReplaceBulkStringsAndAssemble(
+    const std::vector<std::pair<const char *, size_t>> &bulk_strings) {
+    if (bulk_strings.size() != formatted_bulk_string_headers_.size()) {
+        throw std::invalid_argument(fmt::format("Expected {} bulk strings, got {}",
+                                                formatted_bulk_string_headers_.size(), bulk_strings.size()));
+    }
+
+    std::vector<std::pair<const char *, size_t>> ret;
+    ret.reserve(3 * bulk_strings.size() + 1);
+    for (size_t i = 0; i < bulk_strings.size(); i++) {
+        // Make sure we hold on to this formatted string so it remains allocated
+        auto &header = formatted_bulk_string_headers_[i];
+        header = "$";
+        header += fmt::format_int(bulk_strings[i].second).c_str();
+        header += "\r\n";
 
-    std::vector<std::pair<const char *, size_t>> ret(6);
-    for (int i = 0; i < 6; i++) {
-        ret.emplace_back(command_parts_[i], command_parts_lens_[i]);
+        if (!formatted_command_segments_[i].empty()) {
+            ret.emplace_back(formatted_command_segments_[i].data(), formatted_command_segments_[i].size());
+        }
+        ret.emplace_back(header.data(), header.size());
+        if (bulk_strings[i].second > 0) {
+            ret.emplace_back(bulk_strings[i].first, bulk_strings[i].second);
+        }
     }
+    ret.emplace_back(formatted_command_segments_.back().data(), formatted_command_segments_.back().size());
     return ret;
 }
 }
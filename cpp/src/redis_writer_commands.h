@@ -19,25 +19,38 @@ namespace river {
  * this introduces a copy of the data during the formatting step. It so happens that binary strings (or "bulk strings")
  * are passed over the wire unchanged, so this formatting-specific copy is technically unnecessary.
  *
- * This class encapsulates a preformatted redis command and just switches out where we know the big "binary bulk string"
- * corresponding to our River data to be. In the implementation, we're careful to always put the binary bulk data at
- * the end of the string. We "switch" out where the bulk string is by simply keeping track of string pointers instead of
- * actually copying the data.
+ * This class encapsulates a preformatted redis command and just switches out where we know the big "binary bulk
+ * strings" corresponding to our River data to be. By default, that's only the last argument; other arguments (e.g. the
+ * sizes of variable-width samples) can be switched out too by giving their indices. We "switch" out where the bulk
+ * strings are by simply keeping track of string pointers instead of actually copying the data, so the arguments given
+ * when formatting the command are just placeholders.
  *
  * This should then be used in conjunction with river::Redis::SendCommandPreformatted.
  */
 class RedisWriterCommand {
 public:
-    RedisWriterCommand(const std::string &formatted_command);
+    explicit RedisWriterCommand(const std::string &formatted_command);
+
+    /**
+     * @param replaced_arg_indices Indices, in increasing order, of the arguments of the command that are switched out.
+     */
+    RedisWriterCommand(const std::string &formatted_command, const std::vector<int> &replaced_arg_indices);
 
     std::vector<std::pair<const char *, size_t>> ReplaceLastBulkStringAndAssemble(
         const char *data, size_t data_length);
 
+    /**
+     * Assembles the command with the given bulk strings in place of the replaced arguments, in the same order.
+     */
+    std::vector<std::pair<const char *, size_t>> ReplaceBulkStringsAndAssemble(
+        const std::vector<std::pair<const char *, size_t>> &bulk_strings);
+
 private:
-    std::string formatted_command_prefix_;
-    std::string formatted_total_size_bytes_;
-    std::vector<const char *> command_parts_;
-    std::vector<size_t> command_parts_lens_;
+    // The formatted command, split around the replaced arguments: the i-th replaced argument goes between
+    // formatted_command_segments_[i] and formatted_command_segments_[i + 1].
+    std::vector<std::string> formatted_command_segments_;
+    // "$<length>\r\n" of each replaced argument.
+    std::vector<std::string> formatted_bulk_string_headers_;
 };
 
 }
@@ -5,35 +5,30 @@
 #include <rmutil/strings.h>
 #include <rmutil/test_util.h>
 
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#ifdef RIVER_HAS_LZ4
+#include <lz4.h>
+#endif
+#ifdef RIVER_HAS_ZSTD
+#include <zstd.h>
+#endif
+
 #define ASSERT_NOERROR_STRING_FXN(r) \
   if ((r) != REDISMODULE_OK) { \
     return REDISMODULE_ERR; \
   }
 
-int BatchXaddCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
-    if (argc != 6) {
-        return RedisModule_WrongArity(ctx);
-    }
-    RedisModule_AutoMemory(ctx);
-
-    // open the key and make sure it's indeed a STREAM
-    RedisModuleKey *key =
-        RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
-    if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_STREAM &&
-        RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY) {
-        return RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
-    }
-
-    long long index_start;
-    long long num_samples;
-    long long sample_size_bytes;
-    ASSERT_NOERROR_STRING_FXN(RedisModule_StringToLongLong(argv[2], &index_start));
-    ASSERT_NOERROR_STRING_FXN(RedisModule_StringToLongLong(argv[3], &num_samples));
-    ASSERT_NOERROR_STRING_FXN(RedisModule_StringToLongLong(argv[4], &sample_size_bytes));
-
-    size_t value_length;
-    const char *value = RedisModule_StringPtrLen(argv[5], &value_length);
-
+/**
+ * Adds num_samples entries of the form "i <index> val <sample>" to the given stream, where each sample is
+ * sample_size_bytes long and contiguous in value. Sets last_id to the ID of the last entry added.
+ */
+static int StreamAddFixedWidth(RedisModuleCtx *ctx, RedisModuleKey *key, long long index_start, long long num_samples,
+                               long long sample_size_bytes, const char *value, RedisModuleStreamID *last_id) {
     RedisModuleString **xadd_params = (RedisModuleString **) RedisModule_Alloc(sizeof(RedisModuleString *) * 4);
     for (long long i = 0; i < num_samples; i++) {
         const char *i_str = "i";
@@ -47,22 +42,256 @@ int BatchXaddCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
         xadd_params[3] = RedisModule_CreateString(ctx, &value[sample_start], sample_size_bytes);
 
         // fields and values;
-        int stream_add_resp = RedisModule_StreamAdd(key, REDISMODULE_STREAM_ADD_AUTOID, NULL, xadd_params, 2);
+        int stream_add_resp = RedisModule_StreamAdd(key, REDISMODULE_STREAM_ADD_AUTOID, last_id, xadd_params, 2);
+        for (int j = 0; j < 4; j++) {
+            RedisModule_FreeString(ctx, xadd_params[j]);
+        }
         if (stream_add_resp != REDISMODULE_OK) {
-            return RedisModule_ReplyWithError(ctx, "ERR Xadd failed.");
+            RedisModule_Free(xadd_params);
+            return REDISMODULE_ERR;
         }
+    }
+    RedisModule_Free(xadd_params);
+    return REDISMODULE_OK;
+}
+
+/**
+ * Same as StreamAddFixedWidth, but each sample i is sizes[i] bytes long.
+ */
+static int StreamAddVariableWidth(RedisModuleCtx *ctx, RedisModuleKey *key, long long index_start,
+                                  long long num_samples, const int *sizes, const char *value,
+                                  RedisModuleStreamID *last_id) {
+    RedisModuleString **xadd_params = (RedisModuleString **) RedisModule_Alloc(sizeof(RedisModuleString *) * 4);
+    size_t sample_start = 0;
+    for (long long i = 0; i < num_samples; i++) {
+        const char *i_str = "i";
+        xadd_params[0] = RedisModule_CreateString(ctx, i_str, strlen(i_str));
+        xadd_params[1] = RedisModule_CreateStringFromLongLong(ctx, index_start + i);
+
+        const char *val_str = "val";
+        xadd_params[2] = RedisModule_CreateString(ctx, val_str, strlen(val_str));
+        xadd_params[3] = RedisModule_CreateString(ctx, &value[sample_start], sizes[i]);
 
+        // fields and values;
+        int stream_add_resp = RedisModule_StreamAdd(key, REDISMODULE_STREAM_ADD_AUTOID, last_id, xadd_params, 2);
         for (int j = 0; j < 4; j++) {
             RedisModule_FreeString(ctx, xadd_params[j]);
         }
-     }
+        if (stream_add_resp != REDISMODULE_OK) {
+            RedisModule_Free(xadd_params);
+            return REDISMODULE_ERR;
+        }
+        sample_start += sizes[i];
+    }
     RedisModule_Free(xadd_params);
-    return RedisModule_ReplyWithSimpleString(ctx, "OK");
+    return REDISMODULE_OK;
 }
 
-int BatchXaddCompressedCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
-    // batch_xadd_compressed <key> <index start> <n samples> <value in bytes>
-    if (argc != 5) {
+/**
+ * Wire compression, matching compression/wire_codec.h on the client side. Payloads are framed as:
+ *   <uint64 little-endian: length of the uncompressed payload> <LZ4 block or zstd frame>
+ */
+#define RIVER_WIRE_HEADER_SIZE 8
+// Guards against allocating absurd amounts of memory on a malformed header; matches Redis' default
+// proto-max-bulk-len.
+#define RIVER_WIRE_MAX_UNCOMPRESSED_SIZE (512ULL * 1024 * 1024)
+
+typedef enum {
+    RIVER_WIRE_LZ4,
+    RIVER_WIRE_ZSTD,
+    RIVER_WIRE_UNSUPPORTED,
+} RiverWireCodec;
+
+static RiverWireCodec ParseWireCodec(RedisModuleString *codec_str) {
+    size_t len;
+    const char *codec = RedisModule_StringPtrLen(codec_str, &len);
+#ifdef RIVER_HAS_LZ4
+    if (len == 3 && strncasecmp(codec, "LZ4", 3) == 0) {
+        return RIVER_WIRE_LZ4;
+    }
+#endif
+#ifdef RIVER_HAS_ZSTD
+    if (len == 4 && strncasecmp(codec, "ZSTD", 4) == 0) {
+        return RIVER_WIRE_ZSTD;
+    }
+#endif
+    (void) codec;
+    (void) len;
+    return RIVER_WIRE_UNSUPPORTED;
+}
+
+/**
+ * Decompresses a framed payload into a newly allocated buffer (to be freed with RedisModule_Free), returning NULL on
+ * any error.
+ */
+static char *WireDecompress(RiverWireCodec codec, const char *payload, size_t payload_length,
+                            size_t *uncompressed_length) {
+    if (payload_length < RIVER_WIRE_HEADER_SIZE) {
+        return NULL;
+    }
+    uint64_t length = 0;
+    for (int i = 0; i < RIVER_WIRE_HEADER_SIZE; i++) {
+        length |= ((uint64_t) (unsigned char) payload[i]) << (8 * i);
+    }
+    if (length > RIVER_WIRE_MAX_UNCOMPRESSED_SIZE) {
+        return NULL;
+    }
+
+    const char *compressed = payload + RIVER_WIRE_HEADER_SIZE;
+    size_t compressed_length = payload_length - RIVER_WIRE_HEADER_SIZE;
+    // Allocate at least one byte, as an empty batch is still valid.
+    char *ret = RedisModule_Alloc(length > 0 ? length : 1);
+    int ok = 0;
+    switch (codec) {
+        case RIVER_WIRE_LZ4: {
+#ifdef RIVER_HAS_LZ4
+            int decompressed = LZ4_decompress_safe(compressed, ret, (int) compressed_length, (int) length);
+            ok = decompressed >= 0 && (uint64_t) decompressed == length;
+#endif
+            break;
+        }
+        case RIVER_WIRE_ZSTD: {
+#ifdef RIVER_HAS_ZSTD
+            size_t decompressed = ZSTD_decompress(ret, length, compressed, compressed_length);
+            ok = !ZSTD_isError(decompressed) && decompressed == length;
+#endif
+            break;
+        }
+        default:
+            break;
+    }
+    (void) compressed;
+    (void) compressed_length;
+
+    if (!ok) {
+        RedisModule_Free(ret);
+        return NULL;
+    }
+    *uncompressed_length = length;
+    return ret;
+}
+
+/**
+ * Compresses a payload into a newly allocated, framed buffer (to be freed with RedisModule_Free), returning NULL on
+ * any error.
+ */
+static char *WireCompress(RiverWireCodec codec, const char *data, size_t length, size_t *compressed_length) {
+    size_t bound = 0;
+    switch (codec) {
+        case RIVER_WIRE_LZ4:
+#ifdef RIVER_HAS_LZ4
+            bound = LZ4_compressBound((int) length);
+#endif
+            break;
+        case RIVER_WIRE_ZSTD:
+#ifdef RIVER_HAS_ZSTD
+            bound = ZSTD_compressBound(length);
+#endif
+            break;
+        default:
+            break;
+    }
+    if (bound == 0) {
+        return NULL;
+    }
+
+    char *ret = RedisModule_Alloc(RIVER_WIRE_HEADER_SIZE + bound);
+    for (int i = 0; i < RIVER_WIRE_HEADER_SIZE; i++) {
+        ret[i] = (char) ((((uint64_t) length) >> (8 * i)) & 0xFF);
+    }
+
+    size_t written = 0;
+    switch (codec) {
+        case RIVER_WIRE_LZ4: {
+#ifdef RIVER_HAS_LZ4
+            int n = LZ4_compress_default(data, ret + RIVER_WIRE_HEADER_SIZE, (int) length, (int) bound);
+            written = n > 0 ? (size_t) n : 0;
+#endif
+            break;
+        }
+        case RIVER_WIRE_ZSTD: {
+#ifdef RIVER_HAS_ZSTD
+            size_t n = ZSTD_compress(ret + RIVER_WIRE_HEADER_SIZE, bound, data, length, 1);
+            written = ZSTD_isError(n) ? 0 : n;
+#endif
+            break;
+        }
+        default:
+            break;
+    }
+    (void) data;
+
+    if (written == 0) {
+        RedisModule_Free(ret);
+        return NULL;
+    }
+    *compressed_length = RIVER_WIRE_HEADER_SIZE + written;
+    return ret;
+}
+
+/**
+ * Optional retention policy for the batch commands, given as "MAXLEN <n>" or "MAXAGE <ms>" just before the value so
+ * that the value remains the last argument. The stream is trimmed approximately (as with XTRIM ... ~) after adding.
+ */
+typedef struct {
+    enum {
+        RIVER_RETENTION_NONE,
+        RIVER_RETENTION_MAXLEN,
+        RIVER_RETENTION_MAXAGE,
+    } type;
+    long long threshold;
+} RiverRetention;
+
+static int ParseRetention(RedisModuleString *type_str, RedisModuleString *threshold_str, RiverRetention *retention) {
+    size_t len;
+    const char *type = RedisModule_StringPtrLen(type_str, &len);
+    if (len == 6 && strncasecmp(type, "MAXLEN", 6) == 0) {
+        retention->type = RIVER_RETENTION_MAXLEN;
+    } else if (len == 6 && strncasecmp(type, "MAXAGE", 6) == 0) {
+        retention->type = RIVER_RETENTION_MAXAGE;
+    } else {
+        return REDISMODULE_ERR;
+    }
+    if (RedisModule_StringToLongLong(threshold_str, &retention->threshold) != REDISMODULE_OK
+        || retention->threshold < 0) {
+        return REDISMODULE_ERR;
+    }
+    return REDISMODULE_OK;
+}
+
+static void ApplyRetention(RedisModuleKey *key, const RiverRetention *retention) {
+    switch (retention->type) {
+        case RIVER_RETENTION_MAXLEN:
+            RedisModule_StreamTrimByLength(key, REDISMODULE_STREAM_TRIM_APPROX, retention->threshold);
+            break;
+        case RIVER_RETENTION_MAXAGE: {
+            long long now_ms = RedisModule_Milliseconds();
+            if (now_ms > retention->threshold) {
+                RedisModuleStreamID min_id;
+                min_id.ms = (uint64_t) (now_ms - retention->threshold);
+                min_id.seq = 0;
+                RedisModule_StreamTrimByID(key, REDISMODULE_STREAM_TRIM_APPROX, &min_id);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/**
+ * Replies with the given stream ID, as a simple string "<ms>-<seq>". Batch commands reply with the ID of the last entry
+ * they added, so that writers know where the batch ends in the stream without another round trip.
+ */
+static int ReplyWithStreamID(RedisModuleCtx *ctx, const RedisModuleStreamID *id) {
+    char id_str[64];
+    snprintf(id_str, sizeof(id_str), "%llu-%llu", (unsigned long long) id->ms, (unsigned long long) id->seq);
+    return RedisModule_ReplyWithSimpleString(ctx, id_str);
+}
+
+int BatchXaddCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // batch_xadd <key> <index start> <n samples> <sample size in bytes> [MAXLEN <n> | MAXAGE <ms>] <value in bytes>
+    if (argc != 6 && argc != 8) {
         return RedisModule_WrongArity(ctx);
     }
     RedisModule_AutoMemory(ctx);
@@ -76,14 +305,40 @@ int BatchXaddCompressedCommand(RedisModuleCtx *ctx, RedisModuleString **argv, in
     }
 
     long long index_start;
-    ASSERT_NOERROR_STRING_FXN(RedisModule_StringToLongLong(argv[2], &index_start));
-
     long long num_samples;
+    long long sample_size_bytes;
+    ASSERT_NOERROR_STRING_FXN(RedisModule_StringToLongLong(argv[2], &index_start));
     ASSERT_NOERROR_STRING_FXN(RedisModule_StringToLongLong(argv[3], &num_samples));
+    ASSERT_NOERROR_STRING_FXN(RedisModule_StringToLongLong(argv[4], &sample_size_bytes));
+
+    RiverRetention retention = {RIVER_RETENTION_NONE, 0};
+    if (argc == 8 && ParseRetention(argv[5], argv[6], &retention) != REDISMODULE_OK) {
+        return RedisModule_ReplyWithError(ctx, "ERR Invalid retention policy.");
+    }
 
     size_t value_length;
-    const char *value = RedisModule_StringPtrLen(argv[4], &value_length);
+    const char *value = RedisModule_StringPtrLen(argv[argc - 1], &value_length);
 
+    RedisModuleStreamID last_id = {0, 0};
+    if (StreamAddFixedWidth(ctx, key, index_start, num_samples, sample_size_bytes, value, &last_id)
+        != REDISMODULE_OK) {
+        return RedisModule_ReplyWithError(ctx, "ERR Xadd failed.");
+    }
+    ApplyRetention(key, &retention);
+    return ReplyWithStreamID(ctx, &last_id);
+}
+
+/**
+ * Adds a compressed batch of samples: the first entry holds the whole compressed value, and the remaining entries
+ * reference it by ID. Sets last_id to the ID of the last entry added.
+ */
+static int StreamAddCompressed(RedisModuleCtx *ctx,
+                               RedisModuleKey *key,
+                               long long index_start,
+                               long long num_samples,
+                               const char *value,
+                               size_t value_length,
+                               RedisModuleStreamID *last_id) {
     RedisModuleString **xadd_params = (RedisModuleString **) RedisModule_Alloc(sizeof(RedisModuleString *) * 4);
 
     const char *i_str = "i";
@@ -96,8 +351,10 @@ int BatchXaddCompressedCommand(RedisModuleCtx *ctx, RedisModuleString **argv, in
 
     RedisModuleStreamID reference_id;
     int stream_add_resp = RedisModule_StreamAdd(key, REDISMODULE_STREAM_ADD_AUTOID, &reference_id, xadd_params, 2);
+    *last_id = reference_id;
     if (stream_add_resp != REDISMODULE_OK) {
-        return RedisModule_ReplyWithError(ctx, "ERR Xadd failed.");
+        RedisModule_Free(xadd_params);
+        return REDISMODULE_ERR;
     }
     for (int i = 0; i < 4; i++) {
         RedisModule_FreeString(ctx, xadd_params[i]);
@@ -116,9 +373,10 @@ int BatchXaddCompressedCommand(RedisModuleCtx *ctx, RedisModuleString **argv, in
         xadd_params[2] = reference_str;
         xadd_params[3] = reference_id_str;
 
-        stream_add_resp = RedisModule_StreamAdd(key, REDISMODULE_STREAM_ADD_AUTOID, NULL, xadd_params, 2);
+        stream_add_resp = RedisModule_StreamAdd(key, REDISMODULE_STREAM_ADD_AUTOID, last_id, xadd_params, 2);
         if (stream_add_resp != REDISMODULE_OK) {
-            return RedisModule_ReplyWithError(ctx, "ERR Xadd failed.");
+            RedisModule_Free(xadd_params);
+            return REDISMODULE_ERR;
         }
 
         for (int i = 0; i < 2; i++) {
@@ -127,11 +385,44 @@ int BatchXaddCompressedCommand(RedisModuleCtx *ctx, RedisModuleString **argv, in
     }
 
     RedisModule_Free(xadd_params);
-    return RedisModule_ReplyWithSimpleString(ctx, "OK");
+    return REDISMODULE_OK;
 }
 
-int BatchXaddVariableCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
-    // batch_xadd_variable <key> <index start> <sizes in ints> <value in bytes>
+int BatchXaddCompressedCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // batch_xadd_compressed <key> <index start> <n samples> <value in bytes>
+    if (argc != 5) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModule_AutoMemory(ctx);
+
+    // open the key and make sure it's indeed a STREAM
+    RedisModuleKey *key =
+        RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_STREAM &&
+        RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY) {
+        return RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    }
+
+    long long index_start;
+    ASSERT_NOERROR_STRING_FXN(RedisModule_StringToLongLong(argv[2], &index_start));
+
+    long long num_samples;
+    ASSERT_NOERROR_STRING_FXN(RedisModule_StringToLongLong(argv[3], &num_samples));
+
+    size_t value_length;
+    const char *value = RedisModule_StringPtrLen(argv[4], &value_length);
+
+    RedisModuleStreamID last_id = {0, 0};
+    if (StreamAddCompressed(ctx, key, index_start, num_samples, value, value_length, &last_id) != REDISMODULE_OK) {
+        return RedisModule_ReplyWithError(ctx, "ERR Xadd failed.");
+    }
+    return ReplyWithStreamID(ctx, &last_id);
+}
+
+int BatchXaddVariableCompressedCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // batch_xadd_variable_compressed <key> <index start> <n samples> <block in bytes>
+    // The block is <uint32 little-endian: n samples> followed by the compressed sizes and values of the samples; the
+    // number of samples is checked against the block's so that readers can always decode it.
     if (argc != 5) {
         return RedisModule_WrongArity(ctx);
     }
@@ -148,38 +439,293 @@ int BatchXaddVariableCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int
     long long index_start;
     ASSERT_NOERROR_STRING_FXN(RedisModule_StringToLongLong(argv[2], &index_start));
 
+    long long num_samples;
+    ASSERT_NOERROR_STRING_FXN(RedisModule_StringToLongLong(argv[3], &num_samples));
+
+    size_t value_length;
+    const char *value = RedisModule_StringPtrLen(argv[4], &value_length);
+    if (value_length < 4) {
+        return RedisModule_ReplyWithError(ctx, "ERR Block is too short.");
+    }
+    const unsigned char *header = (const unsigned char *) value;
+    uint32_t block_num_samples = (uint32_t) header[0] | ((uint32_t) header[1] << 8)
+                                 | ((uint32_t) header[2] << 16) | ((uint32_t) header[3] << 24);
+    if (num_samples <= 0 || (long long) block_num_samples != num_samples) {
+        return RedisModule_ReplyWithError(ctx, "ERR Number of samples does not match the block.");
+    }
+
+    RedisModuleStreamID last_id = {0, 0};
+    if (StreamAddCompressed(ctx, key, index_start, num_samples, value, value_length, &last_id) != REDISMODULE_OK) {
+        return RedisModule_ReplyWithError(ctx, "ERR Xadd failed.");
+    }
+    return ReplyWithStreamID(ctx, &last_id);
+}
+
+int BatchXaddVariableCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // batch_xadd_variable <key> <index start> <sizes in ints> [MAXLEN <n> | MAXAGE <ms>] <value in bytes>
+    if (argc != 5 && argc != 7) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModule_AutoMemory(ctx);
+
+    // open the key and make sure it's indeed a STREAM
+    RedisModuleKey *key =
+        RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_STREAM &&
+        RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY) {
+        return RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    }
+
+    long long index_start;
+    ASSERT_NOERROR_STRING_FXN(RedisModule_StringToLongLong(argv[2], &index_start));
+
     size_t sizes_length_raw;
     const char *sizes_raw = RedisModule_StringPtrLen(argv[3], &sizes_length_raw);
     const int *sizes = (const int *) sizes_raw;
     long long num_samples = sizes_length_raw / sizeof(int);
 
+    RiverRetention retention = {RIVER_RETENTION_NONE, 0};
+    if (argc == 7 && ParseRetention(argv[4], argv[5], &retention) != REDISMODULE_OK) {
+        return RedisModule_ReplyWithError(ctx, "ERR Invalid retention policy.");
+    }
+
     size_t value_length;
-    const char *value = RedisModule_StringPtrLen(argv[4], &value_length);
+    const char *value = RedisModule_StringPtrLen(argv[argc - 1], &value_length);
 
-    RedisModuleString **xadd_params = (RedisModuleString **) RedisModule_Alloc(sizeof(RedisModuleString *) * 4);
-    size_t sample_start = 0;
-    for (long long i = 0; i < num_samples; i++) {
-        const char *i_str = "i";
-        xadd_params[0] = RedisModule_CreateString(ctx, i_str, strlen(i_str));
-        xadd_params[1] = RedisModule_CreateStringFromLongLong(ctx, index_start + i);
+    RedisModuleStreamID last_id = {0, 0};
+    if (StreamAddVariableWidth(ctx, key, index_start, num_samples, sizes, value, &last_id) != REDISMODULE_OK) {
+        return RedisModule_ReplyWithError(ctx, "ERR Xadd failed.");
+    }
+    ApplyRetention(key, &retention);
+    return ReplyWithStreamID(ctx, &last_id);
+}
 
-        const char *val_str = "val";
-        xadd_params[2] = RedisModule_CreateString(ctx, val_str, strlen(val_str));
-        xadd_params[3] = RedisModule_CreateString(ctx, &value[sample_start], sizes[i]);
+int BatchXaddWireCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // batch_xadd_wire <key> <index start> <n samples> <sample size in bytes, or -1 if variable width> <codec>
+    //     [MAXLEN <n> | MAXAGE <ms>] <compressed value in bytes>
+    // For variable width, the uncompressed value is <sizes in ints> followed by <value in bytes>.
+    if (argc != 7 && argc != 9) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModule_AutoMemory(ctx);
 
-        // fields and values;
-        int stream_add_resp = RedisModule_StreamAdd(key, REDISMODULE_STREAM_ADD_AUTOID, NULL, xadd_params, 2);
-        if (stream_add_resp != REDISMODULE_OK) {
-            return RedisModule_ReplyWithError(ctx, "ERR Xadd failed.");
+    // open the key and make sure it's indeed a STREAM
+    RedisModuleKey *key =
+        RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_STREAM &&
+        RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY) {
+        return RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    }
+
+    long long index_start;
+    long long num_samples;
+    long long sample_size_bytes;
+    ASSERT_NOERROR_STRING_FXN(RedisModule_StringToLongLong(argv[2], &index_start));
+    ASSERT_NOERROR_STRING_FXN(RedisModule_StringToLongLong(argv[3], &num_samples));
+    ASSERT_NOERROR_STRING_FXN(RedisModule_StringToLongLong(argv[4], &sample_size_bytes));
+    if (num_samples < 0) {
+        return RedisModule_ReplyWithError(ctx, "ERR Invalid number of samples.");
+    }
+
+    RiverWireCodec codec = ParseWireCodec(argv[5]);
+    if (codec == RIVER_WIRE_UNSUPPORTED) {
+        return RedisModule_ReplyWithError(ctx, "ERR Unsupported wire compression codec.");
+    }
+
+    RiverRetention retention = {RIVER_RETENTION_NONE, 0};
+    if (argc == 9 && ParseRetention(argv[6], argv[7], &retention) != REDISMODULE_OK) {
+        return RedisModule_ReplyWithError(ctx, "ERR Invalid retention policy.");
+    }
+
+    size_t payload_length;
+    const char *payload = RedisModule_StringPtrLen(argv[argc - 1], &payload_length);
+    size_t value_length;
+    char *value = WireDecompress(codec, payload, payload_length, &value_length);
+    if (value == NULL) {
+        return RedisModule_ReplyWithError(ctx, "ERR Failed to decompress payload.");
+    }
+
+    RedisModuleStreamID last_id = {0, 0};
+    int resp;
+    if (sample_size_bytes < 0) {
+        if ((size_t) num_samples > value_length / sizeof(int)) {
+            RedisModule_Free(value);
+            return RedisModule_ReplyWithError(ctx, "ERR Payload too small for the given number of samples.");
+        }
+        size_t sizes_length = num_samples * sizeof(int);
+        const int *sizes = (const int *) value;
+        size_t total_size = 0;
+        for (long long i = 0; i < num_samples; i++) {
+            if (sizes[i] < 0) {
+                RedisModule_Free(value);
+                return RedisModule_ReplyWithError(ctx, "ERR Invalid sample size.");
+            }
+            total_size += sizes[i];
+        }
+        if (total_size != value_length - sizes_length) {
+            RedisModule_Free(value);
+            return RedisModule_ReplyWithError(ctx, "ERR Payload size does not match the given sizes.");
+        }
+        resp = StreamAddVariableWidth(ctx, key, index_start, num_samples, sizes, value + sizes_length, &last_id);
+    } else {
+        if ((size_t) (num_samples * sample_size_bytes) != value_length) {
+            RedisModule_Free(value);
+            return RedisModule_ReplyWithError(ctx, "ERR Payload size does not match number of samples.");
         }
+        resp = StreamAddFixedWidth(ctx, key, index_start, num_samples, sample_size_bytes, value, &last_id);
+    }
+    RedisModule_Free(value);
 
-        for (int j = 0; j < 4; j++) {
-            RedisModule_FreeString(ctx, xadd_params[j]);
+    if (resp != REDISMODULE_OK) {
+        return RedisModule_ReplyWithError(ctx, "ERR Xadd failed.");
+    }
+    ApplyRetention(key, &retention);
+    return ReplyWithStreamID(ctx, &last_id);
+}
+
+int XrangePackedCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // xrange_packed <key> <start id, inclusive> <count> <codec>
+    //
+    // Reads up to <count> consecutive data entries (i.e. those with exactly the fields "i" and "val") starting at
+    // <start id>, stopping early at the first entry that isn't a data entry (e.g. a tombstone, EOF, or compressed
+    // reference) so the caller can handle it via XRANGE. Replies with an array of:
+    //   1) number of entries read, n
+    //   2) sample index ("i") of the last entry read, or -1 if n = 0
+    //   3) the wire-compressed payload of:
+    //      <n x (uint64 ms, uint64 seq) stream ids> <n x int32 value sizes> <n values, concatenated>
+    //   4) 1 if reading stopped at an entry that isn't a data entry, else 0 (i.e. the stream had no more entries)
+    if (argc != 5) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModule_AutoMemory(ctx);
+
+    RedisModuleKey *key = RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    int key_type = RedisModule_KeyType(key);
+    if (key_type != REDISMODULE_KEYTYPE_STREAM && key_type != REDISMODULE_KEYTYPE_EMPTY) {
+        return RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+    }
+
+    RedisModuleStreamID start_id;
+    if (RedisModule_StringToStreamID(argv[2], &start_id) != REDISMODULE_OK) {
+        return RedisModule_ReplyWithError(ctx, "ERR Invalid stream ID.");
+    }
+
+    long long count;
+    ASSERT_NOERROR_STRING_FXN(RedisModule_StringToLongLong(argv[3], &count));
+    if (count <= 0) {
+        return RedisModule_ReplyWithError(ctx, "ERR Count must be positive.");
+    }
+
+    RiverWireCodec codec = ParseWireCodec(argv[4]);
+    if (codec == RIVER_WIRE_UNSUPPORTED) {
+        return RedisModule_ReplyWithError(ctx, "ERR Unsupported wire compression codec.");
+    }
+
+    long long n = 0;
+    long long last_sample_index = -1;
+    int stopped_at_non_data_entry = 0;
+    uint64_t *ids = NULL;
+    int32_t *sizes = NULL;
+    char *values = NULL;
+    size_t values_length = 0;
+    size_t values_capacity = 0;
+
+    if (key_type == REDISMODULE_KEYTYPE_STREAM
+        && RedisModule_StreamIteratorStart(key, 0, &start_id, NULL) == REDISMODULE_OK) {
+        // Size the buffers by what the stream can actually hold rather than trusting the client's count.
+        long long stream_length = (long long) RedisModule_ValueLength(key);
+        if (count > stream_length) {
+            count = stream_length;
         }
-        sample_start += sizes[i];
+        ids = RedisModule_Alloc(sizeof(uint64_t) * 2 * count);
+        sizes = RedisModule_Alloc(sizeof(int32_t) * count);
+
+        RedisModuleStreamID id;
+        long numfields;
+        while (n < count && RedisModule_StreamIteratorNextID(key, &id, &numfields) == REDISMODULE_OK) {
+            if (numfields != 2) {
+                stopped_at_non_data_entry = 1;
+                break;
+            }
+
+            RedisModuleString *field;
+            RedisModuleString *field_value;
+            const char *sample_index_str = NULL;
+            size_t sample_index_len = 0;
+            const char *val = NULL;
+            size_t val_len = 0;
+            while (RedisModule_StreamIteratorNextField(key, &field, &field_value) == REDISMODULE_OK) {
+                size_t field_len;
+                const char *field_str = RedisModule_StringPtrLen(field, &field_len);
+                if (field_len == 1 && field_str[0] == 'i') {
+                    sample_index_str = RedisModule_StringPtrLen(field_value, &sample_index_len);
+                } else if (field_len == 3 && strncmp(field_str, "val", 3) == 0) {
+                    val = RedisModule_StringPtrLen(field_value, &val_len);
+                }
+            }
+            if (sample_index_str == NULL || val == NULL) {
+                stopped_at_non_data_entry = 1;
+                break;
+            }
+
+            if (values_length + val_len > values_capacity) {
+                values_capacity = (values_length + val_len) * 2;
+                values = RedisModule_Realloc(values, values_capacity);
+            }
+            memcpy(values + values_length, val, val_len);
+            values_length += val_len;
+
+            ids[2 * n] = id.ms;
+            ids[2 * n + 1] = id.seq;
+            sizes[n] = (int32_t) val_len;
+            last_sample_index = strtoll(sample_index_str, NULL, 10);
+            n++;
+        }
+        RedisModule_StreamIteratorStop(key);
     }
-    RedisModule_Free(xadd_params);
-    return RedisModule_ReplyWithSimpleString(ctx, "OK");
+
+    size_t ids_length = sizeof(uint64_t) * 2 * n;
+    size_t sizes_length = sizeof(int32_t) * n;
+    size_t packed_length = ids_length + sizes_length + values_length;
+    char *packed = RedisModule_Alloc(packed_length > 0 ? packed_length : 1);
+    if (n > 0) {
+        memcpy(packed, ids, ids_length);
+        memcpy(packed + ids_length, sizes, sizes_length);
+        memcpy(packed + ids_length + sizes_length, values, values_length);
+    }
+    if (ids != NULL) {
+        RedisModule_Free(ids);
+    }
+    if (sizes != NULL) {
+        RedisModule_Free(sizes);
+    }
+    if (values != NULL) {
+        RedisModule_Free(values);
+    }
+
+    size_t compressed_length;
+    char *compressed = WireCompress(codec, packed, packed_length, &compressed_length);
+    RedisModule_Free(packed);
+    if (compressed == NULL) {
+        return RedisModule_ReplyWithError(ctx, "ERR Failed to compress payload.");
+    }
+
+    RedisModule_ReplyWithArray(ctx, 4);
+    RedisModule_ReplyWithLongLong(ctx, n);
+    RedisModule_ReplyWithLongLong(ctx, last_sample_index);
+    RedisModule_ReplyWithStringBuffer(ctx, compressed, compressed_length);
+    RedisModule_ReplyWithLongLong(ctx, stopped_at_non_data_entry);
+    RedisModule_Free(compressed);
+    return REDISMODULE_OK;
+}
+
+int WireCodecSupportedCommand(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    // wire_codec_supported <codec>
+    // Replies 1 if this build of the module can compress and decompress the given wire codec, else 0.
+    if (argc != 2) {
+        return RedisModule_WrongArity(ctx);
+    }
+    return RedisModule_ReplyWithLongLong(ctx, ParseWireCodec(argv[1]) != RIVER_WIRE_UNSUPPORTED);
 }
 
 int RedisModule_OnLoad(RedisModuleCtx *ctx) {
@@ -193,6 +739,10 @@ int RedisModule_OnLoad(RedisModuleCtx *ctx) {
     RMUtil_RegisterWriteCmd(ctx, "river.batch_xadd", BatchXaddCommand);
     RMUtil_RegisterWriteCmd(ctx, "river.batch_xadd_variable", BatchXaddVariableCommand);
     RMUtil_RegisterWriteCmd(ctx, "river.batch_xadd_compressed", BatchXaddCompressedCommand);
+    RMUtil_RegisterWriteCmd(ctx, "river.batch_xadd_variable_compressed", BatchXaddVariableCompressedCommand);
+    RMUtil_RegisterWriteCmd(ctx, "river.batch_xadd_wire", BatchXaddWireCommand);
+    RMUtil_RegisterReadCmd(ctx, "river.xrange_packed", XrangePackedCommand);
+    RMUtil_RegisterReadCmd(ctx, "river.wire_codec_supported", WireCodecSupportedCommand);
 
     return REDISMODULE_OK;
 }
@@ -9,5 +9,11 @@
 #include "reader.h"
 #include "schema.h"
 #include "redis.h"
+#include "memory_accountant.h"
+#include "broadcaster.h"
+#include "concurrent_writer.h"
+#include "writer_group.h"
+#include "static_schema.h"
+#include "compression/compression_pool.h"
 
 #endif //PARENT_RIVER_H
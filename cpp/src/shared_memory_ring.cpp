@@ -0,0 +1,285 @@
+#include "shared_memory_ring.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <spdlog/fmt/fmt.h>
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace river {
+namespace internal {
+
+static const uint64_t RING_MAGIC = 0x676e697272766972ULL;
+static const uint32_t RING_VERSION = 1;
+static const int64_t MIN_RING_CAPACITY_BYTES = 4096;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "Shared memory rings need lock-free 64-bit atomics.");
+
+// Lives at the start of the shared memory object, followed by the ring's data. The two positions are on separate
+// cache lines, as the writer updates both with every record while readers poll them.
+struct SharedMemoryRing::Header {
+    std::atomic<uint64_t> magic;
+    uint32_t version;
+    uint64_t capacity;
+    int64_t initialized_at_us;
+    char stream_name[256];
+    // Readers can't trust any bytes at positions below (reserved_position - capacity).
+    alignas(64) std::atomic<uint64_t> reserved_position;
+    // All records below this position have been fully written.
+    alignas(64) std::atomic<uint64_t> published_position;
+    std::atomic<uint64_t> latest_record_position;
+};
+
+size_t SharedMemoryRing::DataOffset() {
+    return (sizeof(Header) + 63) / 64 * 64;
+}
+
+std::string SharedMemoryRing::ObjectName(const std::string &stream_name) {
+    // Stream names can contain characters not allowed in object names, so sanitize them and disambiguate with a hash
+    // (FNV-1a, as it must be identical across processes) of the full name.
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    std::string sanitized;
+    for (char c : stream_name) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+        if (sanitized.size() < 200) {
+            sanitized.push_back(isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_' ? c : '_');
+        }
+    }
+    return fmt::format("/river-{}-{:016x}", sanitized, hash);
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+
+std::unique_ptr<SharedMemoryRing> SharedMemoryRing::Create(const std::string &, int64_t, int64_t) {
+    throw std::runtime_error("Shared memory rings are not supported on Windows.");
+}
+
+std::unique_ptr<SharedMemoryRing> SharedMemoryRing::Open(const std::string &, int64_t) {
+    return nullptr;
+}
+
+SharedMemoryRing::~SharedMemoryRing() = default;
+
+#else
+
+std::unique_ptr<SharedMemoryRing> SharedMemoryRing::Create(const std::string &stream_name,
+                                                           int64_t initialized_at_us,
+                                                           int64_t capacity_bytes) {
+    if (capacity_bytes < MIN_RING_CAPACITY_BYTES) {
+        throw std::invalid_argument(fmt::format(
+            "Shared memory ring must be at least {} bytes; got {}.", MIN_RING_CAPACITY_BYTES, capacity_bytes));
+    }
+    if (stream_name.size() >= sizeof(Header::stream_name)) {
+        throw std::invalid_argument("Stream name is too long for a shared memory ring.");
+    }
+
+    std::string object_name = ObjectName(stream_name);
+    // Any existing ring is left over from a previous stream of the same name, whose writer didn't clean up.
+    shm_unlink(object_name.c_str());
+    int fd = shm_open(object_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        throw std::runtime_error(fmt::format("shm_open of {} failed: {}", object_name, strerror(errno)));
+    }
+
+    size_t mapping_num_bytes = DataOffset() + static_cast<size_t>(capacity_bytes);
+    if (ftruncate(fd, static_cast<off_t>(mapping_num_bytes)) != 0) {
+        int err = errno;
+        close(fd);
+        shm_unlink(object_name.c_str());
+        throw std::runtime_error(fmt::format("Sizing {} to {} bytes failed: {}",
+                                             object_name, mapping_num_bytes, strerror(err)));
+    }
+    void *mapping = mmap(nullptr, mapping_num_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int err = errno;
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        shm_unlink(object_name.c_str());
+        throw std::runtime_error(fmt::format("mmap of {} failed: {}", object_name, strerror(err)));
+    }
+
+    auto *header = new (mapping) Header();
+    header->version = RING_VERSION;
+    header->capacity = static_cast<uint64_t>(capacity_bytes);
+    header->initialized_at_us = initialized_at_us;
+    strncpy(header->stream_name, stream_name.c_str(), sizeof(header->stream_name) - 1);
+    header->reserved_position.store(0, std::memory_order_relaxed);
+    header->published_position.store(0, std::memory_order_relaxed);
+    header->latest_record_position.store(0, std::memory_order_relaxed);
+    // Readers ignore the ring until the magic is set, i.e. until the rest of the header is written.
+    header->magic.store(RING_MAGIC, std::memory_order_release);
+
+    return std::unique_ptr<SharedMemoryRing>(new SharedMemoryRing(object_name, true, mapping, mapping_num_bytes));
+}
+
+std::unique_ptr<SharedMemoryRing> SharedMemoryRing::Open(const std::string &stream_name, int64_t initialized_at_us) {
+    std::string object_name = ObjectName(stream_name);
+    int fd = shm_open(object_name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < DataOffset()) {
+        close(fd);
+        return nullptr;
+    }
+    auto mapping_num_bytes = static_cast<size_t>(st.st_size);
+    void *mapping = mmap(nullptr, mapping_num_bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return nullptr;
+    }
+
+    auto *header = reinterpret_cast<Header *>(mapping);
+    if (header->magic.load(std::memory_order_acquire) != RING_MAGIC
+        || header->version != RING_VERSION
+        || header->initialized_at_us != initialized_at_us
+        || strncmp(header->stream_name, stream_name.c_str(), sizeof(header->stream_name)) != 0
+        || DataOffset() + header->capacity != mapping_num_bytes) {
+        munmap(mapping, mapping_num_bytes);
+        return nullptr;
+    }
+
+    return std::unique_ptr<SharedMemoryRing>(new SharedMemoryRing(object_name, false, mapping, mapping_num_bytes));
+}
+
+SharedMemoryRing::~SharedMemoryRing() {
+    if (owned_memory_) {
+        return;
+    }
+    munmap(mapping_, mapping_num_bytes_);
+    if (is_owner_) {
+        shm_unlink(object_name_.c_str());
+    }
+}
+
+#endif
+
+std::unique_ptr<SharedMemoryRing> SharedMemoryRing::CreateInProcess(int64_t capacity_bytes) {
+    if (capacity_bytes < MIN_RING_CAPACITY_BYTES) {
+        throw std::invalid_argument(fmt::format(
+            "Ring must be at least {} bytes; got {}.", MIN_RING_CAPACITY_BYTES, capacity_bytes));
+    }
+
+    // Over-allocate so the header can be aligned to a cache line.
+    size_t num_bytes = DataOffset() + static_cast<size_t>(capacity_bytes);
+    size_t allocated_num_bytes = num_bytes + 64;
+    std::unique_ptr<char[]> memory(new char[allocated_num_bytes]);
+    void *aligned = memory.get();
+    std::align(64, num_bytes, aligned, allocated_num_bytes);
+
+    auto *header = new (aligned) Header();
+    header->version = RING_VERSION;
+    header->capacity = static_cast<uint64_t>(capacity_bytes);
+    header->reserved_position.store(0, std::memory_order_relaxed);
+    header->published_position.store(0, std::memory_order_relaxed);
+    header->latest_record_position.store(0, std::memory_order_relaxed);
+    header->magic.store(RING_MAGIC, std::memory_order_release);
+
+    auto ring = std::unique_ptr<SharedMemoryRing>(new SharedMemoryRing("", false, aligned, num_bytes));
+    ring->owned_memory_ = std::move(memory);
+    return ring;
+}
+
+SharedMemoryRing::SharedMemoryRing(std::string object_name, bool is_owner, void *mapping, size_t mapping_num_bytes)
+    : object_name_(std::move(object_name)), is_owner_(is_owner), mapping_(mapping),
+      mapping_num_bytes_(mapping_num_bytes) {
+    header_ = reinterpret_cast<Header *>(mapping_);
+    data_ = reinterpret_cast<char *>(mapping_) + DataOffset();
+    capacity_ = header_->capacity;
+}
+
+bool SharedMemoryRing::Publish(SharedMemoryRingRecord record, const int *sizes, const char *data) {
+    uint64_t unpadded_num_bytes = sizeof(record) + record.sizes_num_bytes + record.data_num_bytes;
+    record.num_bytes = (unpadded_num_bytes + 7) / 8 * 8;
+    if (record.num_bytes > capacity_) {
+        return false;
+    }
+
+    // Only this (single) writer moves the positions, so they can't change from under us.
+    uint64_t position = header_->published_position.load(std::memory_order_relaxed);
+    uint64_t end_position = position + record.num_bytes;
+
+    // Like a seqlock: readers copy a record out and only then check whether the writer had started overwriting it.
+    header_->reserved_position.store(end_position, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    CopyIn(position, &record, sizeof(record));
+    if (record.sizes_num_bytes > 0) {
+        CopyIn(position + sizeof(record), sizes, record.sizes_num_bytes);
+    }
+    if (record.data_num_bytes > 0) {
+        CopyIn(position + sizeof(record) + record.sizes_num_bytes, data, record.data_num_bytes);
+    }
+
+    header_->latest_record_position.store(position, std::memory_order_relaxed);
+    header_->published_position.store(end_position, std::memory_order_release);
+    return true;
+}
+
+uint64_t SharedMemoryRing::write_position() const {
+    return header_->published_position.load(std::memory_order_acquire);
+}
+
+uint64_t SharedMemoryRing::latest_record_position() const {
+    // Loaded after (and published before) the published position, so it's always of a fully written record.
+    header_->published_position.load(std::memory_order_acquire);
+    return header_->latest_record_position.load(std::memory_order_relaxed);
+}
+
+SharedMemoryRing::ReadResult SharedMemoryRing::ReadHeader(uint64_t position, SharedMemoryRingRecord *record) const {
+    if (position >= header_->published_position.load(std::memory_order_acquire)) {
+        return ReadResult::NOT_YET_PUBLISHED;
+    }
+    if (IsOverrun(position)) {
+        return ReadResult::OVERRUN;
+    }
+    CopyOut(position, record, sizeof(*record));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return IsOverrun(position) ? ReadResult::OVERRUN : ReadResult::OK;
+}
+
+SharedMemoryRing::ReadResult SharedMemoryRing::Read(uint64_t position,
+                                                    SharedMemoryRingRecord *record,
+                                                    std::vector<char> *payload) const {
+    auto result = ReadHeader(position, record);
+    if (result != ReadResult::OK) {
+        return result;
+    }
+
+    // The header wasn't overwritten while copying it, so its sizes can be trusted.
+    payload->resize(record->sizes_num_bytes + record->data_num_bytes);
+    CopyOut(position + sizeof(*record), payload->data(), payload->size());
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return IsOverrun(position) ? ReadResult::OVERRUN : ReadResult::OK;
+}
+
+void SharedMemoryRing::CopyIn(uint64_t position, const void *src, size_t num_bytes) {
+    size_t offset = position % capacity_;
+    size_t first_num_bytes = std::min(num_bytes, static_cast<size_t>(capacity_ - offset));
+    memcpy(data_ + offset, src, first_num_bytes);
+    memcpy(data_, reinterpret_cast<const char *>(src) + first_num_bytes, num_bytes - first_num_bytes);
+}
+
+void SharedMemoryRing::CopyOut(uint64_t position, void *dest, size_t num_bytes) const {
+    size_t offset = position % capacity_;
+    size_t first_num_bytes = std::min(num_bytes, static_cast<size_t>(capacity_ - offset));
+    memcpy(dest, data_ + offset, first_num_bytes);
+    memcpy(reinterpret_cast<char *>(dest) + first_num_bytes, data_, num_bytes - first_num_bytes);
+}
+
+bool SharedMemoryRing::IsOverrun(uint64_t position) const {
+    // Publishing a record up to position R overwrites whatever was at positions below R - capacity.
+    return header_->reserved_position.load(std::memory_order_relaxed) - position > capacity_;
+}
+
+}
+}
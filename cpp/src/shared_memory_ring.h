@@ -0,0 +1,130 @@
+#ifndef RIVER_SRC_SHARED_MEMORY_RING_H_
+#define RIVER_SRC_SHARED_MEMORY_RING_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace river {
+namespace internal {
+
+/**
+ * Header of one batch of samples published to a SharedMemoryRing. In the ring, each record is followed by its
+ * payload: the size of each sample as ints (only for variable-width streams), then the samples themselves.
+ */
+struct SharedMemoryRingRecord {
+    // Total number of bytes this record takes in the ring, including this header and padding.
+    uint64_t num_bytes;
+    int64_t first_sample_index;
+    // Number of samples in this record, or -1 if this record signals EOF.
+    int64_t num_samples;
+    int64_t stream_key_idx;
+    // Redis stream ID ("<ms>-<seq>") of the last sample of this record, so readers can resume from Redis after it.
+    uint64_t last_id_ms;
+    uint64_t last_id_seq;
+    int64_t sizes_num_bytes;
+    int64_t data_num_bytes;
+};
+
+/**
+ * A single-producer, multi-consumer ring of sample batches, through which a StreamWriter publishes samples to
+ * StreamReaders on the same host (via POSIX shared memory) in addition to writing them to Redis, and through which a
+ * StreamBroadcaster publishes samples to its subscribers (in process memory).
+ *
+ * The ring is a byte buffer of records addressed by monotonically increasing positions. The writer never waits for
+ * readers; instead, readers detect when a record they're reading has been overwritten ("overrun") and fall back to
+ * Redis, which remains the source of truth. Readers only ever map the ring read-only.
+ */
+class SharedMemoryRing {
+public:
+    enum class ReadResult {
+        OK,
+        // No record has been published at the given position yet.
+        NOT_YET_PUBLISHED,
+        // The record at the given position has already been (or is being) overwritten.
+        OVERRUN,
+    };
+
+    /**
+     * Name of the shared memory object holding the ring for the given stream.
+     */
+    static std::string ObjectName(const std::string &stream_name);
+
+    /**
+     * Creates the ring for a newly initialized stream, replacing any stale ring of the same name. The ring is removed
+     * once the returned object is destroyed, though readers that have it mapped can continue reading it.
+     */
+    static std::unique_ptr<SharedMemoryRing> Create(const std::string &stream_name,
+                                                    int64_t initialized_at_us,
+                                                    int64_t capacity_bytes);
+
+    /**
+     * Attaches to the ring of the given stream. Returns nullptr if there is no such ring (e.g. the writer is on
+     * another host or didn't enable it), or if it belongs to a different stream of the same name.
+     */
+    static std::unique_ptr<SharedMemoryRing> Open(const std::string &stream_name, int64_t initialized_at_us);
+
+    /**
+     * Creates a ring in this process's memory, for publishing to other threads only.
+     */
+    static std::unique_ptr<SharedMemoryRing> CreateInProcess(int64_t capacity_bytes);
+
+    ~SharedMemoryRing();
+
+    /**
+     * Publishes a record; its num_bytes is filled in here. Returns false if the record is larger than the whole ring,
+     * in which case it's dropped, and readers see a gap in sample indices.
+     */
+    bool Publish(SharedMemoryRingRecord record, const int *sizes, const char *data);
+
+    uint64_t capacity() const {
+        return capacity_;
+    }
+
+    /**
+     * Position at which the next record will be published.
+     */
+    uint64_t write_position() const;
+
+    /**
+     * Position of the most recently published record, from which readers that fell behind can resume.
+     */
+    uint64_t latest_record_position() const;
+
+    /**
+     * Copies out the header of the record at the given position.
+     */
+    ReadResult ReadHeader(uint64_t position, SharedMemoryRingRecord *record) const;
+
+    /**
+     * Copies out the header and payload (sizes, then data) of the record at the given position.
+     */
+    ReadResult Read(uint64_t position, SharedMemoryRingRecord *record, std::vector<char> *payload) const;
+
+private:
+    struct Header;
+    static size_t DataOffset();
+
+    SharedMemoryRing(std::string object_name, bool is_owner, void *mapping, size_t mapping_num_bytes);
+
+    void CopyIn(uint64_t position, const void *src, size_t num_bytes);
+    void CopyOut(uint64_t position, void *dest, size_t num_bytes) const;
+    bool IsOverrun(uint64_t position) const;
+
+    const std::string object_name_;
+    const bool is_owner_;
+    void *mapping_;
+    const size_t mapping_num_bytes_;
+    // Only set for in-process rings, i.e. ones that aren't mapped.
+    std::unique_ptr<char[]> owned_memory_;
+    Header *header_;
+    char *data_;
+    uint64_t capacity_;
+};
+
+}
+}
+
+#endif //RIVER_SRC_SHARED_MEMORY_RING_H_
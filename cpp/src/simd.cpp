@@ -0,0 +1,737 @@
+#include "simd.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#define RIVER_HAS_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace river {
+namespace internal {
+
+int64_t SumSizes(const int *sizes, int64_t num_samples) {
+    int64_t i = 0;
+    int64_t total = 0;
+#if defined(__AVX2__)
+    // Widen to 64 bits before adding, as a batch's total can overflow an int.
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 8 <= num_samples; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(sizes + i));
+        acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+        acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+    }
+    alignas(32) int64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), acc);
+    total = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(__SSE2__)
+    // SSE2 has no sign-extending conversion, so interleave each size with its sign instead.
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 4 <= num_samples; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(sizes + i));
+        __m128i sign = _mm_srai_epi32(v, 31);
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, sign));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(v, sign));
+    }
+    alignas(16) int64_t lanes[2];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes), acc);
+    total = lanes[0] + lanes[1];
+#elif defined(__ARM_NEON)
+    int64x2_t acc = vdupq_n_s64(0);
+    for (; i + 4 <= num_samples; i += 4) {
+        acc = vpadalq_s32(acc, vld1q_s32(sizes + i));
+    }
+    total = vgetq_lane_s64(acc, 0) + vgetq_lane_s64(acc, 1);
+#endif
+    for (; i < num_samples; i++) {
+        total += sizes[i];
+    }
+    return total;
+}
+
+// Copies one field between its column and each sample; sizes known at compile time become single loads and stores.
+template <int FieldSize, bool Interleave>
+static void CopyField(const char *in, int64_t num_samples, char *out, int64_t sample_size) {
+    for (int64_t i = 0; i < num_samples; i++) {
+        if (Interleave) {
+            memcpy(out + i * sample_size, in + i * FieldSize, FieldSize);
+        } else {
+            memcpy(out + i * FieldSize, in + i * sample_size, FieldSize);
+        }
+    }
+}
+
+template <bool Interleave>
+static void CopyField(const char *in, int field_size, int64_t num_samples, char *out, int64_t sample_size) {
+    switch (field_size) {
+        case 1: return CopyField<1, Interleave>(in, num_samples, out, sample_size);
+        case 2: return CopyField<2, Interleave>(in, num_samples, out, sample_size);
+        case 4: return CopyField<4, Interleave>(in, num_samples, out, sample_size);
+        case 8: return CopyField<8, Interleave>(in, num_samples, out, sample_size);
+        default:
+            for (int64_t i = 0; i < num_samples; i++) {
+                if (Interleave) {
+                    memcpy(out + i * sample_size, in + i * field_size, field_size);
+                } else {
+                    memcpy(out + i * field_size, in + i * sample_size, field_size);
+                }
+            }
+    }
+}
+
+#ifdef RIVER_HAS_SSE2
+static inline __m128i Load(const char *p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+static inline void Store(char *p, __m128i v) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v);
+}
+
+// Transposes a square block of 16-byte rows, i.e. (16 / field_size) rows of as many fields: the i-th output row gets
+// the i-th field of each input row. Whether rows are columns or samples, the transpose is the same either way.
+static void Transpose16ByteRows(int field_size, const char *const *in, char *const *out) {
+    if (field_size == 4) {
+        __m128i r0 = Load(in[0]), r1 = Load(in[1]), r2 = Load(in[2]), r3 = Load(in[3]);
+        __m128i t0 = _mm_unpacklo_epi32(r0, r1), t1 = _mm_unpacklo_epi32(r2, r3);
+        __m128i t2 = _mm_unpackhi_epi32(r0, r1), t3 = _mm_unpackhi_epi32(r2, r3);
+        Store(out[0], _mm_unpacklo_epi64(t0, t1));
+        Store(out[1], _mm_unpackhi_epi64(t0, t1));
+        Store(out[2], _mm_unpacklo_epi64(t2, t3));
+        Store(out[3], _mm_unpackhi_epi64(t2, t3));
+    } else if (field_size == 8) {
+        __m128i r0 = Load(in[0]), r1 = Load(in[1]);
+        Store(out[0], _mm_unpacklo_epi64(r0, r1));
+        Store(out[1], _mm_unpackhi_epi64(r0, r1));
+    } else {
+        __m128i r[8];
+        for (int f = 0; f < 8; f++) {
+            r[f] = Load(in[f]);
+        }
+        // Pairs of rows, then quads, then all 8, for fields 0-3 (lo) and 4-7 (hi).
+        __m128i a0 = _mm_unpacklo_epi16(r[0], r[1]), a1 = _mm_unpacklo_epi16(r[2], r[3]);
+        __m128i a2 = _mm_unpacklo_epi16(r[4], r[5]), a3 = _mm_unpacklo_epi16(r[6], r[7]);
+        __m128i a4 = _mm_unpackhi_epi16(r[0], r[1]), a5 = _mm_unpackhi_epi16(r[2], r[3]);
+        __m128i a6 = _mm_unpackhi_epi16(r[4], r[5]), a7 = _mm_unpackhi_epi16(r[6], r[7]);
+        __m128i b0 = _mm_unpacklo_epi32(a0, a1), b1 = _mm_unpacklo_epi32(a2, a3);
+        __m128i b2 = _mm_unpackhi_epi32(a0, a1), b3 = _mm_unpackhi_epi32(a2, a3);
+        __m128i b4 = _mm_unpacklo_epi32(a4, a5), b5 = _mm_unpacklo_epi32(a6, a7);
+        __m128i b6 = _mm_unpackhi_epi32(a4, a5), b7 = _mm_unpackhi_epi32(a6, a7);
+        Store(out[0], _mm_unpacklo_epi64(b0, b1));
+        Store(out[1], _mm_unpackhi_epi64(b0, b1));
+        Store(out[2], _mm_unpacklo_epi64(b2, b3));
+        Store(out[3], _mm_unpackhi_epi64(b2, b3));
+        Store(out[4], _mm_unpacklo_epi64(b4, b5));
+        Store(out[5], _mm_unpackhi_epi64(b4, b5));
+        Store(out[6], _mm_unpacklo_epi64(b6, b7));
+        Store(out[7], _mm_unpackhi_epi64(b6, b7));
+    }
+}
+
+// Moves a group of (16 / field_size) equally sized fields between their columns and the samples, a square block at a
+// time, returning the number of samples done; the rest are left for CopyField().
+template <bool Interleave>
+static int64_t TransposeFieldGroup(int field_size,
+                                   const char *const *in_columns,
+                                   char *const *out_columns,
+                                   const char *in_samples,
+                                   char *out_samples,
+                                   int64_t sample_size,
+                                   int64_t num_samples) {
+    const int block = 16 / field_size;
+    const char *in[8];
+    char *out[8];
+    int64_t i = 0;
+    for (; i + block <= num_samples; i += block) {
+        for (int j = 0; j < block; j++) {
+            if (Interleave) {
+                in[j] = in_columns[j] + i * field_size;
+                out[j] = out_samples + (i + j) * sample_size;
+            } else {
+                in[j] = in_samples + (i + j) * sample_size;
+                out[j] = out_columns[j] + i * field_size;
+            }
+        }
+        Transpose16ByteRows(field_size, in, out);
+    }
+    return i;
+}
+
+// Number of consecutive fields, starting at `field`, that are of the given size and have a column, up to `max`.
+static int RunOfFieldSize(const std::vector<int> &field_sizes,
+                          const void *const *columns,
+                          size_t field,
+                          int size,
+                          int max) {
+    int run = 0;
+    while (run < max && field + run < field_sizes.size() && field_sizes[field + run] == size
+        && columns[field + run] != nullptr) {
+        run++;
+    }
+    return run;
+}
+
+// Size of the fields of the group that can be transposed together starting at `field`, or 0 if none.
+static int TransposableFieldSize(const std::vector<int> &field_sizes, const void *const *columns, size_t field) {
+    for (int size : {4, 8, 2}) {
+        if (RunOfFieldSize(field_sizes, columns, field, size, 16 / size) == 16 / size) {
+            return size;
+        }
+    }
+    return 0;
+}
+#endif
+
+void InterleaveColumns(const char *const *columns,
+                       const std::vector<int> &field_sizes,
+                       int64_t first_sample,
+                       int64_t num_samples,
+                       char *out) {
+    int64_t sample_size = 0;
+    for (int size : field_sizes) {
+        sample_size += size;
+    }
+
+    int64_t field_offset = 0;
+    for (size_t field = 0; field < field_sizes.size();) {
+        int field_size = field_sizes[field];
+        char *field_out = out + field_offset;
+        int num_fields = 1;
+        int64_t samples_done = 0;
+        const char *group[8] = {columns[field] + first_sample * field_size};
+#ifdef RIVER_HAS_SSE2
+        // Transposes in registers need a run of equally sized fields.
+        if (TransposableFieldSize(field_sizes, reinterpret_cast<const void *const *>(columns), field) == field_size) {
+            num_fields = 16 / field_size;
+            for (int f = 0; f < num_fields; f++) {
+                group[f] = columns[field + f] + first_sample * field_size;
+            }
+            samples_done = TransposeFieldGroup<true>(
+                field_size, group, nullptr, nullptr, field_out, sample_size, num_samples);
+        }
+#endif
+        for (int f = 0; f < num_fields; f++) {
+            CopyField<true>(group[f] + samples_done * field_size, field_size, num_samples - samples_done,
+                            field_out + samples_done * sample_size + f * field_size, sample_size);
+        }
+        field += num_fields;
+        field_offset += num_fields * field_size;
+    }
+}
+
+void DeinterleaveColumns(const char *samples,
+                         const std::vector<int> &field_sizes,
+                         int64_t num_samples,
+                         char *const *columns) {
+    int64_t sample_size = 0;
+    for (int size : field_sizes) {
+        sample_size += size;
+    }
+
+    int64_t field_offset = 0;
+    for (size_t field = 0; field < field_sizes.size();) {
+        int field_size = field_sizes[field];
+        const char *field_in = samples + field_offset;
+        if (columns[field] == nullptr) {
+            field++;
+            field_offset += field_size;
+            continue;
+        }
+        int num_fields = 1;
+        int64_t samples_done = 0;
+#ifdef RIVER_HAS_SSE2
+        if (TransposableFieldSize(field_sizes, reinterpret_cast<const void *const *>(columns), field) == field_size) {
+            num_fields = 16 / field_size;
+            samples_done = TransposeFieldGroup<false>(
+                field_size, nullptr, &columns[field], field_in, nullptr, sample_size, num_samples);
+        }
+#endif
+        for (int f = 0; f < num_fields; f++) {
+            CopyField<false>(field_in + samples_done * sample_size + f * field_size, field_size,
+                             num_samples - samples_done, columns[field + f] + samples_done * field_size,
+                             sample_size);
+        }
+        field += num_fields;
+        field_offset += num_fields * field_size;
+    }
+}
+
+static int NumericFieldSize(FieldDefinition::Type type) {
+    switch (type) {
+        case FieldDefinition::INT16: return sizeof(int16_t);
+        case FieldDefinition::INT32: return sizeof(int32_t);
+        case FieldDefinition::FLOAT: return sizeof(float);
+        default: return sizeof(double);
+    }
+}
+
+template <class InT, class OutT>
+static void ConvertColumn(const char *in, int64_t num_samples, double scale, char *out) {
+    auto *in_values = reinterpret_cast<const InT *>(in);
+    auto *out_values = reinterpret_cast<OutT *>(out);
+    auto out_scale = static_cast<OutT>(scale);
+    for (int64_t i = 0; i < num_samples; i++) {
+        out_values[i] = static_cast<OutT>(in_values[i]) * out_scale;
+    }
+}
+
+template <class OutT>
+static void ConvertColumn(const char *in, FieldDefinition::Type in_type, int64_t num_samples, double scale, char *out) {
+    switch (in_type) {
+        case FieldDefinition::INT16: return ConvertColumn<int16_t, OutT>(in, num_samples, scale, out);
+        case FieldDefinition::INT32: return ConvertColumn<int32_t, OutT>(in, num_samples, scale, out);
+        case FieldDefinition::INT64: return ConvertColumn<int64_t, OutT>(in, num_samples, scale, out);
+        case FieldDefinition::FLOAT: return ConvertColumn<float, OutT>(in, num_samples, scale, out);
+        case FieldDefinition::DOUBLE: return ConvertColumn<double, OutT>(in, num_samples, scale, out);
+        default: throw std::invalid_argument("Only numeric fields can be converted.");
+    }
+}
+
+void ConvertColumn(const char *in,
+                   FieldDefinition::Type in_type,
+                   int64_t num_samples,
+                   double scale,
+                   FieldDefinition::Type out_type,
+                   char *out) {
+    if (out_type == FieldDefinition::DOUBLE) {
+        return ConvertColumn<double>(in, in_type, num_samples, scale, out);
+    } else if (out_type != FieldDefinition::FLOAT) {
+        throw std::invalid_argument("Fields can only be converted to FLOAT or DOUBLE.");
+    }
+
+    int64_t i = 0;
+#ifdef RIVER_HAS_SSE2
+    if (in_type == FieldDefinition::INT16) {
+        // The common case of raw ADC samples; sign-extend 8 at a time by shifting them into the top of 32-bit lanes.
+        auto *in_values = reinterpret_cast<const int16_t *>(in);
+        auto *out_values = reinterpret_cast<float *>(out);
+        const __m128 out_scale = _mm_set1_ps(static_cast<float>(scale));
+        for (; i + 8 <= num_samples; i += 8) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in_values + i));
+            __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+            __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+            _mm_storeu_ps(out_values + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), out_scale));
+            _mm_storeu_ps(out_values + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), out_scale));
+        }
+    }
+#endif
+    ConvertColumn<float>(in + i * NumericFieldSize(in_type), in_type, num_samples - i, scale, out + i * sizeof(float));
+}
+
+
+#ifdef RIVER_HAS_SSE2
+static inline __m128i EvenBytes(__m128i a, __m128i b) {
+    const __m128i low_bytes = _mm_set1_epi16(0x00FF);
+    return _mm_packus_epi16(_mm_and_si128(a, low_bytes), _mm_and_si128(b, low_bytes));
+}
+
+static inline __m128i OddBytes(__m128i a, __m128i b) {
+    return _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+}
+
+// Splits 16 elements, i.e. ElementSize vectors, into one vector per byte of the elements: each round splits every pair
+// of vectors into their even and odd bytes, which after log2(ElementSize) rounds leaves byte j of each element in
+// rows[j].
+template <int ElementSize>
+static inline void ShuffleBlock(const char *in, __m128i *rows) {
+    __m128i next[ElementSize];
+    for (int k = 0; k < ElementSize; k++) {
+        rows[k] = Load(in + 16 * k);
+    }
+    for (int round = 1; round < ElementSize; round *= 2) {
+        for (int k = 0; k < ElementSize / 2; k++) {
+            next[k] = EvenBytes(rows[2 * k], rows[2 * k + 1]);
+            next[k + ElementSize / 2] = OddBytes(rows[2 * k], rows[2 * k + 1]);
+        }
+        for (int k = 0; k < ElementSize; k++) {
+            rows[k] = next[k];
+        }
+    }
+}
+
+// The inverse of ShuffleBlock(): each round interleaves the even and odd bytes back together.
+template <int ElementSize>
+static inline void UnshuffleBlock(__m128i *rows, char *out) {
+    __m128i next[ElementSize];
+    for (int round = 1; round < ElementSize; round *= 2) {
+        for (int k = 0; k < ElementSize / 2; k++) {
+            next[2 * k] = _mm_unpacklo_epi8(rows[k], rows[k + ElementSize / 2]);
+            next[2 * k + 1] = _mm_unpackhi_epi8(rows[k], rows[k + ElementSize / 2]);
+        }
+        for (int k = 0; k < ElementSize; k++) {
+            rows[k] = next[k];
+        }
+    }
+    for (int k = 0; k < ElementSize; k++) {
+        Store(out + 16 * k, rows[k]);
+    }
+}
+
+template <int ElementSize>
+static int64_t ByteShuffleBlocks(const char *in, int64_t num_elements, char *out) {
+    __m128i rows[ElementSize];
+    int64_t i = 0;
+    for (; i + 16 <= num_elements; i += 16) {
+        ShuffleBlock<ElementSize>(in + i * ElementSize, rows);
+        for (int j = 0; j < ElementSize; j++) {
+            Store(out + j * num_elements + i, rows[j]);
+        }
+    }
+    return i;
+}
+
+template <int ElementSize>
+static int64_t ByteUnshuffleBlocks(const char *in, int64_t num_elements, char *out) {
+    __m128i rows[ElementSize];
+    int64_t i = 0;
+    for (; i + 16 <= num_elements; i += 16) {
+        for (int j = 0; j < ElementSize; j++) {
+            rows[j] = Load(in + j * num_elements + i);
+        }
+        UnshuffleBlock<ElementSize>(rows, out + i * ElementSize);
+    }
+    return i;
+}
+
+// Writes the 8 bit planes of 16 bytes as 2 bytes each, `plane_size` apart, highest bit first: movemask gathers the
+// top bit of each byte, and adding each byte to itself shifts the next bit up.
+static inline void StoreBitPlanes(__m128i row, char *out, int64_t plane_size) {
+    for (int bit = 7; bit >= 0; bit--) {
+        auto mask = static_cast<uint16_t>(_mm_movemask_epi8(row));
+        memcpy(out + bit * plane_size, &mask, sizeof(mask));
+        row = _mm_add_epi8(row, row);
+    }
+}
+
+static inline __m128i LoadBitPlanes(const char *in, int64_t plane_size) {
+    // Byte i of the row is set in each plane by bit (i % 8) of its byte (i / 8).
+    const __m128i selectors = _mm_set1_epi64x(static_cast<int64_t>(0x8040201008040201ULL));
+    __m128i row = _mm_setzero_si128();
+    for (int bit = 0; bit < 8; bit++) {
+        uint16_t mask;
+        memcpy(&mask, in + bit * plane_size, sizeof(mask));
+        __m128i broadcast = _mm_set_epi64x(static_cast<int64_t>((mask >> 8) * 0x0101010101010101ULL),
+                                           static_cast<int64_t>((mask & 0xFF) * 0x0101010101010101ULL));
+        __m128i is_set = _mm_cmpeq_epi8(_mm_and_si128(broadcast, selectors), selectors);
+        row = _mm_or_si128(row, _mm_and_si128(is_set, _mm_set1_epi8(static_cast<char>(1 << bit))));
+    }
+    return row;
+}
+
+template <int ElementSize>
+static int64_t BitShuffleBlocks(const char *in, int64_t num_elements, char *out) {
+    const int64_t plane_size = num_elements / 8;
+    __m128i rows[ElementSize];
+    int64_t i = 0;
+    for (; i + 16 <= num_elements; i += 16) {
+        ShuffleBlock<ElementSize>(in + i * ElementSize, rows);
+        for (int j = 0; j < ElementSize; j++) {
+            StoreBitPlanes(rows[j], out + 8 * j * plane_size + i / 8, plane_size);
+        }
+    }
+    return i;
+}
+
+template <int ElementSize>
+static int64_t BitUnshuffleBlocks(const char *in, int64_t num_elements, char *out) {
+    const int64_t plane_size = num_elements / 8;
+    __m128i rows[ElementSize];
+    int64_t i = 0;
+    for (; i + 16 <= num_elements; i += 16) {
+        for (int j = 0; j < ElementSize; j++) {
+            rows[j] = LoadBitPlanes(in + 8 * j * plane_size + i / 8, plane_size);
+        }
+        UnshuffleBlock<ElementSize>(rows, out + i * ElementSize);
+    }
+    return i;
+}
+
+// Dispatches to the given kernel for element sizes it has a specialization for; returns the elements done.
+template <template <int> class Kernel>
+static int64_t RunShuffleKernel(int element_size, const char *in, int64_t num_elements, char *out) {
+    switch (element_size) {
+        case 1: return Kernel<1>::Run(in, num_elements, out);
+        case 2: return Kernel<2>::Run(in, num_elements, out);
+        case 4: return Kernel<4>::Run(in, num_elements, out);
+        case 8: return Kernel<8>::Run(in, num_elements, out);
+        default: return 0;
+    }
+}
+
+template <int ElementSize>
+struct ByteShuffleKernel {
+    static int64_t Run(const char *in, int64_t n, char *out) { return ByteShuffleBlocks<ElementSize>(in, n, out); }
+};
+template <int ElementSize>
+struct ByteUnshuffleKernel {
+    static int64_t Run(const char *in, int64_t n, char *out) { return ByteUnshuffleBlocks<ElementSize>(in, n, out); }
+};
+template <int ElementSize>
+struct BitShuffleKernel {
+    static int64_t Run(const char *in, int64_t n, char *out) { return BitShuffleBlocks<ElementSize>(in, n, out); }
+};
+template <int ElementSize>
+struct BitUnshuffleKernel {
+    static int64_t Run(const char *in, int64_t n, char *out) { return BitUnshuffleBlocks<ElementSize>(in, n, out); }
+};
+#endif
+
+void ByteShuffle(const char *in, int64_t length, int element_size, char *out) {
+    const int64_t num_elements = length / element_size;
+    int64_t i = 0;
+#ifdef RIVER_HAS_SSE2
+    i = RunShuffleKernel<ByteShuffleKernel>(element_size, in, num_elements, out);
+#endif
+    for (; i < num_elements; i++) {
+        for (int j = 0; j < element_size; j++) {
+            out[j * num_elements + i] = in[i * element_size + j];
+        }
+    }
+    int64_t shuffled = num_elements * element_size;
+    memcpy(out + shuffled, in + shuffled, length - shuffled);
+}
+
+void ByteUnshuffle(const char *in, int64_t length, int element_size, char *out) {
+    const int64_t num_elements = length / element_size;
+    int64_t i = 0;
+#ifdef RIVER_HAS_SSE2
+    i = RunShuffleKernel<ByteUnshuffleKernel>(element_size, in, num_elements, out);
+#endif
+    for (; i < num_elements; i++) {
+        for (int j = 0; j < element_size; j++) {
+            out[i * element_size + j] = in[j * num_elements + i];
+        }
+    }
+    int64_t shuffled = num_elements * element_size;
+    memcpy(out + shuffled, in + shuffled, length - shuffled);
+}
+
+void BitShuffle(const char *in, int64_t length, int element_size, char *out) {
+    // Bit planes are whole bytes, so only whole groups of 8 elements are shuffled.
+    const int64_t num_elements = (length / element_size) & ~static_cast<int64_t>(7);
+    const int64_t plane_size = num_elements / 8;
+    int64_t i = 0;
+#ifdef RIVER_HAS_SSE2
+    i = RunShuffleKernel<BitShuffleKernel>(element_size, in, num_elements, out);
+#endif
+    for (; i < num_elements; i += 8) {
+        for (int j = 0; j < element_size; j++) {
+            for (int bit = 0; bit < 8; bit++) {
+                uint8_t plane_byte = 0;
+                for (int k = 0; k < 8; k++) {
+                    auto byte = static_cast<uint8_t>(in[(i + k) * element_size + j]);
+                    plane_byte |= ((byte >> bit) & 1) << k;
+                }
+                out[(8 * j + bit) * plane_size + i / 8] = static_cast<char>(plane_byte);
+            }
+        }
+    }
+    int64_t shuffled = num_elements * element_size;
+    memcpy(out + shuffled, in + shuffled, length - shuffled);
+}
+
+void BitUnshuffle(const char *in, int64_t length, int element_size, char *out) {
+    const int64_t num_elements = (length / element_size) & ~static_cast<int64_t>(7);
+    const int64_t plane_size = num_elements / 8;
+    int64_t i = 0;
+#ifdef RIVER_HAS_SSE2
+    i = RunShuffleKernel<BitUnshuffleKernel>(element_size, in, num_elements, out);
+#endif
+    for (; i < num_elements; i += 8) {
+        for (int j = 0; j < element_size; j++) {
+            for (int k = 0; k < 8; k++) {
+                uint8_t byte = 0;
+                for (int bit = 0; bit < 8; bit++) {
+                    auto plane_byte = static_cast<uint8_t>(in[(8 * j + bit) * plane_size + i / 8]);
+                    byte |= ((plane_byte >> k) & 1) << bit;
+                }
+                out[(i + k) * element_size + j] = static_cast<char>(byte);
+            }
+        }
+    }
+    int64_t shuffled = num_elements * element_size;
+    memcpy(out + shuffled, in + shuffled, length - shuffled);
+}
+
+#ifdef RIVER_HAS_SSE2
+template <class T>
+static inline __m128i AddLanes(__m128i a, __m128i b) {
+    if constexpr (sizeof(T) == 1) {
+        return _mm_add_epi8(a, b);
+    } else if constexpr (sizeof(T) == 2) {
+        return _mm_add_epi16(a, b);
+    } else if constexpr (sizeof(T) == 4) {
+        return _mm_add_epi32(a, b);
+    } else {
+        return _mm_add_epi64(a, b);
+    }
+}
+
+template <class T>
+static inline __m128i SubtractLanes(__m128i a, __m128i b) {
+    if constexpr (sizeof(T) == 1) {
+        return _mm_sub_epi8(a, b);
+    } else if constexpr (sizeof(T) == 2) {
+        return _mm_sub_epi16(a, b);
+    } else if constexpr (sizeof(T) == 4) {
+        return _mm_sub_epi32(a, b);
+    } else {
+        return _mm_sub_epi64(a, b);
+    }
+}
+#endif
+
+// Elements are unsigned so that differences wrap around rather than overflow.
+template <class T>
+static void DeltaEncode(const char *in, int64_t num_elements, int64_t stride, char *out) {
+    int64_t i = std::min(stride, num_elements);
+    memcpy(out, in, i * sizeof(T));
+#ifdef RIVER_HAS_SSE2
+    const int64_t lanes = 16 / sizeof(T);
+    for (; i + lanes <= num_elements; i += lanes) {
+        __m128i current = Load(in + i * sizeof(T));
+        __m128i previous = Load(in + (i - stride) * sizeof(T));
+        Store(out + i * sizeof(T), SubtractLanes<T>(current, previous));
+    }
+#endif
+    for (; i < num_elements; i++) {
+        T current, previous;
+        memcpy(&current, in + i * sizeof(T), sizeof(T));
+        memcpy(&previous, in + (i - stride) * sizeof(T), sizeof(T));
+        T delta = current - previous;
+        memcpy(out + i * sizeof(T), &delta, sizeof(T));
+    }
+}
+
+#ifdef RIVER_HAS_SSE2
+// Running sum of the lanes, in log2(lanes) shifted adds.
+template <class T>
+static inline __m128i PrefixSumLanes(__m128i v) {
+    if constexpr (sizeof(T) <= 1) {
+        v = AddLanes<T>(v, _mm_slli_si128(v, 1));
+    }
+    if constexpr (sizeof(T) <= 2) {
+        v = AddLanes<T>(v, _mm_slli_si128(v, 2));
+    }
+    if constexpr (sizeof(T) <= 4) {
+        v = AddLanes<T>(v, _mm_slli_si128(v, 4));
+    }
+    return AddLanes<T>(v, _mm_slli_si128(v, 8));
+}
+
+template <class T>
+static inline __m128i BroadcastLastLane(__m128i v) {
+    if constexpr (sizeof(T) == 1) {
+        v = _mm_unpackhi_epi8(v, v);
+    }
+    if constexpr (sizeof(T) <= 2) {
+        v = _mm_shufflehi_epi16(v, 0xFF);
+    }
+    if constexpr (sizeof(T) <= 4) {
+        return _mm_shuffle_epi32(v, 0xFF);
+    } else {
+        return _mm_unpackhi_epi64(v, v);
+    }
+}
+#endif
+
+template <class T>
+static void DeltaDecode(const char *in, int64_t num_elements, int64_t stride, char *out) {
+    int64_t i = std::min(stride, num_elements);
+    memcpy(out, in, i * sizeof(T));
+#ifdef RIVER_HAS_SSE2
+    const int64_t lanes = 16 / sizeof(T);
+    if (stride == 1) {
+        // Decoding is then a running sum, carrying the last lane of each vector into the next.
+        i = 0;
+        __m128i carry = _mm_setzero_si128();
+        for (; i + lanes <= num_elements; i += lanes) {
+            __m128i current = AddLanes<T>(PrefixSumLanes<T>(Load(in + i * sizeof(T))), carry);
+            Store(out + i * sizeof(T), current);
+            carry = BroadcastLastLane<T>(current);
+        }
+        i = std::max<int64_t>(i, 1);
+    } else if (stride >= lanes) {
+        // Every element of a vector depends only on elements already decoded.
+        for (; i + lanes <= num_elements; i += lanes) {
+            __m128i delta = Load(in + i * sizeof(T));
+            __m128i previous = Load(out + (i - stride) * sizeof(T));
+            Store(out + i * sizeof(T), AddLanes<T>(delta, previous));
+        }
+    }
+#endif
+    for (; i < num_elements; i++) {
+        T delta, previous;
+        memcpy(&delta, in + i * sizeof(T), sizeof(T));
+        memcpy(&previous, out + (i - stride) * sizeof(T), sizeof(T));
+        T current = previous + delta;
+        memcpy(out + i * sizeof(T), &current, sizeof(T));
+    }
+}
+
+void DeltaEncode(const char *in, int64_t length, int element_size, int64_t stride, char *out) {
+    const int64_t num_elements = length / element_size;
+    switch (element_size) {
+        case 1: DeltaEncode<uint8_t>(in, num_elements, stride, out); break;
+        case 2: DeltaEncode<uint16_t>(in, num_elements, stride, out); break;
+        case 4: DeltaEncode<uint32_t>(in, num_elements, stride, out); break;
+        case 8: DeltaEncode<uint64_t>(in, num_elements, stride, out); break;
+        default: throw std::invalid_argument("Delta encoding needs elements of 1, 2, 4, or 8 bytes.");
+    }
+    int64_t encoded = num_elements * element_size;
+    memcpy(out + encoded, in + encoded, length - encoded);
+}
+
+void DeltaDecode(const char *in, int64_t length, int element_size, int64_t stride, char *out) {
+    const int64_t num_elements = length / element_size;
+    switch (element_size) {
+        case 1: DeltaDecode<uint8_t>(in, num_elements, stride, out); break;
+        case 2: DeltaDecode<uint16_t>(in, num_elements, stride, out); break;
+        case 4: DeltaDecode<uint32_t>(in, num_elements, stride, out); break;
+        case 8: DeltaDecode<uint64_t>(in, num_elements, stride, out); break;
+        default: throw std::invalid_argument("Delta encoding needs elements of 1, 2, 4, or 8 bytes.");
+    }
+    int64_t decoded = num_elements * element_size;
+    memcpy(out + decoded, in + decoded, length - decoded);
+}
+
+
+void PromoteInt16ToInt32(const int16_t *in, int64_t num_values, int32_t *out) {
+    int64_t i = 0;
+#ifdef RIVER_HAS_SSE2
+    // Interleaving with zeros puts each value in the top half of a lane, and an arithmetic shift by one leaves it
+    // shifted up by 15, sign-extended.
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= num_values; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_srai_epi32(_mm_unpacklo_epi16(zero, v), 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i + 4), _mm_srai_epi32(_mm_unpackhi_epi16(zero, v), 1));
+    }
+#endif
+    for (; i < num_values; i++) {
+        out[i] = static_cast<int32_t>(static_cast<uint32_t>(in[i]) << 15);
+    }
+}
+
+void DemoteInt32ToInt16(const int32_t *in, int64_t num_values, int16_t *out) {
+    int64_t i = 0;
+#ifdef RIVER_HAS_SSE2
+    // Packing saturates, which is the same as clamping.
+    for (; i + 8 <= num_values; i += 8) {
+        __m128i lo = _mm_srai_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i)), 15);
+        __m128i hi = _mm_srai_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i + 4)), 15);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packs_epi32(lo, hi));
+    }
+#endif
+    for (; i < num_values; i++) {
+        int32_t value = in[i] >> 15;
+        out[i] = static_cast<int16_t>(std::max<int32_t>(-0x8000, std::min<int32_t>(value, 0x7fff)));
+    }
+}
+
+}
+}
@@ -0,0 +1,101 @@
+#ifndef RIVER_SRC_SIMD_H_
+#define RIVER_SRC_SIMD_H_
+
+#include <cstdint>
+#include <vector>
+#include "schema.h"
+
+namespace river {
+namespace internal {
+
+/**
+ * Sum of the given sample sizes, e.g. the number of bytes of a batch of variable-width samples. Vectorized with
+ * whichever of AVX2, SSE2, or NEON the build targets, falling back to plain C++ otherwise.
+ */
+int64_t SumSizes(const int *sizes, int64_t num_samples);
+
+/**
+ * Interleaves columns, one per field of the given sizes, into samples laid out as in a StreamSchema (i.e. the fields
+ * of each sample back to back). Copies samples [first_sample, first_sample + num_samples) of each column to `out`.
+ *
+ * Runs of 4-byte, 8-byte, and 2-byte fields are transposed 4, 2, and 8 fields at a time with SSE2 where available.
+ */
+void InterleaveColumns(const char *const *columns,
+                       const std::vector<int> &field_sizes,
+                       int64_t first_sample,
+                       int64_t num_samples,
+                       char *out);
+
+/**
+ * The inverse of InterleaveColumns(): copies each field of `num_samples` samples into its column. Fields whose column
+ * is null are skipped.
+ */
+void DeinterleaveColumns(const char *samples,
+                         const std::vector<int> &field_sizes,
+                         int64_t num_samples,
+                         char *const *columns);
+
+/**
+ * Converts a column of any numeric type to FLOAT or DOUBLE, multiplying each value by `scale`. INT16 to FLOAT is
+ * vectorized with SSE2 where available.
+ */
+void ConvertColumn(const char *in,
+                   FieldDefinition::Type in_type,
+                   int64_t num_samples,
+                   double scale,
+                   FieldDefinition::Type out_type,
+                   char *out);
+
+/**
+ * Byte-shuffles `length` bytes of elements of `element_size` bytes (as in Blosc): the first byte of every element,
+ * then the second byte of every element, etc. Trailing bytes that don't make up a whole element are copied as is.
+ * Elements of 1, 2, 4, and 8 bytes are shuffled 16 at a time with SSE2 where available.
+ */
+void ByteShuffle(const char *in, int64_t length, int element_size, char *out);
+
+/**
+ * The inverse of ByteShuffle().
+ */
+void ByteUnshuffle(const char *in, int64_t length, int element_size, char *out);
+
+/**
+ * Bit-shuffles elements of `element_size` bytes: like ByteShuffle(), but each byte is further split into its 8 bits,
+ * giving one bit plane per bit of the elements, lowest first. Only whole groups of 8 elements are shuffled; any
+ * elements and bytes after them are copied as is.
+ */
+void BitShuffle(const char *in, int64_t length, int element_size, char *out);
+
+/**
+ * The inverse of BitShuffle().
+ */
+void BitUnshuffle(const char *in, int64_t length, int element_size, char *out);
+
+/**
+ * Replaces each (unsigned, wrapping) integer element of `element_size` bytes, which must be 1, 2, 4, or 8, with its
+ * difference from the element `stride` elements before it, e.g. the previous sample of the same column. The first
+ * `stride` elements, and any trailing bytes, are copied as is.
+ */
+void DeltaEncode(const char *in, int64_t length, int element_size, int64_t stride, char *out);
+
+/**
+ * The inverse of DeltaEncode(). As each element depends on the one `stride` before it, this is only vectorized when
+ * `stride` is 1 (as a running sum) or spans at least 16 bytes.
+ */
+void DeltaDecode(const char *in, int64_t length, int element_size, int64_t stride, char *out);
+
+/**
+ * Promotes int16 values to the range ZFP compresses integers in, i.e. shifted up into the top of an int32 as
+ * zfp_promote_int16_to_int32() does. Vectorized with SSE2 where available.
+ */
+void PromoteInt16ToInt32(const int16_t *in, int64_t num_values, int32_t *out);
+
+/**
+ * The inverse of PromoteInt16ToInt32(), clamping values outside of the int16 range as zfp_demote_int32_to_int16()
+ * does.
+ */
+void DemoteInt32ToInt16(const int32_t *in, int64_t num_values, int16_t *out);
+
+}
+}
+
+#endif //RIVER_SRC_SIMD_H_
@@ -0,0 +1,308 @@
+#ifndef RIVER_SRC_STATIC_SCHEMA_H_
+#define RIVER_SRC_STATIC_SCHEMA_H_
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <spdlog/fmt/fmt.h>
+#include "schema.h"
+#include "reader.h"
+#include "writer.h"
+
+namespace river {
+
+namespace internal {
+
+template <class T>
+struct FieldTypeOf;
+template <> struct FieldTypeOf<double> { static constexpr FieldDefinition::Type value = FieldDefinition::DOUBLE; };
+template <> struct FieldTypeOf<float> { static constexpr FieldDefinition::Type value = FieldDefinition::FLOAT; };
+template <> struct FieldTypeOf<int16_t> { static constexpr FieldDefinition::Type value = FieldDefinition::INT16; };
+template <> struct FieldTypeOf<int32_t> { static constexpr FieldDefinition::Type value = FieldDefinition::INT32; };
+template <> struct FieldTypeOf<int64_t> { static constexpr FieldDefinition::Type value = FieldDefinition::INT64; };
+template <size_t N>
+struct FieldTypeOf<std::array<char, N>> {
+    static constexpr FieldDefinition::Type value = FieldDefinition::FIXED_WIDTH_BYTES;
+};
+
+constexpr bool NamesEqual(const char *a, const char *b) {
+    for (; *a != '\0' && *a == *b; a++, b++) {}
+    return *a == *b;
+}
+
+}
+
+/**
+ * Base of each field of a StaticSchema, giving the field's C++ type; the derived struct gives its name. The type must
+ * be one of double, float, int16_t, int32_t, int64_t, or std::array<char, N> for FIXED_WIDTH_BYTES. E.g.:
+ *
+ *   struct Timestamp : river::Field<int64_t> { static constexpr const char *name = "t"; };
+ *
+ * or equivalently, RIVER_FIELD(Timestamp, "t", int64_t).
+ */
+template <class T>
+struct Field {
+    static_assert(std::is_trivially_copyable<T>::value, "Fields must be trivially copyable.");
+    using type = T;
+    static constexpr FieldDefinition::Type field_type = internal::FieldTypeOf<T>::value;
+    static constexpr int size = sizeof(T);
+};
+
+// The type is variadic so that it can have commas, e.g. std::array<char, 16>.
+#define RIVER_FIELD(StructName, field_name, ...) \
+    struct StructName : ::river::Field<__VA_ARGS__> { static constexpr const char *name = field_name; }
+
+/**
+ * A schema whose fields are known at compile time, e.g.:
+ *
+ *   RIVER_FIELD(Timestamp, "t", int64_t);
+ *   RIVER_FIELD(X, "x", float);
+ *   using MySchema = river::StaticSchema<Timestamp, X>;
+ *
+ * It produces the equivalent runtime StreamSchema, and packs/unpacks samples with code generated per field (constant
+ * offsets and sizes, so the compiler unrolls and vectorizes it) instead of looping over FieldDefinitions. Use with
+ * TypedStreamWriter and TypedStreamReader, which check at compile time that the data given matches the schema.
+ */
+template <class... Fields>
+class StaticSchema {
+public:
+    static_assert(sizeof...(Fields) > 0, "A schema needs at least one field.");
+
+    static constexpr int num_fields = sizeof...(Fields);
+    static constexpr int sample_size = (Fields::size + ...);
+
+private:
+    static constexpr std::array<const char *, num_fields> names_ = {Fields::name...};
+    static constexpr std::array<int, num_fields> sizes_ = {Fields::size...};
+
+    static constexpr bool HasUniqueNames() {
+        for (int i = 0; i < num_fields; i++) {
+            for (int j = i + 1; j < num_fields; j++) {
+                if (internal::NamesEqual(names_[i], names_[j])) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+    static_assert(HasUniqueNames(), "Field names must be unique within a schema.");
+
+    static constexpr std::array<int, num_fields> ComputeOffsets() {
+        std::array<int, num_fields> offsets{};
+        int offset = 0;
+        for (int i = 0; i < num_fields; i++) {
+            offsets[i] = offset;
+            offset += sizes_[i];
+        }
+        return offsets;
+    }
+    static constexpr std::array<int, num_fields> offsets_ = ComputeOffsets();
+
+public:
+    /**
+     * Index of the given field within this schema; doesn't compile if it isn't one of this schema's fields.
+     */
+    template <class F>
+    static constexpr int index_of() {
+        constexpr bool matches[] = {std::is_same<F, Fields>::value...};
+        int index = -1;
+        for (int i = 0; i < num_fields; i++) {
+            if (matches[i]) {
+                index = i;
+            }
+        }
+        return index;
+    }
+
+    template <class F>
+    static constexpr int offset_of() {
+        static_assert(index_of<F>() >= 0, "Field is not part of this schema.");
+        return offsets_[index_of<F>()];
+    }
+
+    static StreamSchema ToStreamSchema() {
+        return StreamSchema(
+            std::vector<FieldDefinition>{FieldDefinition(Fields::name, Fields::field_type, Fields::size)...});
+    }
+
+    static std::string ToJson() {
+        return ToStreamSchema().ToJson();
+    }
+
+    /**
+     * Whether the given runtime schema has exactly these fields, in this order.
+     */
+    static bool Matches(const StreamSchema &schema) {
+        const auto &fields = schema.field_definitions;
+        if (fields.size() != num_fields) {
+            return false;
+        }
+        auto expected = ToStreamSchema().field_definitions;
+        for (int i = 0; i < num_fields; i++) {
+            if (fields[i].name != expected[i].name || fields[i].type != expected[i].type
+                || fields[i].size != expected[i].size) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * One sample, laid out exactly as it is in the stream.
+     */
+    class Sample {
+    public:
+        template <class F>
+        typename F::type get() const {
+            typename F::type value;
+            std::memcpy(&value, bytes_ + offset_of<F>(), sizeof(value));
+            return value;
+        }
+
+        template <class F>
+        void set(const typename F::type &value) {
+            std::memcpy(bytes_ + offset_of<F>(), &value, sizeof(value));
+        }
+
+    private:
+        char bytes_[sample_size];
+    };
+    static_assert(sizeof(Sample) == sample_size, "Samples must be packed.");
+
+    /**
+     * Interleaves samples [first_sample, first_sample + num_samples) of one column per field into `out`.
+     */
+    static void Pack(int64_t first_sample, int64_t num_samples, char *out, const typename Fields::type *... columns) {
+        for (int64_t i = 0; i < num_samples; i++) {
+            char *sample = out + i * sample_size;
+            int64_t column_index = first_sample + i;
+            (std::memcpy(sample + offset_of<Fields>(), columns + column_index, Fields::size), ...);
+        }
+    }
+
+    /**
+     * Copies the given fields, in any order and any subset of this schema's fields, out of `num_samples` samples into
+     * one column each.
+     */
+    template <class... Projected>
+    static void Unpack(const char *samples, int64_t num_samples, typename Projected::type *... columns) {
+        for (int64_t i = 0; i < num_samples; i++) {
+            const char *sample = samples + i * sample_size;
+            (std::memcpy(columns + i, sample + offset_of<Projected>(), Projected::size), ...);
+        }
+    }
+};
+
+template <class Schema>
+class TypedStreamWriter;
+
+/**
+ * A StreamWriter for a StaticSchema: samples and columns given must have the schema's types, or it won't compile.
+ */
+template <class... Fields>
+class TypedStreamWriter<StaticSchema<Fields...>> {
+public:
+    using Schema = StaticSchema<Fields...>;
+    using Sample = typename Schema::Sample;
+
+    explicit TypedStreamWriter(const StreamWriterParams &params) : writer_(params) {}
+
+    void Initialize(const std::string &stream_name,
+                    const std::unordered_map<std::string, std::string> &user_metadata =
+                    std::unordered_map<std::string, std::string>(),
+                    bool compute_local_minus_global_clock = false) {
+        writer_.Initialize(stream_name, Schema::ToStreamSchema(), user_metadata, compute_local_minus_global_clock);
+    }
+
+    void Write(const Sample *samples, int64_t num_samples) {
+        writer_.WriteBytes(reinterpret_cast<const char *>(samples), num_samples);
+    }
+
+    /**
+     * Writes one column per field, in the schema's field order; see StreamWriter#WriteColumns().
+     */
+    void WriteColumns(int64_t num_samples, const typename Fields::type *... columns) {
+        writer_.WritePacked(num_samples, [&](int64_t first_sample, int64_t n, char *out) {
+            Schema::Pack(first_sample, n, out, columns...);
+        });
+    }
+
+    void Stop() {
+        writer_.Stop();
+    }
+
+    StreamWriter &writer() {
+        return writer_;
+    }
+
+private:
+    StreamWriter writer_;
+};
+
+template <class Schema>
+class TypedStreamReader;
+
+/**
+ * A StreamReader for a StaticSchema. #Initialize() throws if the stream's schema isn't exactly this one, after which
+ * reads are checked at compile time.
+ */
+template <class... Fields>
+class TypedStreamReader<StaticSchema<Fields...>> {
+public:
+    using Schema = StaticSchema<Fields...>;
+    using Sample = typename Schema::Sample;
+
+    explicit TypedStreamReader(const StreamReaderParams &params) : reader_(params) {}
+
+    void Initialize(const std::string &stream_name, int timeout_ms = -1) {
+        reader_.Initialize(stream_name, timeout_ms);
+        if (!Schema::Matches(reader_.schema())) {
+            throw StreamReaderException(fmt::format(
+                "Stream {} has schema {}, not the expected {}", stream_name, reader_.schema().ToJson(),
+                Schema::ToJson()));
+        }
+    }
+
+    /**
+     * See StreamReader#ReadBytes().
+     */
+    int64_t Read(Sample *samples, int64_t num_samples, int timeout_ms = -1) {
+        return reader_.ReadBytes(reinterpret_cast<char *>(samples), num_samples, nullptr, nullptr, timeout_ms);
+    }
+
+    /**
+     * Reads only the given fields, into one column each, e.g. ReadFields<X, Timestamp>(n, timeout_ms, xs, ts). Returns
+     * the number of samples read, or -1 on EOF; see StreamReader#ReadBytes().
+     */
+    template <class... Projected>
+    int64_t ReadFields(int64_t num_samples, int timeout_ms, typename Projected::type *... columns) {
+        buffer_.resize(num_samples * Schema::sample_size);
+        int64_t num_read = reader_.ReadBytes(buffer_.data(), num_samples, nullptr, nullptr, timeout_ms);
+        if (num_read > 0) {
+            Schema::template Unpack<Projected...>(buffer_.data(), num_read, columns...);
+        }
+        return num_read;
+    }
+
+    void Stop() {
+        reader_.Stop();
+    }
+
+    StreamReader &reader() {
+        return reader_;
+    }
+
+private:
+    StreamReader reader_;
+    std::vector<char> buffer_;
+};
+
+}
+
+#endif //RIVER_SRC_STATIC_SCHEMA_H_
@@ -0,0 +1,104 @@
+#include "gtest/gtest.h"
+#include "../river.h"
+#include "../tools/uuid.h"
+#include <thread>
+
+using namespace std;
+using namespace river;
+
+static const RedisConnection connection("127.0.0.1", 6379);
+
+class StreamBroadcasterTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        stream_name = uuid::generate_uuid_v4();
+        writer = make_shared<StreamWriter>(connection);
+        StreamSchema schema(vector<FieldDefinition>{FieldDefinition("field1", FieldDefinition::INT64, sizeof(int64_t))});
+        writer->Initialize(stream_name, schema);
+    }
+
+    void TearDown() override {
+        writer->Stop();
+    }
+
+    void Write(int64_t start, int64_t num_samples) {
+        vector<int64_t> data;
+        for (int64_t i = start; i < start + num_samples; i++) {
+            data.push_back(i);
+        }
+        writer->Write(data.data(), num_samples);
+    }
+
+    shared_ptr<StreamWriter> writer;
+    string stream_name;
+};
+
+TEST_F(StreamBroadcasterTest, TestSubscribersReadEverything) {
+    StreamBroadcaster broadcaster(StreamReaderParamsBuilder().connection(connection).build());
+    vector<unique_ptr<StreamSubscriber>> subscribers;
+    for (int i = 0; i < 3; i++) {
+        subscribers.push_back(broadcaster.Subscribe());
+    }
+    broadcaster.Initialize(stream_name);
+
+    int64_t num_samples = 50000;
+    thread writer_thread([&]() {
+        for (int64_t i = 0; i < num_samples; i += 1000) {
+            Write(i, 1000);
+        }
+        writer->Stop();
+    });
+
+    vector<thread> subscriber_threads;
+    for (auto &subscriber : subscribers) {
+        subscriber_threads.emplace_back([&subscriber]() {
+            vector<int64_t> buffer(777);
+            int64_t expected = 0;
+            int64_t num_read;
+            while ((num_read = subscriber->Read(buffer.data(), buffer.size())) >= 0) {
+                for (int64_t i = 0; i < num_read; i++) {
+                    ASSERT_EQ(buffer[i], expected++);
+                }
+            }
+        });
+    }
+
+    writer_thread.join();
+    for (auto &t : subscriber_threads) {
+        t.join();
+    }
+    for (auto &subscriber : subscribers) {
+        ASSERT_EQ(subscriber->total_samples_read(), num_samples);
+        ASSERT_EQ(subscriber->total_samples_dropped(), 0);
+        ASSERT_FALSE(subscriber->Good());
+    }
+    ASSERT_EQ(broadcaster.total_samples_broadcasted(), num_samples);
+}
+
+TEST_F(StreamBroadcasterTest, TestSlowSubscriberDropsSamples) {
+    StreamBroadcaster broadcaster(StreamReaderParamsBuilder().connection(connection).max_fetch_size(100).build(), 8192);
+    auto subscriber = broadcaster.Subscribe();
+    broadcaster.Initialize(stream_name);
+
+    Write(0, 10);
+    int64_t buffer[10];
+    ASSERT_EQ(subscriber->Read(buffer, 10, 1000), 10);
+
+    // Far more than the ring can hold while the subscriber isn't reading.
+    Write(10, 5000);
+    while (broadcaster.total_samples_broadcasted() < 5010) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+
+    ASSERT_EQ(subscriber->Read(buffer, 10, 1000), 10);
+    ASSERT_GT(subscriber->total_samples_dropped(), 0);
+    ASSERT_EQ(buffer[0], 10 + subscriber->total_samples_dropped());
+    for (int i = 1; i < 10; i++) {
+        ASSERT_EQ(buffer[i], buffer[i - 1] + 1);
+    }
+
+    broadcaster.Stop();
+    int64_t num_read;
+    while ((num_read = subscriber->Read(buffer, 10, 1000)) > 0) {}
+    ASSERT_EQ(num_read, -1);
+}
@@ -1,10 +1,16 @@
 #include "gtest/gtest.h"
 #include "../compression/compressor.h"
+#include "../compression/wire_codec.h"
+#include "../compression/compression_pool.h"
+#include "../compression/variable_width_block.h"
+#include "../compression/filter_pipeline.h"
+#include "../compression/adaptive_compressor.h"
 #include <filesystem>
 #include <fstream>
 #include <algorithm>
 #include <numeric>
 #include <cmath>
+#include <random>
 
 class CompressorTest : public ::testing::Test {
 public:
@@ -165,3 +171,376 @@ TEST_F(CompressorTest, TestZfpLossy_Float) {
     double corr = running_corr / sqrt(demeaned_norm2(buffer)) / sqrt(demeaned_norm2(round_tripped));
     ASSERT_GE(corr, 0.95);
 }
+
+TEST_F(CompressorTest, TestZfpReusedAcrossUnevenBatches) {
+    // Batches as the writer sees them: the same compressor over varying numbers of rows, into reused buffers.
+    river::ZfpCompressor<int16_t> compressor(4096, -1, false);
+    river::ZfpDecompressor<int16_t> decompressor;
+    auto buffer = ReadInputSinesInt16();
+    const size_t row_size = 4096 * sizeof(int16_t);
+    const size_t num_rows = buffer.size() * sizeof(int16_t) / row_size;
+    const auto *data = (const char *) buffer.data();
+
+    std::vector<char> compressed, round_tripped;
+    // Twice over, so buffers are reused both after growing and after shrinking.
+    for (int i = 0; i < 2; i++) {
+        for (size_t rows : {num_rows, num_rows / 3, (size_t) 1, num_rows / 2 + 1}) {
+            size_t length = rows * row_size;
+            compressor.compress_into(data, length, &compressed);
+            decompressor.decompress_into(compressed.data(), compressed.size(), &round_tripped);
+            ASSERT_EQ(round_tripped, std::vector<char>(data, data + length)) << rows << " rows";
+            ASSERT_EQ(compressed, compressor.compress(data, length));
+        }
+    }
+}
+
+TEST_F(CompressorTest, TestZfpFixedRateRandomAccess) {
+    auto check_ranges = [](river::Compressor *compressor, river::Decompressor *decompressor, const char *data,
+                           size_t length, size_t row_size) {
+        ASSERT_TRUE(decompressor->supports_random_access());
+        auto compressed = compressor->compress(data, length);
+        auto full = decompressor->decompress(compressed.data(), compressed.size());
+        ASSERT_EQ(full.size(), length);
+
+        // Single rows at the start, middle, and end of blocks, spans of blocks, and ranges not on row boundaries.
+        std::vector<std::pair<size_t, size_t>> ranges = {
+            {0, row_size}, {3 * row_size, row_size}, {37 * row_size, row_size}, {length - row_size, row_size},
+            {5 * row_size, 38 * row_size}, {3, 10}, {row_size - 1, 3}, {12 * row_size + 2, SIZE_MAX},
+        };
+        std::vector<char> out;
+        for (auto [offset, num_bytes] : ranges) {
+            size_t expected_size = std::min(num_bytes, length - offset);
+            ASSERT_EQ(decompressor->decompress_range(compressed.data(), compressed.size(), offset, num_bytes, &out),
+                      expected_size) << offset;
+            ASSERT_EQ(out, std::vector<char>(full.begin() + offset, full.begin() + offset + expected_size)) << offset;
+        }
+        ASSERT_EQ(decompressor->decompress_range(compressed.data(), compressed.size(), length, 1, &out), (size_t) 0);
+        ASSERT_TRUE(out.empty());
+    };
+
+    auto floats = ReadInputSinesFloat();
+    river::ZfpCompressor<float> float_compressor(4096, -1, false, 8);
+    river::ZfpDecompressor<float> float_decompressor(true);
+    check_ranges(&float_compressor, &float_decompressor, (const char *) floats.data(), sizeof(float) * floats.size(),
+                 4096 * sizeof(float));
+
+    auto int16s = ReadInputSinesInt16();
+    river::ZfpCompressor<int16_t> int16_compressor(4096, -1, false, 12);
+    river::ZfpDecompressor<int16_t> int16_decompressor(true);
+    check_ranges(&int16_compressor, &int16_decompressor, (const char *) int16s.data(),
+                 sizeof(int16_t) * int16s.size(), 4096 * sizeof(int16_t));
+
+    // Other ZFP modes don't lay out blocks at fixed offsets.
+    river::ZfpDecompressor<float> lossless_decompressor;
+    ASSERT_FALSE(lossless_decompressor.supports_random_access());
+    river::ZfpCompressor<float> lossless_compressor(4096, -1, false);
+    auto lossless = lossless_compressor.compress((const char *) floats.data(), sizeof(float) * floats.size());
+    std::vector<char> out;
+    ASSERT_THROW(float_decompressor.decompress_range(lossless.data(), lossless.size(), 0, 1, &out),
+                 std::runtime_error);
+}
+
+TEST_F(CompressorTest, TestWireCodecRoundTrip) {
+    auto buffer = ReadInputSinesInt16();
+    for (auto wire_compression : {river::WireCompression::NONE,
+                                  river::WireCompression::LZ4,
+                                  river::WireCompression::ZSTD}) {
+        if (!river::internal::IsWireCompressionSupported(wire_compression)) {
+            continue;
+        }
+        auto compressed = river::internal::WireCompress(
+            wire_compression, (const char *) buffer.data(), sizeof(int16_t) * buffer.size());
+        auto round_tripped = river::internal::WireDecompress(wire_compression, compressed.data(), compressed.size());
+        ASSERT_EQ(round_tripped.size(), sizeof(int16_t) * buffer.size());
+        ASSERT_EQ(memcmp(round_tripped.data(), buffer.data(), round_tripped.size()), 0);
+        if (wire_compression != river::WireCompression::NONE) {
+            ASSERT_LT(compressed.size(), round_tripped.size());
+        }
+
+        // Corrupt headers claiming huge payloads are rejected before allocating.
+        compressed[7] = (char) 0x7F;
+        ASSERT_THROW(river::internal::WireDecompress(wire_compression, compressed.data(), compressed.size()),
+                     std::runtime_error);
+    }
+}
+
+TEST_F(CompressorTest, TestCompressionPoolPreservesResults) {
+    auto buffer = ReadInputSinesInt16();
+    river::CompressionPool pool(4);
+    river::ZfpCompressor<int16_t> serial_compressor(4096, -1, false);
+
+    // Each task gets its own compressor, as they aren't thread-safe.
+    const int num_tasks = 16;
+    std::vector<std::unique_ptr<river::ZfpCompressor<int16_t>>> compressors;
+    std::vector<std::future<std::vector<char>>> futures;
+    for (int i = 0; i < num_tasks; i++) {
+        compressors.push_back(std::make_unique<river::ZfpCompressor<int16_t>>(4096, -1, false));
+        auto *compressor = compressors.back().get();
+        futures.push_back(pool.Submit([compressor, &buffer]() {
+            return compressor->compress((const char *) buffer.data(), sizeof(int16_t) * buffer.size());
+        }));
+    }
+
+    auto expected = serial_compressor.compress((const char *) buffer.data(), sizeof(int16_t) * buffer.size());
+    for (auto &future : futures) {
+        ASSERT_EQ(future.get(), expected);
+    }
+
+    auto failing = pool.Submit([]() -> std::vector<char> { throw std::invalid_argument("failed"); });
+    ASSERT_THROW(failing.get(), std::invalid_argument);
+}
+
+TEST_F(CompressorTest, TestVariableWidthBlockRoundTrip) {
+    river::DummyCompressor compressor;
+    std::vector<std::string> samples = {"a", "", "hello", std::string(1000, 'x'), "world"};
+    std::vector<int> sizes;
+    std::string data;
+    for (const auto &sample : samples) {
+        sizes.push_back(static_cast<int>(sample.size()));
+        data += sample;
+    }
+
+    auto block = river::internal::EncodeVariableWidthBlock(
+        &compressor, data.data(), static_cast<int64_t>(samples.size()), sizes.data(), data.size());
+    std::vector<int> decoded_sizes;
+    std::vector<char> decompressed;
+    int64_t data_offset = river::internal::DecodeVariableWidthBlock(
+        &compressor, block.data(), block.size(), &decoded_sizes, &decompressed);
+    ASSERT_EQ(decoded_sizes, sizes);
+    ASSERT_EQ(std::string(decompressed.data() + data_offset, decompressed.size() - data_offset), data);
+
+    // The sample count in the header must agree with the compressed sizes.
+    block[0]++;
+    ASSERT_THROW(river::internal::DecodeVariableWidthBlock(
+        &compressor, block.data(), block.size(), &decoded_sizes, &decompressed), std::exception);
+}
+
+TEST_F(CompressorTest, TestGeneralPurposeCodecs) {
+    auto buffer = ReadInputSinesInt16();
+    for (const auto &compression : {river::StreamCompression(river::StreamCompression::Type::LZ4),
+                                    river::StreamCompression(river::StreamCompression::Type::LZ4,
+                                                             {{"acceleration", "8"}}),
+                                    river::StreamCompression(river::StreamCompression::Type::ZSTD),
+                                    river::StreamCompression(river::StreamCompression::Type::ZSTD,
+                                                             {{"level", "19"}})}) {
+        auto wire_compression = compression.type() == river::StreamCompression::Type::LZ4
+                                ? river::WireCompression::LZ4 : river::WireCompression::ZSTD;
+        if (!river::internal::IsWireCompressionSupported(wire_compression)) {
+            ASSERT_THROW(river::CreateCompressor(compression), std::logic_error);
+            continue;
+        }
+        auto compressor = river::CreateCompressor(compression);
+        auto decompressor = river::CreateDecompressor(compression);
+        // Unfiltered, these barely compress this file, so only check that it round trips.
+        auto [buffer_copy, round_tripped, compressed_size_bytes] =
+            RoundTripConvert<int16_t>(compressor.get(), decompressor.get());
+        ASSERT_EQ(round_tripped, buffer_copy);
+
+        // Contexts are reused across batches without carrying state over from one to the next.
+        auto first = compressor->compress((const char *) buffer.data(), sizeof(int16_t) * buffer.size());
+        auto second = compressor->compress((const char *) buffer.data(), sizeof(int16_t) * buffer.size());
+        ASSERT_EQ(first, second);
+
+        auto empty = compressor->compress(nullptr, 0);
+        ASSERT_TRUE(decompressor->decompress(empty.data(), empty.size()).empty());
+        ASSERT_THROW(decompressor->decompress(first.data(), first.size() / 2), std::runtime_error);
+
+        // Headers claiming huge batches are rejected before allocating for them.
+        std::vector<char> huge;
+        if (compression.type() == river::StreamCompression::Type::LZ4) {
+            huge = {0, 0, 0, 0, 0, 1, 0, 0};
+        } else {
+            // A zstd frame header (magic number, then a single-segment descriptor) with an 8-byte content size.
+            huge = {(char) 0x28, (char) 0xB5, (char) 0x2F, (char) 0xFD, (char) 0xE0, 0, 0, 0, 0, 0, 1, 0, 0};
+        }
+        ASSERT_THROW(decompressor->decompress(huge.data(), huge.size()), std::runtime_error);
+    }
+}
+
+TEST_F(CompressorTest, TestFilterPipelineRoundTrip) {
+    auto buffer = ReadInputSinesInt16();
+    const auto *data = (const char *) buffer.data();
+    for (const std::string filters : {"delta", "byteshuffle", "bitshuffle", "delta,byteshuffle", "delta,bitshuffle"}) {
+        for (const std::string element_size : {"1", "2", "4", "8"}) {
+            std::unordered_map<std::string, std::string> params = {
+                {"filters", filters}, {"element_size", element_size}, {"num_cols", "4096"}};
+            river::internal::FilteredCompressor compressor(
+                river::internal::FilterPipeline(params), std::make_unique<river::DummyCompressor>());
+            river::internal::FilteredDecompressor decompressor(
+                river::internal::FilterPipeline(params), std::make_unique<river::DummyCompressor>());
+            // Lengths that leave partial vectors, groups of 8 elements, and elements at the end.
+            for (size_t length : {(size_t) 0, (size_t) 5, (size_t) 67, (size_t) 1001, sizeof(int16_t) * buffer.size()}) {
+                auto filtered = compressor.compress(data, length);
+                ASSERT_EQ(filtered.size(), length);
+                auto round_tripped = decompressor.decompress(filtered.data(), filtered.size());
+                ASSERT_EQ(round_tripped, std::vector<char>(data, data + length)) << filters << " " << element_size;
+            }
+        }
+    }
+
+    using Params = std::unordered_map<std::string, std::string>;
+    ASSERT_THROW(river::internal::FilterPipeline(Params{{"filters", "delta"}}), std::invalid_argument);
+    ASSERT_THROW(river::internal::FilterPipeline(Params{{"filters", "delta"}, {"element_size", "3"}}),
+                 std::invalid_argument);
+    ASSERT_THROW(river::internal::FilterPipeline(Params{{"filters", "rle"}, {"element_size", "2"}}),
+                 std::invalid_argument);
+}
+
+TEST_F(CompressorTest, TestFilterPipelineImprovesZstdRatio) {
+    // See tools/river_compression_benchmark.cpp for how filtered codecs compare to ZFP in ratio and speed.
+    using Type = river::StreamCompression::Type;
+    if (!river::internal::IsWireCompressionSupported(river::WireCompression::ZSTD)) {
+        return;
+    }
+    auto buffer = ReadInputSinesInt16();
+    const auto *data = (const char *) buffer.data();
+    const size_t length = sizeof(int16_t) * buffer.size();
+    // Samples of this file are 4096 channels, which change more smoothly across channels than over time.
+    auto filtered = river::StreamCompression(
+        Type::ZSTD, {{"filters", "delta,byteshuffle"}, {"element_size", "2"}, {"num_cols", "1"}});
+    auto unfiltered_size = river::CreateCompressor(river::StreamCompression(Type::ZSTD))->compress(data, length).size();
+    auto filtered_size = river::CreateCompressor(filtered)->compress(data, length).size();
+    ASSERT_LT(filtered_size, unfiltered_size);
+}
+
+TEST_F(CompressorTest, TestFieldGroupsRoundTrip) {
+    auto sines = ReadInputSinesInt16();
+    const int num_channels = 16;
+    const int64_t num_samples = 64;
+    std::vector<river::FieldDefinition> fields;
+    for (int c = 0; c < num_channels / 2; c++) {
+        fields.emplace_back("ch" + std::to_string(c), river::FieldDefinition::INT16, sizeof(int16_t));
+    }
+    // Ungrouped, and splitting the channels into two runs of fields.
+    fields.emplace_back("x", river::FieldDefinition::FLOAT, sizeof(float));
+    for (int c = num_channels / 2; c < num_channels; c++) {
+        fields.emplace_back("ch" + std::to_string(c), river::FieldDefinition::INT16, sizeof(int16_t));
+    }
+    fields.emplace_back("t", river::FieldDefinition::INT64, sizeof(int64_t));
+    river::StreamSchema schema(fields);
+
+    std::vector<char> samples(num_samples * schema.sample_size());
+    for (int64_t i = 0; i < num_samples; i++) {
+        char *sample = &samples[i * schema.sample_size()];
+        for (int c = 0; c < num_channels; c++) {
+            int offset = c < num_channels / 2 ? c * 2 : c * 2 + 4;
+            memcpy(sample + offset, &sines[i * 4096 + c * 256], sizeof(int16_t));
+        }
+        auto x = (float) i;
+        int64_t t = 1000 + i;
+        memcpy(sample + 2 * num_channels / 2, &x, sizeof(x));
+        memcpy(sample + 2 * num_channels + 4, &t, sizeof(t));
+    }
+
+    std::vector<std::string> channel_names;
+    for (int c = 0; c < num_channels; c++) {
+        channel_names.push_back("ch" + std::to_string(c));
+    }
+    for (bool parallel : {false, true}) {
+        auto compression = river::StreamCompression::PerFieldGroup({
+            {channel_names, river::StreamCompression(river::StreamCompression::Type::ZFP_LOSSLESS,
+                                                     {{"data_type", "int16"}})},
+            {{"t"}, river::StreamCompression(river::StreamCompression::Type::DUMMY)},
+        }, parallel);
+        auto compressor = river::CreateCompressor(compression, schema);
+        auto decompressor = river::CreateDecompressor(compression, schema);
+        auto compressed = compressor->compress(samples.data(), samples.size());
+        ASSERT_EQ(decompressor->decompress(compressed.data(), compressed.size()), samples);
+        // Compressors are reused across batches.
+        compressed = compressor->compress(samples.data(), schema.sample_size() * 5);
+        ASSERT_EQ(decompressor->decompress(compressed.data(), compressed.size()),
+                  std::vector<char>(samples.begin(), samples.begin() + schema.sample_size() * 5));
+
+        ASSERT_THROW(river::CreateCompressor(compression), std::invalid_argument);
+    }
+    auto missing_field = river::StreamCompression::PerFieldGroup({
+        {{"y"}, river::StreamCompression(river::StreamCompression::Type::DUMMY)}});
+    ASSERT_THROW(river::CreateCompressor(missing_field, schema), std::invalid_argument);
+    auto overlapping = river::StreamCompression::PerFieldGroup({
+        {{"t"}, river::StreamCompression(river::StreamCompression::Type::DUMMY)},
+        {{"x", "t"}, river::StreamCompression(river::StreamCompression::Type::DUMMY)}});
+    ASSERT_THROW(river::CreateCompressor(overlapping, schema), std::invalid_argument);
+    auto empty = river::StreamCompression::PerFieldGroup({
+        {{}, river::StreamCompression(river::StreamCompression::Type::DUMMY)}});
+    ASSERT_THROW(river::CreateCompressor(empty, schema), std::invalid_argument);
+    ASSERT_THROW(river::CreateDecompressor(empty, schema), std::invalid_argument);
+}
+
+TEST_F(CompressorTest, TestFieldGroupsMustBeHomogeneous) {
+    using Type = river::StreamCompression::Type;
+    river::StreamSchema schema(std::vector<river::FieldDefinition>{
+        river::FieldDefinition("a", river::FieldDefinition::INT16, sizeof(int16_t)),
+        river::FieldDefinition("b", river::FieldDefinition::INT16, sizeof(int16_t)),
+        river::FieldDefinition("t", river::FieldDefinition::INT64, sizeof(int64_t)),
+        river::FieldDefinition("x", river::FieldDefinition::FLOAT, sizeof(float)),
+        river::FieldDefinition("raw", river::FieldDefinition::FIXED_WIDTH_BYTES, 6),
+    });
+    river::StreamCompression zfp_int16(Type::ZFP_LOSSLESS, {{"data_type", "int16"}});
+    river::StreamCompression filtered(Type::ZSTD, {{"filters", "delta"}, {"element_size", "2"}});
+
+    for (const auto &mismatched : {std::vector<std::string>{"a", "t"}, std::vector<std::string>{"a", "x"}}) {
+        auto compression = river::StreamCompression::PerFieldGroup({{mismatched, zfp_int16}});
+        ASSERT_THROW(river::CreateCompressor(compression, schema), std::invalid_argument);
+        ASSERT_THROW(river::CreateDecompressor(compression, schema), std::invalid_argument);
+    }
+    ASSERT_THROW(river::CreateCompressor(river::StreamCompression::PerFieldGroup({{{"raw"}, zfp_int16}}), schema),
+                 std::invalid_argument);
+    ASSERT_THROW(river::CreateCompressor(river::StreamCompression::PerFieldGroup({{{"a", "t"}, filtered}}), schema),
+                 std::invalid_argument);
+
+    // Fixed-width bytes may hold several elements of a filtered group, and unfiltered groups take any fields.
+    ASSERT_NO_THROW(river::CreateCompressor(
+        river::StreamCompression::PerFieldGroup({{{"a", "b", "raw"}, filtered}}), schema));
+    ASSERT_NO_THROW(river::CreateCompressor(
+        river::StreamCompression::PerFieldGroup({{{"a", "t", "x"}, river::StreamCompression(Type::ZSTD)}}), schema));
+}
+
+TEST_F(CompressorTest, TestAdaptivePicksPerBatch) {
+    using Type = river::StreamCompression::Type;
+    auto sines = ReadInputSinesInt16();
+    river::StreamSchema schema(std::vector<river::FieldDefinition>{
+        river::FieldDefinition("x", river::FieldDefinition::INT16, sizeof(int16_t))});
+    std::vector<char> noise(sines.size() * sizeof(int16_t));
+    std::mt19937 mt(0);
+    for (auto &c : noise) {
+        c = (char) mt();
+    }
+    const auto *smooth = (const char *) sines.data();
+
+    std::unique_ptr<river::Compressor> compressor;
+    std::unique_ptr<river::Decompressor> decompressor;
+    auto adaptive = river::StreamCompression::Adaptive(
+        {river::StreamCompression(Type::LZ4), river::StreamCompression(Type::ZSTD, {{"level", "1"}})}, 0, 1);
+    try {
+        compressor = river::CreateCompressor(adaptive, schema);
+        decompressor = river::CreateDecompressor(adaptive, schema);
+    } catch (const std::logic_error &e) {
+        GTEST_SKIP() << e.what();
+    }
+
+    // Each batch is tagged with the candidate it was compressed with: smooth data compresses, and noise doesn't.
+    auto compressed_smooth = compressor->compress(smooth, noise.size());
+    ASSERT_NE(compressed_smooth[0], 2);
+    ASSERT_LT(compressed_smooth.size(), noise.size());
+    auto compressed_noise = compressor->compress(noise.data(), noise.size());
+    ASSERT_EQ(compressed_noise[0], 2);
+    ASSERT_EQ(decompressor->decompress(compressed_smooth.data(), compressed_smooth.size()),
+              std::vector<char>(smooth, smooth + noise.size()));
+    ASSERT_EQ(decompressor->decompress(compressed_noise.data(), compressed_noise.size()), noise);
+
+    auto stats = dynamic_cast<river::internal::AdaptiveCompressor *>(compressor.get())->stats();
+    ASSERT_EQ(stats.size(), (size_t) 3);
+    ASSERT_EQ(stats[2].compression.type(), Type::UNCOMPRESSED);
+    ASSERT_EQ(stats[2].num_batches, 1);
+    ASSERT_EQ(stats[0].num_batches + stats[1].num_batches, 1);
+    ASSERT_GT(std::max(stats[0].ratio(), stats[1].ratio()), 1.0);
+
+    // Nothing fits within an impossibly small CPU budget, so batches are left uncompressed.
+    auto budgeted = river::StreamCompression::Adaptive({river::StreamCompression(Type::ZSTD)}, 1e-9);
+    auto budgeted_compressor = river::CreateCompressor(budgeted, schema);
+    ASSERT_EQ(budgeted_compressor->compress(smooth, noise.size())[0], 1);
+
+    ASSERT_THROW(river::CreateCompressor(adaptive), std::invalid_argument);
+    auto nested = river::StreamCompression::Adaptive({adaptive});
+    ASSERT_THROW(river::CreateCompressor(nested, schema), std::invalid_argument);
+}
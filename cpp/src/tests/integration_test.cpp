@@ -2,6 +2,7 @@
 #include "../river.h"
 #include "../tools/uuid.h"
 #include "compression/compressor_types.h"
+#include <cstdlib>
 #include <thread>
 #include <random>
 
@@ -110,13 +111,21 @@ protected:
     }
 
     void run() {
-        reader = make_shared<StreamReader>(connection);
+        reader = make_shared<StreamReader>(StreamReaderParamsBuilder()
+                                               .connection(connection)
+                                               .wire_compression(wire_compression)
+                                               .shared_memory(shared_memory_ring_bytes > 0)
+                                               .build());
         reader_tail = make_shared<StreamReader>(connection);
         reader_read_and_tail = make_shared<StreamReader>(connection);
         writer = make_shared<StreamWriter>(StreamWriterParamsBuilder()
                                                .connection(connection)
                                                .keys_per_redis_stream(3000)
                                                .compression(StreamCompression(compression_type, compression_params))
+                                               .wire_compression(wire_compression)
+                                               .shared_memory_ring_bytes(shared_memory_ring_bytes)
+                                               .batch_size(batch_size)
+                                               .compression_pool(compression_pool)
                                                .build());
 
         stream_name = uuid::generate_uuid_v4();
@@ -168,6 +177,10 @@ protected:
     bool compute_local_versus_global_clock;
     StreamCompression::Type compression_type = StreamCompression::Type::UNCOMPRESSED;
     std::unordered_map<std::string, std::string> compression_params;
+    WireCompression wire_compression = WireCompression::NONE;
+    int64_t shared_memory_ring_bytes = 0;
+    int batch_size = 1536;
+    shared_ptr<CompressionPool> compression_pool;
 };
 
 TEST_F(IntegrationTest, TestFull) {
@@ -217,3 +230,106 @@ TEST_F(IntegrationTest, TestCompressionDummy) {
     };
     run();
 }
+
+TEST_F(IntegrationTest, TestCompressionPool) {
+    compression_type = StreamCompression::Type::ZFP_LOSSLESS;
+    compression_params = {
+        {"data_type", "double"},
+        {"num_cols", "1"},
+    };
+    // Several batches per write, so that they're compressed ahead of being sent.
+    batch_size = 100;
+    compression_pool = make_shared<CompressionPool>(4);
+    run();
+}
+
+TEST_F(IntegrationTest, TestWireCompressionLz4) {
+    // Falls back to uncompressed transport if the module or codec isn't available, so this should always pass.
+    wire_compression = WireCompression::LZ4;
+    run();
+}
+
+TEST_F(IntegrationTest, TestWireCompressionZstd) {
+    wire_compression = WireCompression::ZSTD;
+    run();
+}
+
+TEST_F(IntegrationTest, TestSharedMemory) {
+    shared_memory_ring_bytes = 1 << 20;
+    run();
+}
+
+TEST_F(IntegrationTest, TestSharedMemoryFallsBehind) {
+    // Only fits about two batches, so the reader regularly falls back to Redis.
+    shared_memory_ring_bytes = 20000;
+    run();
+}
+
+TEST(SharedMemoryTest, TestKeyedReadResumesFromRedisMidRecord) {
+    string stream_name = uuid::generate_uuid_v4();
+    StreamWriter writer(StreamWriterParamsBuilder()
+                            .connection(connection).batch_size(100).shared_memory_ring_bytes(1 << 20).build());
+    writer.Initialize(stream_name, StreamSchema(vector<FieldDefinition>{
+        FieldDefinition("i", FieldDefinition::INT64, sizeof(int64_t))}));
+    StreamReader reader(StreamReaderParamsBuilder().connection(connection).shared_memory(true).build());
+    reader.Initialize(stream_name);
+
+    vector<int64_t> data(100);
+    for (int64_t i = 0; i < 100; i++) {
+        data[i] = i;
+    }
+    writer.Write(data.data(), 100);
+
+    // Partway through the batch's record in the ring, then the rest (along with their keys) from Redis.
+    vector<int64_t> read_data(100);
+    ASSERT_EQ(reader.Read(read_data.data(), 30, nullptr, nullptr, 1000), 30);
+    vector<string> keys(70);
+    string *keys_ptr = keys.data();
+    ASSERT_EQ(reader.Read(&read_data[30], 70, nullptr, &keys_ptr, 1000), 70);
+    ASSERT_EQ(read_data, data);
+
+    StreamReader redis_reader(connection);
+    redis_reader.Initialize(stream_name);
+    vector<string> expected_keys(100);
+    string *expected_keys_ptr = expected_keys.data();
+    ASSERT_EQ(redis_reader.Read(read_data.data(), 100, nullptr, &expected_keys_ptr, 1000), 100);
+    ASSERT_EQ(keys, vector<string>(expected_keys.begin() + 30, expected_keys.end()));
+    writer.Stop();
+}
+
+// Only runs against a Redis Cluster, given by the host:port of any of its nodes in RIVER_TEST_CLUSTER.
+TEST(ClusterIntegrationTest, TestStreamsOnEveryNode) {
+    const char *cluster_endpoint = std::getenv("RIVER_TEST_CLUSTER");
+    if (cluster_endpoint == nullptr) {
+        GTEST_SKIP() << "RIVER_TEST_CLUSTER is not set.";
+    }
+    string endpoint(cluster_endpoint);
+    auto colon = endpoint.rfind(':');
+    RedisConnection cluster_connection(endpoint.substr(0, colon), std::stoi(endpoint.substr(colon + 1)));
+    ASSERT_TRUE(internal::Redis::Create(cluster_connection)->is_cluster());
+
+    // Enough streams that their slots are spread across the nodes, each rolling over stream keys a few times.
+    const int num_streams = 16;
+    const int num_samples = 1000;
+    StreamSchema schema(vector<FieldDefinition>{FieldDefinition("i", FieldDefinition::INT64, sizeof(int64_t))});
+    vector<int64_t> data(num_samples);
+    for (int i = 0; i < num_samples; i++) {
+        data[i] = i;
+    }
+    for (int s = 0; s < num_streams; s++) {
+        string stream_name = uuid::generate_uuid_v4();
+        StreamWriter writer(StreamWriterParamsBuilder()
+                                .connection(cluster_connection).batch_size(64).keys_per_redis_stream(300).build());
+        writer.Initialize(stream_name, schema);
+        writer.Write(data.data(), num_samples);
+        writer.Stop();
+
+        StreamReader reader(cluster_connection);
+        reader.Initialize(stream_name);
+        vector<int64_t> read_data(num_samples);
+        ASSERT_EQ(reader.Read(read_data.data(), num_samples, nullptr, nullptr, 1000), num_samples);
+        ASSERT_EQ(read_data, data);
+        int64_t buffer;
+        ASSERT_EQ(reader.Read(&buffer, 1, nullptr, nullptr, 1000), -1);
+    }
+}
@@ -712,3 +712,182 @@ TEST_F(StreamReaderTest, TestMetadata) {
     unordered_map<string, string> expected = unordered_map<string, string>();
     ASSERT_EQ(reader_->Metadata(), expected);
 }
+
+TEST_F(StreamReaderTest, TestLossyStopsAtGaps) {
+    redisCommand(redis, "HSET %s-metadata retention_json %s", stream_name.c_str(), "{\"max_samples\":10}");
+
+    int data[NUM_ELEMENTS];
+    for (int i = 0; i < NUM_ELEMENTS; i++) {
+        data[i] = i;
+    }
+    // Samples 10-19 were "trimmed" before the reader got to them.
+    for (int i = 0; i < 10; i++) {
+        xadd_sample(0, i, reinterpret_cast<char *>(&data[i]), sizeof(int));
+    }
+    for (int i = 20; i < 30; i++) {
+        xadd_sample(0, i, reinterpret_cast<char *>(&data[i]), sizeof(int));
+    }
+
+    reader_->Initialize(stream_name);
+    ASSERT_TRUE(reader_->is_lossy());
+
+    int read_data[NUM_ELEMENTS];
+    ASSERT_EQ(reader_->Read(read_data, 20), 10);
+    ASSERT_EQ(reader_->total_samples_dropped(), 0);
+    for (int i = 0; i < 10; i++) {
+        ASSERT_EQ(read_data[i], i);
+    }
+
+    ASSERT_EQ(reader_->Read(read_data, 20, nullptr, nullptr, 100), 10);
+    ASSERT_EQ(reader_->total_samples_dropped(), 10);
+    for (int i = 0; i < 10; i++) {
+        ASSERT_EQ(read_data[i], 20 + i);
+    }
+}
+
+TEST_F(StreamReaderTest, TestLossyFastForwardsPastDeletedKeys) {
+    redisCommand(redis, "HSET %s-metadata retention_json %s", stream_name.c_str(), "{\"max_samples\":10}");
+
+    int data[NUM_ELEMENTS];
+    for (int i = 0; i < NUM_ELEMENTS; i++) {
+        data[i] = i;
+    }
+    for (int i = 0; i < 5; i++) {
+        xadd_sample(0, i, reinterpret_cast<char *>(&data[i]), sizeof(int));
+    }
+
+    auto listener = new TestStreamReaderListener();
+    reader_->AddListener(listener);
+    reader_->Initialize(stream_name);
+
+    // As a ring-buffer writer would: move first_stream_key along, then delete the old key (and its tombstone).
+    for (int i = 5; i < 15; i++) {
+        xadd_sample(1, i, reinterpret_cast<char *>(&data[i]), sizeof(int));
+    }
+    redisCommand(redis, "HSET %s-metadata first_stream_key %s-1", stream_name.c_str(), stream_name.c_str());
+    redisCommand(redis, "UNLINK %s-0", stream_name.c_str());
+
+    int read_data[NUM_ELEMENTS];
+    ASSERT_EQ(reader_->Read(read_data, 10, nullptr, nullptr, 100), 10);
+    ASSERT_EQ(reader_->total_samples_dropped(), 5);
+    for (int i = 0; i < 10; i++) {
+        ASSERT_EQ(read_data[i], 5 + i);
+    }
+    ASSERT_STREQ(listener->new_stream_keys.back().c_str(), fmt::format("{}-1", stream_name).c_str());
+}
+
+TEST(ReadColumnsTest, TestDeinterleavesAndConverts) {
+    RedisConnection connection("127.0.0.1", 6379);
+    StreamWriter writer(connection);
+    vector<FieldDefinition> fields = {FieldDefinition("t", FieldDefinition::INT64, sizeof(int64_t))};
+    for (int f = 0; f < 8; f++) {
+        fields.emplace_back(fmt::format("ch{}", f), FieldDefinition::INT16, sizeof(int16_t));
+    }
+    fields.emplace_back("skipped", FieldDefinition::FLOAT, sizeof(float));
+    StreamSchema schema(fields);
+    string stream_name = uuid::generate_uuid_v4();
+    writer.Initialize(stream_name, schema);
+
+    const int64_t num_samples = 37;
+    vector<char> samples(num_samples * schema.sample_size());
+    for (int64_t i = 0; i < num_samples; i++) {
+        char *sample = &samples[i * schema.sample_size()];
+        int64_t t = i * 1000;
+        memcpy(sample, &t, sizeof(t));
+        for (int f = 0; f < 8; f++) {
+            auto value = (int16_t) (i * (f + 1) - 100);
+            memcpy(sample + sizeof(t) + f * sizeof(int16_t), &value, sizeof(value));
+        }
+    }
+    writer.WriteBytes(samples.data(), num_samples);
+    writer.Stop();
+
+    StreamReader reader(connection);
+    reader.Initialize(stream_name);
+    vector<int64_t> t(num_samples);
+    vector<vector<int16_t>> raw_channels(7, vector<int16_t>(num_samples));
+    vector<float> converted_channel(num_samples);
+    vector<void *> columns = {t.data()};
+    for (auto &channel : raw_channels) {
+        columns.push_back(channel.data());
+    }
+    columns.push_back(converted_channel.data());
+    columns.push_back(nullptr);
+    // The last channel is converted into microvolts.
+    unordered_map<string, ColumnConversion> conversions = {{"ch7", ColumnConversion(FieldDefinition::FLOAT, 0.195)}};
+    ASSERT_EQ(reader.ReadColumns(columns.data(), num_samples, conversions), num_samples);
+    for (int64_t i = 0; i < num_samples; i++) {
+        ASSERT_EQ(t[i], i * 1000);
+        for (int f = 0; f < 7; f++) {
+            ASSERT_EQ(raw_channels[f][i], (int16_t) (i * (f + 1) - 100));
+        }
+        ASSERT_FLOAT_EQ(converted_channel[i], (int16_t) (i * 8 - 100) * 0.195f);
+    }
+    ASSERT_EQ(reader.ReadColumns(columns.data(), 1), -1);
+}
+
+TEST(ZfpFixedRateReadTest, TestSeeksAndTailsIntoBatches) {
+    RedisConnection connection("127.0.0.1", 6379);
+    const int num_cols = 4;
+    const int batch_size = 64;
+    const int64_t num_samples = 4 * batch_size;
+    StreamWriter writer(StreamWriterParamsBuilder()
+                            .connection(connection)
+                            .batch_size(batch_size)
+                            .compression(StreamCompression(StreamCompression::Type::ZFP_FIXED_RATE,
+                                                           {{"data_type", "float"},
+                                                            {"num_cols", to_string(num_cols)},
+                                                            {"rate", "16"}}))
+                            .build());
+    vector<FieldDefinition> fields;
+    for (int c = 0; c < num_cols; c++) {
+        fields.emplace_back(fmt::format("ch{}", c), FieldDefinition::FLOAT, sizeof(float));
+    }
+    StreamSchema schema(fields);
+    string stream_name = uuid::generate_uuid_v4();
+    writer.Initialize(stream_name, schema);
+    vector<float> data(num_samples * num_cols);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = sinf((float) i / 10);
+    }
+    writer.WriteBytes(reinterpret_cast<const char *>(data.data()), num_samples);
+
+    // Fixed-rate ZFP is lossy, so compare partial decodes against a read of every sample from the start.
+    StreamReader full_reader(connection);
+    full_reader.Initialize(stream_name);
+    vector<float> expected(data.size());
+    vector<string> keys(num_samples);
+    string *keys_ptr = keys.data();
+    ASSERT_EQ(full_reader.ReadBytes(reinterpret_cast<char *>(expected.data()), num_samples, nullptr, &keys_ptr),
+              num_samples);
+
+    // Seeking into the middle of the second batch decodes just the next sample, then the rest of the batch once read
+    // across, and then whole batches again.
+    const int64_t seek_idx = batch_size + 20;
+    StreamReader seek_reader(connection);
+    seek_reader.Initialize(stream_name);
+    ASSERT_EQ(seek_reader.Seek(keys[seek_idx]), seek_idx + 1);
+    vector<float> read_data((num_samples - seek_idx - 1) * num_cols);
+    for (int64_t read = 0; read < num_samples - seek_idx - 1;) {
+        // Uneven reads, so that some stop partway through the seeked-into sample's batch.
+        int64_t n = seek_reader.ReadBytes(reinterpret_cast<char *>(&read_data[read * num_cols]),
+                                          min<int64_t>(7, num_samples - seek_idx - 1 - read));
+        ASSERT_GT(n, 0);
+        read += n;
+    }
+    ASSERT_EQ(read_data, vector<float>(expected.begin() + (seek_idx + 1) * num_cols, expected.end()));
+
+    // Tailing lands on the last sample of the last batch.
+    StreamReader tail_reader(connection);
+    tail_reader.Initialize(stream_name);
+    vector<float> tailed(num_cols);
+    ASSERT_EQ(tail_reader.TailBytes(reinterpret_cast<char *>(tailed.data())), num_samples);
+    ASSERT_EQ(tailed, vector<float>(expected.end() - num_cols, expected.end()));
+
+    // Samples written after the tail are read from the start of their batch.
+    writer.WriteBytes(reinterpret_cast<const char *>(data.data()), batch_size);
+    writer.Stop();
+    vector<float> after_tail(batch_size * num_cols);
+    ASSERT_EQ(tail_reader.ReadBytes(reinterpret_cast<char *>(after_tail.data()), batch_size), batch_size);
+    ASSERT_EQ(after_tail, vector<float>(expected.begin(), expected.begin() + batch_size * num_cols));
+}
@@ -1,6 +1,9 @@
+#include <cstdlib>
+#include <sys/stat.h>
 #include "gtest/gtest.h"
 #include "../tools/uuid.h"
 #include "../redis.h"
+#include "../redis_writer_commands.h"
 
 using namespace std;
 using namespace river;
@@ -34,3 +37,292 @@ TEST_F(RedisTest, TestExists) {
 }
 
 
+TEST_F(RedisTest, TestRiverFunctionsBatchXadd) {
+    if (!redis->LoadRiverFunctions()) {
+        GTEST_SKIP() << "Redis server does not support Redis Functions.";
+    }
+
+    int64_t data[3] = {10, 11, 12};
+    string key = stream_name + "-0";
+    string num_samples = "3";
+    string sample_size = to_string(sizeof(int64_t));
+    const char *argv[] = {"FCALL", "river_batch_xadd", "1", key.c_str(), "5", num_samples.c_str(),
+                          sample_size.c_str(), (const char *) data};
+    size_t argvlen[] = {5, 16, 1, key.size(), 1, num_samples.size(), sample_size.size(), sizeof(data)};
+    redis->SendCommandArgv(8, argv, argvlen);
+    auto reply = redis->GetReply();
+    ASSERT_EQ(reply->type, REDIS_REPLY_STATUS);
+
+    auto range = redis->Xrange(10, key, 0, 0);
+    ASSERT_EQ(range->type, REDIS_REPLY_ARRAY);
+    ASSERT_EQ(range->elements, 3);
+    // Replies with the ID of the last entry added.
+    ASSERT_EQ(string(reply->str, reply->len), range->element[2]->element[0]->str);
+    for (size_t i = 0; i < range->elements; i++) {
+        // Each entry is [id, [field, value, field, value]]
+        auto fields = range->element[i]->element[1];
+        ASSERT_EQ(fields->elements, 4);
+        ASSERT_STREQ(fields->element[0]->str, "i");
+        ASSERT_EQ(stoll(fields->element[1]->str), 5 + (int64_t) i);
+        ASSERT_STREQ(fields->element[2]->str, "val");
+        ASSERT_EQ(fields->element[3]->len, sizeof(int64_t));
+        ASSERT_EQ(*(int64_t *) fields->element[3]->str, data[i]);
+    }
+
+    redis->Unlink(key);
+}
+
+TEST_F(RedisTest, TestRiverFunctionsBatchXaddVariableChecksSizes) {
+    if (!redis->LoadRiverFunctions()) {
+        GTEST_SKIP() << "Redis server does not support Redis Functions.";
+    }
+    // Already loaded, so left as is.
+    ASSERT_TRUE(redis->LoadRiverFunctions());
+
+    string key = stream_name + "-0";
+    int sizes[2] = {2, 3};
+    int negative_sizes[2] = {6, -1};
+    for (const auto &[sizes_arg, data] : vector<pair<const int *, string>>{
+        {sizes, "abcd"}, {sizes, "abcdef"}, {negative_sizes, "abcde"}}) {
+        const char *argv[] = {"FCALL", "river_batch_xadd_variable", "1", key.c_str(), "0",
+                              (const char *) sizes_arg, data.c_str()};
+        size_t argvlen[] = {5, 25, 1, key.size(), 1, sizeof(sizes), data.size()};
+        redis->SendCommandArgv(7, argv, argvlen);
+        auto reply = redis->GetReply();
+        ASSERT_EQ(reply->type, REDIS_REPLY_ERROR);
+    }
+    ASSERT_FALSE(redis->Exists(key));
+}
+
+
+TEST_F(RedisTest, TestRiverFunctionsRejectBadArguments) {
+    if (!redis->LoadRiverFunctions()) {
+        GTEST_SKIP() << "Redis server does not support Redis Functions.";
+    }
+
+    string key = stream_name + "-0";
+    string metadata_key = stream_name + "-metadata";
+    string one_size("\x01\x00\x00\x00", 4);
+    string one_sample_block("\x01\x00\x00\x00x", 5);
+    // Each function, with one key, and arguments that are each wrong somehow: missing, non-numeric, or out of range.
+    vector<pair<string, vector<vector<string>>>> bad_calls = {
+        {"river_batch_xadd", {{"0", "1"}, {"a", "1", "1", "x"}, {"0", "b", "1", "x"}, {"0", "0", "1", ""},
+                              {"0", "1", "1", "MAXLEN", "c", "x"}, {"0", "2", "1", "x"}}},
+        {"river_batch_xadd_compressed", {{"0", "1"}, {"0", "1", "x", "y"}, {"a", "1", "x"}, {"0", "b", "x"},
+                                         {"0", "0", "x"}, {"0", "-1", "x"}, {"0", "1.5", "x"}}},
+        {"river_batch_xadd_variable", {{"0"}, {"a", one_size, "x"}, {"0", one_size, "xy"}}},
+        {"river_batch_xadd_variable_compressed", {{"0", "1"}, {"0", "b", one_sample_block},
+                                                  {"0", "2", one_sample_block}}},
+        {"river_batch_xadd_shared", {{stream_name}, {stream_name, "a", "1", "1", "x"},
+                                     {stream_name, "0", "1", "1", "x"}, {stream_name, "10", "0", "1", ""}}},
+        {"river_batch_xadd_shared_variable", {{stream_name}, {stream_name, "a", one_size, "x"},
+                                              {stream_name, "10", "", ""}}},
+        {"river_multi_writer_join", {{"odd"}}},
+        {"river_multi_writer_leave", {{stream_name}, {stream_name, "a"}, {stream_name, "10"}}},
+    };
+    for (const auto &[function, calls] : bad_calls) {
+        const string &call_key = function.rfind("river_multi_writer", 0) == 0 ? metadata_key : key;
+        for (const auto &args : calls) {
+            vector<string> parts = {"FCALL", function, "1", call_key};
+            parts.insert(parts.end(), args.begin(), args.end());
+            vector<const char *> argv;
+            vector<size_t> argvlen;
+            for (const auto &part : parts) {
+                argv.push_back(part.data());
+                argvlen.push_back(part.size());
+            }
+            redis->SendCommandArgv(static_cast<int>(argv.size()), argv.data(), argvlen.data());
+            auto reply = redis->GetReply();
+            ASSERT_EQ(reply->type, REDIS_REPLY_ERROR) << function << " accepted " << args.size() << " arguments";
+        }
+    }
+    ASSERT_FALSE(redis->Exists(key));
+    ASSERT_FALSE(redis->Exists(metadata_key));
+}
+
+TEST(RedisClusterTest, TestClusterKeySlot) {
+    // Reference values from the Redis Cluster specification.
+    ASSERT_EQ(internal::ClusterKeySlot("123456789"), 12739);
+    ASSERT_EQ(internal::ClusterKeySlot("foo"), 12182);
+
+    // Only the hash tag is hashed, so all of a stream's keys share a slot...
+    ASSERT_EQ(internal::ClusterKeySlot("{stream}-metadata"), internal::ClusterKeySlot("stream"));
+    ASSERT_EQ(internal::ClusterKeySlot("{stream}-0"), internal::ClusterKeySlot("{stream}-12"));
+    // ...unless the tag is empty, in which case the whole key is hashed.
+    ASSERT_NE(internal::ClusterKeySlot("foo{}{bar}"), internal::ClusterKeySlot("bar"));
+    ASSERT_EQ(internal::ClusterKeySlot("foo{{bar}}zap"), internal::ClusterKeySlot("{bar"));
+}
+
+TEST(RedisClusterTest, TestParsesRedirects) {
+    string endpoint;
+    bool is_ask;
+    redisReply reply{};
+    reply.type = REDIS_REPLY_ERROR;
+    string moved = "MOVED 3999 127.0.0.1:6381";
+    reply.str = moved.data();
+    reply.len = moved.size();
+    ASSERT_TRUE(internal::ParseClusterRedirect(&reply, &endpoint, &is_ask));
+    ASSERT_FALSE(is_ask);
+    ASSERT_EQ(endpoint, "127.0.0.1:6381");
+
+    string ask = "ASK 3999 127.0.0.1:6382";
+    reply.str = ask.data();
+    reply.len = ask.size();
+    ASSERT_TRUE(internal::ParseClusterRedirect(&reply, &endpoint, &is_ask));
+    ASSERT_TRUE(is_ask);
+    ASSERT_EQ(endpoint, "127.0.0.1:6382");
+
+    // Other errors, and non-errors that happen to look like redirects, are left to the caller.
+    string other = "ERR MOVED 3999 127.0.0.1:6381";
+    reply.str = other.data();
+    reply.len = other.size();
+    ASSERT_FALSE(internal::ParseClusterRedirect(&reply, &endpoint, &is_ask));
+    reply.str = moved.data();
+    reply.len = moved.size();
+    reply.type = REDIS_REPLY_STATUS;
+    ASSERT_FALSE(internal::ParseClusterRedirect(&reply, &endpoint, &is_ask));
+    ASSERT_FALSE(internal::ParseClusterRedirect(nullptr, &endpoint, &is_ask));
+}
+
+TEST(RedisClusterTest, TestSlicesPipelinedCommands) {
+    // Commands of a pipelined batch span parts arbitrarily, e.g. a rollover, a batch command split around its data,
+    // then per-sample commands.
+    string rollover = "*1\r\n$4\r\nPING\r\n";
+    string header = "*2\r\n$4\r\nECHO\r\n$3\r\n";
+    string data = "abc";
+    string trailer = "\r\n*1\r\n$4\r\nPING\r\n*1\r\n$4\r\nPING\r\n";
+    vector<pair<const char *, size_t>> parts = {
+        {rollover.data(), rollover.size()}, {header.data(), header.size()},
+        {data.data(), data.size()}, {trailer.data(), trailer.size()}};
+    string ping = "*1\r\n$4\r\nPING\r\n";
+    string echo = header + data + "\r\n";
+    vector<size_t> command_ends = {rollover.size(), rollover.size() + echo.size(),
+                                   rollover.size() + echo.size() + ping.size(),
+                                   rollover.size() + echo.size() + 2 * ping.size()};
+
+    vector<string> commands;
+    size_t start = 0;
+    for (size_t end : command_ends) {
+        string command;
+        for (const auto &part : internal::SliceParts(parts, start, end)) {
+            command.append(part.first, part.second);
+        }
+        commands.push_back(command);
+        start = end;
+    }
+    ASSERT_EQ(commands, vector<string>({rollover, echo, ping, ping}));
+    // The data itself is resent in place rather than copied.
+    auto batch_command_parts = internal::SliceParts(parts, command_ends[0], command_ends[1]);
+    ASSERT_EQ(batch_command_parts.size(), 3);
+    ASSERT_EQ(batch_command_parts[1].first, data.data());
+    ASSERT_TRUE(internal::SliceParts(parts, command_ends[3], command_ends[3]).empty());
+}
+
+TEST(RedisWriterCommandTest, TestReplacesBulkStrings) {
+    auto assemble = [](const vector<pair<const char *, size_t>> &parts) {
+        string ret;
+        for (const auto &part : parts) {
+            ret.append(part.first, part.second);
+        }
+        return ret;
+    };
+
+    // Placeholders, as formatted by hiredis, for: CMD key <sizes> MAXLEN 10 <data>
+    string formatted = "*6\r\n$3\r\nCMD\r\n$3\r\nkey\r\n$0\r\n\r\n$6\r\nMAXLEN\r\n$2\r\n10\r\n$1\r\n_\r\n";
+    RedisWriterCommand command(formatted, {2, 5});
+    string sizes("\x01\x00\x00\x00\x02\x00\x00\x00", 8);
+    ASSERT_EQ(assemble(command.ReplaceBulkStringsAndAssemble({{sizes.data(), sizes.size()}, {"abc", 3}})),
+              "*6\r\n$3\r\nCMD\r\n$3\r\nkey\r\n$8\r\n" + sizes
+              + "\r\n$6\r\nMAXLEN\r\n$2\r\n10\r\n$3\r\nabc\r\n");
+    // Reusable across batches.
+    ASSERT_EQ(assemble(command.ReplaceBulkStringsAndAssemble({{"", 0}, {"de", 2}})),
+              "*6\r\n$3\r\nCMD\r\n$3\r\nkey\r\n$0\r\n\r\n$6\r\nMAXLEN\r\n$2\r\n10\r\n$2\r\nde\r\n");
+
+    RedisWriterCommand last_only(formatted);
+    ASSERT_EQ(assemble(last_only.ReplaceLastBulkStringAndAssemble("xyz", 3)),
+              "*6\r\n$3\r\nCMD\r\n$3\r\nkey\r\n$0\r\n\r\n$6\r\nMAXLEN\r\n$2\r\n10\r\n$3\r\nxyz\r\n");
+}
+
+TEST_F(RedisTest, TestKeyNames) {
+    if (redis->is_cluster()) {
+        ASSERT_EQ(redis->MetadataKey(stream_name), "{" + stream_name + "}-metadata");
+        ASSERT_EQ(redis->StreamKey(stream_name, 3), "{" + stream_name + "}-3");
+    } else {
+        ASSERT_EQ(redis->MetadataKey(stream_name), stream_name + "-metadata");
+        ASSERT_EQ(redis->StreamKey(stream_name, 3), stream_name + "-3");
+    }
+}
+
+TEST_F(RedisTest, TestCreateForReadsFallsBackToPrimary) {
+    // Neither an unreachable endpoint nor a primary are healthy replicas.
+    auto connection = RedisConnection("127.0.0.1", 6379)
+        .AddReadEndpoint("127.0.0.1", 1)
+        .AddReadEndpoint("127.0.0.1", 6379);
+    auto read_redis = internal::Redis::CreateForReads(connection);
+    ASSERT_FALSE(read_redis->is_replica());
+    ASSERT_TRUE(read_redis->CatchUpToPrimary(0));
+
+    redis->SetUserMetadata(stream_name, unordered_map<string, string>({{"key", "value"}}));
+    ASSERT_TRUE(read_redis->GetMetadata(stream_name));
+    ASSERT_GE(redis->ReplicationOffset(), 0);
+    ASSERT_EQ(redis->WaitForReplicas(0, 0), 0);
+    redis->DeleteMetadata(stream_name);
+}
+
+TEST_F(RedisTest, TestSocketOptions) {
+    RedisSocketOptions socket_options;
+    socket_options.tcp_nodelay = false;
+    socket_options.send_buffer_bytes = 1 << 20;
+    socket_options.receive_buffer_bytes = 1 << 20;
+    auto tuned_redis = internal::Redis::Create(RedisConnection("127.0.0.1", 6379).SetSocketOptions(socket_options));
+    ASSERT_GT(tuned_redis->TimeUs(stream_name), 0);
+}
+
+TEST_F(RedisTest, TestUnixSocketDoesNotExist) {
+    auto connection = RedisConnection("127.0.0.1", 6379).SetUnixSocketPath("/nonexistent/redis.sock");
+    ASSERT_THROW(internal::Redis::Create(connection), internal::RedisException);
+}
+
+// Only runs if Redis listens on the Unix socket given by RIVER_TEST_UNIX_SOCKET (by default /tmp/redis.sock).
+TEST_F(RedisTest, TestUnixSocketRoundTrip) {
+    const char *socket_path_env = std::getenv("RIVER_TEST_UNIX_SOCKET");
+    string socket_path = socket_path_env == nullptr ? "/tmp/redis.sock" : socket_path_env;
+    struct stat socket_stat = {};
+    if (stat(socket_path.c_str(), &socket_stat) != 0 || !S_ISSOCK(socket_stat.st_mode)) {
+        GTEST_SKIP() << "No Unix socket at " << socket_path;
+    }
+
+    auto unix_redis = internal::Redis::Create(RedisConnection("127.0.0.1", 6379).SetUnixSocketPath(socket_path));
+    ASSERT_GT(unix_redis->TimeUs(stream_name), 0);
+    unix_redis->SetUserMetadata(stream_name, unordered_map<string, string>({{"key", "value"}}));
+    // Written over the socket, and so visible over TCP too.
+    auto ret = redis->GetUserMetadata(stream_name);
+    ASSERT_TRUE(ret);
+    ASSERT_EQ(ret->at("key"), "value");
+    ret = unix_redis->GetUserMetadata(stream_name);
+    ASSERT_TRUE(ret);
+    ASSERT_EQ(ret->at("key"), "value");
+    unix_redis->DeleteMetadata(stream_name);
+}
+
+TEST_F(RedisTest, TestZeroCopySend) {
+    // Over loopback the kernel copies anyways, but still reports completions for each zero-copy send.
+    RedisSocketOptions socket_options;
+    socket_options.zero_copy_send = true;
+    socket_options.zero_copy_min_bytes = 1024;
+    auto zero_copy_redis = internal::Redis::Create(RedisConnection("127.0.0.1", 6379).SetSocketOptions(socket_options));
+
+    string key = stream_name + "-zerocopy";
+    string value(1 << 20, 'x');
+    string header = "*3\r\n$3\r\nSET\r\n$" + to_string(key.size()) + "\r\n" + key + "\r\n$"
+                    + to_string(value.size()) + "\r\n";
+    string trailer = "\r\n";
+    int bytes_written = zero_copy_redis->SendCommandPreformatted(
+        {{header.data(), header.size()}, {value.data(), value.size()}, {trailer.data(), trailer.size()}});
+    ASSERT_EQ(bytes_written, (int) (header.size() + value.size() + trailer.size()));
+    auto reply = zero_copy_redis->GetReply();
+    ASSERT_EQ(reply->type, REDIS_REPLY_STATUS);
+    zero_copy_redis->WaitForZeroCopyCompletions();
+
+    zero_copy_redis->Unlink(key);
+}
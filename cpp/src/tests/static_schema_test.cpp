@@ -0,0 +1,104 @@
+#include "gtest/gtest.h"
+#include "../river.h"
+#include "../tools/uuid.h"
+
+using namespace std;
+using namespace river;
+
+namespace {
+RIVER_FIELD(Timestamp, "t", int64_t);
+RIVER_FIELD(X, "x", float);
+RIVER_FIELD(Channel, "ch", int16_t);
+RIVER_FIELD(Tag, "tag", std::array<char, 3>);
+}
+
+using TestSchema = StaticSchema<Timestamp, X, Channel, Tag>;
+
+static_assert(TestSchema::sample_size == 8 + 4 + 2 + 3, "");
+static_assert(TestSchema::offset_of<Channel>() == 12, "");
+static_assert(TestSchema::index_of<Tag>() == 3, "");
+
+TEST(StaticSchemaTest, TestToStreamSchema) {
+    auto schema = TestSchema::ToStreamSchema();
+    ASSERT_EQ(schema.field_definitions.size(), 4);
+    ASSERT_EQ(schema.field_definitions[1].name, "x");
+    ASSERT_EQ(schema.field_definitions[1].type, FieldDefinition::FLOAT);
+    ASSERT_EQ(schema.field_definitions[3].type, FieldDefinition::FIXED_WIDTH_BYTES);
+    ASSERT_EQ(schema.field_definitions[3].size, 3);
+    ASSERT_EQ(schema.sample_size(), TestSchema::sample_size);
+    ASSERT_TRUE(TestSchema::Matches(StreamSchema::FromJson(TestSchema::ToJson())));
+    ASSERT_FALSE((StaticSchema<Timestamp, X>::Matches(schema)));
+}
+
+TEST(StaticSchemaTest, TestPackAndUnpack) {
+    const int64_t num_samples = 10;
+    vector<int64_t> ts(num_samples);
+    vector<float> xs(num_samples);
+    vector<int16_t> chs(num_samples);
+    vector<std::array<char, 3>> tags(num_samples);
+    for (int64_t i = 0; i < num_samples; i++) {
+        ts[i] = i * 100;
+        xs[i] = i / 2.0f;
+        chs[i] = (int16_t) -i;
+        tags[i] = {'a', (char) ('a' + i), 'z'};
+    }
+
+    vector<TestSchema::Sample> samples(num_samples - 2);
+    TestSchema::Pack(2, num_samples - 2, reinterpret_cast<char *>(samples.data()),
+                     ts.data(), xs.data(), chs.data(), tags.data());
+    for (int64_t i = 0; i < num_samples - 2; i++) {
+        ASSERT_EQ(samples[i].get<Timestamp>(), ts[i + 2]);
+        ASSERT_EQ(samples[i].get<X>(), xs[i + 2]);
+        ASSERT_EQ(samples[i].get<Channel>(), chs[i + 2]);
+        ASSERT_EQ(samples[i].get<Tag>(), tags[i + 2]);
+    }
+
+    // A projection, out of order.
+    vector<int16_t> projected_chs(num_samples - 2);
+    vector<int64_t> projected_ts(num_samples - 2);
+    TestSchema::Unpack<Channel, Timestamp>(reinterpret_cast<const char *>(samples.data()), num_samples - 2,
+                                           projected_chs.data(), projected_ts.data());
+    ASSERT_EQ(projected_chs, vector<int16_t>(chs.begin() + 2, chs.end()));
+    ASSERT_EQ(projected_ts, vector<int64_t>(ts.begin() + 2, ts.end()));
+}
+
+TEST(StaticSchemaTest, TestTypedWriterAndReader) {
+    RedisConnection connection("127.0.0.1", 6379);
+    string stream_name = uuid::generate_uuid_v4();
+    TypedStreamWriter<TestSchema> writer(StreamWriterParamsBuilder().connection(connection).batch_size(4).build());
+    writer.Initialize(stream_name);
+
+    const int64_t num_samples = 25;
+    vector<int64_t> ts(num_samples);
+    vector<float> xs(num_samples);
+    vector<int16_t> chs(num_samples);
+    vector<std::array<char, 3>> tags(num_samples, {'a', 'b', 'c'});
+    for (int64_t i = 0; i < num_samples; i++) {
+        ts[i] = i;
+        xs[i] = i * 1.5f;
+        chs[i] = (int16_t) (i - 10);
+    }
+    writer.WriteColumns(num_samples, ts.data(), xs.data(), chs.data(), tags.data());
+    TestSchema::Sample last;
+    last.set<Timestamp>(num_samples);
+    last.set<X>(0);
+    last.set<Channel>(0);
+    last.set<Tag>({'x', 'y', 'z'});
+    writer.Write(&last, 1);
+    writer.Stop();
+
+    TypedStreamReader<StaticSchema<Timestamp, X>> wrong_reader(StreamReaderParamsBuilder().connection(connection).build());
+    ASSERT_THROW(wrong_reader.Initialize(stream_name), StreamReaderException);
+
+    TypedStreamReader<TestSchema> reader(StreamReaderParamsBuilder().connection(connection).build());
+    reader.Initialize(stream_name);
+    vector<float> read_xs(num_samples);
+    vector<int64_t> read_ts(num_samples);
+    ASSERT_EQ(reader.ReadFields<X>(num_samples, 1000, read_xs.data()), num_samples);
+    ASSERT_EQ(read_xs, xs);
+    TestSchema::Sample read_last;
+    ASSERT_EQ(reader.Read(&read_last, 1), 1);
+    ASSERT_EQ(read_last.get<Timestamp>(), num_samples);
+    ASSERT_EQ(read_last.get<Tag>(), (std::array<char, 3>{'x', 'y', 'z'}));
+    ASSERT_EQ(reader.ReadFields<Timestamp>(1, 1000, read_ts.data()), -1);
+}
@@ -2,6 +2,10 @@
 #include "../river.h"
 #include "../tools/uuid.h"
 #include <cstring>
+#include <functional>
+#include <thread>
+#include <random>
+#include <spdlog/fmt/fmt.h>
 #include <unordered_map>
 
 using namespace std;
@@ -203,6 +207,217 @@ TEST_F(StreamWriterTest, TestVariableBinary) {
     });
 }
 
+// Writes all of data (of variable-width samples if sizes are given), stops the writer, and checks that a reader reads
+// it all back. Reads are of uneven lengths, so that some start on samples that only reference their compressed batch.
+static void WriteAndReadBack(StreamWriter &writer, const StreamSchema &schema, const vector<char> &data,
+                             const vector<int> &sizes = {}) {
+    int64_t num_samples = sizes.empty() ? (int64_t) data.size() / schema.sample_size() : (int64_t) sizes.size();
+    writer.WriteBytes(data.data(), num_samples, sizes.empty() ? nullptr : sizes.data());
+    writer.Stop();
+
+    StreamReader reader(RedisConnection("127.0.0.1", 6379));
+    reader.Initialize(writer.stream_name());
+    vector<char> read_data(data.size());
+    vector<int> read_sizes(num_samples);
+    int *read_sizes_ptr = read_sizes.data();
+    int64_t num_read = 0;
+    size_t read_idx = 0;
+    while (num_read < num_samples) {
+        int64_t n = reader.ReadBytes(&read_data[read_idx], min<int64_t>(5, num_samples - num_read),
+                                     sizes.empty() ? nullptr : &read_sizes_ptr, nullptr, 1000);
+        ASSERT_GT(n, 0);
+        for (int64_t i = 0; i < n; i++) {
+            read_idx += sizes.empty() ? schema.sample_size() : read_sizes_ptr[i];
+        }
+        num_read += n;
+        read_sizes_ptr += n;
+    }
+    if (!sizes.empty()) {
+        ASSERT_EQ(read_sizes, sizes);
+    }
+    ASSERT_EQ(read_data, data);
+}
+
+TEST(VariableWidthCompressionTest, TestReadsBackSizes) {
+    RedisConnection connection("127.0.0.1", 6379);
+    // Small batches and keys, so that reads start mid-batch and batches straddle key rollovers.
+    StreamWriter writer(StreamWriterParamsBuilder()
+                            .connection(connection)
+                            .batch_size(7)
+                            .keys_per_redis_stream(50)
+                            .compression(StreamCompression(StreamCompression::Type::DUMMY))
+                            .build());
+    string stream_name = uuid::generate_uuid_v4();
+    StreamSchema schema(vector<FieldDefinition>{FieldDefinition("bytes", FieldDefinition::VARIABLE_WIDTH_BYTES, 0)});
+    writer.Initialize(stream_name, schema);
+
+    vector<char> data(NUM_ELEMENTS * (NUM_ELEMENTS + 1) / 2);
+    vector<int> sizes(NUM_ELEMENTS);
+    size_t idx = 0;
+    for (int i = 0; i < NUM_ELEMENTS; i++) {
+        sizes[i] = i % 17;
+        for (int j = 0; j < sizes[i]; j++) {
+            data[idx++] = (char) (i + j);
+        }
+    }
+    data.resize(idx);
+    WriteAndReadBack(writer, schema, data, sizes);
+}
+
+TEST(GeneralPurposeCompressionTest, TestMixedSchema) {
+    RedisConnection connection("127.0.0.1", 6379);
+    StreamWriter writer(StreamWriterParamsBuilder()
+                            .connection(connection)
+                            .batch_size(7)
+                            .compression(StreamCompression(StreamCompression::Type::ZSTD, {{"level", "1"}}))
+                            .build());
+    string stream_name = uuid::generate_uuid_v4();
+    StreamSchema schema(vector<FieldDefinition>{
+        FieldDefinition("counter", FieldDefinition::INT64, sizeof(int64_t)),
+        FieldDefinition("tag", FieldDefinition::FIXED_WIDTH_BYTES, 3),
+        FieldDefinition("x", FieldDefinition::DOUBLE, sizeof(double)),
+    });
+    try {
+        writer.Initialize(stream_name, schema);
+    } catch (const std::logic_error &e) {
+        GTEST_SKIP() << "River was built without zstd: " << e.what();
+    }
+
+    const int sample_size = schema.sample_size();
+    vector<char> data(NUM_ELEMENTS * sample_size);
+    for (int i = 0; i < NUM_ELEMENTS; i++) {
+        char *sample = &data[i * sample_size];
+        int64_t counter = i;
+        double x = i * 0.5;
+        memcpy(sample, &counter, sizeof(counter));
+        memcpy(sample + sizeof(counter), "abc", 3);
+        memcpy(sample + sizeof(counter) + 3, &x, sizeof(x));
+    }
+    WriteAndReadBack(writer, schema, data);
+}
+
+TEST(FieldGroupCompressionTest, TestCompressesGroupsSeparately) {
+    RedisConnection connection("127.0.0.1", 6379);
+    vector<FieldDefinition> fields;
+    vector<string> channel_names;
+    const int num_channels = 8;
+    for (int c = 0; c < num_channels; c++) {
+        channel_names.push_back(fmt::format("ch{}", c));
+        fields.emplace_back(channel_names.back(), FieldDefinition::INT16, sizeof(int16_t));
+    }
+    fields.emplace_back("t", FieldDefinition::INT64, sizeof(int64_t));
+    StreamSchema schema(fields);
+    StreamWriter writer(StreamWriterParamsBuilder()
+                            .connection(connection)
+                            .batch_size(16)
+                            .compression(StreamCompression::PerFieldGroup({
+                                {channel_names, StreamCompression(StreamCompression::Type::ZFP_LOSSLESS,
+                                                                  {{"data_type", "int16"}})},
+                                {{"t"}, StreamCompression(StreamCompression::Type::DUMMY)},
+                            }))
+                            .build());
+    string stream_name = uuid::generate_uuid_v4();
+    writer.Initialize(stream_name, schema);
+
+    const int sample_size = schema.sample_size();
+    vector<char> data(NUM_ELEMENTS * sample_size);
+    for (int i = 0; i < NUM_ELEMENTS; i++) {
+        char *sample = &data[i * sample_size];
+        for (int c = 0; c < num_channels; c++) {
+            auto value = (int16_t) (i * (c + 1));
+            memcpy(sample + c * sizeof(int16_t), &value, sizeof(value));
+        }
+        int64_t t = 1000 + i;
+        memcpy(sample + num_channels * sizeof(int16_t), &t, sizeof(t));
+    }
+    WriteAndReadBack(writer, schema, data);
+}
+
+TEST(AdaptiveCompressionTest, TestReadsBatchesOfEachCandidate) {
+    RedisConnection connection("127.0.0.1", 6379);
+    const int num_channels = 8;
+    vector<FieldDefinition> fields;
+    for (int c = 0; c < num_channels; c++) {
+        fields.emplace_back(fmt::format("ch{}", c), FieldDefinition::INT16, sizeof(int16_t));
+    }
+    StreamSchema schema(fields);
+    const int batch_size = 16;
+    StreamWriter writer(StreamWriterParamsBuilder()
+                            .connection(connection)
+                            .batch_size(batch_size)
+                            .compression(StreamCompression::Adaptive(
+                                {StreamCompression(StreamCompression::Type::ZFP_LOSSLESS,
+                                                   {{"data_type", "int16"}, {"num_cols", "8"}}),
+                                 StreamCompression(StreamCompression::Type::DUMMY)},
+                                0, 2, 64 * schema.sample_size()))
+                            .build());
+    string stream_name = uuid::generate_uuid_v4();
+    writer.Initialize(stream_name, schema);
+
+    // Smooth channels, which ZFP compresses well, then noise, which is better left uncompressed.
+    const int sample_size = schema.sample_size();
+    vector<char> data(NUM_ELEMENTS * sample_size);
+    auto *values = (int16_t *) data.data();
+    std::mt19937 mt(0);
+    for (int i = 0; i < NUM_ELEMENTS * num_channels; i++) {
+        values[i] = i < NUM_ELEMENTS * num_channels / 2 ? (int16_t) (i / num_channels) : (int16_t) mt();
+    }
+    WriteAndReadBack(writer, schema, data);
+
+    auto stats = writer.CompressionStats();
+    ASSERT_EQ(stats.size(), (size_t) 3);
+    ASSERT_EQ(stats[2].compression.type(), StreamCompression::Type::UNCOMPRESSED);
+    ASSERT_EQ(stats[0].num_batches + stats[1].num_batches + stats[2].num_batches,
+              (NUM_ELEMENTS + batch_size - 1) / batch_size);
+    ASSERT_GT(stats[0].num_batches, 0);
+    ASSERT_GT(stats[0].ratio(), 1.0);
+}
+
+TEST(WriteColumnsTest, TestInterleavesFields) {
+    RedisConnection connection("127.0.0.1", 6379);
+    StreamWriter writer(StreamWriterParamsBuilder().connection(connection).batch_size(10).build());
+    // Covers each run of equally-sized fields that's transposed together, plus fields handled one at a time.
+    vector<FieldDefinition> fields = {FieldDefinition("t", FieldDefinition::INT64, sizeof(int64_t))};
+    for (int f = 0; f < 4; f++) {
+        fields.emplace_back(fmt::format("f{}", f), FieldDefinition::FLOAT, sizeof(float));
+    }
+    for (int f = 0; f < 8; f++) {
+        fields.emplace_back(fmt::format("s{}", f), FieldDefinition::INT16, sizeof(int16_t));
+    }
+    fields.emplace_back("d0", FieldDefinition::DOUBLE, sizeof(double));
+    fields.emplace_back("d1", FieldDefinition::DOUBLE, sizeof(double));
+    fields.emplace_back("b", FieldDefinition::FIXED_WIDTH_BYTES, 3);
+    StreamSchema schema(fields);
+    string stream_name = uuid::generate_uuid_v4();
+    writer.Initialize(stream_name, schema);
+
+    const int64_t num_samples = 37;
+    vector<vector<char>> columns;
+    vector<const void *> column_ptrs;
+    for (const auto &field : fields) {
+        columns.emplace_back(num_samples * field.size);
+        for (size_t i = 0; i < columns.back().size(); i++) {
+            columns.back()[i] = (char) (i * 7 + columns.size());
+        }
+        column_ptrs.push_back(columns.back().data());
+    }
+    writer.WriteColumns(column_ptrs.data(), num_samples);
+    writer.Stop();
+
+    StreamReader reader(connection);
+    reader.Initialize(stream_name);
+    int sample_size = schema.sample_size();
+    vector<char> samples(num_samples * sample_size);
+    ASSERT_EQ(reader.ReadBytes(samples.data(), num_samples), num_samples);
+    for (int64_t i = 0; i < num_samples; i++) {
+        int offset = 0;
+        for (size_t f = 0; f < fields.size(); f++) {
+            ASSERT_EQ(memcmp(&samples[i * sample_size + offset], &columns[f][i * fields[f].size], fields[f].size), 0);
+            offset += fields[f].size;
+        }
+    }
+}
+
 TEST_F(StreamWriterTest, TestGetSetMetadata) {
     ASSERT_TRUE(writer->Metadata().empty());
     writer->Stop();
@@ -250,3 +465,344 @@ TEST_F(StreamWriterTest, TestStopImmediately) {
   // Ensure no errors; probably could check things in Redis to double check nothing happened, but meh.
   writer->Stop();
 }
+
+TEST_F(StreamWriterTest, TestRetentionMaxSamples) {
+    stream_name = uuid::generate_uuid_v4();
+    auto ring_writer = make_shared<StreamWriter>(StreamWriterParamsBuilder()
+                                                     .connection(RedisConnection("127.0.0.1", 6379))
+                                                     .keys_per_redis_stream(2000)
+                                                     .retention_max_samples(500)
+                                                     .build());
+    StreamSchema schema(vector<FieldDefinition>{FieldDefinition("field1", FieldDefinition::DOUBLE, sizeof(double))});
+    ring_writer->Initialize(stream_name, schema);
+
+    vector<double> data(10000);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = (double) i;
+    }
+    ring_writer->Write(data.data(), (int64_t) data.size());
+
+    auto *reply = (redisReply *) redisCommand(redis, "HGET %s-metadata retention_json", stream_name.c_str());
+    ASSERT_EQ(reply->type, REDIS_REPLY_STRING);
+    freeReplyObject(reply);
+
+    // Only the previous and current keys are retained, and each is trimmed (approximately) to the max samples.
+    reply = (redisReply *) redisCommand(redis, "HGET %s-metadata first_stream_key", stream_name.c_str());
+    ASSERT_STREQ(reply->str, fmt::format("{}-3", stream_name).c_str());
+    freeReplyObject(reply);
+    reply = (redisReply *) redisCommand(redis, "EXISTS %s-2", stream_name.c_str());
+    ASSERT_EQ(reply->integer, 0);
+    freeReplyObject(reply);
+    reply = (redisReply *) redisCommand(redis, "XLEN %s-3", stream_name.c_str());
+    ASSERT_LT(reply->integer, 1000);
+    freeReplyObject(reply);
+
+    ring_writer->Stop();
+}
+
+TEST_F(StreamWriterTest, TestMemoryStatus) {
+    vector<double> data(NUM_ELEMENTS);
+    writer->Write(data.data(), (int64_t) data.size());
+
+    StreamMemoryAccountant accountant(RedisConnection("127.0.0.1", 6379), 1);
+    int64_t stream_bytes = accountant.MeasureStream(stream_name);
+    ASSERT_GT(stream_bytes, NUM_ELEMENTS * sizeof(double));
+    ASSERT_EQ(accountant.MeasureStream(uuid::generate_uuid_v4()), -1);
+
+    accountant.Refresh();
+    ASSERT_TRUE(accountant.is_over_budget());
+    ASSERT_GE(accountant.total_bytes(), stream_bytes);
+
+    StreamMemoryStatus status = writer->MemoryStatus();
+    ASSERT_TRUE(status.is_over_budget());
+    ASSERT_EQ(status.budget_bytes, 1);
+    ASSERT_EQ(status.total_bytes, accountant.total_bytes());
+    ASSERT_EQ(status.stream_bytes, accountant.bytes_by_stream().at(stream_name));
+    ASSERT_GT(status.updated_at_us, 0);
+
+    auto *reply = (redisReply *) redisCommand(redis, "UNLINK %s %s",
+                                              StreamMemoryAccountant::STATUS_KEY,
+                                              StreamMemoryAccountant::STREAMS_KEY);
+    freeReplyObject(reply);
+    ASSERT_FALSE(writer->MemoryStatus().is_over_budget());
+}
+
+TEST(StreamMemoryAccountantTest, TestMeasuresRolledOverKeysOnce) {
+    RedisConnection connection("127.0.0.1", 6379);
+    string stream_name = uuid::generate_uuid_v4();
+    StreamWriter writer(StreamWriterParamsBuilder().connection(connection).keys_per_redis_stream(100).build());
+    writer.Initialize(stream_name, StreamSchema(vector<FieldDefinition>{
+        FieldDefinition("i", FieldDefinition::INT64, sizeof(int64_t))}));
+    vector<int64_t> data(300);
+    writer.Write(data.data(), 250);
+
+    // Measuring from cached sizes of keys 0 and 1 must agree with measuring every key afresh, as the stream grows
+    // and as its earliest keys are deleted.
+    StreamMemoryAccountant accountant(connection, 0);
+    int64_t stream_bytes = accountant.MeasureStream(stream_name);
+    ASSERT_EQ(accountant.MeasureStream(stream_name), stream_bytes);
+    writer.Write(data.data(), 300);
+    ASSERT_EQ(accountant.MeasureStream(stream_name),
+              StreamMemoryAccountant(connection, 0).MeasureStream(stream_name));
+    ASSERT_GT(accountant.MeasureStream(stream_name), stream_bytes);
+
+    struct timeval timeout = {1, 500000};
+    redisContext *redis = redisConnectWithTimeout("127.0.0.1", 6379, timeout);
+    freeReplyObject(redisCommand(redis, "HSET %s-metadata first_stream_key %s-2",
+                                 stream_name.c_str(), stream_name.c_str()));
+    freeReplyObject(redisCommand(redis, "UNLINK %s-0 %s-1", stream_name.c_str(), stream_name.c_str()));
+    redisFree(redis);
+    ASSERT_EQ(accountant.MeasureStream(stream_name),
+              StreamMemoryAccountant(connection, 0).MeasureStream(stream_name));
+    writer.Stop();
+}
+
+// Runs producers concurrently, each writing samples of (producer, i) for i in [0, num_samples_per_producer), 10 at a
+// time, via the given function.
+static void RunProducers(int num_producers, int num_samples_per_producer,
+                         const function<void(int32_t producer, const char *data)> &write) {
+    vector<thread> threads;
+    for (int32_t producer = 0; producer < num_producers; producer++) {
+        threads.emplace_back([&write, producer, num_samples_per_producer]() {
+            for (int32_t i = 0; i < num_samples_per_producer; i += 10) {
+                int32_t data[10][2];
+                for (int32_t j = 0; j < 10; j++) {
+                    data[j][0] = producer;
+                    data[j][1] = i + j;
+                }
+                write(producer, reinterpret_cast<const char *>(data));
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+}
+
+// Reads back num_samples samples written by RunProducers(), checking each producer's are in the order it wrote them.
+static void ReadBackInProducerOrder(StreamReader &reader, int num_producers, int64_t num_samples) {
+    vector<int32_t> read_data(2 * num_samples);
+    ASSERT_EQ(reader.ReadBytes(reinterpret_cast<char *>(read_data.data()), num_samples, nullptr, nullptr, 1000),
+              num_samples);
+    vector<int32_t> next_i(num_producers, 0);
+    for (size_t k = 0; k < read_data.size(); k += 2) {
+        ASSERT_EQ(read_data[k + 1], next_i[read_data[k]]++);
+    }
+}
+
+static StreamSchema ProducerSchema() {
+    return StreamSchema(vector<FieldDefinition>{
+        FieldDefinition("producer", FieldDefinition::INT32, sizeof(int32_t)),
+        FieldDefinition("i", FieldDefinition::INT32, sizeof(int32_t))});
+}
+
+TEST(ConcurrentStreamWriterTest, TestPreservesPerProducerOrder) {
+    RedisConnection connection("127.0.0.1", 6379);
+    string stream_name = uuid::generate_uuid_v4();
+    ConcurrentStreamWriter writer(StreamWriterParamsBuilder().connection(connection).batch_size(100).build());
+    writer.Initialize(stream_name, ProducerSchema());
+
+    const int num_producers = 4;
+    const int num_samples_per_producer = 5000;
+    RunProducers(num_producers, num_samples_per_producer, [&writer](int32_t, const char *data) {
+        writer.WriteBytes(data, 10);
+    });
+    writer.Flush();
+    ASSERT_EQ(writer.total_samples_written(), num_producers * num_samples_per_producer);
+    writer.Stop();
+
+    StreamReader reader(connection);
+    reader.Initialize(stream_name);
+    ReadBackInProducerOrder(reader, num_producers, num_producers * num_samples_per_producer);
+}
+
+TEST(ConcurrentStreamWriterTest, TestStopWritesEveryAcceptedWrite) {
+    RedisConnection connection("127.0.0.1", 6379);
+    string stream_name = uuid::generate_uuid_v4();
+    // Bounded so that producers are also waiting on the flusher when Stop() is called.
+    ConcurrentStreamWriter writer(StreamWriterParamsBuilder().connection(connection).batch_size(100).build(), 1000);
+    writer.Initialize(stream_name, ProducerSchema());
+
+    const int num_producers = 4;
+    atomic<int64_t> num_samples_accepted(0);
+    thread stopper([&writer]() {
+        this_thread::sleep_for(chrono::milliseconds(50));
+        writer.Stop();
+    });
+    RunProducers(num_producers, 100000, [&writer, &num_samples_accepted](int32_t, const char *data) {
+        try {
+            writer.WriteBytes(data, 10);
+            num_samples_accepted += 10;
+        } catch (const StreamWriterException &e) {
+            // Stopped.
+        }
+    });
+    stopper.join();
+    ASSERT_EQ(writer.total_samples_written(), num_samples_accepted.load());
+
+    StreamReader reader(connection);
+    reader.Initialize(stream_name);
+    ReadBackInProducerOrder(reader, num_producers, num_samples_accepted);
+    int32_t buffer[2];
+    ASSERT_EQ(reader.ReadBytes(reinterpret_cast<char *>(buffer), 1, nullptr, nullptr, 1000), -1);
+}
+
+TEST(MultiWriterTest, TestWritersShareOneStream) {
+    RedisConnection connection("127.0.0.1", 6379);
+    string stream_name = uuid::generate_uuid_v4();
+    StreamSchema schema = ProducerSchema();
+    // Small enough that the stream rolls over keys while both writers are writing.
+    auto params = StreamWriterParamsBuilder()
+        .connection(connection).batch_size(100).keys_per_redis_stream(1000).multi_writer(true).build();
+
+    const int num_writers = 2;
+    const int num_samples_per_writer = 5000;
+    vector<unique_ptr<StreamWriter>> writers;
+    for (int i = 0; i < num_writers; i++) {
+        writers.push_back(make_unique<StreamWriter>(params));
+        writers.back()->Initialize(stream_name, schema);
+    }
+    ASSERT_EQ(writers[0]->initialized_at_us(), writers[1]->initialized_at_us());
+
+    RunProducers(num_writers, num_samples_per_writer, [&writers](int32_t w, const char *data) {
+        writers[w]->WriteBytes(data, 10);
+    });
+
+    StreamReader reader(connection);
+    reader.Initialize(stream_name);
+    ReadBackInProducerOrder(reader, num_writers, num_writers * num_samples_per_writer);
+
+    // The stream only ends once every writer has stopped.
+    int32_t buffer[2];
+    writers[0]->Stop();
+    ASSERT_EQ(reader.ReadBytes(reinterpret_cast<char *>(buffer), 1, nullptr, nullptr, 100), 0);
+    writers[1]->Stop();
+    ASSERT_EQ(reader.ReadBytes(reinterpret_cast<char *>(buffer), 1, nullptr, nullptr, 1000), -1);
+
+    StreamWriter late_writer(params);
+    ASSERT_THROW(late_writer.Initialize(stream_name, schema), StreamExistsException);
+}
+
+TEST(MultiWriterTest, TestWriterCatchesUpToStreamKeysOfOtherWriters) {
+    RedisConnection connection("127.0.0.1", 6379);
+    string stream_name = uuid::generate_uuid_v4();
+    StreamSchema schema(vector<FieldDefinition>{FieldDefinition("i", FieldDefinition::INT32, sizeof(int32_t))});
+    auto params = StreamWriterParamsBuilder()
+        .connection(connection).batch_size(100).keys_per_redis_stream(1000).multi_writer(true).build();
+
+    StreamWriter first_writer(params);
+    first_writer.Initialize(stream_name, schema);
+    StreamWriter idle_writer(params);
+    idle_writer.Initialize(stream_name, schema);
+
+    // The idle writer last saw the stream at its first stream key, so must retry its write and its leave with the
+    // stream keys the first writer has since moved on to.
+    vector<int32_t> data(2510);
+    for (int32_t i = 0; i < 2510; i++) {
+        data[i] = i;
+    }
+    first_writer.Write(data.data(), 2500);
+    idle_writer.Write(&data[2500], 10);
+    idle_writer.Stop();
+    first_writer.Stop();
+
+    StreamReader reader(connection);
+    reader.Initialize(stream_name);
+    vector<int32_t> read_data(data.size());
+    ASSERT_EQ(reader.ReadBytes(reinterpret_cast<char *>(read_data.data()), 2510), 2510);
+    ASSERT_EQ(read_data, data);
+    int32_t buffer;
+    ASSERT_EQ(reader.ReadBytes(reinterpret_cast<char *>(&buffer), 1, nullptr, nullptr, 1000), -1);
+}
+
+// Writes 1000 samples to each of num_streams streams of a group, 100 per stream per flush, and reads them back.
+static void WriteGroupAndReadBack(int num_streams, int64_t keys_per_redis_stream) {
+    RedisConnection connection("127.0.0.1", 6379);
+    StreamWriterGroup group(StreamWriterParamsBuilder()
+                                .connection(connection).batch_size(50)
+                                .keys_per_redis_stream(keys_per_redis_stream).build());
+    StreamSchema schema(vector<FieldDefinition>{FieldDefinition("i", FieldDefinition::INT64, sizeof(int64_t))});
+
+    const int64_t num_samples = 1000;
+    vector<string> stream_names;
+    for (int s = 0; s < num_streams; s++) {
+        stream_names.push_back(uuid::generate_uuid_v4());
+        ASSERT_EQ(group.AddStream(stream_names.back(), schema), s);
+    }
+    for (int64_t i = 0; i < num_samples; i += 100) {
+        for (int s = 0; s < num_streams; s++) {
+            vector<int64_t> data(100);
+            for (int64_t j = 0; j < 100; j++) {
+                data[j] = s * num_samples + i + j;
+            }
+            group.Write(s, data.data(), 100);
+        }
+        group.Flush();
+    }
+    group.Stop();
+
+    for (int s = 0; s < num_streams; s++) {
+        ASSERT_EQ(group.stream(s).total_samples_written(), num_samples);
+        StreamReader reader(connection);
+        reader.Initialize(stream_names[s]);
+        vector<int64_t> read_data(num_samples);
+        ASSERT_EQ(reader.Read(read_data.data(), num_samples), num_samples);
+        for (int64_t i = 0; i < num_samples; i++) {
+            ASSERT_EQ(read_data[i], s * num_samples + i);
+        }
+        int64_t buffer;
+        ASSERT_EQ(reader.Read(&buffer, 1), -1);
+    }
+}
+
+TEST(StreamWriterGroupTest, TestWritesEveryStream) {
+    // Small enough that streams roll over keys within one flush.
+    WriteGroupAndReadBack(50, 300);
+}
+
+TEST(StreamWriterGroupTest, TestRollsOverMidFlush) {
+    // Each flush sends two batches per stream, and some flushes (e.g. of samples 200-300) roll over to the next
+    // stream key between them, while the first batch is still buffered.
+    WriteGroupAndReadBack(5, 250);
+}
+
+TEST(StreamWriterGroupTest, TestFailedFlushLeavesNoRepliesQueued) {
+    RedisConnection connection("127.0.0.1", 6379);
+    StreamWriterGroup group(StreamWriterParamsBuilder().connection(connection).batch_size(50).build());
+    StreamSchema schema(vector<FieldDefinition>{FieldDefinition("i", FieldDefinition::INT64, sizeof(int64_t))});
+    vector<string> stream_names;
+    for (int s = 0; s < 3; s++) {
+        stream_names.push_back(uuid::generate_uuid_v4());
+        group.AddStream(stream_names.back(), schema);
+    }
+
+    // Batches of the first stream now fail, while those of the others (sent after it in the same flush) don't.
+    struct timeval timeout = {1, 500000};
+    redisContext *redis = redisConnectWithTimeout("127.0.0.1", 6379, timeout);
+    freeReplyObject(redisCommand(redis, "SET %s-0 x", stream_names[0].c_str()));
+    vector<int64_t> data(100);
+    for (int64_t j = 0; j < 100; j++) {
+        data[j] = j;
+    }
+    for (int s = 0; s < 3; s++) {
+        group.Write(s, data.data(), 100);
+    }
+    ASSERT_THROW(group.Flush(), StreamWriterException);
+
+    // Were any replies of the failed flush left unread, the next flush would misread them as its own.
+    freeReplyObject(redisCommand(redis, "UNLINK %s-0", stream_names[0].c_str()));
+    redisFree(redis);
+    for (int s = 1; s < 3; s++) {
+        group.Write(s, data.data(), 100);
+    }
+    group.Flush();
+    for (int s = 1; s < 3; s++) {
+        StreamReader reader(connection);
+        reader.Initialize(stream_names[s]);
+        vector<int64_t> read_data(200);
+        ASSERT_EQ(reader.Read(read_data.data(), 200, nullptr, nullptr, 1000), 200);
+        for (int64_t i = 0; i < 200; i++) {
+            ASSERT_EQ(read_data[i], i % 100);
+        }
+    }
+}
@@ -1,4 +1,5 @@
 #include <chrono>
+#include <ctime>
 #include <spdlog/fmt/fmt.h>
 #include <fstream>
 #include <cxxopts.hpp>
@@ -19,6 +20,16 @@ int main(int argc, char **argv) {
       ("p,redis_port", "Redis port [optional]", cxxopts::value<int>()->default_value("6379"))
       ("w,redis_password", "Redis password [optional]", cxxopts::value<string>()->default_value(""))
       ("f,redis_password_file", "Redis password file [optional]", cxxopts::value<string>()->default_value(""))
+      ("redis_unix_socket",
+       "Path to Redis's Unix domain socket; if given, used instead of TCP [optional]",
+       cxxopts::value<std::string>()->default_value(""))
+      ("tcp_nodelay", "Whether to set TCP_NODELAY", cxxopts::value<bool>()->default_value("true"))
+      ("socket_send_buffer_bytes", "SO_SNDBUF; 0 for the OS default", cxxopts::value<int>()->default_value("0"))
+      ("socket_receive_buffer_bytes", "SO_RCVBUF; 0 for the OS default", cxxopts::value<int>()->default_value("0"))
+      ("socket_busy_poll_us", "SO_BUSY_POLL (Linux only); 0 to disable", cxxopts::value<int>()->default_value("0"))
+      ("zero_copy_send",
+       "Send large batches via MSG_ZEROCOPY (Linux only)",
+       cxxopts::value<bool>()->default_value("false"))
       ("num_samples",
        "Number of samples to write to redis [default 1 million]",
        cxxopts::value<int64_t>()->default_value("1000000"))
@@ -34,6 +45,9 @@ int main(int argc, char **argv) {
       ("compression_params",
        "Json-serialized string for parameters",
        cxxopts::value<std::string>()->default_value("{}"))
+      ("wire_compression",
+       "Compression of data in flight to/from Redis (NONE, LZ4, or ZSTD); requires the River module",
+       cxxopts::value<std::string>()->default_value("NONE"))
       ("input_file",
        "Path to an input file to load data; must be of size num_samples * sample_size",
        cxxopts::value<std::string>()->default_value(""))
@@ -53,8 +67,18 @@ int main(int argc, char **argv) {
     string compression_params_json = result["compression_params"].as<string>();
     std::unordered_map<std::string, std::string> compression_params = json::parse(compression_params_json);
 
+    WireCompression wire_compression = WireCompressionFromName(result["wire_compression"].as<string>());
+
     string input_file = result["input_file"].as<string>();
 
+    string redis_unix_socket = result["redis_unix_socket"].as<string>();
+    RedisSocketOptions socket_options;
+    socket_options.tcp_nodelay = result["tcp_nodelay"].as<bool>();
+    socket_options.send_buffer_bytes = result["socket_send_buffer_bytes"].as<int>();
+    socket_options.receive_buffer_bytes = result["socket_receive_buffer_bytes"].as<int>();
+    socket_options.busy_poll_us = result["socket_busy_poll_us"].as<int>();
+    socket_options.zero_copy_send = result["zero_copy_send"].as<bool>();
+
   if (!redis_password_file.empty() && redis_password.empty()) {
     std::ifstream infile;
     infile.open(redis_password_file);
@@ -62,10 +86,19 @@ int main(int argc, char **argv) {
   }
 
   river::RedisConnection connection(redis_hostname, redis_port, redis_password);
-  StreamReader reader(connection);
+  connection.SetSocketOptions(socket_options);
+  if (!redis_unix_socket.empty()) {
+    connection.SetUnixSocketPath(redis_unix_socket);
+  }
+  cout << "Transport: " << (redis_unix_socket.empty() ? "tcp" : "unix socket " + redis_unix_socket) << endl;
+  StreamReader reader(StreamReaderParamsBuilder()
+                          .connection(connection)
+                          .wire_compression(wire_compression)
+                          .build());
     StreamWriter writer(StreamWriterParamsBuilder()
                             .connection(connection)
                             .compression(StreamCompression::Create(compression_type, compression_params))
+                            .wire_compression(wire_compression)
                             .build());
 
   string stream_name = uuid::generate_uuid_v4();
@@ -92,7 +125,9 @@ int main(int argc, char **argv) {
   }
 
   auto start_time = chrono::steady_clock::now();
+  std::clock_t start_cpu = std::clock();
   int64_t num_written = 0;
+  int64_t num_batches = 0;
   int64_t data_index = 0;
   while (num_written < num_samples) {
     int64_t remaining = num_samples - num_written;
@@ -100,15 +135,23 @@ int main(int argc, char **argv) {
     writer.WriteBytes(&data.front() + data_index, num_to_write);
     data_index += num_to_write * sample_size;
     num_written += num_to_write;
+    num_batches++;
   }
   writer.Stop();
 
   auto end_time = chrono::steady_clock::now();
+  double cpu_seconds = (double) (std::clock() - start_cpu) / CLOCKS_PER_SEC;
   long long int us = chrono::duration_cast<chrono::microseconds>(end_time - start_time).count();
   double throughput = num_samples / (us / 1e6);
   cout << fmt::format(
-      "Put {} elements in {:.3f} ms ({:.3f} items/sec, {:.3f} MB/sec) for stream {}",
-      num_written, us / 1000.0f, throughput, throughput * sample_size / 1024 / 1024, stream_name)
+      "Put {} elements in {:.3f} ms ({:.3f} items/sec, {:.3f} MB/sec, {:.3f} us/batch) for stream {}",
+      num_written, us / 1000.0f, throughput, throughput * sample_size / 1024 / 1024,
+      num_batches > 0 ? (double) us / num_batches : 0.0, stream_name)
+       << endl;
+  // Includes formatting and (if any) compression, so compare across send paths with the same settings.
+  cout << fmt::format(
+      "Writer used {:.3f} s of CPU ({:.3f} CPU-s/GB sent)",
+      cpu_seconds, cpu_seconds / ((double) num_written * sample_size / 1e9))
        << endl;
 
   reader.Initialize(stream_name);
@@ -0,0 +1,134 @@
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <spdlog/fmt/fmt.h>
+#include <cxxopts.hpp>
+#include "../river.h"
+#include "../compression/compressor.h"
+
+using namespace river;
+using namespace std;
+
+namespace {
+size_t DataTypeSize(const string &data_type) {
+  if (data_type == "int16") {
+    return sizeof(int16_t);
+  } else if (data_type == "int32" || data_type == "float") {
+    return sizeof(int32_t);
+  } else if (data_type == "double") {
+    return sizeof(double);
+  }
+  throw std::invalid_argument("Unsupported data_type " + data_type);
+}
+
+// Sinusoids of increasing frequency and phase across columns, quantized to int16, so that neighboring values of a row
+// (and, less so, of a column) are correlated, as with e.g. neural recordings.
+vector<char> GenerateSines(int num_cols, int num_rows) {
+  vector<int16_t> values(static_cast<size_t>(num_cols) * num_rows);
+  for (int r = 0; r < num_rows; r++) {
+    for (int c = 0; c < num_cols; c++) {
+      double phase = M_PI * c / num_cols;
+      double freq = 1 + 9.0 * c / num_cols;
+      values[static_cast<size_t>(r) * num_cols + c] = static_cast<int16_t>(sin(freq * r / 10 + phase) * (1 << 14));
+    }
+  }
+  const auto *bytes = reinterpret_cast<const char *>(values.data());
+  return {bytes, bytes + values.size() * sizeof(int16_t)};
+}
+}
+
+int main(int argc, char **argv) {
+  cxxopts::Options options("RiverCompressionBenchmark",
+                           "Compares the ratio and speed of River's stream compressions on the same data.");
+  options.add_options()
+      ("help", "Prints this help.")
+      ("input_file",
+       "Path to raw samples to compress; if not given, uses generated int16 sinusoids [optional]",
+       cxxopts::value<string>()->default_value(""))
+      ("data_type", "Type of the values in input_file: int16, int32, float, or double",
+       cxxopts::value<string>()->default_value("int16"))
+      ("num_cols", "Number of values per sample", cxxopts::value<int>()->default_value("4096"))
+      ("num_rows", "Number of samples to generate if no input_file is given", cxxopts::value<int>()->default_value("64"))
+      ("iterations", "Number of times to compress and decompress with each compression",
+       cxxopts::value<int>()->default_value("20"))
+      ;
+  auto result = options.parse(argc, argv);
+  if (result.count("help")) {
+    cout << options.help() << endl;
+    return 0;
+  }
+
+  string input_file = result["input_file"].as<string>();
+  string data_type = result["data_type"].as<string>();
+  int num_cols = result["num_cols"].as<int>();
+  int iterations = result["iterations"].as<int>();
+
+  vector<char> data;
+  if (!input_file.empty()) {
+    std::ifstream in(input_file, std::ios::binary);
+    data = {std::istreambuf_iterator<char>(in), {}};
+  } else {
+    data_type = "int16";
+    data = GenerateSines(num_cols, result["num_rows"].as<int>());
+  }
+  size_t element_size = DataTypeSize(data_type);
+  if (data.empty() || data.size() % (element_size * num_cols) != 0) {
+    throw std::invalid_argument("Input must be a nonzero number of samples of num_cols values of data_type.");
+  }
+
+  using Type = StreamCompression::Type;
+  // Delta-encode each value against its neighbor within a sample, which for data like the generated sinusoids changes
+  // more smoothly across columns than over time.
+  unordered_map<string, string> filter_params = {{"element_size", to_string(element_size)}, {"num_cols", "1"}};
+  vector<pair<string, StreamCompression>> compressions = {
+      {"ZFP_LOSSLESS", StreamCompression(Type::ZFP_LOSSLESS, {{"data_type", data_type},
+                                                              {"num_cols", to_string(num_cols)}})},
+      {"LZ4", StreamCompression(Type::LZ4)},
+      {"ZSTD", StreamCompression(Type::ZSTD)},
+  };
+  for (auto type : {Type::LZ4, Type::ZSTD}) {
+    for (const string filters : {"byteshuffle", "delta,byteshuffle", "delta,bitshuffle"}) {
+      auto params = filter_params;
+      params["filters"] = filters;
+      compressions.emplace_back(filters + "," + StreamCompression(type).name(), StreamCompression(type, params));
+    }
+  }
+
+  cout << fmt::format("Compressing {} bytes ({} {} values per sample), {} times each",
+                      data.size(), num_cols, data_type, iterations) << endl;
+  for (auto &[label, compression] : compressions) {
+    unique_ptr<Compressor> compressor;
+    unique_ptr<Decompressor> decompressor;
+    try {
+      compressor = CreateCompressor(compression);
+      decompressor = CreateDecompressor(compression);
+    } catch (const std::logic_error &e) {
+      cout << fmt::format("{:>24}: not built", label) << endl;
+      continue;
+    }
+
+    vector<char> compressed, round_tripped;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+      compressor->compress_into(data.data(), data.size(), &compressed);
+    }
+    auto compressed_at = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+      decompressor->decompress_into(compressed.data(), compressed.size(), &round_tripped);
+    }
+    auto decompressed_at = chrono::steady_clock::now();
+    if (round_tripped != data) {
+      cout << fmt::format("{:>24}: did not round trip", label) << endl;
+      return 1;
+    }
+
+    auto mb_per_s = [&](chrono::steady_clock::duration elapsed) {
+      return (double) data.size() * iterations / chrono::duration<double>(elapsed).count() / 1e6;
+    };
+    cout << fmt::format("{:>24}: ratio {:.3f}, compress {:.1f} MB/s, decompress {:.1f} MB/s",
+                        label, (double) data.size() / compressed.size(),
+                        mb_per_s(compressed_at - start), mb_per_s(decompressed_at - compressed_at)) << endl;
+  }
+  return 0;
+}
@@ -4,9 +4,17 @@
 #include <cstring>
 #include <spdlog/fmt/fmt.h>
 #include <chrono>
+#include <deque>
+#include <future>
 #include "writer.h"
 #include "redis_writer_commands.h"
+#include "shared_memory_ring.h"
 #include "compression/compressor.h"
+#include "compression/compression_pool.h"
+#include "compression/adaptive_compressor.h"
+#include "compression/variable_width_block.h"
+#include "simd.h"
+#include "compression/wire_codec.h"
 #include <spdlog/spdlog.h>
 #include <nlohmann/json.hpp>
 
@@ -16,14 +24,26 @@ using namespace std;
 namespace river {
 
 StreamWriter::StreamWriter(const StreamWriterParams& params)
-        : redis_batch_size_(params.batch_size), keys_per_redis_stream_(params.keys_per_redis_stream) {
-    this->redis_ = internal::Redis::Create(params.connection);
+        : StreamWriter(params, internal::Redis::Create(params.connection)) {}
+
+StreamWriter::StreamWriter(const StreamWriterParams& params, std::shared_ptr<internal::Redis> redis)
+        : redis_(std::move(redis)), redis_batch_size_(params.batch_size),
+          keys_per_redis_stream_(params.keys_per_redis_stream), multi_writer_(params.multi_writer) {
 
     this->is_stopped_ = false;
     this->is_initialized_ = false;
     this->total_samples_written_ = 0LL;
     this->last_stream_key_idx_ = 0;
+    this->multi_writer_next_sample_index_ = 0;
     this->compression_ = params.compression;
+    this->wire_compression_ = params.wire_compression;
+    this->retention_max_samples_ = params.retention_max_samples;
+    this->retention_max_age_ms_ = params.retention_max_age_ms;
+    this->local_minus_server_clock_us_ = 0;
+    this->first_stream_key_idx_ = 0;
+    this->shared_memory_ring_bytes_ = params.shared_memory_ring_bytes;
+    this->compression_pool_ = params.compression_pool;
+    this->warned_shared_memory_ring_too_small_ = false;
 
     this->schema_ = nullptr;
     this->sample_size_ = -1;
@@ -34,8 +54,19 @@ StreamWriter::StreamWriter(const StreamWriterParams& params)
     if (keys_per_redis_stream_ <= 0) {
         throw StreamWriterException("Invalid keys per redis stream given, needs to be positive.");
     }
+    if (retention_max_samples_ < 0 || retention_max_age_ms_ < 0) {
+        throw StreamWriterException("Invalid retention given, needs to be nonnegative.");
+    }
+    if (retention_max_samples_ > 0 && retention_max_age_ms_ > 0) {
+        throw StreamWriterException("Only one of max samples or max age retention can be given.");
+    }
+    if (shared_memory_ring_bytes_ < 0) {
+        throw StreamWriterException("Invalid shared memory ring size given, needs to be nonnegative.");
+    }
 }
 
+StreamWriter::~StreamWriter() = default;
+
 void StreamWriter::Initialize(const string &stream_name,
                               const StreamSchema &schema,
                               const unordered_map<string, string> &user_metadata,
@@ -53,7 +84,13 @@ void StreamWriter::Initialize(const string &stream_name,
     }
 
     auto maybe_metadata = redis_->GetMetadata(stream_name);
-    if (maybe_metadata) {
+    if (maybe_metadata && multi_writer_ && maybe_metadata->count("multi_writer") > 0) {
+        if ((*maybe_metadata)["active_writers"] == "0") {
+            throw StreamExistsException(fmt::format(
+                "Stream has already been stopped by all of its writers; cannot join it. Stream: {}", stream_name));
+        }
+        // Otherwise, join it below.
+    } else if (maybe_metadata) {
         stringstream ss;
         ss << "Stream metadata key exists already; does a stream with this name already exist? Stream: " << stream_name;
         throw StreamExistsException(ss.str());
@@ -65,7 +102,7 @@ void StreamWriter::Initialize(const string &stream_name,
 
     string serialized_schema = schema.ToJson();
 
-    string first_stream_key = fmt::format("{}-0", stream_name);
+    string first_stream_key = redis_->StreamKey(stream_name, 0);
     vector<pair<string, string>> fields = {
         {"first_stream_key", first_stream_key},
         {"schema", serialized_schema},
@@ -73,7 +110,8 @@ void StreamWriter::Initialize(const string &stream_name,
 
     // If enabled, calculate the delta between clocks of the client and Redis server, and store offset
     if (compute_local_minus_global_clock) {
-        auto local_minus_server_clock = ComputeLocalMinusServerClocks();
+        auto local_minus_server_clock = ComputeLocalMinusServerClocks(stream_name);
+        local_minus_server_clock_us_ = local_minus_server_clock;
         initialized_at_us_ = chrono::duration_cast<std::chrono::microseconds>(
                 chrono::system_clock::now().time_since_epoch()).count() - local_minus_server_clock;
         string local_minus_server_clock_f = fmt::format_int(local_minus_server_clock).str();
@@ -86,21 +124,86 @@ void StreamWriter::Initialize(const string &stream_name,
     string initialized_at_us_f = fmt::format_int(initialized_at_us_).str();
     fields.emplace_back("initialized_at_us", initialized_at_us_f);
 
-    this->compressor_ = CreateCompressor(compression_);
+    bool has_retention = retention_max_samples_ > 0 || retention_max_age_ms_ > 0;
+    if (has_retention && compression_.type() != StreamCompression::Type::UNCOMPRESSED) {
+        // Compressed batches reference a single entry holding the whole batch, which trimming could remove.
+        throw StreamWriterException("Retention is not supported with compression.");
+    }
+    if (has_retention) {
+        // Signals to readers (and ingesters) that this stream is lossy, i.e. samples can be dropped.
+        json retention;
+        if (retention_max_samples_ > 0) {
+            retention["max_samples"] = retention_max_samples_;
+        } else {
+            retention["max_age_ms"] = retention_max_age_ms_;
+        }
+        fields.emplace_back("retention_json", retention.dump());
+    }
+    if (retention_max_age_ms_ > 0 && !compute_local_minus_global_clock) {
+        // Trimming by age via XTRIM MINID needs the server's clock, as entry IDs are in its milliseconds.
+        local_minus_server_clock_us_ = ComputeLocalMinusServerClocks(stream_name);
+    }
+
+    if (schema.has_variable_width_field()
+        && (compression_.type() == StreamCompression::Type::ZFP_LOSSLESS
+            || compression_.type() == StreamCompression::Type::ZFP_LOSSY
+            || compression_.type() == StreamCompression::Type::ZFP_FIXED_RATE
+            || compression_.type() == StreamCompression::Type::FIELD_GROUPS)) {
+        throw StreamWriterException(fmt::format("{} compresses fixed-width samples only; variable-width fields need a "
+                                                "general-purpose compression.", compression_.name()));
+    }
+
+    this->compressor_ = CreateCompressor(compression_, schema);
     if (compressor_) {
         json compressor_params;
         compressor_params["name"] = compression_.name();
         compressor_params["params"] = compression_.params();
         fields.emplace_back("compression_params_json", compressor_params.dump());
+
+        if (compression_pool_) {
+            // Keep at least two batches in flight so that one is always compressing while another is sent.
+            int num_batches_ahead = std::max(2, compression_pool_->num_threads());
+            for (int i = 0; i < num_batches_ahead; i++) {
+                pooled_compressors_.push_back(CreateCompressor(compression_, schema));
+            }
+        }
     }
 
-    auto num_fields_added = static_cast<size_t>(
-            redis_->SetMetadataAndUserMetadata(stream_name, fields, user_metadata));
-    // Ensure to add 1 for user_metadata
-    if (fields.size() + 1 != num_fields_added) {
-        throw StreamWriterException(
-                fmt::format("Stream exists already! stream {}. Expected {} fields to be written but {} were written.",
-                            stream_name, fields.size(), num_fields_added));
+    if (multi_writer_) {
+        // Writers roll over keys and trim by their own sample counts, and compressed batches assume a writer knows
+        // its batch's sample indices when compressing it, neither of which holds with multiple writers.
+        if (has_retention || compressor_) {
+            throw StreamWriterException("Multiple writers are not supported with compression or retention.");
+        }
+        if (!redis_->LoadRiverFunctions()) {
+            throw StreamWriterException("Multiple writers require Redis Functions (Redis >= 7.0).");
+        }
+        fields.emplace_back("multi_writer", "1");
+        fields.emplace_back("keys_per_redis_stream", fmt::format_int(keys_per_redis_stream_).str());
+        if (!redis_->CreateOrJoinMultiWriterStream(stream_name, fields, user_metadata)) {
+            // Joined an existing stream, so adopt its metadata rather than ours.
+            auto existing_metadata = redis_->GetMetadata(stream_name);
+            if (!existing_metadata
+                || (*existing_metadata)["schema"] != serialized_schema
+                || (*existing_metadata)["keys_per_redis_stream"] != fmt::format_int(keys_per_redis_stream_).str()) {
+                redis_->LeaveMultiWriterStream(stream_name, keys_per_redis_stream_, 0);
+                throw StreamExistsException(fmt::format(
+                    "Stream exists with a different schema or keys per redis stream; cannot join it. Stream: {}",
+                    stream_name));
+            }
+            initialized_at_us_ = stoll((*existing_metadata)["initialized_at_us"]);
+            multi_writer_next_sample_index_ = stoll((*existing_metadata)["next_sample_index"]);
+            spdlog::info("Joined existing multi-writer stream {}.", stream_name);
+        }
+    } else {
+        auto num_fields_added = static_cast<size_t>(
+                redis_->SetMetadataAndUserMetadata(stream_name, fields, user_metadata));
+        // Ensure to add 1 for user_metadata
+        if (fields.size() + 1 != num_fields_added) {
+            throw StreamWriterException(
+                    fmt::format("Stream exists already! stream {}. Expected {} fields to be written but {} were written.",
+                                stream_name, fields.size(), num_fields_added));
+        }
     }
 
     auto metadata = redis_->GetMetadata(stream_name);
@@ -128,21 +231,62 @@ void StreamWriter::Initialize(const string &stream_name,
     this->sample_size_ = this->schema_->sample_size();
     this->has_variable_width_field_ = this->schema_->has_variable_width_field();
 
-    // TODO: handle this by encoding sizes in compressed
-    if (this->has_variable_width_field_ && this->compression_.type() != StreamCompression::Type::UNCOMPRESSED) {
-        throw StreamWriterException("Having variable width fields with compression is not supported right now");
-    }
-
     auto installed_modules = redis_->GetInstalledModules();
-    if (std::find(installed_modules.begin(), installed_modules.end(), "river") != installed_modules.end()) {
+    if (multi_writer_) {
+        // Functions were loaded above; the module has no multi-writer counterpart.
+        this->batch_command_mode_ = BatchCommandMode::FUNCTION;
+    } else if (std::find(installed_modules.begin(), installed_modules.end(), "river") != installed_modules.end()) {
         spdlog::info("Found river module installed. Utilizing it for performance.");
-        this->has_module_installed_ = true;
+        this->batch_command_mode_ = BatchCommandMode::MODULE;
+    } else if (redis_->LoadRiverFunctions()) {
+        spdlog::info("River module not installed, but loaded River's Redis Functions library. Utilizing it for "
+                     "performance.");
+        this->batch_command_mode_ = BatchCommandMode::FUNCTION;
     } else {
-        this->has_module_installed_ = false;
+        this->batch_command_mode_ = BatchCommandMode::PER_SAMPLE_XADD;
     }
 
-    if (!this->has_module_installed_ && this->compression_.type() != StreamCompression::Type::UNCOMPRESSED) {
-        throw StreamWriterException("Module must be installed to support compression.");
+    if (this->batch_command_mode_ == BatchCommandMode::PER_SAMPLE_XADD
+        && this->compression_.type() != StreamCompression::Type::UNCOMPRESSED) {
+        throw StreamWriterException(
+            "Either the River module or Redis Functions (Redis >= 7.0) must be available to support compression.");
+    }
+
+    if (this->wire_compression_ != WireCompression::NONE) {
+        // Wire compression is purely a bandwidth optimization, so fall back to sending uncompressed data rather
+        // than failing when it can't be used.
+        auto wire_compression_name = WireCompressionName(this->wire_compression_);
+        if (this->batch_command_mode_ != BatchCommandMode::MODULE) {
+            spdlog::warn("Wire compression {} requires the River module; sending data uncompressed.",
+                         wire_compression_name);
+            this->wire_compression_ = WireCompression::NONE;
+        } else if (!internal::IsWireCompressionSupported(this->wire_compression_)) {
+            spdlog::warn("Wire compression {} not supported by this build; sending data uncompressed.",
+                         wire_compression_name);
+            this->wire_compression_ = WireCompression::NONE;
+        } else if (!redis_->IsWireCodecSupportedByModule(wire_compression_name)) {
+            spdlog::warn("Wire compression {} not supported by the River module; sending data uncompressed.",
+                         wire_compression_name);
+            this->wire_compression_ = WireCompression::NONE;
+        } else if (this->compression_.type() != StreamCompression::Type::UNCOMPRESSED) {
+            spdlog::warn("Stream is already compressed via {}; not using wire compression {}.",
+                         this->compression_.name(), wire_compression_name);
+            this->wire_compression_ = WireCompression::NONE;
+        }
+    }
+
+    if (shared_memory_ring_bytes_ > 0 && multi_writer_) {
+        spdlog::warn("Shared memory rings are not supported with multiple writers; only writing to Redis.");
+    } else if (shared_memory_ring_bytes_ > 0) {
+        // Like wire compression, the ring only speeds up local readers, who can always read from Redis instead.
+        try {
+            shared_memory_ring_ = internal::SharedMemoryRing::Create(
+                stream_name, initialized_at_us_, shared_memory_ring_bytes_);
+            spdlog::info("Publishing samples to shared memory ring {} of {} bytes.",
+                         internal::SharedMemoryRing::ObjectName(stream_name), shared_memory_ring_bytes_);
+        } catch (const std::exception &e) {
+            spdlog::warn("Could not create shared memory ring; only writing to Redis. Error: {}", e.what());
+        }
     }
 }
 
@@ -150,7 +294,129 @@ void StreamWriter::WriteBytes(const char *data, int64_t num_samples, const int *
     if (num_samples <= 0) {
         return;
     }
+    CheckWritable(sizes);
+
+    // When compressing on a pool, the next batches are compressed while the current one is sent.
+    deque<future<vector<char>>> compressed_batches;
+    int64_t samples_compressed = 0;
+    int64_t bytes_compressed = 0;
+    size_t next_pooled_compressor = 0;
+    auto compress_ahead = [&]() {
+        while (compressed_batches.size() < pooled_compressors_.size() && samples_compressed < num_samples) {
+            int64_t batch_num_samples = std::min<int64_t>(num_samples - samples_compressed, redis_batch_size_);
+            const int *batch_sizes = has_variable_width_field_ ? &sizes[samples_compressed] : nullptr;
+            int64_t batch_num_bytes = has_variable_width_field_
+                                      ? internal::SumSizes(batch_sizes, batch_num_samples)
+                                      : batch_num_samples * sample_size_;
+            // A compressor is only reused once the batch it last compressed has been taken off the front.
+            Compressor *compressor = pooled_compressors_[next_pooled_compressor++ % pooled_compressors_.size()].get();
+            const char *batch_data = &data[bytes_compressed];
+            compressed_batches.push_back(compression_pool_->Submit(
+                [this, compressor, batch_data, batch_num_samples, batch_sizes, batch_num_bytes]() {
+                    return CompressBatch(compressor, batch_data, batch_num_samples, batch_sizes, batch_num_bytes);
+                }));
+            samples_compressed += batch_num_samples;
+            bytes_compressed += batch_num_bytes;
+        }
+    };
+
+    int64_t data_index = 0;
+    int64_t samples_written = 0;
+    try {
+        compress_ahead();
+        while (samples_written < num_samples) {
+            auto samples_remaining = num_samples - samples_written;
+            int64_t samples_to_write_in_batch =
+                samples_remaining > redis_batch_size_ ? redis_batch_size_ : samples_remaining;
+            const int *batch_sizes = has_variable_width_field_ ? &sizes[samples_written] : nullptr;
+
+            if (multi_writer_) {
+                // Sample indices, and thus stream keys, are only known once Redis reserves them.
+                data_index += WriteMultiWriterBatch(&data[data_index], samples_to_write_in_batch, batch_sizes);
+                samples_written += samples_to_write_in_batch;
+                total_samples_written_ += samples_to_write_in_batch;
+                continue;
+            }
+
+            PreparedBatch batch;
+            if (!compressed_batches.empty()) {
+                batch.data_holder = compressed_batches.front().get();
+                batch.has_compressed_data = true;
+                compressed_batches.pop_front();
+                compress_ahead();
+            }
+            PrepareBatch(&data[data_index], samples_to_write_in_batch, batch_sizes, &batch);
+            auto bytes_written = redis_->SendCommandPreformatted(batch.command_parts);
+            if (bytes_written < 0) {
+                throw StreamWriterException(
+                    fmt::format("Failed to write apprporiate number of bytes! wrote bytes={}", bytes_written));
+            }
+            FinishBatch(batch);
+
+            data_index += batch.data_num_bytes;
+            samples_written += samples_to_write_in_batch;
+        }
+    } catch (...) {
+        // Tasks still on the pool refer to the caller's data, so must finish before returning.
+        for (auto &compressed_batch : compressed_batches) {
+            if (compressed_batch.valid()) {
+                compressed_batch.wait();
+            }
+        }
+        throw;
+    }
+}
+
+void StreamWriter::WriteColumns(const void *const *columns, int64_t num_samples) {
+    auto *column_bytes = reinterpret_cast<const char *const *>(columns);
+    // Filled in once WritePacked() has checked there's a schema.
+    vector<int> field_sizes;
+    WritePacked(num_samples, [&](int64_t first_sample, int64_t n, char *out) {
+        if (field_sizes.empty()) {
+            for (const auto &field : schema_->field_definitions) {
+                field_sizes.push_back(field.size);
+            }
+        }
+        internal::InterleaveColumns(column_bytes, field_sizes, first_sample, n, out);
+    });
+}
+
+void StreamWriter::WritePacked(int64_t num_samples, const std::function<void(int64_t, int64_t, char *)> &pack) {
+    if (num_samples <= 0) {
+        return;
+    }
+    if (has_variable_width_field_) {
+        throw StreamWriterException("Columns can only be written to streams without variable-width fields.");
+    }
+    CheckWritable(nullptr);
+
+    int64_t samples_per_write = ColumnSamplesPerWrite(num_samples);
+    interleaved_columns_.resize(samples_per_write * sample_size_);
+    for (int64_t samples_written = 0; samples_written < num_samples; samples_written += samples_per_write) {
+        int64_t n = std::min(samples_per_write, num_samples - samples_written);
+        pack(samples_written, n, interleaved_columns_.data());
+        WriteBytes(interleaved_columns_.data(), n);
+    }
+}
+
+int64_t StreamWriter::ColumnSamplesPerWrite(int64_t num_samples) const {
+    // Enough batches at a time to keep a compression pool busy.
+    int64_t samples_per_write = int64_t{redis_batch_size_} * std::max<int64_t>(1, pooled_compressors_.size());
+    return std::min(samples_per_write, num_samples);
+}
+
+vector<char> StreamWriter::CompressBatch(Compressor *compressor,
+                                        const char *data,
+                                        int64_t num_samples,
+                                        const int *sizes,
+                                        int64_t data_num_bytes) const {
+    if (has_variable_width_field_) {
+        return internal::EncodeVariableWidthBlock(compressor, data, num_samples, sizes, data_num_bytes);
+    }
+    return compressor->compress(data, data_num_bytes);
+}
 
+void StreamWriter::CheckWritable(const int *sizes) {
     if (!is_initialized_) {
         throw StreamWriterException("Stream is not yet initialized. Call #Initialize() first.");
     }
@@ -162,199 +428,468 @@ void StreamWriter::WriteBytes(const char *data, int64_t num_samples, const int *
     if (this->has_variable_width_field_ && sizes == nullptr) {
         throw StreamWriterException("Stream has variable width fields; the size of each sample must be given!");
     }
-    bool has_compression = (bool) compressor_;
+}
 
-    int64_t data_index = 0;
-    int64_t samples_written = 0;
-    while (samples_written < num_samples) {
-        auto samples_remaining = num_samples - samples_written;
-        int64_t samples_to_write_in_batch =
-            samples_remaining > redis_batch_size_ ? redis_batch_size_ : samples_remaining;
-
-        int stream_key_idx = static_cast<int>(total_samples_written_ / keys_per_redis_stream_);
-
-        if (stream_key_idx != last_stream_key_idx_) {
-            auto reply = redis_->Xadd(
-                fmt::format("{}-{}", stream_name_, last_stream_key_idx_),
-                {{"tombstone", "1"},
-                 {"next_stream_key", fmt::format("{}-{}", stream_name_, stream_key_idx)},
-                 {"sample_index", fmt::format_int(
-                     total_samples_written_ == 0 ? total_samples_written_ : total_samples_written_ - 1).str()}});
-
-            spdlog::info(
-                "Adding tombstone entry for stream {}, key idx {} at samples {} | Response : {}",
-                stream_name_, last_stream_key_idx_, total_samples_written_, std::to_string(reply->type));
-
-            last_stream_key_idx_ = stream_key_idx;
-        }
-
-        if (has_module_installed_) {
-            // We preallocate / reuse the command buffer as much as possible, as much of the bottleneck is in the
-            // formatting of the command and copying of data. Instead, we do a "zero-copy" (ish) methodology where we
-            // manually manage formatting and sending of the command, such that we don't ever copy the <data> until we need
-            // to send it via network. A strong assumption in this methodology is that all XADD commands sent via Redis are
-            // fairly uniform, and just need the last argument (the "data") switched out.
-            // In addition, to reduce network bandwidth, we have a set of functions in a Redis server module (under the
-            // library name "river") that is tailored towards our batch use of XADD. In particular, it minimizes the
-            // redundant characters sent over the network.
-            int append_argc = (this->has_variable_width_field_ || has_compression) ? 5 : 6;
-            std::vector<const char *> append_argv(append_argc);
-            std::vector<size_t> append_arglens(append_argc);
-
-            const string &stream_key_formatted = fmt::format("{}-{}", stream_name_, stream_key_idx);
-            append_argv[1] = stream_key_formatted.c_str();
-            append_arglens[1] = strlen(append_argv[1]);
-
-            auto formatted_global_index = fmt::format_int(total_samples_written_);
-            append_argv[2] = formatted_global_index.c_str();
-            append_arglens[2] = strlen(append_argv[2]);
-
-            const char *data_to_write;
-            int64_t data_to_write_num_bytes;
-
-            // Placeholder vectors in case memory needs to be retained until sending
-            std::vector<char> data_holder;
-
-            auto formatted_num_samples = fmt::format_int(samples_to_write_in_batch).str();
-            if (has_compression) {
-                data_holder = compressor_->compress(&data[data_index], samples_to_write_in_batch * sample_size_);
-                data_to_write = data_holder.data();
-                data_to_write_num_bytes = (int64_t) data_holder.size();
-
-                append_argv[0] = "RIVER.batch_xadd_compressed";
-                append_arglens[0] = strlen(append_argv[0]);
-
-                append_argv[3] = formatted_num_samples.c_str();
-                append_arglens[3] = formatted_num_samples.size();
-
-                // Overwritten later down, doesn't matter now.
-                append_argv[4] = "\0";
-                append_arglens[4] = 1;
-            } else if (this->has_variable_width_field_) {
-                append_argv[0] = "RIVER.batch_xadd_variable";
-                append_arglens[0] = strlen(append_argv[0]);
-
-                // TODO: we end up making a copy of sizes here instead of avoiding a copy like the data; we can
-                // improve this by making sizes zero-copy as well
-                append_argv[3] = (const char *) (&sizes[samples_written]);
-                append_arglens[3] = sizeof(int) * samples_to_write_in_batch;
-
-                // Overwritten later down, doesn't matter now.
-                append_argv[4] = "\0";
-                append_arglens[4] = 1;
-
-                data_to_write = &data[data_index];
-                data_to_write_num_bytes = 0;
-                for (int i = 0; i < samples_to_write_in_batch; i++) {
-                    data_to_write_num_bytes += sizes[samples_written + i];
-                }
-            } else {
-                append_argv[0] = "RIVER.batch_xadd";
-                append_arglens[0] = strlen(append_argv[0]);
+void StreamWriter::PrepareBatch(const char *data, int64_t num_samples, const int *sizes, PreparedBatch *batch) {
+    int stream_key_idx = static_cast<int>(total_samples_written_ / keys_per_redis_stream_);
+    if (stream_key_idx != last_stream_key_idx_) {
+        spdlog::info("Adding tombstone entry for stream {}, key idx {} at samples {}",
+                     stream_name_, last_stream_key_idx_, total_samples_written_);
+        const string last_stream_key = redis_->StreamKey(stream_name_, last_stream_key_idx_);
+        const string next_stream_key = redis_->StreamKey(stream_name_, stream_key_idx);
+        auto formatted_tombstone_index = fmt::format_int(
+            total_samples_written_ == 0 ? total_samples_written_ : total_samples_written_ - 1);
+        const char *xadd_argv[] = {"XADD", last_stream_key.c_str(), "*", "tombstone", "1",
+                                   "next_stream_key", next_stream_key.c_str(),
+                                   "sample_index", formatted_tombstone_index.c_str()};
+        size_t xadd_arglens[] = {4, last_stream_key.size(), 1, 9, 1, 15, next_stream_key.size(), 12,
+                                 formatted_tombstone_index.size()};
+        redis_->AppendFormattedCommandArgv(&batch->rollover_commands, 9, xadd_argv, xadd_arglens);
+        batch->rollover_reply_types.push_back(REDIS_REPLY_STRING);
+        batch->command_ends.push_back(batch->rollover_commands.size());
+
+        if (retention_max_samples_ > 0 || retention_max_age_ms_ > 0) {
+            // In ring-buffer mode, keep only the previous key (which was trimmed while it was being written to)
+            // and the new one. The metadata is updated first so new readers never start at a deleted key.
+            const string metadata_key = redis_->MetadataKey(stream_name_);
+            const char *hset_argv[] = {"HSET", metadata_key.c_str(), "first_stream_key", last_stream_key.c_str()};
+            size_t hset_arglens[] = {4, metadata_key.size(), 16, last_stream_key.size()};
+            redis_->AppendFormattedCommandArgv(&batch->rollover_commands, 4, hset_argv, hset_arglens);
+            batch->rollover_reply_types.push_back(REDIS_REPLY_INTEGER);
+            batch->command_ends.push_back(batch->rollover_commands.size());
+            for (; first_stream_key_idx_ < last_stream_key_idx_; first_stream_key_idx_++) {
+                const string stream_key_to_unlink = redis_->StreamKey(stream_name_, first_stream_key_idx_);
+                const char *unlink_argv[] = {"UNLINK", stream_key_to_unlink.c_str()};
+                size_t unlink_arglens[] = {6, stream_key_to_unlink.size()};
+                redis_->AppendFormattedCommandArgv(&batch->rollover_commands, 2, unlink_argv, unlink_arglens);
+                batch->rollover_reply_types.push_back(REDIS_REPLY_INTEGER);
+                batch->command_ends.push_back(batch->rollover_commands.size());
+            }
+        }
 
-                append_argv[3] = formatted_num_samples.c_str();
-                append_arglens[3] = strlen(append_argv[3]);
+        last_stream_key_idx_ = stream_key_idx;
+    }
+
+    batch->data = data;
+    batch->sizes = sizes;
+    batch->num_samples = num_samples;
+    batch->first_sample_index = total_samples_written_;
+    batch->stream_key_idx = stream_key_idx;
+    const string &stream_key_formatted = redis_->StreamKey(stream_name_, stream_key_idx);
+    // Ends of each command in formatted_commands, relative to its start.
+    vector<size_t> formatted_command_ends;
+
+    // Number of bytes of `data` that this batch covers, regardless of what's actually sent over the network.
+    int64_t batch_num_bytes = this->has_variable_width_field_
+                              ? internal::SumSizes(sizes, num_samples)
+                              : sample_size_ * num_samples;
+    batch->data_num_bytes = batch_num_bytes;
+
+    const bool has_retention = retention_max_samples_ > 0 || retention_max_age_ms_ > 0;
+    if (batch_command_mode_ != BatchCommandMode::PER_SAMPLE_XADD) {
+        // We preallocate / reuse the command buffer as much as possible, as much of the bottleneck is in the
+        // formatting of the command and copying of data. Instead, we do a "zero-copy" (ish) methodology where we
+        // manually manage formatting and sending of the command, such that we don't ever copy the <data> until we need
+        // to send it via network. A strong assumption in this methodology is that all XADD commands sent via Redis are
+        // fairly uniform, and just need the last argument (the "data") switched out.
+        // In addition, to reduce network bandwidth, we have a set of functions in a Redis server module (under the
+        // library name "river") that is tailored towards our batch use of XADD. In particular, it minimizes the
+        // redundant characters sent over the network. If the module isn't installed, the same commands are
+        // available as Redis Functions, which take identical arguments but are invoked via
+        // FCALL <function name> <numkeys> <key> ...
+        const bool has_compression = (bool) compressor_;
+        const bool has_wire_compression = wire_compression_ != WireCompression::NONE;
+        const char *command_name;
+        if (has_wire_compression) {
+            // Only set when the module is installed; see Initialize().
+            command_name = "RIVER.batch_xadd_wire";
+        } else if (has_compression && this->has_variable_width_field_) {
+            command_name = batch_command_mode_ == BatchCommandMode::MODULE
+                           ? "RIVER.batch_xadd_variable_compressed" : "river_batch_xadd_variable_compressed";
+        } else if (has_compression) {
+            command_name = batch_command_mode_ == BatchCommandMode::MODULE
+                           ? "RIVER.batch_xadd_compressed" : "river_batch_xadd_compressed";
+        } else if (this->has_variable_width_field_) {
+            command_name = batch_command_mode_ == BatchCommandMode::MODULE
+                           ? "RIVER.batch_xadd_variable" : "river_batch_xadd_variable";
+        } else {
+            command_name = batch_command_mode_ == BatchCommandMode::MODULE
+                           ? "RIVER.batch_xadd" : "river_batch_xadd";
+        }
 
-                auto formatted_sample_size_bytes = fmt::format_int(sample_size_);
-                append_argv[4] = formatted_sample_size_bytes.c_str();
-                append_arglens[4] = strlen(append_argv[4]);
+        std::vector<const char *> append_argv;
+        std::vector<size_t> append_arglens;
+        if (batch_command_mode_ == BatchCommandMode::FUNCTION) {
+            append_argv.push_back("FCALL");
+            append_argv.push_back(command_name);
+            append_argv.push_back("1");
+        } else {
+            append_argv.push_back(command_name);
+        }
 
-                // Overwritten later down, doesn't matter now.
-                append_argv[5] = "\0";
-                append_arglens[5] = 1;
+        append_argv.push_back(stream_key_formatted.c_str());
 
-                data_to_write = &data[data_index];
-                data_to_write_num_bytes = sample_size_ * samples_to_write_in_batch;
-            }
+        auto formatted_global_index = fmt::format_int(total_samples_written_);
+        append_argv.push_back(formatted_global_index.c_str());
 
-            std::string formatted_command_str =
-                redis_->FormatCommandArgv(append_argc, append_argv.data(), append_arglens.data());
-            RedisWriterCommand xadd_redis_command_(formatted_command_str);
+        const char *data_to_write;
+        int64_t data_to_write_num_bytes;
+        int sizes_arg_index = -1;
 
-            auto commands_to_send = xadd_redis_command_.ReplaceLastBulkStringAndAssemble(
-                data_to_write, data_to_write_num_bytes);
+        auto formatted_num_samples = fmt::format_int(num_samples).str();
+        auto formatted_sample_size_bytes = fmt::format_int(sample_size_);
+        auto wire_compression_name = WireCompressionName(wire_compression_);
+        for (const char *arg : append_argv) {
+            append_arglens.push_back(strlen(arg));
+        }
 
-            auto bytes_written = redis_->SendCommandPreformatted(commands_to_send);
-            if (bytes_written < 0) {
-                throw StreamWriterException(
-                    fmt::format("Failed to write apprporiate number of bytes! wrote bytes={}", bytes_written));
+        if (has_wire_compression) {
+            const char *uncompressed;
+            size_t uncompressed_num_bytes;
+            std::vector<char> variable_width_holder;
+            if (this->has_variable_width_field_) {
+                // Sizes are sent in the same compressed payload, ahead of the data.
+                int64_t sizes_num_bytes = sizeof(int) * num_samples;
+                variable_width_holder.resize(sizes_num_bytes + batch_num_bytes);
+                memcpy(variable_width_holder.data(), sizes, sizes_num_bytes);
+                memcpy(variable_width_holder.data() + sizes_num_bytes, data, batch_num_bytes);
+                uncompressed = variable_width_holder.data();
+                uncompressed_num_bytes = variable_width_holder.size();
+            } else {
+                uncompressed = data;
+                uncompressed_num_bytes = batch_num_bytes;
             }
+            batch->data_holder = internal::WireCompress(wire_compression_, uncompressed, uncompressed_num_bytes);
+            data_to_write = batch->data_holder.data();
+            data_to_write_num_bytes = (int64_t) batch->data_holder.size();
 
-            data_index += data_to_write_num_bytes;
-
-            auto reply = redis_->GetReply();
-            if (reply->type != REDIS_REPLY_STATUS || reply->len == 0) {
-                if (reply->type == REDIS_REPLY_ERROR && reply->len > 0) {
-                    throw StreamWriterException(
-                        fmt::format("batch_xadd response was ERROR: {} ", reply->str));
-                } else {
-                    throw StreamWriterException(
-                        fmt::format("Reply was not of the right type (was {}) and/or had invalid length ({})",
-                                    reply->type, reply->len));
-                }
+            append_argv.push_back(formatted_num_samples.c_str());
+            append_arglens.push_back(formatted_num_samples.size());
+
+            append_argv.push_back(this->has_variable_width_field_ ? "-1" : formatted_sample_size_bytes.c_str());
+            append_arglens.push_back(strlen(append_argv.back()));
+
+            append_argv.push_back(wire_compression_name.c_str());
+            append_arglens.push_back(wire_compression_name.size());
+        } else if (has_compression) {
+            if (!batch->has_compressed_data) {
+                batch->data_holder = CompressBatch(compressor_.get(), data, num_samples, sizes, batch_num_bytes);
             }
+            data_to_write = batch->data_holder.data();
+            data_to_write_num_bytes = (int64_t) batch->data_holder.size();
+
+            append_argv.push_back(formatted_num_samples.c_str());
+            append_arglens.push_back(formatted_num_samples.size());
+        } else if (this->has_variable_width_field_) {
+            // Sizes are switched out in the formatted command just like the data, so neither is copied.
+            sizes_arg_index = static_cast<int>(append_argv.size());
+            append_argv.push_back("");
+            append_arglens.push_back(0);
+
+            data_to_write = data;
+            data_to_write_num_bytes = batch_num_bytes;
         } else {
-            // We preallocate / reuse the command buffer as much as possible, as much of the bottleneck is in the
-            // formatting of the command.
-            const int append_argc = 7;
-            std::vector<const char *> append_argv(append_argc);
-            std::vector<size_t> append_arglens(append_argc);
-
-            append_argv[0] = "XADD";
-            append_arglens[0] = strlen(append_argv[0]);
-
-            const string &stream_key_formatted = fmt::format("{}-{}", stream_name_, stream_key_idx);
-            append_argv[1] = stream_key_formatted.c_str();
-            append_arglens[1] = strlen(append_argv[1]);
-
-            append_argv[2] = "*";
-            append_arglens[2] = 1;
-
-            append_argv[3] = "val";
-            append_arglens[3] = strlen(append_argv[3]);
-
-            // Set per sample below
-            append_argv[4] = nullptr;
-            append_arglens[4] = sample_size_;
-
-            // Set per sample below
-            append_argv[5] = "i";
-            append_arglens[5] = strlen(append_argv[5]);
-
-            // Set per sample below
-            append_argv[6] = nullptr;
-            append_arglens[6] = 0;
-
-            for (int64_t i = 0; i < samples_to_write_in_batch; i++) {
-                int64_t global_index = total_samples_written_ + i;
-                auto formatted_global_index = fmt::format_int(global_index);
-                append_argv[6] = formatted_global_index.c_str();
-                append_arglens[6] = formatted_global_index.size();
-
-                append_argv[4] = &data[data_index];
-                if (!this->has_variable_width_field_) {
-                    data_index += sample_size_;
-                } else {
-                    int this_sample_size = sizes[samples_written + i];
-                    append_arglens[4] = this_sample_size;
-                    data_index += this_sample_size;
-                }
+            append_argv.push_back(formatted_num_samples.c_str());
+            append_arglens.push_back(formatted_num_samples.size());
+
+            append_argv.push_back(formatted_sample_size_bytes.c_str());
+            append_arglens.push_back(formatted_sample_size_bytes.size());
+
+            data_to_write = data;
+            data_to_write_num_bytes = batch_num_bytes;
+        }
+
+        auto formatted_retention_max_samples = fmt::format_int(retention_max_samples_);
+        auto formatted_retention_max_age_ms = fmt::format_int(retention_max_age_ms_);
+        if (retention_max_samples_ > 0) {
+            append_argv.push_back("MAXLEN");
+            append_arglens.push_back(strlen(append_argv.back()));
+            append_argv.push_back(formatted_retention_max_samples.c_str());
+            append_arglens.push_back(formatted_retention_max_samples.size());
+        } else if (retention_max_age_ms_ > 0) {
+            append_argv.push_back("MAXAGE");
+            append_arglens.push_back(strlen(append_argv.back()));
+            append_argv.push_back(formatted_retention_max_age_ms.c_str());
+            append_arglens.push_back(formatted_retention_max_age_ms.size());
+        }
+
+        // Overwritten later down, doesn't matter now.
+        append_argv.push_back("\0");
+        append_arglens.push_back(1);
+        auto append_argc = static_cast<int>(append_argv.size());
+
+        auto formatted_command = redis_->FormatCommandArgv(append_argc, append_argv.data(), append_arglens.data());
+        if (sizes_arg_index >= 0) {
+            batch->command = std::make_unique<RedisWriterCommand>(
+                formatted_command, std::vector<int>{sizes_arg_index, append_argc - 1});
+            batch->command_parts = batch->command->ReplaceBulkStringsAndAssemble(
+                {{(const char *) sizes, sizeof(int) * num_samples}, {data_to_write, data_to_write_num_bytes}});
+        } else {
+            batch->command = std::make_unique<RedisWriterCommand>(formatted_command);
+            batch->command_parts = batch->command->ReplaceLastBulkStringAndAssemble(
+                data_to_write, data_to_write_num_bytes);
+        }
+
+    } else {
+        // One XADD per sample, formatted into a single buffer that's sent at once.
+        const int append_argc = 7;
+        std::vector<const char *> append_argv(append_argc);
+        std::vector<size_t> append_arglens(append_argc);
+
+        append_argv[0] = "XADD";
+        append_arglens[0] = strlen(append_argv[0]);
+
+        append_argv[1] = stream_key_formatted.c_str();
+        append_arglens[1] = strlen(append_argv[1]);
+
+        append_argv[2] = "*";
+        append_arglens[2] = 1;
+
+        append_argv[3] = "val";
+        append_arglens[3] = strlen(append_argv[3]);
+
+        // Set per sample below
+        append_argv[4] = nullptr;
+        append_arglens[4] = sample_size_;
+
+        // Set per sample below
+        append_argv[5] = "i";
+        append_arglens[5] = strlen(append_argv[5]);
+
+        // Set per sample below
+        append_argv[6] = nullptr;
+        append_arglens[6] = 0;
+
+        int64_t data_index = 0;
+        for (int64_t i = 0; i < num_samples; i++) {
+            int64_t global_index = total_samples_written_ + i;
+            auto formatted_global_index = fmt::format_int(global_index);
+            append_argv[6] = formatted_global_index.c_str();
+            append_arglens[6] = formatted_global_index.size();
 
-                redis_->SendCommandArgv(append_argc, append_argv.data(), append_arglens.data());
+            append_argv[4] = &data[data_index];
+            if (!this->has_variable_width_field_) {
+                data_index += sample_size_;
+            } else {
+                int this_sample_size = sizes[i];
+                append_arglens[4] = this_sample_size;
+                data_index += this_sample_size;
+            }
+
+            redis_->AppendFormattedCommandArgv(
+                &batch->formatted_commands, append_argc, append_argv.data(), append_arglens.data());
+            formatted_command_ends.push_back(batch->formatted_commands.size());
+        }
+
+        // Trim once per batch rather than per XADD, pipelined along with the batch.
+        if (has_retention) {
+            string threshold;
+            const char *strategy;
+            if (retention_max_samples_ > 0) {
+                strategy = "MAXLEN";
+                threshold = fmt::format_int(retention_max_samples_).str();
+            } else {
+                // MINID is in terms of the server clock, so adjust by its offset as measured via TIME.
+                strategy = "MINID";
+                int64_t server_now_ms = (chrono::duration_cast<std::chrono::microseconds>(
+                    chrono::system_clock::now().time_since_epoch()).count() - local_minus_server_clock_us_) / 1000;
+                threshold = fmt::format_int(std::max(int64_t{0}, server_now_ms - retention_max_age_ms_)).str();
             }
+            const char *xtrim_argv[] = {"XTRIM", stream_key_formatted.c_str(), strategy, "~", threshold.c_str()};
+            size_t xtrim_arglens[] = {5, stream_key_formatted.size(), strlen(strategy), 1, threshold.size()};
+            redis_->AppendFormattedCommandArgv(&batch->formatted_commands, 5, xtrim_argv, xtrim_arglens);
+            formatted_command_ends.push_back(batch->formatted_commands.size());
+        }
+    }
+    size_t command_end = batch->rollover_commands.size();
+    for (const auto &part : batch->command_parts) {
+        command_end += part.second;
+    }
+    if (batch_command_mode_ != BatchCommandMode::PER_SAMPLE_XADD) {
+        batch->command_ends.push_back(command_end);
+    }
+    for (size_t formatted_command_end : formatted_command_ends) {
+        batch->command_ends.push_back(command_end + formatted_command_end);
+    }
+    if (!batch->formatted_commands.empty()) {
+        batch->command_parts.emplace_back(batch->formatted_commands.data(), batch->formatted_commands.size());
+    }
+    if (!batch->rollover_commands.empty()) {
+        batch->command_parts.insert(batch->command_parts.begin(),
+                                    {batch->rollover_commands.data(), batch->rollover_commands.size()});
+    }
+
+    // Commands are pipelined, so need to be explicitly sent to the node owning this key.
+    redis_->RouteToKey(stream_key_formatted);
+    total_samples_written_ += num_samples;
+}
 
-            for (int64_t i = 0; i < samples_to_write_in_batch; i++) {
-                auto reply = redis_->GetReply();
-                if (reply->type != REDIS_REPLY_STRING || reply->len == 0) {
-                    throw StreamWriterException(
-                        fmt::format("Reply was not of the right type (was {}) and/or had invalid length ({})",
-                                    reply->type, reply->len));
+void StreamWriter::FinishBatch(const PreparedBatch &batch) {
+    // Every reply is read before any is checked, so that an error leaves none queued for the next batch to misread.
+    auto replies = redis_->GetPipelinedReplies(batch.command_parts, batch.command_ends);
+    // The data (either the caller's or the batch's) must outlive any zero-copy sends of it.
+    redis_->WaitForZeroCopyCompletions();
+    auto reply_it = replies.begin();
+
+    for (int reply_type : batch.rollover_reply_types) {
+        const auto &reply = *reply_it++;
+        if (reply->type != reply_type) {
+            throw StreamWriterException(fmt::format(
+                "Failed to roll over stream {} to key idx {}: {}", stream_name_, batch.stream_key_idx,
+                reply->type == REDIS_REPLY_ERROR ? string(reply->str, reply->len) : std::to_string(reply->type)));
+        }
+    }
+
+    // Redis stream ID of the last sample of this batch; only needed when publishing to a shared memory ring.
+    string last_id;
+    if (batch_command_mode_ != BatchCommandMode::PER_SAMPLE_XADD) {
+        const auto &reply = *reply_it++;
+        if (reply->type != REDIS_REPLY_STATUS || reply->len == 0) {
+            if (reply->type == REDIS_REPLY_ERROR && reply->len > 0) {
+                throw StreamWriterException(
+                    fmt::format("batch_xadd response was ERROR: {} ", reply->str));
+            } else {
+                throw StreamWriterException(
+                    fmt::format("Reply was not of the right type (was {}) and/or had invalid length ({})",
+                                reply->type, reply->len));
+            }
+        }
+        if (shared_memory_ring_) {
+            // Batch commands reply with the ID of the last entry they added...
+            last_id.assign(reply->str, reply->len);
+            if (last_id == "OK") {
+                // ...except those of River modules predating that, for which look it up. As this writer is the only
+                // one writing to this key, that's the last sample of this batch.
+                auto last_reply = redis_->Xrevrange(
+                    1, redis_->StreamKey(stream_name_, batch.stream_key_idx), "+", 0, 0);
+                if (last_reply->elements != 1) {
+                    throw StreamWriterException("Unexpected reply when fetching the last stream ID.");
                 }
+                last_id = last_reply->element[0]->element[0]->str;
+            }
+        }
+    } else {
+        for (int64_t i = 0; i < batch.num_samples; i++) {
+            const auto &reply = *reply_it++;
+            if (reply->type != REDIS_REPLY_STRING || reply->len == 0) {
+                throw StreamWriterException(
+                    fmt::format("Reply was not of the right type (was {}) and/or had invalid length ({})",
+                                reply->type, reply->len));
+            }
+            if (shared_memory_ring_ && i == batch.num_samples - 1) {
+                last_id = reply->str;
             }
         }
+        if (retention_max_samples_ > 0 || retention_max_age_ms_ > 0) {
+            const auto &reply = *reply_it++;
+            if (reply->type != REDIS_REPLY_INTEGER) {
+                throw StreamWriterException(fmt::format("XTRIM failed; reply was of type {}", reply->type));
+            }
+        }
+    }
 
-        samples_written += samples_to_write_in_batch;
-        total_samples_written_ += samples_to_write_in_batch;
+    if (shared_memory_ring_) {
+        PublishToSharedMemory(batch, last_id);
+    }
+}
+
+int64_t StreamWriter::WriteMultiWriterBatch(const char *data, int64_t num_samples, const int *sizes) {
+    int64_t num_bytes = sizes != nullptr ? internal::SumSizes(sizes, num_samples) : sample_size_ * num_samples;
+
+    const string key_prefix = redis_->StreamKeyPrefix(stream_name_);
+    auto formatted_keys_per_redis_stream = fmt::format_int(keys_per_redis_stream_);
+    auto formatted_num_samples = fmt::format_int(num_samples);
+    auto formatted_sample_size_bytes = fmt::format_int(sample_size_);
+
+    // Other writers may have moved the stream on to stream keys we didn't declare, in which case nothing was written
+    // and we retry with the stream's actual next sample index.
+    for (int attempt = 0; attempt < internal::Redis::MULTI_WRITER_MAX_ATTEMPTS; attempt++) {
+        vector<string> keys = redis_->MultiWriterKeys(
+            stream_name_, keys_per_redis_stream_, multi_writer_next_sample_index_, num_samples);
+        auto formatted_num_keys = fmt::format_int(keys.size());
+
+        // Same "zero-copy" formatting as in WriteBytes().
+        std::vector<const char *> append_argv = {
+            "FCALL", sizes != nullptr ? "river_batch_xadd_shared_variable" : "river_batch_xadd_shared",
+            formatted_num_keys.c_str()};
+        for (const auto &key : keys) {
+            append_argv.push_back(key.c_str());
+        }
+        append_argv.push_back(key_prefix.c_str());
+        append_argv.push_back(formatted_keys_per_redis_stream.c_str());
+        std::vector<size_t> append_arglens;
+        for (const char *arg : append_argv) {
+            append_arglens.push_back(strlen(arg));
+        }
+        if (sizes != nullptr) {
+            append_argv.push_back("");
+            append_arglens.push_back(0);
+        } else {
+            append_argv.push_back(formatted_num_samples.c_str());
+            append_arglens.push_back(formatted_num_samples.size());
+            append_argv.push_back(formatted_sample_size_bytes.c_str());
+            append_arglens.push_back(formatted_sample_size_bytes.size());
+        }
+        // Overwritten later down, doesn't matter now.
+        append_argv.push_back("\0");
+        append_arglens.push_back(1);
+
+        std::string formatted_command_str = redis_->FormatCommandArgv(
+            static_cast<int>(append_argv.size()), append_argv.data(), append_arglens.data());
+        redis_->RouteToKey(keys[0]);
+        // Kept until the reply is read, as command_parts points into it and may be resent to another node.
+        std::unique_ptr<RedisWriterCommand> command;
+        vector<pair<const char *, size_t>> command_parts;
+        if (sizes != nullptr) {
+            // Sizes are the argument right before the data.
+            int argc = static_cast<int>(append_argv.size());
+            command = std::make_unique<RedisWriterCommand>(formatted_command_str, std::vector<int>{argc - 2, argc - 1});
+            command_parts = command->ReplaceBulkStringsAndAssemble(
+                {{(const char *) sizes, sizeof(int) * num_samples}, {data, num_bytes}});
+        } else {
+            command = std::make_unique<RedisWriterCommand>(formatted_command_str);
+            command_parts = command->ReplaceLastBulkStringAndAssemble(data, num_bytes);
+        }
+        int bytes_written = redis_->SendCommandPreformatted(command_parts);
+        if (bytes_written < 0) {
+            throw StreamWriterException(
+                fmt::format("Failed to write apprporiate number of bytes! wrote bytes={}", bytes_written));
+        }
+
+        size_t command_end = 0;
+        for (const auto &part : command_parts) {
+            command_end += part.second;
+        }
+        auto replies = redis_->GetPipelinedReplies(command_parts, {command_end});
+        redis_->WaitForZeroCopyCompletions();
+        const auto &reply = replies[0];
+        if (internal::Redis::ParseUndeclaredKeysError(reply.get(), &multi_writer_next_sample_index_)) {
+            continue;
+        }
+        if (reply->type != REDIS_REPLY_INTEGER) {
+            if (reply->type == REDIS_REPLY_ERROR && reply->len > 0) {
+                throw StreamWriterException(fmt::format("batch_xadd_shared response was ERROR: {} ", reply->str));
+            }
+            throw StreamWriterException(fmt::format("Reply was not of the right type (was {})", reply->type));
+        }
+        multi_writer_next_sample_index_ = reply->integer + num_samples;
+        return num_bytes;
+    }
+    throw StreamWriterException("batch_xadd_shared failed; other writers kept moving the stream to new stream keys.");
+}
+
+void StreamWriter::PublishToSharedMemory(const PreparedBatch &batch, const string &last_id) {
+    internal::SharedMemoryRingRecord record{};
+    record.first_sample_index = batch.first_sample_index;
+    record.num_samples = batch.num_samples;
+    record.stream_key_idx = batch.stream_key_idx;
+    internal::DecodeCursor(last_id.c_str(), &record.last_id_ms, &record.last_id_seq);
+    record.sizes_num_bytes = batch.sizes == nullptr ? 0 : static_cast<int64_t>(sizeof(int) * batch.num_samples);
+    record.data_num_bytes = batch.data_num_bytes;
+    if (!shared_memory_ring_->Publish(record, batch.sizes, batch.data) && !warned_shared_memory_ring_too_small_) {
+        spdlog::warn("Batch of {} bytes doesn't fit in the shared memory ring; local readers will read it from "
+                     "Redis. Consider a larger shared_memory_ring_bytes.", batch.data_num_bytes);
+        warned_shared_memory_ring_too_small_ = true;
     }
 }
 
@@ -362,13 +897,14 @@ int64_t StreamWriter::initialized_at_us() {
     return initialized_at_us_;
 }
 
-int64_t StreamWriter::ComputeLocalMinusServerClocks() {
+int64_t StreamWriter::ComputeLocalMinusServerClocks(const string &stream_name) {
+    string key = redis_->MetadataKey(stream_name);
     int64_t sum_deltas = 0;
     int num_round_trips = 100;
     for (int i = 0; i < num_round_trips; i++) {
         int64_t before = chrono::duration_cast<std::chrono::microseconds>(
                 chrono::system_clock::now().time_since_epoch()).count();
-        int64_t redis_time = redis_->TimeUs();
+        int64_t redis_time = redis_->TimeUs(key);
         int64_t after = chrono::duration_cast<std::chrono::microseconds>(
                 chrono::system_clock::now().time_since_epoch()).count();
         int64_t local_time = (after + before) / 2;
@@ -385,8 +921,19 @@ void StreamWriter::Stop() {
         return;
     }
 
-    string stream_key = fmt::format("{}-{}", stream_name_, last_stream_key_idx_);
-    redis_->Xadd(stream_key,
+    if (multi_writer_) {
+        if (redis_->LeaveMultiWriterStream(stream_name_, keys_per_redis_stream_, multi_writer_next_sample_index_)) {
+            spdlog::info("Last writer of stream {} stopped; adding eof entry.", stream_name_);
+        } else {
+            spdlog::info("Writer of stream {} stopped after {} samples; other writers are still active.",
+                         stream_name_, total_samples_written_);
+        }
+        is_stopped_ = true;
+        return;
+    }
+
+    string stream_key = redis_->StreamKey(stream_name_, last_stream_key_idx_);
+    auto reply = redis_->Xadd(stream_key,
                  {{"eof", "1"},
                   {"sample_index",
                    fmt::format_int(total_samples_written_ == 0 ? 0 : total_samples_written_ - 1).str()}});
@@ -394,9 +941,49 @@ void StreamWriter::Stop() {
     spdlog::info("Adding eof entry for stream {}, idx {} at samples {}",
                  stream_name_, last_stream_key_idx_, total_samples_written_);
 
+    if (shared_memory_ring_ && reply->type == REDIS_REPLY_STRING) {
+        // Local readers then read the EOF itself from Redis.
+        internal::SharedMemoryRingRecord record{};
+        record.first_sample_index = total_samples_written_;
+        record.num_samples = -1;
+        record.stream_key_idx = last_stream_key_idx_;
+        internal::DecodeCursor(reply->str, &record.last_id_ms, &record.last_id_seq);
+        shared_memory_ring_->Publish(record, nullptr, nullptr);
+    }
+
     is_stopped_ = true;
 }
 
+StreamMemoryStatus StreamWriter::MemoryStatus() {
+    return StreamMemoryAccountant::FetchStatus(redis_.get(), stream_name_);
+}
+
+vector<AdaptiveCompressionStats> StreamWriter::CompressionStats() {
+    vector<AdaptiveCompressionStats> ret;
+    vector<Compressor *> compressors = {compressor_.get()};
+    for (const auto &pooled_compressor : pooled_compressors_) {
+        compressors.push_back(pooled_compressor.get());
+    }
+    for (auto *compressor : compressors) {
+        auto *adaptive_compressor = dynamic_cast<internal::AdaptiveCompressor *>(compressor);
+        if (adaptive_compressor == nullptr) {
+            continue;
+        }
+        // Every compressor has the same candidates, in the same order.
+        auto stats = adaptive_compressor->stats();
+        if (ret.empty()) {
+            ret = stats;
+            continue;
+        }
+        for (size_t i = 0; i < stats.size(); i++) {
+            ret[i].num_batches += stats[i].num_batches;
+            ret[i].uncompressed_bytes += stats[i].uncompressed_bytes;
+            ret[i].compressed_bytes += stats[i].compressed_bytes;
+        }
+    }
+    return ret;
+}
+
 const string& StreamWriter::stream_name() {
     return stream_name_;
 }
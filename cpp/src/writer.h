@@ -5,14 +5,22 @@
 #include <iostream>
 #include <mutex>
 #include <cstring>
+#include <functional>
 #include <unordered_map>
 #include <memory>
 #include <utility>
 #include "schema.h"
 #include "redis.h"
+#include "memory_accountant.h"
 #include "compression/compressor_types.h"
 
 namespace river {
+namespace internal {
+class SharedMemoryRing;
+}
+class RedisWriterCommand;
+class CompressionPool;
+
 class StreamWriterException : public std::exception {
  public:
     explicit StreamWriterException(const std::string& message) {
@@ -40,15 +48,33 @@ public:
     int64_t keys_per_redis_stream;
     int batch_size;
     StreamCompression compression;
+    WireCompression wire_compression;
+    int64_t retention_max_samples;
+    int64_t retention_max_age_ms;
+    int64_t shared_memory_ring_bytes;
+    bool multi_writer;
+    std::shared_ptr<CompressionPool> compression_pool;
 private:
     StreamWriterParams(RedisConnection _connection,
                        int64_t _keys_per_redis_stream,
                        int _batch_size,
-                       StreamCompression _compression) :
+                       StreamCompression _compression,
+                       WireCompression _wire_compression,
+                       int64_t _retention_max_samples,
+                       int64_t _retention_max_age_ms,
+                       int64_t _shared_memory_ring_bytes,
+                       bool _multi_writer,
+                       std::shared_ptr<CompressionPool> _compression_pool) :
         connection(std::move(_connection)),
         keys_per_redis_stream(_keys_per_redis_stream),
         batch_size(_batch_size),
-        compression(_compression) {}
+        compression(_compression),
+        wire_compression(_wire_compression),
+        retention_max_samples(_retention_max_samples),
+        retention_max_age_ms(_retention_max_age_ms),
+        shared_memory_ring_bytes(_shared_memory_ring_bytes),
+        multi_writer(_multi_writer),
+        compression_pool(std::move(_compression_pool)) {}
     friend StreamWriterParamsBuilder;
 };
 
@@ -70,12 +96,74 @@ public:
         compression_ = compression;
         return *this;
     }
+    /**
+     * Compresses batches in flight to Redis, reducing bandwidth for writers on slow links. Only takes effect if the
+     * River module is installed (and built with the codec) and the stream is otherwise uncompressed.
+     */
+    StreamWriterParamsBuilder &wire_compression(WireCompression wire_compression) {
+        wire_compression_ = wire_compression;
+        return *this;
+    }
+
+    /**
+     * Makes this stream a ring buffer that retains (approximately) only the last `max_samples` samples; older samples
+     * are trimmed from Redis as new ones are written. Readers that fall behind skip ahead to the oldest retained
+     * sample (see StreamReader#total_samples_dropped()). Not supported with compression.
+     */
+    StreamWriterParamsBuilder &retention_max_samples(int64_t max_samples) {
+        retention_max_samples_ = max_samples;
+        return *this;
+    }
+    /**
+     * Like #retention_max_samples(), but retains samples written in (approximately) the last `max_age_ms`
+     * milliseconds, according to the Redis server's clock.
+     */
+    StreamWriterParamsBuilder &retention_max_age_ms(int64_t max_age_ms) {
+        retention_max_age_ms_ = max_age_ms;
+        return *this;
+    }
+    /**
+     * Also publishes samples into a shared memory ring of the given size, from which readers on the same host (see
+     * StreamReaderParamsBuilder#shared_memory()) can read them without a round trip to Redis. Samples are still written
+     * to Redis, which readers fall back to whenever they fall more than a ring's worth of samples behind. The ring
+     * should hold at least a few batches.
+     */
+    StreamWriterParamsBuilder &shared_memory_ring_bytes(int64_t num_bytes) {
+        shared_memory_ring_bytes_ = num_bytes;
+        return *this;
+    }
+    /**
+     * Allows several writers, e.g. in different processes, to append to the same stream. The first writer to
+     * initialize creates the stream, and later ones with the same schema join it. Each batch reserves its sample
+     * indices atomically in Redis, so readers see a single stream with monotonic sample indices; samples of any one
+     * writer keep their order, while batches of different writers interleave. The stream ends once every writer has
+     * stopped. Requires Redis Functions (Redis >= 7.0), and isn't supported with compression or retention.
+     */
+    StreamWriterParamsBuilder &multi_writer(bool multi_writer) {
+        multi_writer_ = multi_writer;
+        return *this;
+    }
+    /**
+     * Compresses batches on the given pool of worker threads (which can be shared across writers) rather than on the
+     * calling thread, such that upcoming batches of a write are compressed while the current one is sent to Redis.
+     * Only has an effect for compressed streams, and only overlaps batches within one call to StreamWriter#Write(), so
+     * write several batches' worth of samples at a time to benefit.
+     */
+    StreamWriterParamsBuilder &compression_pool(std::shared_ptr<CompressionPool> compression_pool) {
+        compression_pool_ = std::move(compression_pool);
+        return *this;
+    }
 
     StreamWriterParams build() {
         if (!connection_) {
             throw std::invalid_argument("Need to provide a connection!");
         }
-        return {*connection_, keys_per_redis_stream_, batch_size_, compression_};
+        if (retention_max_samples_ > 0 && retention_max_age_ms_ > 0) {
+            throw std::invalid_argument("Only one of retention_max_samples and retention_max_age_ms can be given.");
+        }
+        return {*connection_, keys_per_redis_stream_, batch_size_, compression_, wire_compression_,
+                retention_max_samples_, retention_max_age_ms_, shared_memory_ring_bytes_, multi_writer_,
+                compression_pool_};
     }
 
 private:
@@ -83,6 +171,12 @@ private:
     int64_t keys_per_redis_stream_ = int64_t{1LL << 24};
     int batch_size_ = 1536;
     StreamCompression compression_{StreamCompression::Type::UNCOMPRESSED};
+    WireCompression wire_compression_ = WireCompression::NONE;
+    int64_t retention_max_samples_ = 0;
+    int64_t retention_max_age_ms_ = 0;
+    int64_t shared_memory_ring_bytes_ = 0;
+    bool multi_writer_ = false;
+    std::shared_ptr<CompressionPool> compression_pool_;
 };
 
 
@@ -117,6 +211,8 @@ public:
                 .batch_size(batch_size)
                 .build()) {}
 
+    ~StreamWriter();
+
     /**
      * Initialize this stream for writing. The given stream name must be unique within the Redis used. This
      * initialization puts necessary information (e.g. schemas and timestamps) into redis. Optionally, it can accept
@@ -155,6 +251,19 @@ public:
      */
     void WriteBytes(const char *data, int64_t num_samples, const int *sizes = nullptr);
 
+    /**
+     * Writes samples given column-wise, i.e. one array per field of the schema, in the schema's field order, each of
+     * num_samples values of that field's size. Fields are interleaved into samples a batch at a time, so no copy of
+     * all of the data is made. Only for schemas without variable-width fields.
+     */
+    void WriteColumns(const void *const *columns, int64_t num_samples);
+
+    /**
+     * Like WriteColumns(), but for data in any layout: pack(first_sample, n, out) is called a batch at a time to write
+     * samples [first_sample, first_sample + n) into out, which holds n samples. Used by e.g. TypedStreamWriter.
+     */
+    void WritePacked(int64_t num_samples, const std::function<void(int64_t, int64_t, char *)> &pack);
+
     /**
      * A copy of the stream's schema that was provided on initialize().
      */
@@ -166,7 +275,8 @@ public:
     const std::string& stream_name();
 
     /**
-     * Number of samples written to this stream since initialization.
+     * Number of samples written to this stream since initialization. For multi-writer streams, only counts samples
+     * written by this writer.
      */
     int64_t total_samples_written();
 
@@ -185,6 +295,19 @@ public:
      */
     void SetMetadata(const std::unordered_map<std::string, std::string>& metadata);
 
+    /**
+     * Redis memory usage of this stream and of all streams, as last published by a StreamMemoryAccountant (e.g. by an
+     * ingester run with --memory_budget_bytes). Writers should back off while this is over budget, since Redis may
+     * otherwise run out of memory. Each call is a round trip to Redis, so avoid calling this on every write.
+     */
+    StreamMemoryStatus MemoryStatus();
+
+    /**
+     * For ADAPTIVE compression, each candidate compression along with how many batches it was picked for and how well
+     * it compressed them; see StreamCompression#Adaptive(). Empty for other compressions.
+     */
+    std::vector<AdaptiveCompressionStats> CompressionStats();
+
     /**
      * Stops this stream permanently. This method must be called once the stream is finished in order to notify readers
      * that the stream has terminated.
@@ -192,9 +315,65 @@ public:
     void Stop();
 
 private:
-    int64_t ComputeLocalMinusServerClocks();
+    /**
+     * How batches of samples are written to Redis. In order of preference: via the River Redis module if it's installed;
+     * else via River's Redis Functions library if the server supports it; else via one XADD per sample.
+     */
+    enum class BatchCommandMode {
+        PER_SAMPLE_XADD,
+        MODULE,
+        FUNCTION,
+    };
 
-    std::unique_ptr<internal::Redis> redis_;
+    /**
+     * A batch of samples formatted into Redis command(s) by PrepareBatch(), to be sent via
+     * Redis#SendCommandPreformatted() (possibly pipelined along with other batches, see StreamWriterGroup) and then
+     * have its replies read by FinishBatch(). Must stay in place until then, as command_parts points into it.
+     */
+    struct PreparedBatch {
+        const char *data = nullptr;
+        const int *sizes = nullptr;
+        int64_t num_samples = 0;
+        int64_t data_num_bytes = 0;
+        int64_t first_sample_index = 0;
+        int stream_key_idx = 0;
+        std::unique_ptr<RedisWriterCommand> command;
+        std::vector<char> data_holder;
+        // Whether data_holder was already set to the compressed data, e.g. by a CompressionPool.
+        bool has_compressed_data = false;
+        // Commands sent ahead of `command` when the batch rolls over to a new stream key (i.e. the tombstone of the
+        // previous key, and any retention cleanup), along with the reply type each should get. Pipelined with the
+        // batch so they can't overtake earlier batches of the previous key that are still to be sent.
+        std::string rollover_commands;
+        std::vector<int> rollover_reply_types;
+        // Commands sent after `command`, if any.
+        std::string formatted_commands;
+        std::vector<std::pair<const char *, size_t>> command_parts;
+        // Byte offset within command_parts at which each of its commands ends, so that any redirected by the cluster
+        // can be resent on their own.
+        std::vector<size_t> command_ends;
+    };
+
+    StreamWriter(const StreamWriterParams &params, std::shared_ptr<internal::Redis> redis);
+    friend class StreamWriterGroup;
+
+    // Against the clock of the node owning the given stream, which in cluster mode is the one stamping its entry IDs.
+    int64_t ComputeLocalMinusServerClocks(const std::string &stream_name);
+    void CheckWritable(const int *sizes);
+    // How many samples WritePacked() interleaves at a time, out of num_samples.
+    int64_t ColumnSamplesPerWrite(int64_t num_samples) const;
+    std::vector<char> CompressBatch(Compressor *compressor,
+                                    const char *data,
+                                    int64_t num_samples,
+                                    const int *sizes,
+                                    int64_t data_num_bytes) const;
+    void PrepareBatch(const char *data, int64_t num_samples, const int *sizes, PreparedBatch *batch);
+    void FinishBatch(const PreparedBatch &batch);
+    void PublishToSharedMemory(const PreparedBatch &batch, const std::string &last_id);
+    int64_t WriteMultiWriterBatch(const char *data, int64_t num_samples, const int *sizes);
+
+    // Shared with the other writers of a StreamWriterGroup, if any.
+    std::shared_ptr<internal::Redis> redis_;
 
     const int redis_batch_size_;
     const int64_t keys_per_redis_stream_;
@@ -203,10 +382,30 @@ private:
     std::string stream_name_;
     int sample_size_;
     bool has_variable_width_field_;
-    bool has_module_installed_;
+    BatchCommandMode batch_command_mode_;
 
     StreamCompression compression_;
     std::unique_ptr<Compressor> compressor_;
+    std::shared_ptr<CompressionPool> compression_pool_;
+    // One per batch that can be compressed ahead on compression_pool_, as compressors aren't thread-safe. Empty if
+    // not compressing on a pool.
+    std::vector<std::unique_ptr<Compressor>> pooled_compressors_;
+    // Reused by WritePacked() to hold the interleaved samples of a batch.
+    std::vector<char> interleaved_columns_;
+    WireCompression wire_compression_;
+    // Ring-buffer retention; at most one is positive.
+    int64_t retention_max_samples_;
+    int64_t retention_max_age_ms_;
+    int64_t local_minus_server_clock_us_;
+    int first_stream_key_idx_;
+    int64_t shared_memory_ring_bytes_;
+    std::unique_ptr<internal::SharedMemoryRing> shared_memory_ring_;
+    bool warned_shared_memory_ring_too_small_;
+    // Whether other writers may be appending to this stream; see StreamWriterParamsBuilder#multi_writer().
+    const bool multi_writer_;
+    // The stream's next sample index as of this writer's last write, from which to guess the stream keys its next
+    // write lands in; see Redis#MultiWriterKeys().
+    int64_t multi_writer_next_sample_index_;
 
     int64_t total_samples_written_;
     bool is_stopped_;
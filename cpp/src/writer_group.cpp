@@ -0,0 +1,158 @@
+#include "writer_group.h"
+
+#include <exception>
+
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+#include "redis_writer_commands.h"
+#include "simd.h"
+
+using namespace std;
+
+namespace river {
+
+// Streams of a group compress their batches as they're prepared on Flush(), so have no use for a pool.
+static StreamWriterParams WithoutCompressionPool(StreamWriterParams params) {
+    params.compression_pool = nullptr;
+    return params;
+}
+
+StreamWriterGroup::StreamWriterGroup(const StreamWriterParams &params, int64_t max_buffered_bytes)
+    : params_(WithoutCompressionPool(params)), max_buffered_bytes_(max_buffered_bytes), buffered_bytes_(0) {
+    if (params.multi_writer) {
+        throw StreamWriterException("Multi-writer streams are not supported in a StreamWriterGroup.");
+    }
+    redis_ = internal::Redis::Create(params.connection);
+}
+
+StreamWriterGroup::~StreamWriterGroup() {
+    try {
+        Stop();
+    } catch (const exception &e) {
+        spdlog::error("Error stopping stream writer group: {}", e.what());
+    }
+}
+
+int StreamWriterGroup::AddStream(const string &stream_name,
+                                 const StreamSchema &schema,
+                                 const unordered_map<string, string> &user_metadata,
+                                 bool compute_local_minus_global_clock) {
+    // StreamWriter's constructor is private, hence no make_unique.
+    unique_ptr<StreamWriter> writer(new StreamWriter(params_, redis_));
+    writer->Initialize(stream_name, schema, user_metadata, compute_local_minus_global_clock);
+    streams_.emplace_back();
+    streams_.back().writer = std::move(writer);
+    return static_cast<int>(streams_.size()) - 1;
+}
+
+StreamWriter &StreamWriterGroup::stream(int stream_idx) {
+    if (stream_idx < 0 || stream_idx >= static_cast<int>(streams_.size())) {
+        throw StreamWriterException(fmt::format("No stream with index {} in this group.", stream_idx));
+    }
+    return *streams_[stream_idx].writer;
+}
+
+void StreamWriterGroup::WriteBytes(int stream_idx, const char *data, int64_t num_samples, const int *sizes) {
+    auto &writer = stream(stream_idx);
+    if (num_samples <= 0) {
+        return;
+    }
+    writer.CheckWritable(sizes);
+
+    auto &s = streams_[stream_idx];
+    int64_t num_bytes = 0;
+    if (writer.has_variable_width_field_) {
+        num_bytes = internal::SumSizes(sizes, num_samples);
+        s.sizes.insert(s.sizes.end(), sizes, sizes + num_samples);
+    } else {
+        num_bytes = num_samples * writer.sample_size_;
+    }
+    s.data.insert(s.data.end(), data, data + num_bytes);
+    s.num_samples += num_samples;
+
+    buffered_bytes_ += num_bytes;
+    if (buffered_bytes_ >= max_buffered_bytes_) {
+        Flush();
+    }
+}
+
+void StreamWriterGroup::Flush() {
+    // Cleared however the flush ends, so that a failed flush isn't retried with samples that were partly written.
+    struct BufferClearer {
+        StreamWriterGroup *group;
+        ~BufferClearer() {
+            group->ClearBuffers();
+        }
+    } buffer_clearer{this};
+
+    // Batches are prepared in place, as their commands point into them.
+    vector<pair<StreamWriter *, unique_ptr<StreamWriter::PreparedBatch>>> batches;
+    for (auto &s : streams_) {
+        auto *writer = s.writer.get();
+        int64_t data_index = 0;
+        for (int64_t samples_written = 0; samples_written < s.num_samples;) {
+            int64_t num_samples = min<int64_t>(s.num_samples - samples_written, writer->redis_batch_size_);
+            auto batch = make_unique<StreamWriter::PreparedBatch>();
+            writer->PrepareBatch(&s.data[data_index], num_samples,
+                                 writer->has_variable_width_field_ ? &s.sizes[samples_written] : nullptr,
+                                 batch.get());
+            data_index += batch->data_num_bytes;
+            samples_written += num_samples;
+            if (redis_->is_cluster()) {
+                // Streams may live on different nodes, so send each as soon as it's routed.
+                if (redis_->SendCommandPreformatted(batch->command_parts) < 0) {
+                    throw StreamWriterException("Failed to send batch to Redis.");
+                }
+                writer->FinishBatch(*batch);
+            } else {
+                batches.emplace_back(writer, std::move(batch));
+            }
+        }
+    }
+
+    if (!batches.empty()) {
+        // Batches of low-rate streams are small, so copying them into one buffer is cheaper than a send per part.
+        send_buffer_.clear();
+        for (const auto &batch : batches) {
+            for (const auto &part : batch.second->command_parts) {
+                send_buffer_.append(part.first, part.second);
+            }
+        }
+        if (redis_->SendCommandPreformatted({{send_buffer_.data(), send_buffer_.size()}}) < 0) {
+            throw StreamWriterException("Failed to send batches to Redis.");
+        }
+        // Replies arrive in the order the batches were sent. Every batch's are read even once one fails, so that
+        // none are left queued on the connection for later commands to misread.
+        exception_ptr first_error;
+        for (const auto &batch : batches) {
+            try {
+                batch.first->FinishBatch(*batch.second);
+            } catch (const StreamWriterException &e) {
+                if (!first_error) {
+                    first_error = current_exception();
+                }
+            }
+        }
+        if (first_error) {
+            rethrow_exception(first_error);
+        }
+    }
+}
+
+void StreamWriterGroup::ClearBuffers() {
+    for (auto &s : streams_) {
+        s.data.clear();
+        s.sizes.clear();
+        s.num_samples = 0;
+    }
+    buffered_bytes_ = 0;
+}
+
+void StreamWriterGroup::Stop() {
+    Flush();
+    for (auto &s : streams_) {
+        s.writer->Stop();
+    }
+}
+
+}
@@ -0,0 +1,99 @@
+#ifndef RIVER_SRC_WRITER_GROUP_H_
+#define RIVER_SRC_WRITER_GROUP_H_
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "writer.h"
+
+namespace river {
+
+/**
+ * Writes many streams over one Redis connection, e.g. hundreds of low-rate streams from one process. Each stream is a
+ * StreamWriter with its own schema, compression, and key rollover, but writes to all of them are buffered by the
+ * group and sent on #Flush() as one pipeline: the batches of every stream are coalesced into a single send, and
+ * their replies are then read back in order. Thus the round trips per flush stay constant regardless of the number of
+ * streams.
+ *
+ * Not thread-safe. In cluster mode, each stream's batches are instead sent to whichever node owns it, one stream at a
+ * time.
+ */
+class StreamWriterGroup {
+public:
+    /**
+     * @param params Parameters of each stream's writer; all streams share params.connection. Its compression_pool is
+     * ignored, as batches are compressed as they're flushed.
+     * @param max_buffered_bytes Writes are flushed automatically once at least this many bytes are buffered across
+     * all streams.
+     */
+    explicit StreamWriterGroup(const StreamWriterParams &params, int64_t max_buffered_bytes = int64_t{1} << 22);
+
+    ~StreamWriterGroup();
+
+    /**
+     * Initializes a new stream in this group; see StreamWriter#Initialize(). Returns the index of the stream within
+     * this group, to be given to #Write().
+     */
+    int AddStream(const std::string &stream_name,
+                  const StreamSchema &schema,
+                  const std::unordered_map<std::string, std::string> &user_metadata =
+                  std::unordered_map<std::string, std::string>(),
+                  bool compute_local_minus_global_clock = false);
+
+    /**
+     * Buffers samples to be written to the given stream on the next #Flush(); see StreamWriter#Write().
+     */
+    template <class DataT>
+    void Write(int stream_idx, DataT *data, int64_t num_samples, const int *sizes = nullptr) {
+        auto &writer = stream(stream_idx);
+        if (!writer.has_variable_width_field_ && sizeof(data[0]) != writer.sample_size_) {
+            throw StreamWriterException("Sample size that was given is not equal to the data!");
+        }
+        WriteBytes(stream_idx, reinterpret_cast<const char *>(data), num_samples, sizes);
+    }
+
+    void WriteBytes(int stream_idx, const char *data, int64_t num_samples, const int *sizes = nullptr);
+
+    /**
+     * Writes all buffered samples of all streams to Redis. The buffers are emptied even if this throws, in which case
+     * some of their samples may not have been written.
+     */
+    void Flush();
+
+    /**
+     * Flushes, and then stops all streams; see StreamWriter#Stop().
+     */
+    void Stop();
+
+    /**
+     * The writer of the given stream, e.g. for its metadata. Writes made directly to it aren't buffered by the group.
+     */
+    StreamWriter &stream(int stream_idx);
+
+    int num_streams() const {
+        return static_cast<int>(streams_.size());
+    }
+
+private:
+    struct Stream {
+        std::unique_ptr<StreamWriter> writer;
+        std::vector<char> data;
+        std::vector<int> sizes;
+        int64_t num_samples = 0;
+    };
+
+    void ClearBuffers();
+
+    const StreamWriterParams params_;
+    const int64_t max_buffered_bytes_;
+    std::shared_ptr<internal::Redis> redis_;
+    std::vector<Stream> streams_;
+    int64_t buffered_bytes_;
+    // Reused across flushes; holds the commands of every batch of a flush.
+    std::string send_buffer_;
+};
+
+}
+
+#endif //RIVER_SRC_WRITER_GROUP_H_
@@ -3,26 +3,10 @@
 #include "mex_helpers.hpp"
 #include "stream_schema_helper.h"
 #include <river/river.h>
+#include <cstring>
 
 using namespace river;
 
-template<class TypeC, class TypeMx>
-TypeMx *set_data(
-    const FieldDefinition& field_def,
-    const char *buffer,
-    int64_t num_read,
-    int64_t sample_size,
-    int64_t col_offset_bytes) {
-  TypeMx *dynamicData = (TypeMx *) mxMalloc(num_read * sizeof(TypeC));
-  for (int row_idx = 0; row_idx < num_read; row_idx++) {
-    const char *buffer_offset = &buffer[sample_size * row_idx + col_offset_bytes];
-    dynamicData[row_idx] = *((const TypeC *) buffer_offset);
-  }
-  return dynamicData;
-
-}
-
-
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 {
   // Get the command string
@@ -123,81 +107,57 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
     }
 
     int64_t n_to_read = to_int(prhs[2]);
-    int64_t sample_size = instance->schema().sample_size();
-    int64_t total_size_bytes = sample_size * n_to_read;
-    std::vector<char> buffer(total_size_bytes);
-    int64_t num_read = instance->ReadBytes(buffer.data(), n_to_read);
+    auto field_defs = instance->schema().field_definitions;
+    int n_cols = field_defs.size();
+
+    // Numeric fields are read straight into MATLAB arrays; fixed-width bytes are split into one array per row after.
+    std::vector<void *> columns(n_cols);
+    std::vector<std::vector<char>> bytes_columns(n_cols);
+    for (int col_idx = 0; col_idx < n_cols; col_idx++) {
+      auto field_def = field_defs[col_idx];
+      if (field_def.type == FieldDefinition::FIXED_WIDTH_BYTES) {
+        bytes_columns[col_idx].resize(n_to_read * field_def.size);
+        columns[col_idx] = bytes_columns[col_idx].data();
+      } else {
+        columns[col_idx] = mxMalloc(n_to_read * field_def.size);
+      }
+    }
+    int64_t num_read = instance->ReadColumns(columns.data(), n_to_read);
 
     plhs[0] = from_int(num_read);
     if (num_read >= 0) {
-      auto field_defs = instance->schema().field_definitions;
-      int n_cols = field_defs.size();
-
       mxArray *out = mxCreateCellMatrix(1, n_cols);
-      int64_t col_offset_bytes = 0;
       for (int col_idx = 0; col_idx < n_cols; col_idx++) {
         auto field_def = field_defs[col_idx];
         mxArray *out_col = nullptr;
 
         switch (field_def.type) {
           case FieldDefinition::DOUBLE:
-            {
-              mxDouble *out_col_data = set_data<double, mxDouble>(
-                  field_def,
-                  buffer.data(),
-                  num_read,
-                  sample_size,
-                  col_offset_bytes);
-              out_col = mxCreateNumericMatrix(
-                  0, 0, mxDOUBLE_CLASS, mxREAL);
-              mxSetDoubles(out_col, out_col_data);
-            } break;
+            out_col = mxCreateNumericMatrix(0, 0, mxDOUBLE_CLASS, mxREAL);
+            mxSetDoubles(out_col, (mxDouble *) columns[col_idx]);
+            break;
           case FieldDefinition::FLOAT:
-            {
-              mxSingle *out_col_data = set_data<float, mxSingle>(
-                  field_def,
-                  buffer.data(),
-                  num_read,
-                  sample_size,
-                  col_offset_bytes);
-              out_col = mxCreateNumericMatrix(
-                  0, 0, mxSINGLE_CLASS, mxREAL);
-              mxSetSingles(out_col, out_col_data);
-            } break;
+            out_col = mxCreateNumericMatrix(0, 0, mxSINGLE_CLASS, mxREAL);
+            mxSetSingles(out_col, (mxSingle *) columns[col_idx]);
+            break;
+          case FieldDefinition::INT16:
+            out_col = mxCreateNumericMatrix(0, 0, mxINT16_CLASS, mxREAL);
+            mxSetInt16s(out_col, (mxInt16 *) columns[col_idx]);
+            break;
           case FieldDefinition::INT32:
-            {
-              mxInt32 *out_col_data = set_data<int32_t, mxInt32>(
-                  field_def,
-                  buffer.data(),
-                  num_read,
-                  sample_size,
-                  col_offset_bytes);
-              out_col = mxCreateNumericMatrix(
-                  0, 0, mxINT32_CLASS, mxREAL);
-              mxSetInt32s(out_col, out_col_data);
-            } break;
+            out_col = mxCreateNumericMatrix(0, 0, mxINT32_CLASS, mxREAL);
+            mxSetInt32s(out_col, (mxInt32 *) columns[col_idx]);
+            break;
           case FieldDefinition::INT64:
-            {
-              mxInt64 *out_col_data = set_data<int64_t, mxInt64>(
-                  field_def,
-                  buffer.data(),
-                  num_read,
-                  sample_size,
-                  col_offset_bytes);
-              out_col = mxCreateNumericMatrix(
-                  0, 0, mxINT64_CLASS, mxREAL);
-              mxSetInt64s(out_col, out_col_data);
-            } break;
+            out_col = mxCreateNumericMatrix(0, 0, mxINT64_CLASS, mxREAL);
+            mxSetInt64s(out_col, (mxInt64 *) columns[col_idx]);
+            break;
           case FieldDefinition::FIXED_WIDTH_BYTES:
             {
               out_col = mxCreateCellMatrix(num_read, 1);
               for (int row_idx = 0; row_idx < num_read; row_idx++) {
                 mxUint8 *out_col_data = (mxUint8 *) mxMalloc(field_def.size * sizeof(mxUint8));
-
-                const char *buffer_offset = &buffer[sample_size * row_idx + col_offset_bytes];
-                for (int byte_idx = 0; byte_idx < field_def.size; byte_idx++) {
-                  out_col_data[byte_idx] = buffer_offset[byte_idx];
-                }
+                memcpy(out_col_data, &bytes_columns[col_idx][row_idx * field_def.size], field_def.size);
 
                 mxArray *out_col_data_wrapped = mxCreateNumericMatrix(0, 0, mxUINT8_CLASS, mxREAL);
                 mxSetUint8s(out_col_data_wrapped, out_col_data);
@@ -217,10 +177,14 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
           mxSetN(out_col, 1);
         }
         mxSetCell(out, col_idx, out_col);
-        col_offset_bytes += field_def.size;
       }
       plhs[1] = out;
     } else {
+      for (int col_idx = 0; col_idx < n_cols; col_idx++) {
+        if (field_defs[col_idx].type != FieldDefinition::FIXED_WIDTH_BYTES) {
+          mxFree(columns[col_idx]);
+        }
+      }
       plhs[1] = mxCreateCellMatrix(0, 0);
     }
     return;
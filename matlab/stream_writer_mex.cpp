@@ -3,6 +3,7 @@
 #include "mex_helpers.hpp"
 #include "stream_schema_helper.h"
 #include <river/river.h>
+#include <cstring>
 
 using namespace river;
 
@@ -118,75 +119,48 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
     }
 
     int64_t n_to_write = mxGetNumberOfElements(mxGetCell(data, 0));
-    int64_t sample_size = instance->schema().sample_size();
-    int64_t total_size_bytes = sample_size * n_to_write;
-    std::vector<char> buffer(total_size_bytes);
 
-    // Copy the table columns into a temp buffer before giving to River
-    int64_t col_offset_bytes = 0;
+    // Numeric columns are given to River as is, which interleaves them into samples. Only fixed-width bytes, which
+    // MATLAB holds as one array per row, are first gathered into a contiguous column.
+    std::vector<const void *> columns(n_cols);
+    std::vector<std::vector<char>> gathered_columns;
     for (int col_idx = 0; col_idx < n_cols; col_idx++) {
       auto field_def = field_defs[col_idx];
+      mxArray *data_col = mxGetCell(data, col_idx);
       switch (field_def.type) {
         case FieldDefinition::DOUBLE:
-          {
-            mxDouble *data_col = mxGetDoubles(mxGetCell(data, col_idx));
-            for (int row_idx = 0; row_idx < n_to_write; row_idx++) {
-              const char *buffer_offset = &buffer[row_idx * sample_size + col_offset_bytes];
-              *((double *) buffer_offset) = data_col[row_idx];
-            }
-          } break;
+          columns[col_idx] = mxGetDoubles(data_col);
+          break;
         case FieldDefinition::FLOAT:
-          {
-            mxSingle *data_col = mxGetSingles(mxGetCell(data, col_idx));
-            for (int row_idx = 0; row_idx < n_to_write; row_idx++) {
-              const char *buffer_offset = &buffer[row_idx * sample_size + col_offset_bytes];
-              *((float *) buffer_offset) = data_col[row_idx];
-            }
-          } break;
+          columns[col_idx] = mxGetSingles(data_col);
+          break;
         case FieldDefinition::INT16:
-          {
-            mxInt16 *data_col = mxGetInt16s(mxGetCell(data, col_idx));
-            for (int row_idx = 0; row_idx < n_to_write; row_idx++) {
-              const char *buffer_offset = &buffer[row_idx * sample_size + col_offset_bytes];
-              *((int16_t *) buffer_offset) = data_col[row_idx];
-            }
-          } break;
+          columns[col_idx] = mxGetInt16s(data_col);
+          break;
         case FieldDefinition::INT32:
-          {
-            mxInt32 *data_col = mxGetInt32s(mxGetCell(data, col_idx));
-            for (int row_idx = 0; row_idx < n_to_write; row_idx++) {
-              const char *buffer_offset = &buffer[row_idx * sample_size + col_offset_bytes];
-              *((int32_t *) buffer_offset) = data_col[row_idx];
-            }
-          } break;
+          columns[col_idx] = mxGetInt32s(data_col);
+          break;
         case FieldDefinition::INT64:
-          {
-            mxInt64 *data_col = mxGetInt64s(mxGetCell(data, col_idx));
-            for (int row_idx = 0; row_idx < n_to_write; row_idx++) {
-              const char *buffer_offset = &buffer[row_idx * sample_size + col_offset_bytes];
-              *((int64_t *) buffer_offset) = data_col[row_idx];
-            }
-          } break;
+          columns[col_idx] = mxGetInt64s(data_col);
+          break;
         case FieldDefinition::FIXED_WIDTH_BYTES:
           {
-            mxArray *data_col_wrapper = mxGetCell(data, col_idx);
+            gathered_columns.emplace_back(n_to_write * field_def.size);
+            auto &gathered = gathered_columns.back();
             for (int row_idx = 0; row_idx < n_to_write; row_idx++) {
-              mxUint8 *data_col = mxGetUint8s(mxGetCell(data_col_wrapper, row_idx));
-              for (int byte_idx = 0; byte_idx < field_def.size; byte_idx++) {
-                char *buffer_offset = &buffer[row_idx * sample_size + col_offset_bytes];
-                buffer_offset[byte_idx] = data_col[byte_idx];
-              }
+              mxUint8 *data_row = mxGetUint8s(mxGetCell(data_col, row_idx));
+              memcpy(&gathered[row_idx * field_def.size], data_row, field_def.size);
             }
+            columns[col_idx] = gathered.data();
           } break;
         default:
           {
             mexErrMsgTxt("write: unhandled field def.");
           } return;
       }
-      col_offset_bytes += field_def.size;
     }
 
-    instance->WriteBytes(buffer.data(), n_to_write);
+    instance->WriteColumns(columns.data(), n_to_write);
     return;
   } else if (!strcmp("stop", cmd)) {
     if (nlhs != 0) {